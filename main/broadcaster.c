@@ -1,34 +1,216 @@
 #include "broadcaster.h"
+#include "query_scheduler.h"
 #include "relay_core.h"
 #include "router.h"
 #include "sub_manager.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include <string.h>
 
 static const char *TAG = "broadcaster";
 
-void broadcaster_fanout(relay_ctx_t *ctx, const nostr_event *event)
+#define BROADCASTER_STOP_WAIT_MS   2000
+#define BROADCASTER_INLINE_WAIT_MS 20
+
+typedef struct {
+    nostr_event *event;
+    int64_t enqueued_at;
+} fanout_item_t;
+
+static void fanout_matches(relay_ctx_t *ctx, const nostr_event *event, int64_t enqueued_at,
+                           sub_match_result_t *result)
 {
     if (!ctx || !ctx->sub_manager) {
         return;
     }
 
-    sub_match_result_t matches;
-    sub_manager_match(ctx->sub_manager, event, &matches);
+    if (ctx->query_sched) {
+        qsched_live_begin(ctx->query_sched);
+    }
 
-    if (matches.count == 0) {
+    sub_event_digest_t digest;
+    result->count = 0;
+    if (sub_event_digest_init(&digest, event)) {
+        sub_manager_match(ctx->sub_manager, &digest, result);
+        sub_event_digest_free(&digest);
+    }
+
+    if (result->count == 0) {
         ESP_LOGD(TAG, "No subscribers for event kind=%d", event->kind);
+        if (ctx->query_sched) {
+            qsched_live_end(ctx->query_sched);
+        }
         return;
     }
 
-    ESP_LOGD(TAG, "Broadcasting event kind=%d to %d subscriptions",
-             event->kind, matches.count);
+    ESP_LOGD(TAG, "Broadcasting event kind=%d to %" PRIu32 " subscriptions",
+             event->kind, result->count);
 
-    for (uint8_t i = 0; i < matches.count; i++) {
-        sub_match_entry_t *entry = &matches.matches[i];
-        router_send_event(ctx, entry->conn_fd, entry->sub_id, event);
+    ws_frame_t *frame = router_event_frame(event);
+    if (frame) {
+        frame->enqueued_at = enqueued_at;
+    }
+    for (uint32_t i = 0; frame && i < result->count; i++) {
+        sub_match_entry_t *entry = &result->matches[i];
+        router_send_event_frame(ctx, entry->conn_fd, entry->sub_id, frame);
         ESP_LOGD(TAG, "Sent to sub=%s fd=%d", entry->sub_id, entry->conn_fd);
     }
+    ws_frame_release(frame);
+
+    if (ctx->query_sched) {
+        qsched_live_end(ctx->query_sched);
+    }
+
+    ESP_LOGD(TAG, "Broadcast complete: %" PRIu32 " subscriptions", result->count);
+}
+
+void broadcaster_fanout(relay_ctx_t *ctx, const nostr_event *event)
+{
+    sub_match_result_t matches = {0};
+    fanout_matches(ctx, event, esp_timer_get_time(), &matches);
+    sub_match_result_free(&matches);
+}
+
+static void note_depth(broadcaster_t *bc)
+{
+    uint32_t depth = uxQueueMessagesWaiting(bc->queue);
+    unsigned int peak = atomic_load(&bc->depth_high_water);
+    while (depth > peak && !atomic_compare_exchange_weak(&bc->depth_high_water, &peak, depth)) {
+    }
+}
+
+static void fanout_task(void *arg)
+{
+    broadcaster_t *bc = (broadcaster_t *)arg;
+    fanout_item_t item;
+    sub_match_result_t matches = {0};
+
+    while (1) {
+        if (xQueueReceive(bc->queue, &item, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (!item.event) {
+            break;
+        }
+
+        fanout_matches(bc->ctx, item.event, item.enqueued_at, &matches);
+        atomic_fetch_add(&bc->delivered, 1);
+        nostr_event_destroy(item.event);
+    }
+
+    sub_match_result_free(&matches);
+
+    bc->task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t broadcaster_init(broadcaster_t *bc, relay_ctx_t *ctx, uint16_t queue_depth,
+                           bool drop_on_full)
+{
+    memset(bc, 0, sizeof(broadcaster_t));
+    bc->ctx = ctx;
+    bc->queue_depth = queue_depth > 0 ? queue_depth : 1;
+    bc->drop_on_full = drop_on_full;
+
+    bc->queue = xQueueCreate(bc->queue_depth, sizeof(fanout_item_t));
+    if (!bc->queue) return ESP_ERR_NO_MEM;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(fanout_task, "fanout", BROADCASTER_TASK_STACK,
+                                             bc, BROADCASTER_TASK_PRIORITY, &bc->task,
+                                             BROADCASTER_TASK_CORE);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create fanout task");
+        vQueueDelete(bc->queue);
+        bc->queue = NULL;
+        bc->task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Fanout task started (queue=%u, overflow=%s)",
+             bc->queue_depth, drop_on_full ? "drop" : "inline");
+    return ESP_OK;
+}
+
+void broadcaster_stop(broadcaster_t *bc)
+{
+    if (!bc->queue) return;
+
+    fanout_item_t stop = { .event = NULL };
+    if (bc->task) {
+        xQueueSendToBack(bc->queue, &stop, pdMS_TO_TICKS(BROADCASTER_STOP_WAIT_MS));
+    }
+    for (int waited = 0; bc->task && waited < BROADCASTER_STOP_WAIT_MS; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (bc->task) {
+        ESP_LOGW(TAG, "Fanout task did not stop, deleting");
+        vTaskDelete(bc->task);
+        bc->task = NULL;
+    }
+
+    fanout_item_t item;
+    while (xQueueReceive(bc->queue, &item, 0) == pdTRUE) {
+        if (item.event) {
+            nostr_event_destroy(item.event);
+        }
+    }
+    vQueueDelete(bc->queue);
+    bc->queue = NULL;
+}
+
+esp_err_t broadcaster_submit(broadcaster_t *bc, nostr_event **event)
+{
+    if (!bc->queue) return ESP_ERR_INVALID_STATE;
+
+    fanout_item_t item = {
+        .event = *event,
+        .enqueued_at = esp_timer_get_time(),
+    };
+
+    // Give the fanout task a moment to drain before going inline, since an
+    // inline fanout overtakes everything still queued.
+    TickType_t wait = bc->drop_on_full ? 0 : pdMS_TO_TICKS(BROADCASTER_INLINE_WAIT_MS);
+    if (xQueueSendToBack(bc->queue, &item, wait) == pdTRUE) {
+        *event = NULL;
+        atomic_fetch_add(&bc->enqueued, 1);
+        note_depth(bc);
+        return ESP_OK;
+    }
+
+    if (bc->drop_on_full) {
+        unsigned int dropped = atomic_fetch_add(&bc->dropped, 1) + 1;
+        ESP_LOGW(TAG, "Fanout queue full, live delivery dropped (dropped=%u)", dropped);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    atomic_fetch_add(&bc->inline_fanouts, 1);
+    ESP_LOGD(TAG, "Fanout queue full, delivering inline");
+    broadcaster_fanout(bc->ctx, item.event);
+    return ESP_OK;
+}
 
-    ESP_LOGD(TAG, "Broadcast complete: %d subscriptions", matches.count);
+void broadcaster_get_stats(broadcaster_t *bc, broadcaster_stats_t *stats)
+{
+    memset(stats, 0, sizeof(broadcaster_stats_t));
+    if (!bc->queue) return;
+
+    stats->depth = uxQueueMessagesWaiting(bc->queue);
+    stats->depth_high_water = atomic_load(&bc->depth_high_water);
+    stats->capacity = bc->queue_depth;
+    stats->enqueued = atomic_load(&bc->enqueued);
+    stats->delivered = atomic_load(&bc->delivered);
+    stats->dropped = atomic_load(&bc->dropped);
+    stats->inline_fanouts = atomic_load(&bc->inline_fanouts);
+
+    // Dispatch latency runs from submit until a live frame's bytes are
+    // accepted by the socket, measured per subscriber in the flush path.
+    ws_server_t *ws = &bc->ctx->ws_server;
+    uint32_t sent = atomic_load(&ws->live_sent);
+    stats->dispatch_last_us = atomic_load(&ws->live_last_us);
+    stats->dispatch_max_us = atomic_load(&ws->live_max_us);
+    if (sent > 0) {
+        stats->dispatch_avg_us = (uint32_t)(atomic_load(&ws->live_total_us) / sent);
+    }
 }
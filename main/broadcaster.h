@@ -1,10 +1,55 @@
 #ifndef BROADCASTER_H
 #define BROADCASTER_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "nostr_relay_protocol.h"
 
+#define BROADCASTER_TASK_STACK    6144
+#define BROADCASTER_TASK_PRIORITY CONFIG_WISP_FANOUT_PRIORITY
+#define BROADCASTER_TASK_CORE     (CONFIG_WISP_FANOUT_CORE < 0 ? tskNO_AFFINITY : CONFIG_WISP_FANOUT_CORE)
+
 typedef struct relay_ctx relay_ctx_t;
 
+typedef struct broadcaster {
+    relay_ctx_t *ctx;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    uint16_t queue_depth;
+    bool drop_on_full;
+    atomic_uint enqueued;
+    atomic_uint delivered;
+    atomic_uint dropped;
+    atomic_uint inline_fanouts;
+    atomic_uint depth_high_water;
+} broadcaster_t;
+
+typedef struct {
+    uint32_t depth;
+    uint32_t depth_high_water;
+    uint32_t capacity;
+    uint32_t enqueued;
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t inline_fanouts;
+    uint32_t dispatch_last_us;
+    uint32_t dispatch_avg_us;
+    uint32_t dispatch_max_us;
+} broadcaster_stats_t;
+
+esp_err_t broadcaster_init(broadcaster_t *bc, relay_ctx_t *ctx, uint16_t queue_depth,
+                           bool drop_on_full);
+void broadcaster_stop(broadcaster_t *bc);
+
+esp_err_t broadcaster_submit(broadcaster_t *bc, nostr_event **event);
+void broadcaster_get_stats(broadcaster_t *bc, broadcaster_stats_t *stats);
+
 void broadcaster_fanout(relay_ctx_t *ctx, const nostr_event *event);
 
 #endif
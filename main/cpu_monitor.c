@@ -0,0 +1,53 @@
+#include "cpu_monitor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/task.h"
+
+esp_err_t cpu_monitor_sample(cpu_monitor_t *mon, cpu_usage_t *out)
+{
+    memset(out, 0, sizeof(cpu_usage_t));
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+    UBaseType_t capacity = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(capacity * sizeof(TaskStatus_t));
+    if (!tasks) return ESP_ERR_NO_MEM;
+
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, capacity, &total);
+    if (count == 0) {
+        free(tasks);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t idle[CPU_MONITOR_MAX_CORES] = { 0 };
+    for (int core = 0; core < CPU_MONITOR_MAX_CORES; core++) {
+        TaskHandle_t handle = xTaskGetIdleTaskHandleForCore(core);
+        for (UBaseType_t i = 0; i < count; i++) {
+            if (tasks[i].xHandle == handle) {
+                idle[core] = tasks[i].ulRunTimeCounter;
+                break;
+            }
+        }
+    }
+    free(tasks);
+
+    uint32_t elapsed = total - mon->last_total;
+    bool valid = mon->primed && elapsed > 0;
+    out->cores = CPU_MONITOR_MAX_CORES;
+    for (int core = 0; core < CPU_MONITOR_MAX_CORES; core++) {
+        if (valid) {
+            uint64_t idle_elapsed = idle[core] - mon->last_idle[core];
+            if (idle_elapsed > elapsed) idle_elapsed = elapsed;
+            out->busy_percent[core] = (uint8_t)(100 - idle_elapsed * 100 / elapsed);
+        }
+        mon->last_idle[core] = idle[core];
+    }
+    mon->last_total = total;
+    mon->primed = true;
+    return valid ? ESP_OK : ESP_ERR_INVALID_STATE;
+#else
+    (void)mon;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef CPU_MONITOR_H
+#define CPU_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define CPU_MONITOR_MAX_CORES portNUM_PROCESSORS
+
+typedef struct {
+    uint32_t last_total;
+    uint32_t last_idle[CPU_MONITOR_MAX_CORES];
+    bool primed;
+} cpu_monitor_t;
+
+typedef struct {
+    uint8_t cores;
+    uint8_t busy_percent[CPU_MONITOR_MAX_CORES];
+} cpu_usage_t;
+
+esp_err_t cpu_monitor_sample(cpu_monitor_t *mon, cpu_usage_t *out);
+
+#endif
@@ -1,8 +1,10 @@
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "broadcaster.h"
 #include "deletion.h"
+#include "query_scheduler.h"
 #include "relay_core.h"
 #include "router.h"
 #include "storage_engine.h"
@@ -13,8 +15,10 @@
 
 static const char *TAG = "handlers";
 
-int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event *event)
+int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event **event_ref, bool *duplicate)
 {
+    nostr_event *event = *event_ref;
+    *duplicate = false;
     validator_config_t config = {
         .max_event_age_sec = ctx->config.max_event_age_sec,
         .max_future_sec = ctx->config.max_future_sec,
@@ -23,6 +27,11 @@ int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event *event)
     };
 
     validation_result_t result = validator_check_event(event, &config, ctx->storage);
+    if (result == VALIDATION_ERR_DUPLICATE) {
+        ESP_LOGD(TAG, "EVENT: duplicate fd=%d", conn_fd);
+        *duplicate = true;
+        return NOSTR_RELAY_OK;
+    }
     if (result != VALIDATION_OK) {
         ESP_LOGW(TAG, "Validation failed: %s", validator_result_string(result));
         return validator_result_to_relay_error(result);
@@ -37,7 +46,11 @@ int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event *event)
 
     if (!ephemeral && ctx->storage) {
         storage_error_t store_result = storage_save_event(ctx->storage, event);
-        if (store_result != STORAGE_OK && store_result != STORAGE_ERR_DUPLICATE) {
+        if (store_result == STORAGE_ERR_DUPLICATE) {
+            *duplicate = true;
+            return NOSTR_RELAY_OK;
+        }
+        if (store_result != STORAGE_OK) {
             ESP_LOGE(TAG, "Storage failed: %d", store_result);
             return NOSTR_RELAY_ERR_STORAGE;
         }
@@ -45,7 +58,9 @@ int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event *event)
 
     ESP_LOGI(TAG, "EVENT: kind=%d fd=%d ephemeral=%d", event->kind, conn_fd, ephemeral);
 
-    broadcaster_fanout(ctx, event);
+    if (!ctx->broadcaster || broadcaster_submit(ctx->broadcaster, event_ref) == ESP_ERR_INVALID_STATE) {
+        broadcaster_fanout(ctx, event);
+    }
 
     return NOSTR_RELAY_OK;
 }
@@ -67,57 +82,59 @@ void handle_req(relay_ctx_t *ctx, int conn_fd, router_req_t *req)
         return;
     }
 
-    if (ctx->storage) {
-        #define MAX_SENT_IDS 64
-        uint8_t (*sent_ids)[32] = malloc(MAX_SENT_IDS * sizeof(*sent_ids));
-        uint16_t sent_count = 0;
-        if (sent_ids == NULL) {
-            ESP_LOGW(TAG, "Failed to allocate sent_ids, dedup disabled");
+    if (ctx->storage && ctx->query_sched) {
+        if (qsched_submit(ctx->query_sched, conn_fd, req->sub_id,
+                          req->filters, req->filter_count) == ESP_OK) {
+            req->filters = NULL;
+            req->filter_count = 0;
+            return;
         }
+        sub_manager_remove(ctx->sub_manager, conn_fd, req->sub_id);
+        router_send_closed(ctx, conn_fd, req->sub_id, "error: too many pending queries");
+        return;
+    }
 
-        for (size_t i = 0; i < req->filter_count; i++) {
-            nostr_event **events = NULL;
-            uint16_t event_count = 0;
-            uint16_t limit = req->filters[i].limit > 0 ? req->filters[i].limit : 100;
-
-            storage_error_t query_result = storage_query_events(ctx->storage,
-                                                                 &req->filters[i],
-                                                                 &events,
-                                                                 &event_count,
-                                                                 limit);
-            if (query_result == STORAGE_OK && events) {
-                for (uint16_t e = 0; e < event_count; e++) {
-                    bool duplicate = false;
-                    if (sent_ids) {
-                        for (uint16_t s = 0; s < sent_count; s++) {
-                            if (memcmp(sent_ids[s], events[e]->id, 32) == 0) {
-                                duplicate = true;
-                                break;
-                            }
-                        }
-                    }
-                    if (!duplicate) {
-                        router_send_event(ctx, conn_fd, req->sub_id, events[e]);
-                        if (sent_ids && sent_count < MAX_SENT_IDS) {
-                            memcpy(sent_ids[sent_count++], events[e]->id, 32);
-                        }
-                    }
-                }
-                storage_free_query_results(events, event_count);
-            }
+    router_send_eose(ctx, conn_fd, req->sub_id);
+}
+
+void handle_count(relay_ctx_t *ctx, int conn_fd, router_req_t *req)
+{
+    uint32_t count = 0;
+
+    ESP_LOGI(TAG, "COUNT: sub=%s filters=%zu fd=%d", req->sub_id, req->filter_count, conn_fd);
+
+    if (ctx->storage && ctx->query_sched) {
+        if (qsched_submit_count(ctx->query_sched, conn_fd, req->sub_id,
+                                req->filters, req->filter_count) == ESP_OK) {
+            req->filters = NULL;
+            req->filter_count = 0;
+        } else {
+            router_send_closed(ctx, conn_fd, req->sub_id, "error: too many pending queries");
         }
-        if (sent_ids) {
-            free(sent_ids);
+        return;
+    }
+
+    if (ctx->storage) {
+        storage_error_t err = storage_count_events(ctx->storage, req->filters,
+                                                   req->filter_count, &count);
+        if (err != STORAGE_OK) {
+            ESP_LOGW(TAG, "COUNT failed: %d", err);
+            router_send_closed(ctx, conn_fd, req->sub_id, "error: count failed");
+            return;
         }
     }
 
-    router_send_eose(ctx, conn_fd, req->sub_id);
+    router_send_count(ctx, conn_fd, req->sub_id, count, false);
 }
 
 int handle_close(relay_ctx_t *ctx, int conn_fd, const char *sub_id)
 {
     ESP_LOGI(TAG, "CLOSE: sub=%s fd=%d", sub_id, conn_fd);
 
+    if (ctx->query_sched) {
+        qsched_cancel(ctx->query_sched, conn_fd, sub_id);
+    }
+
     if (ctx->sub_manager) {
         return sub_manager_remove(ctx->sub_manager, conn_fd, sub_id);
     }
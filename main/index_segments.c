@@ -0,0 +1,752 @@
+#include "index_segments.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "index_seg";
+
+#define SEG_MAGIC   0x58444957
+#define SEG_VERSION 1
+#define SEG_BLOOM_BITS (INDEX_SEG_BLOOM_BYTES * 8)
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t seq;
+    uint32_t count;
+    uint32_t min_created_at;
+    uint32_t max_created_at;
+    uint32_t min_expires_at;
+    uint32_t max_expires_at;
+    uint8_t  bloom[INDEX_SEG_BLOOM_BYTES];
+} seg_header_t;
+
+static void *seg_alloc(size_t size)
+{
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) {
+        p = malloc(size);
+    }
+    return p;
+}
+
+static void get_seg_path(const index_segs_t *segs, uint32_t seq, const char *ext,
+                         char *path, size_t len)
+{
+    snprintf(path, len, "%s/seg_%08" PRIx32 ".%s", segs->dir, seq, ext);
+}
+
+static long entry_offset(uint32_t pos)
+{
+    return (long)sizeof(seg_header_t) + (long)pos * (long)sizeof(storage_index_entry_t);
+}
+
+static void bloom_add(uint8_t *bloom, const uint8_t event_id[32])
+{
+    for (int k = 0; k < 3; k++) {
+        uint32_t h;
+        memcpy(&h, event_id + k * 4, sizeof(h));
+        h %= SEG_BLOOM_BITS;
+        bloom[h >> 3] |= (uint8_t)(1u << (h & 7));
+    }
+}
+
+static bool bloom_test(const uint8_t *bloom, const uint8_t event_id[32])
+{
+    for (int k = 0; k < 3; k++) {
+        uint32_t h;
+        memcpy(&h, event_id + k * 4, sizeof(h));
+        h %= SEG_BLOOM_BITS;
+        if (!(bloom[h >> 3] & (1u << (h & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compare_created_at(const void *a, const void *b)
+{
+    const storage_index_entry_t *ea = a;
+    const storage_index_entry_t *eb = b;
+    if (ea->created_at < eb->created_at) return -1;
+    if (ea->created_at > eb->created_at) return 1;
+    return memcmp(ea->event_id, eb->event_id, 32);
+}
+
+static esp_err_t insert_seg(index_segs_t *segs, const index_seg_t *seg)
+{
+    if (segs->seg_count >= segs->seg_capacity) {
+        uint32_t new_cap = segs->seg_capacity ? segs->seg_capacity * 2 : 8;
+        index_seg_t *grown = realloc(segs->segs, new_cap * sizeof(index_seg_t));
+        if (!grown) {
+            return ESP_ERR_NO_MEM;
+        }
+        segs->segs = grown;
+        segs->seg_capacity = new_cap;
+    }
+
+    uint32_t at = segs->seg_count;
+    while (at > 0 && segs->segs[at - 1].seq > seg->seq) {
+        at--;
+    }
+    memmove(&segs->segs[at + 1], &segs->segs[at],
+            (segs->seg_count - at) * sizeof(index_seg_t));
+    segs->segs[at] = *seg;
+    segs->seg_count++;
+    segs->live_entries += seg->live_count;
+    return ESP_OK;
+}
+
+static esp_err_t write_segment(index_segs_t *segs, uint32_t seq, const char *ext,
+                               const storage_index_entry_t *entries, uint32_t count,
+                               index_seg_t *out)
+{
+    seg_header_t *hdr = calloc(1, sizeof(seg_header_t));
+    uint8_t *bloom = seg_alloc(INDEX_SEG_BLOOM_BYTES);
+    if (!hdr || !bloom) {
+        free(hdr);
+        free(bloom);
+        return ESP_ERR_NO_MEM;
+    }
+
+    hdr->magic = SEG_MAGIC;
+    hdr->version = SEG_VERSION;
+    hdr->entry_size = sizeof(storage_index_entry_t);
+    hdr->seq = seq;
+    hdr->count = count;
+    hdr->min_created_at = count > 0 ? entries[0].created_at : 0;
+    hdr->max_created_at = count > 0 ? entries[count - 1].created_at : 0;
+
+    uint32_t live = 0;
+    hdr->min_expires_at = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].expires_at > 0 && entries[i].expires_at < hdr->min_expires_at) {
+            hdr->min_expires_at = entries[i].expires_at;
+        }
+        if (entries[i].expires_at > hdr->max_expires_at) {
+            hdr->max_expires_at = entries[i].expires_at;
+        }
+        bloom_add(hdr->bloom, entries[i].event_id);
+        if (!(entries[i].flags & STORAGE_FLAG_DELETED)) {
+            live++;
+        }
+    }
+
+    char path[64];
+    get_seg_path(segs, seq, ext, path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        free(hdr);
+        free(bloom);
+        return ESP_FAIL;
+    }
+
+    bool ok = fwrite(hdr, sizeof(seg_header_t), 1, f) == 1;
+    if (ok && count > 0) {
+        ok = fwrite(entries, sizeof(storage_index_entry_t), count, f) == count;
+    }
+    fclose(f);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Short write to %s", path);
+        unlink(path);
+        free(hdr);
+        free(bloom);
+        return ESP_FAIL;
+    }
+
+    memcpy(bloom, hdr->bloom, INDEX_SEG_BLOOM_BYTES);
+    out->seq = seq;
+    out->count = count;
+    out->live_count = live;
+    out->min_created_at = hdr->min_created_at;
+    out->max_created_at = hdr->max_created_at;
+    out->min_expires_at = hdr->min_expires_at;
+    out->max_expires_at = hdr->max_expires_at;
+    out->bloom = bloom;
+
+    free(hdr);
+    return ESP_OK;
+}
+
+static esp_err_t load_segment(index_segs_t *segs, uint32_t seq,
+                              storage_index_entry_t *page)
+{
+    char path[64];
+    get_seg_path(segs, seq, "idx", path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+
+    seg_header_t *hdr = malloc(sizeof(seg_header_t));
+    if (!hdr) {
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (fread(hdr, sizeof(seg_header_t), 1, f) != 1 ||
+        hdr->magic != SEG_MAGIC || hdr->version != SEG_VERSION ||
+        hdr->entry_size != sizeof(storage_index_entry_t) || hdr->seq != seq) {
+        ESP_LOGW(TAG, "Discarding invalid segment %s", path);
+        free(hdr);
+        fclose(f);
+        unlink(path);
+        return ESP_FAIL;
+    }
+
+    uint32_t live = 0;
+    uint32_t read_total = 0;
+    while (read_total < hdr->count) {
+        uint32_t n = hdr->count - read_total;
+        if (n > INDEX_SEG_PAGE_ENTRIES) n = INDEX_SEG_PAGE_ENTRIES;
+        if (fread(page, sizeof(storage_index_entry_t), n, f) != n) {
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (!(page[i].flags & STORAGE_FLAG_DELETED)) {
+                live++;
+            }
+        }
+        read_total += n;
+    }
+    fclose(f);
+
+    if (read_total != hdr->count) {
+        ESP_LOGW(TAG, "Truncated segment %s (%" PRIu32 "/%" PRIu32 ")",
+                 path, read_total, hdr->count);
+        hdr->count = read_total;
+    }
+
+    index_seg_t seg = {
+        .seq = seq,
+        .count = hdr->count,
+        .live_count = live,
+        .min_created_at = hdr->min_created_at,
+        .max_created_at = hdr->max_created_at,
+        .min_expires_at = hdr->min_expires_at,
+        .max_expires_at = hdr->max_expires_at,
+        .bloom = seg_alloc(INDEX_SEG_BLOOM_BYTES),
+    };
+    if (!seg.bloom) {
+        free(hdr);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(seg.bloom, hdr->bloom, INDEX_SEG_BLOOM_BYTES);
+    free(hdr);
+
+    esp_err_t err = insert_seg(segs, &seg);
+    if (err != ESP_OK) {
+        free(seg.bloom);
+    }
+    return err;
+}
+
+static void recover_tmp_segment(index_segs_t *segs, uint32_t seq)
+{
+    char tmp_path[64];
+    char idx_path[64];
+    struct stat st;
+
+    get_seg_path(segs, seq, "tmp", tmp_path, sizeof(tmp_path));
+    get_seg_path(segs, seq, "idx", idx_path, sizeof(idx_path));
+
+    if (stat(idx_path, &st) == 0) {
+        unlink(tmp_path);
+    } else if (rename(tmp_path, idx_path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+esp_err_t index_segs_init(index_segs_t *segs, const char *dir)
+{
+    memset(segs, 0, sizeof(index_segs_t));
+    strncpy(segs->dir, dir, sizeof(segs->dir) - 1);
+    mkdir(segs->dir, 0755);
+
+    DIR *d = opendir(segs->dir);
+    if (!d) {
+        ESP_LOGE(TAG, "Failed to open %s", segs->dir);
+        return ESP_FAIL;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        uint32_t seq;
+        char ext[4];
+        if (sscanf(de->d_name, "seg_%8" SCNx32 ".%3s", &seq, ext) == 2 &&
+            strcmp(ext, "tmp") == 0) {
+            recover_tmp_segment(segs, seq);
+        }
+    }
+    rewinddir(d);
+
+    storage_index_entry_t *page = malloc(INDEX_SEG_PAGE_ENTRIES * sizeof(storage_index_entry_t));
+    if (!page) {
+        closedir(d);
+        return ESP_ERR_NO_MEM;
+    }
+
+    while ((de = readdir(d)) != NULL) {
+        uint32_t seq;
+        char ext[4];
+        if (sscanf(de->d_name, "seg_%8" SCNx32 ".%3s", &seq, ext) != 2 ||
+            strcmp(ext, "idx") != 0) {
+            continue;
+        }
+        if (load_segment(segs, seq, page) == ESP_OK && seq >= segs->next_seq) {
+            segs->next_seq = seq + 1;
+        }
+    }
+
+    free(page);
+    closedir(d);
+
+    ESP_LOGI(TAG, "Loaded %" PRIu32 " segments, %" PRIu32 " live entries",
+             segs->seg_count, segs->live_entries);
+    return ESP_OK;
+}
+
+void index_segs_destroy(index_segs_t *segs)
+{
+    for (uint32_t i = 0; i < segs->seg_count; i++) {
+        free(segs->segs[i].bloom);
+    }
+    free(segs->segs);
+    segs->segs = NULL;
+    segs->seg_count = 0;
+    segs->seg_capacity = 0;
+    segs->live_entries = 0;
+}
+
+esp_err_t index_segs_append(index_segs_t *segs, const storage_index_entry_t *entries, uint32_t count)
+{
+    if (count == 0 || count > INDEX_SEG_MAX_ENTRIES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    storage_index_entry_t *sorted = seg_alloc(count * sizeof(storage_index_entry_t));
+    if (!sorted) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(sorted, entries, count * sizeof(storage_index_entry_t));
+    qsort(sorted, count, sizeof(storage_index_entry_t), compare_created_at);
+
+    index_seg_t seg;
+    esp_err_t err = write_segment(segs, segs->next_seq, "idx", sorted, count, &seg);
+    free(sorted);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = insert_seg(segs, &seg);
+    if (err != ESP_OK) {
+        char path[64];
+        get_seg_path(segs, seg.seq, "idx", path, sizeof(path));
+        unlink(path);
+        free(seg.bloom);
+        return err;
+    }
+
+    segs->next_seq++;
+    ESP_LOGI(TAG, "Spilled %" PRIu32 " entries to segment %" PRIu32, count, seg.seq);
+    return ESP_OK;
+}
+
+esp_err_t index_segs_read(index_segs_t *segs, uint32_t seg_idx, uint32_t pos,
+                          storage_index_entry_t *out, uint32_t count)
+{
+    if (seg_idx >= segs->seg_count || pos + count > segs->segs[seg_idx].count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char path[64];
+    get_seg_path(segs, segs->segs[seg_idx].seq, "idx", path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (fseek(f, entry_offset(pos), SEEK_SET) != 0 ||
+        fread(out, sizeof(storage_index_entry_t), count, f) != count) {
+        err = ESP_FAIL;
+    }
+    fclose(f);
+    return err;
+}
+
+uint32_t index_segs_upper_bound(index_segs_t *segs, uint32_t seg_idx, uint32_t created_at)
+{
+    index_seg_t *seg = &segs->segs[seg_idx];
+    if (created_at >= seg->max_created_at) return seg->count;
+    if (created_at < seg->min_created_at) return 0;
+
+    char path[64];
+    get_seg_path(segs, seg->seq, "idx", path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return seg->count;
+    }
+
+    uint32_t lo = 0;
+    uint32_t hi = seg->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        storage_index_entry_t entry;
+        if (fseek(f, entry_offset(mid), SEEK_SET) != 0 ||
+            fread(&entry, sizeof(entry), 1, f) != 1) {
+            hi = seg->count;
+            break;
+        }
+        if (entry.created_at <= created_at) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    fclose(f);
+    return hi;
+}
+
+bool index_segs_find(index_segs_t *segs, const uint8_t event_id[32],
+                     storage_index_entry_t *out, uint32_t *seg_idx, uint32_t *pos)
+{
+    storage_index_entry_t *page = NULL;
+
+    for (uint32_t s = segs->seg_count; s-- > 0;) {
+        index_seg_t *seg = &segs->segs[s];
+        if (seg->live_count == 0 || !bloom_test(seg->bloom, event_id)) {
+            continue;
+        }
+
+        if (!page) {
+            page = malloc(INDEX_SEG_PAGE_ENTRIES * sizeof(storage_index_entry_t));
+            if (!page) return false;
+        }
+
+        for (uint32_t p = 0; p < seg->count; p += INDEX_SEG_PAGE_ENTRIES) {
+            uint32_t n = seg->count - p;
+            if (n > INDEX_SEG_PAGE_ENTRIES) n = INDEX_SEG_PAGE_ENTRIES;
+            if (index_segs_read(segs, s, p, page, n) != ESP_OK) {
+                break;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                if (!(page[i].flags & STORAGE_FLAG_DELETED) &&
+                    memcmp(page[i].event_id, event_id, 32) == 0) {
+                    if (out) *out = page[i];
+                    if (seg_idx) *seg_idx = s;
+                    if (pos) *pos = p + i;
+                    free(page);
+                    return true;
+                }
+            }
+        }
+    }
+
+    free(page);
+    return false;
+}
+
+esp_err_t index_segs_mark_deleted(index_segs_t *segs, uint32_t seg_idx, uint32_t pos)
+{
+    if (seg_idx >= segs->seg_count || pos >= segs->segs[seg_idx].count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    index_seg_t *seg = &segs->segs[seg_idx];
+    char path[64];
+    get_seg_path(segs, seg->seq, "idx", path, sizeof(path));
+    FILE *f = fopen(path, "r+b");
+    if (!f) {
+        return ESP_FAIL;
+    }
+
+    storage_index_entry_t entry;
+    esp_err_t err = ESP_FAIL;
+    if (fseek(f, entry_offset(pos), SEEK_SET) == 0 &&
+        fread(&entry, sizeof(entry), 1, f) == 1) {
+        if (entry.flags & STORAGE_FLAG_DELETED) {
+            err = ESP_OK;
+        } else {
+            entry.flags |= STORAGE_FLAG_DELETED;
+            if (fseek(f, entry_offset(pos), SEEK_SET) == 0 &&
+                fwrite(&entry, sizeof(entry), 1, f) == 1) {
+                if (seg->live_count > 0) seg->live_count--;
+                if (segs->live_entries > 0) segs->live_entries--;
+                err = ESP_OK;
+            }
+        }
+    }
+    fclose(f);
+    return err;
+}
+
+void index_segs_remove(index_segs_t *segs, uint32_t seg_idx)
+{
+    if (seg_idx >= segs->seg_count) return;
+
+    index_seg_t *seg = &segs->segs[seg_idx];
+    char path[64];
+    get_seg_path(segs, seg->seq, "idx", path, sizeof(path));
+    unlink(path);
+
+    segs->live_entries -= seg->live_count;
+    free(seg->bloom);
+    memmove(&segs->segs[seg_idx], &segs->segs[seg_idx + 1],
+            (segs->seg_count - seg_idx - 1) * sizeof(index_seg_t));
+    segs->seg_count--;
+}
+
+static uint32_t collect_live(index_segs_t *segs, uint32_t seg_idx,
+                             storage_index_entry_t *out, uint32_t max)
+{
+    index_seg_t *seg = &segs->segs[seg_idx];
+    uint32_t n_out = 0;
+
+    for (uint32_t p = 0; p < seg->count; p += INDEX_SEG_PAGE_ENTRIES) {
+        uint32_t n = seg->count - p;
+        if (n > INDEX_SEG_PAGE_ENTRIES) n = INDEX_SEG_PAGE_ENTRIES;
+        storage_index_entry_t *page = &out[n_out];
+        if (n_out + n > max || index_segs_read(segs, seg_idx, p, page, n) != ESP_OK) {
+            return UINT32_MAX;
+        }
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (!(page[i].flags & STORAGE_FLAG_DELETED)) {
+                page[kept++] = page[i];
+            }
+        }
+        n_out += kept;
+    }
+    return n_out;
+}
+
+static bool merge_pair(index_segs_t *segs, uint32_t i, storage_index_entry_t *buf)
+{
+    index_seg_t *b = &segs->segs[i + 1];
+    uint32_t cap = INDEX_SEG_MAX_ENTRIES + INDEX_SEG_PAGE_ENTRIES;
+
+    uint32_t na = collect_live(segs, i, buf, cap);
+    if (na == UINT32_MAX) return false;
+    uint32_t nb = collect_live(segs, i + 1, buf + na, cap - na);
+    if (nb == UINT32_MAX || na + nb > INDEX_SEG_MAX_ENTRIES) return false;
+
+    qsort(buf, na + nb, sizeof(storage_index_entry_t), compare_created_at);
+
+    uint32_t seq = b->seq;
+    index_seg_t merged;
+    if (write_segment(segs, seq, "tmp", buf, na + nb, &merged) != ESP_OK) {
+        return false;
+    }
+
+    char tmp_path[64];
+    char b_path[64];
+    get_seg_path(segs, seq, "tmp", tmp_path, sizeof(tmp_path));
+    get_seg_path(segs, seq, "idx", b_path, sizeof(b_path));
+    unlink(b_path);
+    if (rename(tmp_path, b_path) != 0) {
+        ESP_LOGE(TAG, "Failed to install merged segment %" PRIu32, seq);
+        free(merged.bloom);
+        return false;
+    }
+
+    segs->live_entries -= b->live_count;
+    free(b->bloom);
+    *b = merged;
+    segs->live_entries += merged.live_count;
+    segs->generation++;
+
+    index_segs_remove(segs, i);
+    return true;
+}
+
+int index_segs_compact(index_segs_t *segs)
+{
+    int merged = 0;
+    storage_index_entry_t *buf = NULL;
+
+    uint32_t i = 0;
+    while (i < segs->seg_count) {
+        if (segs->segs[i].live_count == 0) {
+            index_segs_remove(segs, i);
+            merged++;
+            continue;
+        }
+
+        if (i + 1 < segs->seg_count &&
+            segs->segs[i].live_count + segs->segs[i + 1].live_count <= INDEX_SEG_MAX_ENTRIES) {
+            if (!buf) {
+                buf = seg_alloc((INDEX_SEG_MAX_ENTRIES + INDEX_SEG_PAGE_ENTRIES) *
+                                sizeof(storage_index_entry_t));
+                if (!buf) break;
+            }
+            if (merge_pair(segs, i, buf)) {
+                merged++;
+                continue;
+            }
+        }
+        i++;
+    }
+
+    free(buf);
+    if (merged > 0) {
+        ESP_LOGI(TAG, "Compacted segments: %d merged/removed, %" PRIu32 " remaining",
+                 merged, segs->seg_count);
+    }
+    return merged;
+}
+
+static int32_t seg_at_or_below(const index_segs_t *segs, uint32_t seq)
+{
+    for (uint32_t s = segs->seg_count; s-- > 0;) {
+        if (segs->segs[s].seq <= seq) {
+            return (int32_t)s;
+        }
+    }
+    return -1;
+}
+
+static int32_t seg_at_or_above(const index_segs_t *segs, uint32_t seq)
+{
+    for (uint32_t s = 0; s < segs->seg_count; s++) {
+        if (segs->segs[s].seq >= seq) {
+            return (int32_t)s;
+        }
+    }
+    return -1;
+}
+
+static void cursor_enter(index_segs_cursor_t *cur, uint32_t seq)
+{
+    cur->seq = seq;
+    cur->pos = UINT32_MAX;
+    cur->lo = 0;
+    cur->pass_floor = UINT32_MAX;
+    cur->has_last = false;
+}
+
+static int cursor_key_cmp(const index_segs_cursor_t *cur, const storage_index_entry_t *entry)
+{
+    if (entry->created_at != cur->last_created_at) {
+        return entry->created_at < cur->last_created_at ? -1 : 1;
+    }
+    return memcmp(entry->event_id, cur->last_id, 32);
+}
+
+static bool cursor_seen(const index_segs_cursor_t *cur, const storage_index_entry_t *entry)
+{
+    if (entry->file_index >= cur->file_bound || entry->file_index < cur->lo) return true;
+    return cur->has_last && cursor_key_cmp(cur, entry) >= 0;
+}
+
+void index_segs_cursor_init(index_segs_t *segs, index_segs_cursor_t *cur, uint32_t file_bound)
+{
+    memset(cur, 0, sizeof(*cur));
+    cursor_enter(cur, UINT32_MAX);
+    cur->gen = segs->generation;
+    cur->file_bound = file_bound;
+}
+
+bool index_segs_cursor_scan(index_segs_t *segs, index_segs_cursor_t *cur,
+                            uint32_t since, uint32_t until, storage_index_entry_t *page,
+                            index_segs_visit_fn visit, void *ctx)
+{
+    // A merge keeps the newer segment's seq, so our position now lives in the
+    // first segment at or above it. Resume there after the last key; entries
+    // pulled in from older segments sit below pass_floor and wait for a second
+    // pass, entries from newer ones are already above file_bound.
+    if (cur->gen != segs->generation) {
+        cur->gen = segs->generation;
+        int32_t si = cur->seq == UINT32_MAX ? -1 : seg_at_or_above(segs, cur->seq);
+        if (si >= 0 && cur->pos == 0) {
+            cursor_enter(cur, segs->segs[si].seq);
+        } else if (si >= 0) {
+            cur->seq = segs->segs[si].seq;
+            cur->pos = UINT32_MAX;
+            if (cur->pass_floor != UINT32_MAX && cur->pass_floor > cur->lo) {
+                cur->lo = cur->pass_floor;
+            }
+        }
+    }
+
+    for (;;) {
+        int32_t si;
+        if (cur->pos == 0) {
+            si = cur->seq == 0 ? -1 : seg_at_or_below(segs, cur->seq - 1);
+        } else {
+            si = seg_at_or_below(segs, cur->seq);
+        }
+        if (si < 0) {
+            return true;
+        }
+
+        index_seg_t *seg = &segs->segs[si];
+        if (seg->seq != cur->seq) {
+            cursor_enter(cur, seg->seq);
+        }
+
+        uint32_t pos = cur->pos;
+        if (seg->live_count == 0 ||
+            (since > 0 && seg->max_created_at < since) ||
+            (until > 0 && seg->min_created_at > until)) {
+            pos = 0;
+        } else if (pos == UINT32_MAX) {
+            pos = until > 0 ? index_segs_upper_bound(segs, (uint32_t)si, until) : seg->count;
+            if (cur->has_last) {
+                uint32_t resume = index_segs_upper_bound(segs, (uint32_t)si, cur->last_created_at);
+                if (resume < pos) pos = resume;
+            }
+        } else if (pos > seg->count) {
+            pos = seg->count;
+        }
+
+        bool more = true;
+        while (pos > 0 && more) {
+            uint32_t start = pos > INDEX_SEG_PAGE_ENTRIES ? pos - INDEX_SEG_PAGE_ENTRIES : 0;
+            if (index_segs_read(segs, (uint32_t)si, start, page, pos - start) != ESP_OK) {
+                pos = 0;
+                break;
+            }
+
+            while (pos > start && more) {
+                const storage_index_entry_t *entry = &page[pos - 1 - start];
+                if (since > 0 && entry->created_at < since) {
+                    pos = 0;
+                    break;
+                }
+                pos--;
+                bool seen = cursor_seen(cur, entry);
+                more = visit(entry, seen, ctx);
+                if (!seen && entry->file_index < cur->pass_floor) {
+                    cur->pass_floor = entry->file_index;
+                }
+                cur->last_created_at = entry->created_at;
+                memcpy(cur->last_id, entry->event_id, 32);
+                cur->has_last = true;
+            }
+        }
+
+        cur->pos = pos;
+        if (pos > 0) {
+            return false;
+        }
+        if (cur->lo > 0) {
+            cur->file_bound = cur->lo;
+            cursor_enter(cur, cur->seq);
+        } else if (cur->pass_floor < cur->file_bound) {
+            cur->file_bound = cur->pass_floor;
+        }
+        if (!more) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef INDEX_SEGMENTS_H
+#define INDEX_SEGMENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define INDEX_SEG_MAX_ENTRIES   1024
+#define INDEX_SEG_BLOOM_BYTES   1024
+#define INDEX_SEG_PAGE_ENTRIES  64
+#define INDEX_SEG_DIR_LEN       32
+
+#define STORAGE_FLAG_DELETED  0x01
+
+typedef struct __attribute__((packed)) storage_index_entry {
+    uint8_t  event_id[32];
+    uint32_t created_at;
+    uint32_t expires_at;
+    uint32_t file_index;
+    uint16_t kind;
+    uint8_t  pubkey_prefix[4];
+    uint8_t  flags;
+    uint8_t  reserved;
+} storage_index_entry_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t count;
+    uint32_t live_count;
+    uint32_t min_created_at;
+    uint32_t max_created_at;
+    uint32_t min_expires_at;
+    uint32_t max_expires_at;
+    uint8_t *bloom;
+} index_seg_t;
+
+typedef struct {
+    index_seg_t *segs;
+    uint32_t seg_count;
+    uint32_t seg_capacity;
+    uint32_t next_seq;
+    uint32_t live_entries;
+    uint32_t generation;
+    char dir[INDEX_SEG_DIR_LEN];
+} index_segs_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t pos;
+    uint32_t gen;
+    uint32_t file_bound;
+    uint32_t lo;
+    uint32_t pass_floor;
+    uint32_t last_created_at;
+    uint8_t  last_id[32];
+    bool     has_last;
+} index_segs_cursor_t;
+
+typedef bool (*index_segs_visit_fn)(const storage_index_entry_t *entry, bool seen, void *ctx);
+
+esp_err_t index_segs_init(index_segs_t *segs, const char *dir);
+void index_segs_destroy(index_segs_t *segs);
+
+esp_err_t index_segs_append(index_segs_t *segs, const storage_index_entry_t *entries, uint32_t count);
+
+esp_err_t index_segs_read(index_segs_t *segs, uint32_t seg_idx, uint32_t pos,
+                          storage_index_entry_t *out, uint32_t count);
+
+uint32_t index_segs_upper_bound(index_segs_t *segs, uint32_t seg_idx, uint32_t created_at);
+
+bool index_segs_find(index_segs_t *segs, const uint8_t event_id[32],
+                     storage_index_entry_t *out, uint32_t *seg_idx, uint32_t *pos);
+
+esp_err_t index_segs_mark_deleted(index_segs_t *segs, uint32_t seg_idx, uint32_t pos);
+
+void index_segs_remove(index_segs_t *segs, uint32_t seg_idx);
+
+int index_segs_compact(index_segs_t *segs);
+
+void index_segs_cursor_init(index_segs_t *segs, index_segs_cursor_t *cur, uint32_t file_bound);
+
+// Walks segments newest first, each in descending (created_at, event_id) order,
+// until visit returns false. Entries the cursor must not report (already passed,
+// or at or above file_bound) are handed over with seen set. Returns true when done.
+bool index_segs_cursor_scan(index_segs_t *segs, index_segs_cursor_t *cur,
+                            uint32_t since, uint32_t until, storage_index_entry_t *page,
+                            index_segs_visit_fn visit, void *ctx);
+
+#endif
@@ -7,6 +7,9 @@
 #include "nvs_flash.h"
 
 #include "nostr.h"
+#include "broadcaster.h"
+#include "cpu_monitor.h"
+#include "query_scheduler.h"
 #include "rate_limiter.h"
 #include "relay_core.h"
 #include "router.h"
@@ -19,14 +22,19 @@ static relay_ctx_t g_relay_ctx;
 static sub_manager_t g_sub_manager;
 static storage_engine_t g_storage;
 static rate_limiter_t g_rate_limiter;
+static query_sched_t g_query_sched;
+static broadcaster_t g_broadcaster;
 
 #define MEM_MONITOR_INTERVAL_MS 60000
-#define MEM_MONITOR_STACK_SIZE  2048
+#define MEM_MONITOR_STACK_SIZE  4096
 #define WATCHDOG_TIMEOUT_MS     30000
 
 static void memory_monitor_task(void *arg)
 {
     (void)arg;
+#ifdef CONFIG_WISP_CPU_MONITOR
+    cpu_monitor_t cpu_mon = {0};
+#endif
 
     while (1) {
         uint32_t free_heap = esp_get_free_heap_size();
@@ -41,6 +49,46 @@ static void memory_monitor_task(void *arg)
             ESP_LOGW(TAG, "Low memory warning: %lu bytes free", (unsigned long)free_heap);
         }
 
+        if (g_relay_ctx.broadcaster) {
+            broadcaster_stats_t fanout;
+            broadcaster_get_stats(&g_broadcaster, &fanout);
+            ESP_LOGI(TAG, "Fanout queue: %lu/%lu (peak %lu), sent %lu, dropped %lu, inline %lu, "
+                     "dispatch avg %lu us max %lu us",
+                     (unsigned long)fanout.depth, (unsigned long)fanout.capacity,
+                     (unsigned long)fanout.depth_high_water, (unsigned long)fanout.delivered,
+                     (unsigned long)fanout.dropped, (unsigned long)fanout.inline_fanouts,
+                     (unsigned long)fanout.dispatch_avg_us, (unsigned long)fanout.dispatch_max_us);
+        }
+
+        ws_queue_stats_t queues[WS_MAX_CONNECTIONS];
+        uint8_t queue_count = ws_server_queue_stats(&g_relay_ctx.ws_server, queues, WS_MAX_CONNECTIONS);
+        for (uint8_t i = 0; i < queue_count; i++) {
+            ESP_LOGI(TAG, "Outbound fd=%d: %lu bytes / %u frames (peak %lu), dropped %lu",
+                     queues[i].fd, (unsigned long)queues[i].bytes, queues[i].frames,
+                     (unsigned long)queues[i].bytes_peak, (unsigned long)queues[i].dropped);
+        }
+
+        rx_pool_stats_t rx;
+        rx_pool_get_stats(&g_relay_ctx.ws_server.rx_pool, &rx);
+        ESP_LOGI(TAG, "Receive buffers: %lu reused, %lu allocated, %lu in use, %lu bytes cached",
+                 (unsigned long)rx.hits, (unsigned long)rx.misses,
+                 (unsigned long)rx.in_use, (unsigned long)rx.cached_bytes);
+
+#ifdef CONFIG_WISP_CPU_MONITOR
+        cpu_usage_t cpu;
+        if (cpu_monitor_sample(&cpu_mon, &cpu) == ESP_OK) {
+            for (uint8_t core = 0; core < cpu.cores; core++) {
+                ESP_LOGI(TAG, "CPU%u busy: %u%%", core, cpu.busy_percent[core]);
+            }
+        }
+#endif
+
+#ifdef CONFIG_WISP_WS_DEFLATE
+        ESP_LOGI(TAG, "Outbound payload: %lu bytes raw, %lu bytes on wire",
+                 (unsigned long)g_relay_ctx.ws_server.tx_raw_bytes,
+                 (unsigned long)g_relay_ctx.ws_server.tx_wire_bytes);
+#endif
+
         vTaskDelay(pdMS_TO_TICKS(MEM_MONITOR_INTERVAL_MS));
     }
 }
@@ -62,8 +110,16 @@ static void init_watchdog(void)
     }
 }
 
+static bool on_ws_idle(int fd)
+{
+    return sub_manager_count(&g_sub_manager, fd) == 0;
+}
+
 static void on_ws_disconnect(int fd)
 {
+    if (g_relay_ctx.query_sched) {
+        qsched_cancel_conn(&g_query_sched, fd);
+    }
     sub_manager_remove_all(&g_sub_manager, fd);
     rate_limiter_reset(&g_rate_limiter, fd);
 }
@@ -76,18 +132,21 @@ static void on_ws_message(int fd, const char *data, size_t len)
     }
 
     router_msg_t msg;
-    nostr_relay_error_t result = router_parse(data, len, &msg);
-    if (result != NOSTR_RELAY_OK) {
-        router_send_notice(&g_relay_ctx, fd, "error: failed to parse message");
-        return;
-    }
-
+    router_parse(data, len, &msg);
     router_dispatch(&g_relay_ctx, fd, &msg);
     router_msg_free(&msg);
 }
 
 static void cleanup_relay_resources(bool cleanup_rate_limiter, bool cleanup_storage, bool cleanup_sub_manager)
 {
+    if (g_relay_ctx.broadcaster) {
+        broadcaster_stop(&g_broadcaster);
+        g_relay_ctx.broadcaster = NULL;
+    }
+    if (g_relay_ctx.query_sched) {
+        qsched_destroy(&g_query_sched);
+        g_relay_ctx.query_sched = NULL;
+    }
     if (cleanup_rate_limiter && g_relay_ctx.rate_limiter) {
         rate_limiter_destroy(&g_rate_limiter);
         g_relay_ctx.rate_limiter = NULL;
@@ -111,11 +170,26 @@ static void start_relay_server(ip_event_got_ip_t *event)
 
     g_relay_ctx.config.port = 4869;
     g_relay_ctx.config.max_event_age_sec = 21 * 24 * 60 * 60;
-    g_relay_ctx.config.max_subs_per_conn = 8;
+    g_relay_ctx.config.max_subs_per_conn = CONFIG_WISP_SUB_MAX_PER_CONN;
     g_relay_ctx.config.max_filters_per_sub = 4;
     g_relay_ctx.config.max_future_sec = 900;
-
-    if (sub_manager_init(&g_sub_manager) != ESP_OK) {
+    g_relay_ctx.config.req_max_entries = CONFIG_WISP_REQ_BUDGET_ENTRIES;
+    g_relay_ctx.config.req_max_files = CONFIG_WISP_REQ_BUDGET_FILES;
+    g_relay_ctx.config.req_max_ms = CONFIG_WISP_REQ_BUDGET_MS;
+#ifdef CONFIG_WISP_REQ_BUDGET_SEND_CLOSED
+    g_relay_ctx.config.req_budget_closes = true;
+#else
+    g_relay_ctx.config.req_budget_closes = false;
+#endif
+
+    sub_limits_t sub_limits = {
+        .max_total = CONFIG_WISP_SUB_MAX_TOTAL,
+        .max_per_conn = g_relay_ctx.config.max_subs_per_conn,
+#ifdef CONFIG_WISP_SUB_POOL_PSRAM
+        .use_psram = true,
+#endif
+    };
+    if (sub_manager_init(&g_sub_manager, &sub_limits) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to init subscription manager");
         return;
     }
@@ -142,6 +216,24 @@ static void start_relay_server(ip_event_got_ip_t *event)
     rate_limiter_init(&g_rate_limiter, &rate_cfg);
     g_relay_ctx.rate_limiter = &g_rate_limiter;
 
+    if (qsched_init(&g_query_sched, &g_relay_ctx) == ESP_OK) {
+        g_relay_ctx.query_sched = &g_query_sched;
+    } else {
+        ESP_LOGW(TAG, "Query scheduler unavailable, REQs will not backfill");
+    }
+
+#ifdef CONFIG_WISP_FANOUT_OVERFLOW_DROP
+    bool fanout_drop = true;
+#else
+    bool fanout_drop = false;
+#endif
+    if (broadcaster_init(&g_broadcaster, &g_relay_ctx, CONFIG_WISP_FANOUT_QUEUE_DEPTH,
+                         fanout_drop) == ESP_OK) {
+        g_relay_ctx.broadcaster = &g_broadcaster;
+    } else {
+        ESP_LOGW(TAG, "Fanout task unavailable, events will fan out inline");
+    }
+
     esp_err_t ret = ws_server_init(&g_relay_ctx.ws_server, g_relay_ctx.config.port, on_ws_message);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to init ws server: %s", esp_err_to_name(ret));
@@ -149,6 +241,7 @@ static void start_relay_server(ip_event_got_ip_t *event)
         return;
     }
     ws_server_set_disconnect_cb(on_ws_disconnect);
+    ws_server_set_idle_cb(on_ws_idle);
 
     ESP_LOGI(TAG, "Relay listening on ws://" IPSTR ":%d",
              IP2STR(&event->ip_info.ip), g_relay_ctx.config.port);
@@ -235,7 +328,9 @@ void app_main(void)
     nostr_init();
 
     TaskHandle_t mem_mon_handle = NULL;
-    BaseType_t task_ret = xTaskCreate(memory_monitor_task, "mem_mon", MEM_MONITOR_STACK_SIZE, NULL, 1, &mem_mon_handle);
+    BaseType_t task_ret = xTaskCreatePinnedToCore(memory_monitor_task, "mem_mon", MEM_MONITOR_STACK_SIZE,
+                                                  NULL, CONFIG_WISP_MONITOR_PRIORITY, &mem_mon_handle,
+                                                  CONFIG_WISP_MONITOR_CORE < 0 ? tskNO_AFFINITY : CONFIG_WISP_MONITOR_CORE);
     if (task_ret != pdPASS) {
         ESP_LOGW(TAG, "Failed to create mem_mon task (stack=%d)", MEM_MONITOR_STACK_SIZE);
     }
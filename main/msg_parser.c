@@ -0,0 +1,715 @@
+#include "msg_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 16
+
+enum {
+    F_ID         = 1 << 0,
+    F_PUBKEY     = 1 << 1,
+    F_CREATED_AT = 1 << 2,
+    F_KIND       = 1 << 3,
+    F_TAGS       = 1 << 4,
+    F_CONTENT    = 1 << 5,
+    F_SIG        = 1 << 6,
+    F_ALL        = (1 << 7) - 1
+};
+
+typedef struct {
+    const char *p;
+    const char *end;
+} cursor_t;
+
+typedef struct {
+    const char *raw;
+    size_t raw_len;
+    size_t len;
+    bool escaped;
+} span_t;
+
+static void skip_ws(cursor_t *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+        c->p++;
+    }
+}
+
+static bool peek(cursor_t *c, char ch)
+{
+    skip_ws(c);
+    return c->p < c->end && *c->p == ch;
+}
+
+static bool expect(cursor_t *c, char ch)
+{
+    if (!peek(c, ch)) return false;
+    c->p++;
+    return true;
+}
+
+static int hex_val(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static bool read_u16(const char **p, const char *end, uint32_t *out)
+{
+    if (end - *p < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_val((*p)[i]);
+        if (d < 0) return false;
+        v = (v << 4) | (uint32_t)d;
+    }
+    *p += 4;
+    *out = v;
+    return true;
+}
+
+static bool unicode_escape(const char **p, const char *end, uint32_t *cp)
+{
+    uint32_t hi, lo;
+    if (!read_u16(p, end, &hi) || hi == 0) return false;
+    if (hi >= 0xDC00 && hi <= 0xDFFF) return false;
+    if (hi < 0xD800 || hi > 0xDBFF) {
+        *cp = hi;
+        return true;
+    }
+    if (end - *p < 2 || (*p)[0] != '\\' || (*p)[1] != 'u') return false;
+    *p += 2;
+    if (!read_u16(p, end, &lo) || lo < 0xDC00 || lo > 0xDFFF) return false;
+    *cp = 0x10000 + ((hi - 0xD800) << 10) + (lo - 0xDC00);
+    return true;
+}
+
+static size_t utf8_len(uint32_t cp)
+{
+    if (cp < 0x80) return 1;
+    if (cp < 0x800) return 2;
+    if (cp < 0x10000) return 3;
+    return 4;
+}
+
+static char *utf8_put(char *out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *out++ = (char)cp;
+    } else if (cp < 0x800) {
+        *out++ = (char)(0xC0 | (cp >> 6));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = (char)(0xE0 | (cp >> 12));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (cp >> 18));
+        *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+static char simple_escape(char ch)
+{
+    switch (ch) {
+        case '"':  return '"';
+        case '\\': return '\\';
+        case '/':  return '/';
+        case 'b':  return '\b';
+        case 'f':  return '\f';
+        case 'n':  return '\n';
+        case 'r':  return '\r';
+        case 't':  return '\t';
+        default:   return 0;
+    }
+}
+
+static bool scan_string(cursor_t *c, span_t *s)
+{
+    if (!expect(c, '"')) return false;
+    s->raw = c->p;
+    s->len = 0;
+    s->escaped = false;
+
+    while (c->p < c->end) {
+        unsigned char ch = (unsigned char)*c->p++;
+        if (ch == '"') {
+            s->raw_len = (size_t)(c->p - 1 - s->raw);
+            return true;
+        }
+        if (ch < 0x20) return false;
+        if (ch != '\\') {
+            s->len++;
+            continue;
+        }
+        s->escaped = true;
+        if (c->p >= c->end) return false;
+        ch = (unsigned char)*c->p++;
+        if (ch == 'u') {
+            uint32_t cp;
+            if (!unicode_escape(&c->p, c->end, &cp)) return false;
+            s->len += utf8_len(cp);
+        } else if (simple_escape((char)ch)) {
+            s->len++;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void span_decode(const span_t *s, char *out)
+{
+    if (!s->escaped) {
+        memcpy(out, s->raw, s->raw_len);
+        out[s->raw_len] = '\0';
+        return;
+    }
+
+    const char *p = s->raw;
+    const char *end = s->raw + s->raw_len;
+    while (p < end) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        p++;
+        if (*p == 'u') {
+            uint32_t cp = 0;
+            p++;
+            unicode_escape(&p, end, &cp);
+            out = utf8_put(out, cp);
+        } else {
+            *out++ = simple_escape(*p++);
+        }
+    }
+    *out = '\0';
+}
+
+static void span_prefix(const span_t *s, char *out, size_t max)
+{
+    size_t n = 0;
+    if (!s->escaped) {
+        n = s->raw_len < max ? s->raw_len : max;
+        while (n > 0 && n < s->raw_len && ((unsigned char)s->raw[n] & 0xC0) == 0x80) n--;
+        memcpy(out, s->raw, n);
+    }
+    out[n] = '\0';
+}
+
+static char *span_dup(const span_t *s)
+{
+    char *out = malloc(s->len + 1);
+    if (out) span_decode(s, out);
+    return out;
+}
+
+static bool span_is(const span_t *s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return !s->escaped && s->raw_len == n && memcmp(s->raw, lit, n) == 0;
+}
+
+static bool span_is_hex(const span_t *s)
+{
+    if (s->escaped || s->raw_len == 0 || s->raw_len > 64) return false;
+    for (size_t i = 0; i < s->raw_len; i++) {
+        if (hex_val(s->raw[i]) < 0) return false;
+    }
+    return true;
+}
+
+static bool span_hex(const span_t *s, uint8_t *out, size_t bytes)
+{
+    if (s->escaped || s->raw_len != bytes * 2) return false;
+    for (size_t i = 0; i < bytes; i++) {
+        int hi = hex_val(s->raw[2 * i]);
+        int lo = hex_val(s->raw[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+static bool scan_int(cursor_t *c, int64_t *out)
+{
+    skip_ws(c);
+    bool neg = c->p < c->end && *c->p == '-';
+    if (neg) c->p++;
+    if (c->p >= c->end || *c->p < '0' || *c->p > '9') return false;
+
+    int64_t v = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        int d = *c->p++ - '0';
+        if (v > (INT64_MAX - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    if (c->p < c->end && (*c->p == '.' || *c->p == 'e' || *c->p == 'E')) return false;
+    *out = neg ? -v : v;
+    return true;
+}
+
+static bool skip_digits(cursor_t *c)
+{
+    const char *start = c->p;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') c->p++;
+    return c->p > start;
+}
+
+static bool skip_number(cursor_t *c)
+{
+    if (c->p < c->end && *c->p == '-') c->p++;
+    if (!skip_digits(c)) return false;
+    if (c->p < c->end && *c->p == '.') {
+        c->p++;
+        if (!skip_digits(c)) return false;
+    }
+    if (c->p < c->end && (*c->p == 'e' || *c->p == 'E')) {
+        c->p++;
+        if (c->p < c->end && (*c->p == '+' || *c->p == '-')) c->p++;
+        if (!skip_digits(c)) return false;
+    }
+    return true;
+}
+
+static bool skip_literal(cursor_t *c, const char *lit)
+{
+    size_t n = strlen(lit);
+    if ((size_t)(c->end - c->p) < n || memcmp(c->p, lit, n) != 0) return false;
+    c->p += n;
+    return true;
+}
+
+static bool skip_value(cursor_t *c, int depth)
+{
+    span_t s;
+    if (depth > MAX_DEPTH) return false;
+    skip_ws(c);
+    if (c->p >= c->end) return false;
+
+    switch (*c->p) {
+        case '"':
+            return scan_string(c, &s);
+        case '[':
+            c->p++;
+            if (expect(c, ']')) return true;
+            do {
+                if (!skip_value(c, depth + 1)) return false;
+            } while (expect(c, ','));
+            return expect(c, ']');
+        case '{':
+            c->p++;
+            if (expect(c, '}')) return true;
+            do {
+                if (!scan_string(c, &s) || !expect(c, ':') || !skip_value(c, depth + 1)) return false;
+            } while (expect(c, ','));
+            return expect(c, '}');
+        case 't':
+            return skip_literal(c, "true");
+        case 'f':
+            return skip_literal(c, "false");
+        case 'n':
+            return skip_literal(c, "null");
+        default:
+            return skip_number(c);
+    }
+}
+
+static bool scan_tag(cursor_t *c, span_t *values, size_t *count)
+{
+    span_t tmp;
+    size_t n = 0;
+    if (!expect(c, '[')) return false;
+    if (!peek(c, ']')) {
+        do {
+            if (n >= MSG_PARSER_MAX_TAG_VALUES) return false;
+            if (!scan_string(c, values ? &values[n] : &tmp)) return false;
+            n++;
+        } while (expect(c, ','));
+    }
+    if (!expect(c, ']')) return false;
+    *count = n;
+    return true;
+}
+
+static bool scan_tags(cursor_t *c, size_t *count)
+{
+    size_t n = 0, values;
+    if (!expect(c, '[')) return false;
+    if (!peek(c, ']')) {
+        do {
+            if (++n > MSG_PARSER_MAX_TAGS || !scan_tag(c, NULL, &values)) return false;
+        } while (expect(c, ','));
+    }
+    if (!expect(c, ']')) return false;
+    *count = n;
+    return true;
+}
+
+static bool build_tags(nostr_event *ev, cursor_t c, size_t count)
+{
+    span_t values[MSG_PARSER_MAX_TAG_VALUES];
+    if (count == 0) return true;
+
+    ev->tags = calloc(count, sizeof(nostr_tag));
+    if (!ev->tags) return false;
+
+    expect(&c, '[');
+    for (size_t i = 0; i < count; i++) {
+        size_t n;
+        if ((i > 0 && !expect(&c, ',')) || !scan_tag(&c, values, &n)) return false;
+
+        nostr_tag *tag = &ev->tags[ev->tags_count++];
+        if (n == 0) continue;
+        tag->values = calloc(n, sizeof(char *));
+        if (!tag->values) return false;
+        for (size_t j = 0; j < n; j++) {
+            tag->values[j] = span_dup(&values[j]);
+            if (!tag->values[j]) return false;
+            tag->count++;
+        }
+    }
+    return true;
+}
+
+static unsigned event_field(const span_t *key)
+{
+    if (span_is(key, "id")) return F_ID;
+    if (span_is(key, "pubkey")) return F_PUBKEY;
+    if (span_is(key, "created_at")) return F_CREATED_AT;
+    if (span_is(key, "kind")) return F_KIND;
+    if (span_is(key, "tags")) return F_TAGS;
+    if (span_is(key, "content")) return F_CONTENT;
+    if (span_is(key, "sig")) return F_SIG;
+    return 0;
+}
+
+static nostr_relay_error_t parse_event(cursor_t *c, nostr_event **out, char *id_hex)
+{
+    nostr_event head;
+    memset(&head, 0, sizeof(head));
+    span_t key, s, content = {0};
+    cursor_t value, tags = {0};
+    size_t tags_count = 0;
+    unsigned seen = 0;
+    int64_t n;
+    nostr_relay_error_t err, first = NOSTR_RELAY_OK;
+
+    if (!expect(c, '{')) return NOSTR_RELAY_ERR_INVALID_JSON;
+    if (!peek(c, '}')) {
+        do {
+            if (!scan_string(c, &key) || !expect(c, ':')) return NOSTR_RELAY_ERR_INVALID_JSON;
+            unsigned field = event_field(&key);
+            if (field & seen) return NOSTR_RELAY_ERR_INVALID_JSON;
+            seen |= field;
+
+            err = NOSTR_RELAY_OK;
+            value = *c;
+            switch (field) {
+                case F_ID:
+                    if (!scan_string(c, &s)) {
+                        err = NOSTR_RELAY_ERR_INVALID_ID;
+                        break;
+                    }
+                    if (s.raw_len <= 64) span_prefix(&s, id_hex, 64);
+                    if (!span_hex(&s, head.id, sizeof(head.id))) err = NOSTR_RELAY_ERR_INVALID_ID;
+                    break;
+                case F_PUBKEY:
+                    if (!scan_string(c, &s) || !span_hex(&s, head.pubkey.data, sizeof(head.pubkey.data))) {
+                        err = NOSTR_RELAY_ERR_INVALID_PUBKEY;
+                    }
+                    break;
+                case F_SIG:
+                    if (!scan_string(c, &s) || !span_hex(&s, head.sig, sizeof(head.sig))) {
+                        err = NOSTR_RELAY_ERR_INVALID_SIG;
+                    }
+                    break;
+                case F_CREATED_AT:
+                    if (!scan_int(c, &n) || n < 0) err = NOSTR_RELAY_ERR_INVALID_CREATED_AT;
+                    else head.created_at = n;
+                    break;
+                case F_KIND:
+                    if (!scan_int(c, &n) || n < 0 || n > UINT16_MAX) err = NOSTR_RELAY_ERR_INVALID_KIND;
+                    else head.kind = (uint16_t)n;
+                    break;
+                case F_TAGS:
+                    skip_ws(c);
+                    tags = *c;
+                    if (!scan_tags(c, &tags_count)) err = NOSTR_RELAY_ERR_INVALID_TAGS;
+                    tags.end = c->p;
+                    break;
+                case F_CONTENT:
+                    if (!scan_string(c, &content) || content.len > MSG_PARSER_MAX_CONTENT) {
+                        err = NOSTR_RELAY_ERR_INVALID_CONTENT;
+                    }
+                    break;
+                default:
+                    if (!skip_value(c, 1)) return NOSTR_RELAY_ERR_INVALID_JSON;
+                    break;
+            }
+
+            // Keep scanning past a bad field so the id can still be reported
+            if (err != NOSTR_RELAY_OK) {
+                *c = value;
+                if (!skip_value(c, 1)) return first != NOSTR_RELAY_OK ? first : err;
+                if (first == NOSTR_RELAY_OK) first = err;
+            }
+        } while (expect(c, ','));
+    }
+    if (!expect(c, '}')) return NOSTR_RELAY_ERR_INVALID_JSON;
+    if (first != NOSTR_RELAY_OK) return first;
+    if (seen != F_ALL) return NOSTR_RELAY_ERR_MISSING_FIELD;
+
+    nostr_event *ev = malloc(sizeof(nostr_event));
+    if (!ev) return NOSTR_RELAY_ERR_MEMORY;
+    *ev = head;
+    ev->content = span_dup(&content);
+    if (!ev->content || !build_tags(ev, tags, tags_count)) {
+        nostr_event_destroy(ev);
+        return NOSTR_RELAY_ERR_MEMORY;
+    }
+    *out = ev;
+    return NOSTR_RELAY_OK;
+}
+
+static void free_strings(char **values, size_t count)
+{
+    for (size_t i = 0; i < count; i++) free(values[i]);
+    free(values);
+}
+
+static bool string_array(cursor_t *c, bool hex, char ***out, size_t *count)
+{
+    span_t s;
+    size_t n = 0;
+    if (*out) return false;
+
+    skip_ws(c);
+    cursor_t start = *c;
+    if (!expect(c, '[')) return false;
+    if (!peek(c, ']')) {
+        do {
+            if (++n > MSG_PARSER_MAX_FILTER_VALUES || !scan_string(c, &s)) return false;
+            if (hex && !span_is_hex(&s)) return false;
+        } while (expect(c, ','));
+    }
+    if (!expect(c, ']')) return false;
+    if (n == 0) return true;
+
+    char **values = calloc(n, sizeof(char *));
+    if (!values) return false;
+    expect(&start, '[');
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) expect(&start, ',');
+        scan_string(&start, &s);
+        values[i] = span_dup(&s);
+        if (!values[i]) {
+            free_strings(values, i);
+            return false;
+        }
+    }
+    *out = values;
+    *count = n;
+    return true;
+}
+
+static bool kind_array(cursor_t *c, int32_t **out, size_t *count)
+{
+    int64_t v;
+    size_t n = 0;
+    if (*out) return false;
+
+    skip_ws(c);
+    cursor_t start = *c;
+    if (!expect(c, '[')) return false;
+    if (!peek(c, ']')) {
+        do {
+            if (++n > MSG_PARSER_MAX_FILTER_VALUES || !scan_int(c, &v)) return false;
+            if (v < 0 || v > UINT16_MAX) return false;
+        } while (expect(c, ','));
+    }
+    if (!expect(c, ']')) return false;
+    if (n == 0) return true;
+
+    int32_t *kinds = malloc(n * sizeof(int32_t));
+    if (!kinds) return false;
+    expect(&start, '[');
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) expect(&start, ',');
+        scan_int(&start, &v);
+        kinds[i] = (int32_t)v;
+    }
+    *out = kinds;
+    *count = n;
+    return true;
+}
+
+static bool tag_filter(cursor_t *c, char name, nostr_filter_t *f)
+{
+    if (name == 'e') return string_array(c, false, &f->e_tags, &f->e_tags_count);
+    if (name == 'p') return string_array(c, false, &f->p_tags, &f->p_tags_count);
+
+    for (size_t i = 0; i < f->generic_tags_count; i++) {
+        if (f->generic_tags[i].tag_name == name) return false;
+    }
+    nostr_generic_tag_filter_t *tags = realloc(f->generic_tags,
+        (f->generic_tags_count + 1) * sizeof(nostr_generic_tag_filter_t));
+    if (!tags) return false;
+    f->generic_tags = tags;
+
+    nostr_generic_tag_filter_t *g = &tags[f->generic_tags_count];
+    memset(g, 0, sizeof(*g));
+    g->tag_name = name;
+    if (!string_array(c, false, &g->values, &g->values_count)) return false;
+    f->generic_tags_count++;
+    return true;
+}
+
+static bool scan_bound(cursor_t *c, int64_t *out)
+{
+    int64_t v;
+    if (!scan_int(c, &v) || v < 0) return false;
+    *out = v;
+    return true;
+}
+
+static bool parse_filter_field(cursor_t *c, const span_t *key, nostr_filter_t *f)
+{
+    int64_t v;
+    if (span_is(key, "ids")) return string_array(c, true, &f->ids, &f->ids_count);
+    if (span_is(key, "authors")) return string_array(c, true, &f->authors, &f->authors_count);
+    if (span_is(key, "kinds")) return kind_array(c, &f->kinds, &f->kinds_count);
+    if (span_is(key, "since")) return scan_bound(c, &f->since);
+    if (span_is(key, "until")) return scan_bound(c, &f->until);
+    if (span_is(key, "limit")) {
+        if (!scan_bound(c, &v)) return false;
+        f->limit = v > INT32_MAX ? INT32_MAX : (int32_t)v;
+        return true;
+    }
+    if (!key->escaped && key->raw_len == 2 && key->raw[0] == '#' &&
+        ((key->raw[1] >= 'a' && key->raw[1] <= 'z') || (key->raw[1] >= 'A' && key->raw[1] <= 'Z'))) {
+        return tag_filter(c, key->raw[1], f);
+    }
+    return skip_value(c, 1);
+}
+
+static nostr_relay_error_t parse_filter(cursor_t *c, nostr_filter_t *f)
+{
+    span_t key;
+    if (!expect(c, '{')) return NOSTR_RELAY_ERR_INVALID_JSON;
+    if (!peek(c, '}')) {
+        do {
+            if (!scan_string(c, &key) || !expect(c, ':') || !parse_filter_field(c, &key, f)) {
+                return NOSTR_RELAY_ERR_INVALID_JSON;
+            }
+        } while (expect(c, ','));
+    }
+    return expect(c, '}') ? NOSTR_RELAY_OK : NOSTR_RELAY_ERR_INVALID_JSON;
+}
+
+static nostr_relay_error_t parse_sub_id(cursor_t *c, char *out)
+{
+    span_t s;
+    if (!expect(c, ',')) return NOSTR_RELAY_ERR_MISSING_FIELD;
+    if (!scan_string(c, &s)) return NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID;
+    if (s.len > MSG_PARSER_MAX_SUB_ID) {
+        span_prefix(&s, out, MSG_PARSER_MAX_SUB_ID);
+        return NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID;
+    }
+    span_decode(&s, out);
+    return NOSTR_RELAY_OK;
+}
+
+static nostr_relay_error_t parse_req(cursor_t *c, msg_parsed_t *out)
+{
+    nostr_relay_error_t err = parse_sub_id(c, out->sub_id);
+    if (err != NOSTR_RELAY_OK) return err;
+
+    cursor_t start = *c;
+    size_t n = 0;
+    while (expect(c, ',')) {
+        if (++n > MSG_PARSER_MAX_FILTERS) return NOSTR_RELAY_ERR_TOO_MANY_FILTERS;
+        if (!skip_value(c, 1)) return NOSTR_RELAY_ERR_INVALID_JSON;
+    }
+    if (n == 0) return NOSTR_RELAY_ERR_MISSING_FIELD;
+
+    out->filters = calloc(n, sizeof(nostr_filter_t));
+    if (!out->filters) return NOSTR_RELAY_ERR_MEMORY;
+    for (size_t i = 0; i < n; i++) {
+        expect(&start, ',');
+        out->filter_count++;
+        err = parse_filter(&start, &out->filters[i]);
+        if (err != NOSTR_RELAY_OK) return err;
+    }
+    return NOSTR_RELAY_OK;
+}
+
+static nostr_relay_error_t skip_rest(cursor_t *c)
+{
+    while (expect(c, ',')) {
+        if (!skip_value(c, 1)) return NOSTR_RELAY_ERR_INVALID_JSON;
+    }
+    return NOSTR_RELAY_OK;
+}
+
+nostr_relay_error_t msg_parse(const char *json, size_t len, msg_parsed_t *out)
+{
+    memset(out, 0, sizeof(msg_parsed_t));
+    out->type = MSG_PARSER_UNKNOWN;
+    if (!json || len == 0 || len > MSG_PARSER_MAX_LEN) return NOSTR_RELAY_ERR_INVALID_JSON;
+
+    cursor_t c = { json, json + len };
+    span_t type;
+    if (!expect(&c, '[') || !scan_string(&c, &type)) return NOSTR_RELAY_ERR_INVALID_JSON;
+
+    nostr_relay_error_t err;
+    if (span_is(&type, "EVENT")) {
+        out->type = MSG_PARSER_EVENT;
+        err = expect(&c, ',') ? parse_event(&c, &out->event, out->event_id) : NOSTR_RELAY_ERR_MISSING_FIELD;
+    } else if (span_is(&type, "REQ")) {
+        out->type = MSG_PARSER_REQ;
+        err = parse_req(&c, out);
+    } else if (span_is(&type, "COUNT")) {
+        out->type = MSG_PARSER_COUNT;
+        err = parse_req(&c, out);
+    } else if (span_is(&type, "CLOSE")) {
+        out->type = MSG_PARSER_CLOSE;
+        err = parse_sub_id(&c, out->sub_id);
+    } else {
+        out->type = span_is(&type, "AUTH") ? MSG_PARSER_AUTH : MSG_PARSER_UNKNOWN;
+        err = skip_rest(&c);
+    }
+
+    if (err == NOSTR_RELAY_OK) {
+        if (!expect(&c, ']')) {
+            err = NOSTR_RELAY_ERR_INVALID_JSON;
+        } else {
+            skip_ws(&c);
+            if (c.p != c.end) err = NOSTR_RELAY_ERR_INVALID_JSON;
+        }
+    }
+    if (err != NOSTR_RELAY_OK) msg_parsed_free(out);
+    return err;
+}
+
+void msg_parsed_free(msg_parsed_t *msg)
+{
+    if (!msg) return;
+    if (msg->event) {
+        nostr_event_destroy(msg->event);
+        msg->event = NULL;
+    }
+    if (msg->filters) {
+        for (size_t i = 0; i < msg->filter_count; i++) {
+            nostr_filter_free(&msg->filters[i]);
+        }
+        nostr_free(msg->filters);
+        msg->filters = NULL;
+        msg->filter_count = 0;
+    }
+}
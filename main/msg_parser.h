@@ -0,0 +1,41 @@
+#ifndef MSG_PARSER_H
+#define MSG_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nostr_relay_protocol.h"
+
+#define MSG_PARSER_MAX_LEN            65536
+#define MSG_PARSER_MAX_SUB_ID         64
+#define MSG_PARSER_MAX_FILTERS        16
+#define MSG_PARSER_MAX_FILTER_VALUES  256
+#define MSG_PARSER_MAX_TAGS           100
+#define MSG_PARSER_MAX_TAG_VALUES     16
+#define MSG_PARSER_MAX_CONTENT        32768
+
+typedef enum {
+    MSG_PARSER_EVENT,
+    MSG_PARSER_REQ,
+    MSG_PARSER_COUNT,
+    MSG_PARSER_CLOSE,
+    MSG_PARSER_AUTH,
+    MSG_PARSER_UNKNOWN
+} msg_parser_type_t;
+
+typedef struct {
+    msg_parser_type_t type;
+    nostr_event *event;
+    char event_id[65];
+    char sub_id[MSG_PARSER_MAX_SUB_ID + 1];
+    nostr_filter_t *filters;
+    size_t filter_count;
+} msg_parsed_t;
+
+// On failure type, event_id and sub_id keep whatever was read before the
+// error (sub_id truncated if too long) so the caller can answer OK/CLOSED.
+nostr_relay_error_t msg_parse(const char *json, size_t len, msg_parsed_t *out);
+void msg_parsed_free(msg_parsed_t *msg);
+
+#endif
@@ -1,18 +1,23 @@
 #include "nip11.h"
+#include "sdkconfig.h"
+#include <stdio.h>
 #include <string.h>
 
+#define NIP11_STR(x) NIP11_XSTR(x)
+#define NIP11_XSTR(x) #x
+
 static const char *NIP11_JSON =
 "{"
   "\"name\":\"wisp-esp32\","
   "\"description\":\"Minimal Nostr relay with 21-day TTL\","
   "\"pubkey\":\"\","
   "\"contact\":\"\","
-  "\"supported_nips\":[1,9,11,20,40],"
+  "\"supported_nips\":[1,9,11,20,40,45],"
   "\"software\":\"https://github.com/privkeyio/wisp-esp32\","
   "\"version\":\"0.1.0\","
   "\"limitation\":{"
     "\"max_message_length\":65536,"
-    "\"max_subscriptions\":8,"
+    "\"max_subscriptions\":" NIP11_STR(CONFIG_WISP_SUB_MAX_PER_CONN) ","
     "\"max_filters\":4,"
     "\"max_limit\":500,"
     "\"max_subid_length\":64,"
@@ -51,3 +56,22 @@ esp_err_t nip11_options_handler(httpd_req_t *req)
     httpd_resp_set_status(req, "204 No Content");
     return httpd_resp_send(req, NULL, 0);
 }
+
+size_t nip11_build_response(char *out, size_t size, bool options, bool nostr_json)
+{
+    static const char cors[] =
+        "Access-Control-Allow-Origin: *\r\n"
+        "Access-Control-Allow-Headers: Content-Type, Accept\r\n"
+        "Access-Control-Allow-Methods: GET, OPTIONS\r\n";
+    int n;
+    if (options) {
+        n = snprintf(out, size, "HTTP/1.1 204 No Content\r\n%sContent-Length: 0\r\n"
+                     "Connection: close\r\n\r\n", cors);
+    } else {
+        n = snprintf(out, size, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%sContent-Length: %u\r\n"
+                     "Connection: close\r\n\r\n%s",
+                     nostr_json ? "application/nostr+json" : "application/json", cors,
+                     (unsigned)strlen(NIP11_JSON), NIP11_JSON);
+    }
+    return n < 0 || (size_t)n >= size ? 0 : (size_t)n;
+}
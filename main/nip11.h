@@ -1,9 +1,12 @@
 #ifndef NIP11_H
 #define NIP11_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_http_server.h"
 
 esp_err_t nip11_handler(httpd_req_t *req);
 esp_err_t nip11_options_handler(httpd_req_t *req);
+size_t nip11_build_response(char *out, size_t size, bool options, bool nostr_json);
 
 #endif
@@ -0,0 +1,467 @@
+#include "query_scheduler.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sub_manager.h"
+#include "relay_core.h"
+
+static const char *TAG = "query_sched";
+
+#define QSCHED_STOP_WAIT_MS 2000
+
+static uint16_t filter_limit(const nostr_filter_t *filter)
+{
+    if (filter->limit <= 0) return QSCHED_DEFAULT_LIMIT;
+    if (filter->limit > QSCHED_MAX_LIMIT) return QSCHED_MAX_LIMIT;
+    return (uint16_t)filter->limit;
+}
+
+static void start_filter(query_sched_t *qs, qsched_job_t *job)
+{
+    job->filter_sent = 0;
+    if (job->filter_idx < job->filter_count) {
+        job->filter_limit = filter_limit(&job->filters[job->filter_idx]);
+        storage_cursor_init(qs->ctx->storage, &job->cursor);
+    }
+}
+
+static void free_job(qsched_job_t *job)
+{
+    if (job->filters) {
+        for (size_t i = 0; i < job->filter_count; i++) {
+            nostr_filter_free(&job->filters[i]);
+        }
+        nostr_free(job->filters);
+    }
+    free(job->sent_ids);
+    storage_count_release(job->count_query);
+    free(job);
+}
+
+static void unlink_job(query_sched_t *qs, qsched_job_t *job)
+{
+    qsched_job_t *prev = NULL;
+    for (qsched_job_t *it = qs->head; it; prev = it, it = it->next) {
+        if (it != job) continue;
+        if (prev) {
+            prev->next = job->next;
+        } else {
+            qs->head = job->next;
+        }
+        if (qs->tail == job) {
+            qs->tail = prev;
+        }
+        job->next = NULL;
+        qs->job_count--;
+        return;
+    }
+}
+
+static void append_job(query_sched_t *qs, qsched_job_t *job)
+{
+    job->next = NULL;
+    if (qs->tail) {
+        qs->tail->next = job;
+    } else {
+        qs->head = job;
+    }
+    qs->tail = job;
+    qs->job_count++;
+}
+
+static qsched_job_t *pick_job(query_sched_t *qs)
+{
+    qsched_job_t *next_conn = NULL;
+    qsched_job_t *lowest = NULL;
+
+    for (qsched_job_t *job = qs->head; job; job = job->next) {
+        if (job->cancelled || job->running) continue;
+        if (ws_server_backfill_paused(&qs->ctx->ws_server, job->conn_fd)) {
+            qs->backfill_paused++;
+            continue;
+        }
+        if (job->conn_fd > qs->last_fd &&
+            (!next_conn || job->conn_fd < next_conn->conn_fd)) {
+            next_conn = job;
+        }
+        if (!lowest || job->conn_fd < lowest->conn_fd) {
+            lowest = job;
+        }
+    }
+
+    qsched_job_t *job = next_conn ? next_conn : lowest;
+    if (job) {
+        job->running = true;
+        qs->last_fd = job->conn_fd;
+    }
+    return job;
+}
+
+static bool already_sent(qsched_job_t *job, const uint8_t id[32])
+{
+    if (!job->sent_ids) return false;
+    for (uint16_t i = 0; i < job->sent_count; i++) {
+        if (memcmp(job->sent_ids[i], id, 32) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t budget_left(uint32_t budget, uint32_t used, uint32_t slice_max)
+{
+    if (budget == 0) return slice_max;
+    if (used >= budget) return 0;
+    return budget - used < slice_max ? budget - used : slice_max;
+}
+
+static bool budget_exhausted(const relay_ctx_t *ctx, const qsched_job_t *job)
+{
+    return (ctx->config.req_max_entries > 0 && job->entries_used >= ctx->config.req_max_entries) ||
+           (ctx->config.req_max_files > 0 && job->files_used >= ctx->config.req_max_files) ||
+           (ctx->config.req_max_ms > 0 && job->busy_us >= (int64_t)ctx->config.req_max_ms * 1000);
+}
+
+static void finish_over_budget(query_sched_t *qs, qsched_job_t *job)
+{
+    relay_ctx_t *ctx = qs->ctx;
+    qs->budget_exhausted++;
+
+    ESP_LOGW(TAG, "%s budget exhausted sub=%s fd=%d entries=%" PRIu32 " files=%" PRIu32 " ms=%" PRId64,
+             job->count_query ? "COUNT" : "REQ", job->sub_id, job->conn_fd,
+             job->entries_used, job->files_used, job->busy_us / 1000);
+
+    if (job->count_query) {
+        if (ctx->config.req_budget_closes) {
+            router_send_closed(ctx, job->conn_fd, job->sub_id, "error: count too expensive, narrow the filter");
+        } else {
+            router_send_count(ctx, job->conn_fd, job->sub_id, job->counted, true);
+        }
+        return;
+    }
+
+    if (ctx->config.req_budget_closes) {
+        if (ctx->sub_manager) {
+            sub_manager_remove(ctx->sub_manager, job->conn_fd, job->sub_id);
+        }
+        router_send_closed(ctx, job->conn_fd, job->sub_id, "error: query too expensive, narrow the filter");
+    } else {
+        router_send_eose(ctx, job->conn_fd, job->sub_id);
+    }
+}
+
+static bool run_slice(query_sched_t *qs, qsched_job_t *job)
+{
+    relay_ctx_t *ctx = qs->ctx;
+    int64_t started = esp_timer_get_time();
+
+    while (job->filter_idx < job->filter_count) {
+        nostr_event *events[QSCHED_SLICE_EVENTS];
+        uint16_t count = 0;
+        uint16_t remaining = job->filter_limit - job->filter_sent;
+        storage_slice_t slice = {
+            .max_entries = budget_left(ctx->config.req_max_entries, job->entries_used,
+                                       QSCHED_SLICE_ENTRIES),
+            .max_files = budget_left(ctx->config.req_max_files, job->files_used,
+                                     QSCHED_SLICE_FILES),
+        };
+
+        storage_error_t err = storage_query_slice(ctx->storage, &job->filters[job->filter_idx],
+                                                  &job->cursor, &slice, events, &count,
+                                                  remaining < QSCHED_SLICE_EVENTS ? remaining : QSCHED_SLICE_EVENTS);
+
+        xSemaphoreTake(qs->lock, portMAX_DELAY);
+        bool cancelled = job->cancelled;
+        xSemaphoreGive(qs->lock);
+
+        for (uint16_t e = 0; e < count; e++) {
+            if (!cancelled && !already_sent(job, events[e]->id)) {
+                router_send_event(ctx, job->conn_fd, job->sub_id, events[e]);
+                if (job->sent_ids && job->sent_count < QSCHED_SENT_IDS) {
+                    memcpy(job->sent_ids[job->sent_count++], events[e]->id, 32);
+                }
+            }
+            nostr_event_destroy(events[e]);
+        }
+        job->filter_sent += count;
+        job->entries_used += slice.entries_examined;
+        job->files_used += slice.files_loaded;
+
+        if (cancelled) {
+            return true;
+        }
+
+        if (err != STORAGE_OK || job->cursor.phase == STORAGE_CURSOR_DONE ||
+            job->filter_sent >= job->filter_limit) {
+            job->filter_idx++;
+            start_filter(qs, job);
+            if (slice.entries_examined > 0) {
+                break;
+            }
+            continue;
+        }
+        break;
+    }
+
+    job->busy_us += esp_timer_get_time() - started;
+
+    if (job->filter_idx >= job->filter_count) {
+        router_send_eose(ctx, job->conn_fd, job->sub_id);
+        return true;
+    }
+
+    if (budget_exhausted(ctx, job)) {
+        finish_over_budget(qs, job);
+        return true;
+    }
+    return false;
+}
+
+static bool run_count_slice(query_sched_t *qs, qsched_job_t *job)
+{
+    relay_ctx_t *ctx = qs->ctx;
+    int64_t started = esp_timer_get_time();
+    storage_slice_t slice = {
+        .max_entries = budget_left(ctx->config.req_max_entries, job->entries_used,
+                                   QSCHED_SLICE_ENTRIES),
+        .max_files = budget_left(ctx->config.req_max_files, job->files_used,
+                                 QSCHED_SLICE_FILES),
+    };
+
+    storage_error_t err = storage_count_slice(ctx->storage, job->count_query, &job->cursor,
+                                              &slice, &job->counted);
+    job->entries_used += slice.entries_examined;
+    job->files_used += slice.files_loaded;
+    job->busy_us += esp_timer_get_time() - started;
+
+    xSemaphoreTake(qs->lock, portMAX_DELAY);
+    bool cancelled = job->cancelled;
+    xSemaphoreGive(qs->lock);
+    if (cancelled) {
+        return true;
+    }
+
+    if (err != STORAGE_OK) {
+        router_send_closed(ctx, job->conn_fd, job->sub_id, "error: count failed");
+        return true;
+    }
+    if (job->cursor.phase == STORAGE_CURSOR_DONE) {
+        router_send_count(ctx, job->conn_fd, job->sub_id, job->counted, false);
+        return true;
+    }
+    if (budget_exhausted(ctx, job)) {
+        finish_over_budget(qs, job);
+        return true;
+    }
+    return false;
+}
+
+static void qsched_task(void *arg)
+{
+    query_sched_t *qs = (query_sched_t *)arg;
+
+    while (!qs->stop) {
+        xSemaphoreTake(qs->lock, portMAX_DELAY);
+        qsched_job_t *job = pick_job(qs);
+        xSemaphoreGive(qs->lock);
+
+        if (!job) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(qs->job_count > 0 ? QSCHED_PAUSE_POLL_MS : 1000));
+            continue;
+        }
+
+        while (atomic_load(&qs->live_active) > 0 && !qs->stop) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+        }
+
+        ws_server_cork(&qs->ctx->ws_server, job->conn_fd);
+        bool done = job->count_query ? run_count_slice(qs, job) : run_slice(qs, job);
+        ws_server_uncork(&qs->ctx->ws_server, job->conn_fd);
+        qs->slices_run++;
+
+        xSemaphoreTake(qs->lock, portMAX_DELAY);
+        job->running = false;
+        unlink_job(qs, job);
+        if (done || job->cancelled) {
+            free_job(job);
+        } else {
+            append_job(qs, job);
+        }
+        xSemaphoreGive(qs->lock);
+    }
+
+    qs->task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t qsched_init(query_sched_t *qs, relay_ctx_t *ctx)
+{
+    memset(qs, 0, sizeof(query_sched_t));
+    qs->ctx = ctx;
+    qs->last_fd = -1;
+    atomic_init(&qs->live_active, 0);
+
+    qs->lock = xSemaphoreCreateMutex();
+    if (!qs->lock) return ESP_ERR_NO_MEM;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(qsched_task, "query_sched", QSCHED_TASK_STACK,
+                                             qs, QSCHED_TASK_PRIORITY, &qs->task, QSCHED_TASK_CORE);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create scheduler task");
+        vSemaphoreDelete(qs->lock);
+        qs->lock = NULL;
+        qs->task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void qsched_destroy(query_sched_t *qs)
+{
+    if (!qs->lock) return;
+
+    qs->stop = true;
+    if (qs->task) {
+        xTaskNotifyGive(qs->task);
+    }
+    for (int waited = 0; qs->task && waited < QSCHED_STOP_WAIT_MS; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    while (qs->head) {
+        qsched_job_t *job = qs->head;
+        qs->head = job->next;
+        free_job(job);
+    }
+    qs->tail = NULL;
+    qs->job_count = 0;
+
+    vSemaphoreDelete(qs->lock);
+    qs->lock = NULL;
+}
+
+static void cancel_job_locked(query_sched_t *qs, qsched_job_t *job)
+{
+    job->cancelled = true;
+    if (!job->running) {
+        unlink_job(qs, job);
+        free_job(job);
+    }
+}
+
+static esp_err_t submit_job(query_sched_t *qs, int conn_fd, const char *sub_id,
+                            nostr_filter_t *filters, size_t filter_count, bool count)
+{
+    qsched_job_t *job = calloc(1, sizeof(qsched_job_t));
+    if (!job) return ESP_ERR_NO_MEM;
+
+    job->conn_fd = conn_fd;
+    strncpy(job->sub_id, sub_id, ROUTER_MAX_SUB_ID);
+    job->sub_id[ROUTER_MAX_SUB_ID] = '\0';
+    if (count) {
+        job->count_query = storage_count_prepare(filters, filter_count);
+        if (!job->count_query) {
+            free(job);
+            return ESP_ERR_NO_MEM;
+        }
+    } else {
+        job->sent_ids = malloc(QSCHED_SENT_IDS * sizeof(*job->sent_ids));
+        if (!job->sent_ids) {
+            ESP_LOGW(TAG, "Failed to allocate sent_ids, dedup disabled");
+        }
+    }
+
+    xSemaphoreTake(qs->lock, portMAX_DELAY);
+
+    qsched_job_t *it = qs->head;
+    while (it) {
+        qsched_job_t *next = it->next;
+        if (!it->cancelled && it->conn_fd == conn_fd && (it->count_query != NULL) == count &&
+            strcmp(it->sub_id, job->sub_id) == 0) {
+            cancel_job_locked(qs, it);
+        }
+        it = next;
+    }
+
+    if (qs->job_count >= QSCHED_MAX_JOBS) {
+        xSemaphoreGive(qs->lock);
+        free(job->sent_ids);
+        storage_count_release(job->count_query);
+        free(job);
+        ESP_LOGW(TAG, "Query queue full, rejecting sub=%s fd=%d", sub_id, conn_fd);
+        return ESP_ERR_NO_MEM;
+    }
+
+    job->filters = filters;
+    job->filter_count = filter_count;
+    if (count) {
+        storage_cursor_init(qs->ctx->storage, &job->cursor);
+    } else {
+        start_filter(qs, job);
+    }
+    append_job(qs, job);
+
+    xSemaphoreGive(qs->lock);
+
+    xTaskNotifyGive(qs->task);
+    return ESP_OK;
+}
+
+esp_err_t qsched_submit(query_sched_t *qs, int conn_fd, const char *sub_id,
+                        nostr_filter_t *filters, size_t filter_count)
+{
+    return submit_job(qs, conn_fd, sub_id, filters, filter_count, false);
+}
+
+esp_err_t qsched_submit_count(query_sched_t *qs, int conn_fd, const char *sub_id,
+                              nostr_filter_t *filters, size_t filter_count)
+{
+    return submit_job(qs, conn_fd, sub_id, filters, filter_count, true);
+}
+
+bool qsched_cancel(query_sched_t *qs, int conn_fd, const char *sub_id)
+{
+    bool found = false;
+
+    xSemaphoreTake(qs->lock, portMAX_DELAY);
+    qsched_job_t *it = qs->head;
+    while (it) {
+        qsched_job_t *next = it->next;
+        if (!it->cancelled && it->conn_fd == conn_fd && strcmp(it->sub_id, sub_id) == 0) {
+            cancel_job_locked(qs, it);
+            found = true;
+        }
+        it = next;
+    }
+    xSemaphoreGive(qs->lock);
+
+    return found;
+}
+
+void qsched_cancel_conn(query_sched_t *qs, int conn_fd)
+{
+    xSemaphoreTake(qs->lock, portMAX_DELAY);
+    qsched_job_t *it = qs->head;
+    while (it) {
+        qsched_job_t *next = it->next;
+        if (!it->cancelled && it->conn_fd == conn_fd) {
+            cancel_job_locked(qs, it);
+        }
+        it = next;
+    }
+    xSemaphoreGive(qs->lock);
+}
+
+void qsched_live_begin(query_sched_t *qs)
+{
+    atomic_fetch_add(&qs->live_active, 1);
+}
+
+void qsched_live_end(query_sched_t *qs)
+{
+    atomic_fetch_sub(&qs->live_active, 1);
+}
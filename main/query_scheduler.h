@@ -0,0 +1,82 @@
+#ifndef QUERY_SCHEDULER_H
+#define QUERY_SCHEDULER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nostr_relay_protocol.h"
+#include "router.h"
+#include "storage_engine.h"
+
+#define QSCHED_MAX_JOBS        32
+#define QSCHED_SLICE_ENTRIES   64
+#define QSCHED_SLICE_FILES     8
+#define QSCHED_SLICE_EVENTS    8
+#define QSCHED_SENT_IDS        64
+#define QSCHED_DEFAULT_LIMIT   100
+#define QSCHED_MAX_LIMIT       500
+#define QSCHED_TASK_STACK      8192
+#define QSCHED_TASK_PRIORITY   CONFIG_WISP_QSCHED_PRIORITY
+#define QSCHED_TASK_CORE       (CONFIG_WISP_QSCHED_CORE < 0 ? tskNO_AFFINITY : CONFIG_WISP_QSCHED_CORE)
+#define QSCHED_PAUSE_POLL_MS   20
+
+typedef struct relay_ctx relay_ctx_t;
+
+typedef struct qsched_job {
+    struct qsched_job *next;
+    int conn_fd;
+    char sub_id[ROUTER_MAX_SUB_ID + 1];
+    nostr_filter_t *filters;
+    size_t filter_count;
+    size_t filter_idx;
+    storage_cursor_t cursor;
+    uint16_t filter_sent;
+    uint16_t filter_limit;
+    uint8_t (*sent_ids)[32];
+    uint16_t sent_count;
+    storage_count_query_t *count_query;
+    uint32_t counted;
+    uint32_t entries_used;
+    uint32_t files_used;
+    int64_t busy_us;
+    bool running;
+    bool cancelled;
+} qsched_job_t;
+
+typedef struct query_sched {
+    relay_ctx_t *ctx;
+    qsched_job_t *head;
+    qsched_job_t *tail;
+    uint16_t job_count;
+    int last_fd;
+    atomic_int live_active;
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+    volatile bool stop;
+    uint32_t slices_run;
+    uint32_t budget_exhausted;
+    uint32_t backfill_paused;
+} query_sched_t;
+
+esp_err_t qsched_init(query_sched_t *qs, relay_ctx_t *ctx);
+void qsched_destroy(query_sched_t *qs);
+
+esp_err_t qsched_submit(query_sched_t *qs, int conn_fd, const char *sub_id,
+                        nostr_filter_t *filters, size_t filter_count);
+
+esp_err_t qsched_submit_count(query_sched_t *qs, int conn_fd, const char *sub_id,
+                              nostr_filter_t *filters, size_t filter_count);
+
+bool qsched_cancel(query_sched_t *qs, int conn_fd, const char *sub_id);
+void qsched_cancel_conn(query_sched_t *qs, int conn_fd);
+
+void qsched_live_begin(query_sched_t *qs);
+void qsched_live_end(query_sched_t *qs);
+
+#endif
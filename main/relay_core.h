@@ -8,12 +8,16 @@
 typedef struct sub_manager sub_manager_t;
 typedef struct storage_engine storage_engine_t;
 typedef struct rate_limiter rate_limiter_t;
+typedef struct query_sched query_sched_t;
+typedef struct broadcaster broadcaster_t;
 
 typedef struct relay_ctx {
     ws_server_t ws_server;
     sub_manager_t *sub_manager;
     storage_engine_t *storage;
     rate_limiter_t *rate_limiter;
+    query_sched_t *query_sched;
+    broadcaster_t *broadcaster;
 
     struct {
         uint16_t port;
@@ -21,6 +25,10 @@ typedef struct relay_ctx {
         uint8_t max_subs_per_conn;
         uint8_t max_filters_per_sub;
         int64_t max_future_sec;
+        uint32_t req_max_entries;
+        uint32_t req_max_files;
+        uint32_t req_max_ms;
+        bool req_budget_closes;
     } config;
 } relay_ctx_t;
 
@@ -1,3 +1,6 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "esp_log.h"
@@ -16,37 +19,54 @@ nostr_relay_error_t router_parse(const char *json, size_t len, router_msg_t *out
     memset(out, 0, sizeof(router_msg_t));
     out->type = ROUTER_MSG_INVALID;
 
-    nostr_client_msg_t msg;
-    nostr_relay_error_t result = nostr_client_msg_parse(json, len, &msg);
+    msg_parsed_t msg;
+    nostr_relay_error_t result = msg_parse(json, len, &msg);
     if (result != NOSTR_RELAY_OK) {
         ESP_LOGW(TAG, "Parse failed: %d", result);
+        out->error = result;
+        switch (msg.type) {
+            case MSG_PARSER_EVENT:
+                out->type = ROUTER_MSG_EVENT;
+                memcpy(out->event_id, msg.event_id, sizeof(out->event_id));
+                break;
+            case MSG_PARSER_REQ:
+            case MSG_PARSER_COUNT:
+                out->type = msg.type == MSG_PARSER_COUNT ? ROUTER_MSG_COUNT : ROUTER_MSG_REQ;
+                memcpy(out->data.req.sub_id, msg.sub_id, sizeof(out->data.req.sub_id));
+                break;
+            case MSG_PARSER_CLOSE:
+                out->type = ROUTER_MSG_CLOSE;
+                memcpy(out->data.close.sub_id, msg.sub_id, sizeof(out->data.close.sub_id));
+                break;
+            default:
+                break;
+        }
         return result;
     }
 
     switch (msg.type) {
-        case NOSTR_CLIENT_MSG_EVENT:
+        case MSG_PARSER_EVENT:
             out->type = ROUTER_MSG_EVENT;
-            out->data.event = msg.data.event.event;
-            msg.data.event.event = NULL;
+            out->data.event = msg.event;
+            msg.event = NULL;
             break;
 
-        case NOSTR_CLIENT_MSG_REQ:
-            out->type = ROUTER_MSG_REQ;
-            strncpy(out->data.req.sub_id, msg.data.req.subscription_id, ROUTER_MAX_SUB_ID);
-            out->data.req.sub_id[ROUTER_MAX_SUB_ID] = '\0';
-            out->data.req.filters = msg.data.req.filters;
-            out->data.req.filter_count = msg.data.req.filters_count;
-            msg.data.req.filters = NULL;
-            msg.data.req.filters_count = 0;
+        case MSG_PARSER_REQ:
+        case MSG_PARSER_COUNT:
+            out->type = msg.type == MSG_PARSER_COUNT ? ROUTER_MSG_COUNT : ROUTER_MSG_REQ;
+            memcpy(out->data.req.sub_id, msg.sub_id, sizeof(out->data.req.sub_id));
+            out->data.req.filters = msg.filters;
+            out->data.req.filter_count = msg.filter_count;
+            msg.filters = NULL;
+            msg.filter_count = 0;
             break;
 
-        case NOSTR_CLIENT_MSG_CLOSE:
+        case MSG_PARSER_CLOSE:
             out->type = ROUTER_MSG_CLOSE;
-            strncpy(out->data.close.sub_id, msg.data.close.subscription_id, ROUTER_MAX_SUB_ID);
-            out->data.close.sub_id[ROUTER_MAX_SUB_ID] = '\0';
+            memcpy(out->data.close.sub_id, msg.sub_id, sizeof(out->data.close.sub_id));
             break;
 
-        case NOSTR_CLIENT_MSG_AUTH:
+        case MSG_PARSER_AUTH:
             out->type = ROUTER_MSG_AUTH;
             break;
 
@@ -55,7 +75,7 @@ nostr_relay_error_t router_parse(const char *json, size_t len, router_msg_t *out
             break;
     }
 
-    nostr_client_msg_free(&msg);
+    msg_parsed_free(&msg);
     return NOSTR_RELAY_OK;
 }
 
@@ -72,6 +92,7 @@ void router_msg_free(router_msg_t *msg)
             break;
 
         case ROUTER_MSG_REQ:
+        case ROUTER_MSG_COUNT:
             if (msg->data.req.filters) {
                 for (size_t i = 0; i < msg->data.req.filter_count; i++) {
                     nostr_filter_free(&msg->data.req.filters[i]);
@@ -162,11 +183,89 @@ esp_err_t router_send_event(relay_ctx_t *ctx, int conn_fd, const char *sub_id,
     return send_err;
 }
 
-extern int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event *event);
+static size_t json_escape(char *out, size_t size, const char *str)
+{
+    size_t pos = 0;
+    for (; *str && pos + 7 < size; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\') {
+            out[pos++] = '\\';
+            out[pos++] = (char)c;
+        } else if (c < 0x20) {
+            pos += snprintf(out + pos, size - pos, "\\u%04x", c);
+        } else {
+            out[pos++] = (char)c;
+        }
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+ws_frame_t *router_event_frame(const nostr_event *event)
+{
+    ws_frame_t *frame = ws_frame_alloc(ROUTER_EVENT_BUF_SIZE);
+    if (!frame) {
+        ESP_LOGE(TAG, "Failed to allocate event frame");
+        return NULL;
+    }
+
+    nostr_relay_error_t err = nostr_event_serialize(event, frame->data, ROUTER_EVENT_BUF_SIZE - 1,
+                                                    &frame->len);
+    if (err != NOSTR_RELAY_OK) {
+        ESP_LOGE(TAG, "Serialize event failed: %d", err);
+        ws_frame_release(frame);
+        return NULL;
+    }
+    frame->data[frame->len++] = ']';
+#ifdef CONFIG_WISP_WS_DEFLATE_SKIP_EPHEMERAL
+    frame->compress = !nostr_kind_is_ephemeral(event->kind);
+#endif
+    return ws_frame_shrink(frame);
+}
+
+esp_err_t router_send_event_frame(relay_ctx_t *ctx, int conn_fd, const char *sub_id,
+                                  ws_frame_t *frame)
+{
+    char prefix[ROUTER_MAX_SUB_ID * 6 + 24];
+    size_t len = sizeof("[\"EVENT\",\"") - 1;
+    memcpy(prefix, "[\"EVENT\",\"", len);
+    len += json_escape(prefix + len, sizeof(prefix) - len - 2, sub_id);
+    prefix[len++] = '"';
+    prefix[len++] = ',';
+
+    esp_err_t send_err = ws_server_send_shared(&ctx->ws_server, conn_fd, prefix, len, frame);
+    if (send_err != ESP_OK) {
+        ESP_LOGW(TAG, "Send event failed fd=%d: %d", conn_fd, send_err);
+    }
+    return send_err;
+}
+
+esp_err_t router_send_count(relay_ctx_t *ctx, int conn_fd, const char *sub_id, uint32_t count,
+                            bool approximate)
+{
+    char escaped[ROUTER_MAX_SUB_ID * 6 + 1];
+    json_escape(escaped, sizeof(escaped), sub_id);
+
+    char buf[ROUTER_SEND_BUF_SIZE];
+    int len = snprintf(buf, sizeof(buf), "[\"COUNT\",\"%s\",{\"count\":%" PRIu32 "%s}]",
+                       escaped, count, approximate ? ",\"approximate\":true" : "");
+    if (len < 0 || (size_t)len >= sizeof(buf)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t send_err = ws_server_send(&ctx->ws_server, conn_fd, buf, len);
+    if (send_err != ESP_OK) {
+        ESP_LOGW(TAG, "Send count failed fd=%d: %d", conn_fd, send_err);
+    }
+    return send_err;
+}
+
+extern int handle_event(relay_ctx_t *ctx, int conn_fd, nostr_event **event, bool *duplicate);
 extern void handle_req(relay_ctx_t *ctx, int conn_fd, router_req_t *req);
+extern void handle_count(relay_ctx_t *ctx, int conn_fd, router_req_t *req);
 extern int handle_close(relay_ctx_t *ctx, int conn_fd, const char *sub_id);
 
-static const char *get_event_rejection_message(nostr_relay_error_t err)
+static const char *get_rejection_message(nostr_relay_error_t err)
 {
     switch (err) {
         case NOSTR_RELAY_ERR_INVALID_SIG:
@@ -177,6 +276,33 @@ static const char *get_event_rejection_message(nostr_relay_error_t err)
         case NOSTR_RELAY_ERR_ID_MISMATCH:
             return NOSTR_OK_PREFIX_INVALID "bad event id";
 
+        case NOSTR_RELAY_ERR_INVALID_PUBKEY:
+            return NOSTR_OK_PREFIX_INVALID "bad pubkey";
+
+        case NOSTR_RELAY_ERR_INVALID_CREATED_AT:
+            return NOSTR_OK_PREFIX_INVALID "bad created_at";
+
+        case NOSTR_RELAY_ERR_INVALID_KIND:
+            return NOSTR_OK_PREFIX_INVALID "bad kind";
+
+        case NOSTR_RELAY_ERR_INVALID_TAGS:
+            return NOSTR_OK_PREFIX_INVALID "bad or too many tags";
+
+        case NOSTR_RELAY_ERR_INVALID_CONTENT:
+            return NOSTR_OK_PREFIX_INVALID "bad or oversize content";
+
+        case NOSTR_RELAY_ERR_MISSING_FIELD:
+            return NOSTR_OK_PREFIX_INVALID "missing field";
+
+        case NOSTR_RELAY_ERR_INVALID_JSON:
+            return NOSTR_OK_PREFIX_INVALID "malformed message";
+
+        case NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID:
+            return NOSTR_OK_PREFIX_INVALID "invalid subscription id";
+
+        case NOSTR_RELAY_ERR_TOO_MANY_FILTERS:
+            return NOSTR_OK_PREFIX_INVALID "too many filters";
+
         case NOSTR_RELAY_ERR_FUTURE_EVENT:
             return NOSTR_OK_PREFIX_INVALID "event too far in future";
 
@@ -191,8 +317,66 @@ static const char *get_event_rejection_message(nostr_relay_error_t err)
     }
 }
 
+static bool check_req(relay_ctx_t *ctx, int conn_fd, router_req_t *req)
+{
+    if (ctx->rate_limiter &&
+        !rate_limiter_check(ctx->rate_limiter, conn_fd, RATE_TYPE_REQ)) {
+        router_send_closed(ctx, conn_fd, req->sub_id, "rate-limited:");
+        return false;
+    }
+
+    if (req->sub_id[0] == '\0') {
+        router_send_closed(ctx, conn_fd, req->sub_id, "error: invalid subscription id");
+        return false;
+    }
+
+    if (req->filter_count > ROUTER_MAX_FILTERS) {
+        router_send_closed(ctx, conn_fd, req->sub_id, "error: too many filters");
+        return false;
+    }
+
+    return true;
+}
+
+static void reject_msg(relay_ctx_t *ctx, int conn_fd, const router_msg_t *msg)
+{
+    const char *message = get_rejection_message(msg->error);
+    switch (msg->type) {
+        case ROUTER_MSG_EVENT:
+            if (msg->event_id[0]) {
+                router_send_ok(ctx, conn_fd, msg->event_id, false, message);
+                return;
+            }
+            break;
+
+        case ROUTER_MSG_REQ:
+        case ROUTER_MSG_COUNT:
+            if (msg->data.req.sub_id[0]) {
+                router_send_closed(ctx, conn_fd, msg->data.req.sub_id, message);
+                return;
+            }
+            break;
+
+        case ROUTER_MSG_CLOSE:
+            if (msg->data.close.sub_id[0]) {
+                router_send_closed(ctx, conn_fd, msg->data.close.sub_id, message);
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+    router_send_notice(ctx, conn_fd, message);
+}
+
 void router_dispatch(relay_ctx_t *ctx, int conn_fd, router_msg_t *msg)
 {
+    if (msg->error != NOSTR_RELAY_OK) {
+        reject_msg(ctx, conn_fd, msg);
+        return;
+    }
+
     switch (msg->type) {
         case ROUTER_MSG_EVENT: {
             nostr_event *event = msg->data.event;
@@ -207,10 +391,17 @@ void router_dispatch(relay_ctx_t *ctx, int conn_fd, router_msg_t *msg)
                 break;
             }
 
-            int result = handle_event(ctx, conn_fd, event);
+            bool duplicate;
+            int result = handle_event(ctx, conn_fd, &msg->data.event, &duplicate);
+
+            if (duplicate) {
+                router_send_ok(ctx, conn_fd, id_hex, true,
+                               NOSTR_OK_PREFIX_DUPLICATE "already have this event");
+                break;
+            }
 
             bool accepted = (result == NOSTR_RELAY_OK);
-            const char *message = accepted ? "" : get_event_rejection_message(result);
+            const char *message = accepted ? "" : get_rejection_message(result);
             router_send_ok(ctx, conn_fd, id_hex, accepted, message);
             break;
         }
@@ -219,24 +410,19 @@ void router_dispatch(relay_ctx_t *ctx, int conn_fd, router_msg_t *msg)
             router_req_t *req = &msg->data.req;
             ESP_LOGD(TAG, "REQ fd=%d sub=%s filters=%zu", conn_fd, req->sub_id, req->filter_count);
 
-            if (ctx->rate_limiter &&
-                !rate_limiter_check(ctx->rate_limiter, conn_fd, RATE_TYPE_REQ)) {
-                router_send_closed(ctx, conn_fd, req->sub_id, "rate-limited:");
-                break;
+            if (check_req(ctx, conn_fd, req)) {
+                handle_req(ctx, conn_fd, req);
             }
+            break;
+        }
 
-            size_t sub_len = strlen(req->sub_id);
-            if (sub_len == 0 || sub_len > ROUTER_MAX_SUB_ID) {
-                router_send_closed(ctx, conn_fd, req->sub_id, "error: invalid subscription id");
-                break;
-            }
+        case ROUTER_MSG_COUNT: {
+            router_req_t *req = &msg->data.req;
+            ESP_LOGD(TAG, "COUNT fd=%d sub=%s filters=%zu", conn_fd, req->sub_id, req->filter_count);
 
-            if (req->filter_count > ROUTER_MAX_FILTERS) {
-                router_send_closed(ctx, conn_fd, req->sub_id, "error: too many filters");
-                break;
+            if (check_req(ctx, conn_fd, req)) {
+                handle_count(ctx, conn_fd, req);
             }
-
-            handle_req(ctx, conn_fd, req);
             break;
         }
 
@@ -3,15 +3,19 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_err.h"
+#include "msg_parser.h"
 #include "nostr_relay_protocol.h"
+#include "ws_server.h"
 
 typedef struct relay_ctx relay_ctx_t;
 
 typedef enum {
     ROUTER_MSG_EVENT,
     ROUTER_MSG_REQ,
+    ROUTER_MSG_COUNT,
     ROUTER_MSG_CLOSE,
     ROUTER_MSG_AUTH,
     ROUTER_MSG_UNKNOWN,
@@ -19,7 +23,7 @@ typedef enum {
 } router_msg_type_t;
 
 #define ROUTER_MAX_FILTERS 4
-#define ROUTER_MAX_SUB_ID  64
+#define ROUTER_MAX_SUB_ID  MSG_PARSER_MAX_SUB_ID
 
 typedef struct {
     char sub_id[ROUTER_MAX_SUB_ID + 1];
@@ -33,6 +37,8 @@ typedef struct {
 
 typedef struct {
     router_msg_type_t type;
+    nostr_relay_error_t error;
+    char event_id[65];
     union {
         nostr_event *event;
         router_req_t req;
@@ -59,4 +65,12 @@ esp_err_t router_send_closed(relay_ctx_t *ctx, int conn_fd, const char *sub_id,
 esp_err_t router_send_event(relay_ctx_t *ctx, int conn_fd, const char *sub_id,
                             const nostr_event *event);
 
+ws_frame_t *router_event_frame(const nostr_event *event);
+
+esp_err_t router_send_event_frame(relay_ctx_t *ctx, int conn_fd, const char *sub_id,
+                                  ws_frame_t *frame);
+
+esp_err_t router_send_count(relay_ctx_t *ctx, int conn_fd, const char *sub_id, uint32_t count,
+                            bool approximate);
+
 #endif
@@ -0,0 +1,158 @@
+#include "rx_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+struct rx_buf {
+    rx_buf_t *next;
+    uint8_t cls;
+    char data[];
+};
+
+static const uint32_t CLASS_SIZES[RX_POOL_CLASSES] = {
+    512, 2048, 8192, 32768, RX_POOL_MAX_SIZE + RX_POOL_HEADROOM
+};
+
+static rx_buf_t *buf_from_data(const char *data)
+{
+    return (rx_buf_t *)(data - offsetof(rx_buf_t, data));
+}
+
+static int class_for(size_t len)
+{
+    for (int i = 0; i < RX_POOL_CLASSES; i++) {
+        if (len <= CLASS_SIZES[i]) return i;
+    }
+    return -1;
+}
+
+static rx_buf_t *buf_alloc(rx_pool_t *pool, int cls)
+{
+    size_t size = sizeof(rx_buf_t) + CLASS_SIZES[cls] + 1;
+    rx_buf_t *buf = NULL;
+    if (pool->use_psram && CLASS_SIZES[cls] >= RX_POOL_PSRAM_MIN) {
+        buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (!buf) {
+        buf = malloc(size);
+    }
+    if (buf) {
+        buf->cls = (uint8_t)cls;
+    }
+    return buf;
+}
+
+esp_err_t rx_pool_init(rx_pool_t *pool, size_t cache_limit, bool use_psram)
+{
+    memset(pool, 0, sizeof(rx_pool_t));
+    pool->lock = xSemaphoreCreateMutex();
+    if (!pool->lock) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < RX_POOL_CLASSES; i++) {
+        pool->classes[i].size = CLASS_SIZES[i];
+    }
+    pool->cache_limit = cache_limit;
+    pool->use_psram = use_psram;
+    return ESP_OK;
+}
+
+void rx_pool_destroy(rx_pool_t *pool)
+{
+    for (int i = 0; i < RX_POOL_CLASSES; i++) {
+        rx_pool_class_t *c = &pool->classes[i];
+        while (c->free_list) {
+            rx_buf_t *buf = c->free_list;
+            c->free_list = buf->next;
+            free(buf);
+        }
+        c->cached = 0;
+    }
+    pool->cached_bytes = 0;
+    if (pool->lock) {
+        vSemaphoreDelete(pool->lock);
+        pool->lock = NULL;
+    }
+}
+
+char *rx_pool_alloc(rx_pool_t *pool, size_t len)
+{
+    int cls = class_for(len);
+    if (cls < 0) return NULL;
+
+    xSemaphoreTake(pool->lock, portMAX_DELAY);
+    rx_pool_class_t *c = &pool->classes[cls];
+    rx_buf_t *buf = c->free_list;
+    if (buf) {
+        c->free_list = buf->next;
+        c->cached--;
+        pool->cached_bytes -= c->size;
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pool->in_use++;
+    xSemaphoreGive(pool->lock);
+
+    if (!buf) {
+        buf = buf_alloc(pool, cls);
+        if (!buf) {
+            xSemaphoreTake(pool->lock, portMAX_DELAY);
+            pool->in_use--;
+            xSemaphoreGive(pool->lock);
+            return NULL;
+        }
+    }
+    return buf->data;
+}
+
+char *rx_pool_grow(rx_pool_t *pool, char *data, size_t used, size_t len)
+{
+    if (!data) return rx_pool_alloc(pool, len);
+    if (len <= rx_pool_capacity(data)) return data;
+
+    char *grown = rx_pool_alloc(pool, len);
+    if (!grown) return NULL;
+    memcpy(grown, data, used);
+    rx_pool_release(pool, data);
+    return grown;
+}
+
+size_t rx_pool_capacity(const char *data)
+{
+    return CLASS_SIZES[buf_from_data(data)->cls];
+}
+
+void rx_pool_release(rx_pool_t *pool, char *data)
+{
+    if (!data) return;
+
+    rx_buf_t *buf = buf_from_data(data);
+    xSemaphoreTake(pool->lock, portMAX_DELAY);
+    rx_pool_class_t *c = &pool->classes[buf->cls];
+    pool->in_use--;
+    if (pool->cached_bytes + c->size <= pool->cache_limit) {
+        buf->next = c->free_list;
+        c->free_list = buf;
+        c->cached++;
+        pool->cached_bytes += c->size;
+        buf = NULL;
+    }
+    xSemaphoreGive(pool->lock);
+
+    free(buf);
+}
+
+void rx_pool_get_stats(rx_pool_t *pool, rx_pool_stats_t *out)
+{
+    memset(out, 0, sizeof(rx_pool_stats_t));
+    if (!pool->lock) return;
+
+    xSemaphoreTake(pool->lock, portMAX_DELAY);
+    out->hits = pool->hits;
+    out->misses = pool->misses;
+    out->in_use = pool->in_use;
+    out->cached_bytes = (uint32_t)pool->cached_bytes;
+    xSemaphoreGive(pool->lock);
+}
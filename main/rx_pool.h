@@ -0,0 +1,51 @@
+#ifndef RX_POOL_H
+#define RX_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define RX_POOL_CLASSES     5
+#define RX_POOL_MAX_SIZE    65536
+#define RX_POOL_HEADROOM    16
+#define RX_POOL_PSRAM_MIN   8192
+
+typedef struct rx_buf rx_buf_t;
+
+typedef struct {
+    rx_buf_t *free_list;
+    uint32_t size;
+    uint16_t cached;
+} rx_pool_class_t;
+
+typedef struct {
+    rx_pool_class_t classes[RX_POOL_CLASSES];
+    SemaphoreHandle_t lock;
+    size_t cache_limit;
+    size_t cached_bytes;
+    bool use_psram;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t in_use;
+} rx_pool_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t in_use;
+    uint32_t cached_bytes;
+} rx_pool_stats_t;
+
+esp_err_t rx_pool_init(rx_pool_t *pool, size_t cache_limit, bool use_psram);
+void rx_pool_destroy(rx_pool_t *pool);
+
+char *rx_pool_alloc(rx_pool_t *pool, size_t len);
+char *rx_pool_grow(rx_pool_t *pool, char *data, size_t used, size_t len);
+size_t rx_pool_capacity(const char *data);
+void rx_pool_release(rx_pool_t *pool, char *data);
+void rx_pool_get_stats(rx_pool_t *pool, rx_pool_stats_t *out);
+
+#endif
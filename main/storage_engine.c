@@ -13,6 +13,8 @@
 static const char *TAG = "storage";
 
 #define INDEX_NVS_NAMESPACE "nostr_idx"
+#define INDEX_NVS_CHUNK 50
+#define INDEX_NVS_MAX_CHUNKS ((STORAGE_MAX_EVENTS + INDEX_NVS_CHUNK - 1) / INDEX_NVS_CHUNK)
 #define EVENTS_DIR "/littlefs/events"
 
 static void get_event_path(const uint8_t event_id[32], uint32_t file_index,
@@ -27,7 +29,7 @@ static void get_event_path(const uint8_t event_id[32], uint32_t file_index,
 static storage_index_entry_t *find_index_entry(storage_engine_t *engine,
                                                const uint8_t event_id[32])
 {
-    for (uint16_t i = 0; i < engine->index_count; i++) {
+    for (uint32_t i = 0; i < engine->index_count; i++) {
         if (memcmp(engine->index[i].event_id, event_id, 32) == 0 &&
             !(engine->index[i].flags & STORAGE_FLAG_DELETED)) {
             return &engine->index[i];
@@ -36,6 +38,59 @@ static storage_index_entry_t *find_index_entry(storage_engine_t *engine,
     return NULL;
 }
 
+typedef struct {
+    storage_index_entry_t *hot;
+    storage_index_entry_t cold_entry;
+    uint32_t seg;
+    uint32_t pos;
+} index_loc_t;
+
+static bool locate_entry(storage_engine_t *engine, const uint8_t event_id[32],
+                         index_loc_t *loc)
+{
+    loc->hot = find_index_entry(engine, event_id);
+    if (loc->hot) {
+        return true;
+    }
+    return index_segs_find(&engine->cold, event_id, &loc->cold_entry, &loc->seg, &loc->pos);
+}
+
+static const storage_index_entry_t *loc_entry(const index_loc_t *loc)
+{
+    return loc->hot ? loc->hot : &loc->cold_entry;
+}
+
+static void mark_loc_deleted(storage_engine_t *engine, index_loc_t *loc)
+{
+    if (loc->hot) {
+        loc->hot->flags |= STORAGE_FLAG_DELETED;
+    } else {
+        index_segs_mark_deleted(&engine->cold, loc->seg, loc->pos);
+        loc->cold_entry.flags |= STORAGE_FLAG_DELETED;
+    }
+}
+
+static int compact_hot_tier(storage_engine_t *engine)
+{
+    uint32_t write_idx = 0;
+    int compacted = 0;
+
+    for (uint32_t read_idx = 0; read_idx < engine->index_count; read_idx++) {
+        if (!(engine->index[read_idx].flags & STORAGE_FLAG_DELETED)) {
+            if (write_idx != read_idx) {
+                memcpy(&engine->index[write_idx], &engine->index[read_idx],
+                       sizeof(storage_index_entry_t));
+            }
+            write_idx++;
+        } else {
+            compacted++;
+        }
+    }
+
+    engine->index_count = write_idx;
+    return compacted;
+}
+
 static int save_index_to_nvs(storage_engine_t *engine)
 {
     nvs_handle_t nvs;
@@ -45,12 +100,13 @@ static int save_index_to_nvs(storage_engine_t *engine)
         return STORAGE_ERR_IO;
     }
 
-    err = nvs_set_u16(nvs, "count", engine->index_count);
+    err = nvs_set_u32(nvs, "count32", engine->index_count);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set count: %d", err);
         nvs_close(nvs);
         return STORAGE_ERR_IO;
     }
+    nvs_erase_key(nvs, "count");
 
     err = nvs_set_u32(nvs, "next_idx", engine->next_file_index);
     if (err != ESP_OK) {
@@ -59,14 +115,13 @@ static int save_index_to_nvs(storage_engine_t *engine)
         return STORAGE_ERR_IO;
     }
 
-    const uint16_t chunk_size = 50;
-    uint16_t num_chunks = (engine->index_count + chunk_size - 1) / chunk_size;
-    if (engine->index_count == 0) num_chunks = 0;
+    const uint32_t chunk_size = INDEX_NVS_CHUNK;
+    uint32_t num_chunks = (engine->index_count + chunk_size - 1) / chunk_size;
 
-    for (uint16_t i = 0; i < engine->index_count; i += chunk_size) {
+    for (uint32_t i = 0; i < engine->index_count; i += chunk_size) {
         char key[16];
-        snprintf(key, sizeof(key), "idx_%u", i / chunk_size);
-        uint16_t entries = engine->index_count - i;
+        snprintf(key, sizeof(key), "idx_%" PRIu32, i / chunk_size);
+        uint32_t entries = engine->index_count - i;
         if (entries > chunk_size) entries = chunk_size;
         err = nvs_set_blob(nvs, key, &engine->index[i],
                            entries * sizeof(storage_index_entry_t));
@@ -77,9 +132,9 @@ static int save_index_to_nvs(storage_engine_t *engine)
         }
     }
 
-    for (uint16_t chunk = num_chunks; chunk < 100; chunk++) {
+    for (uint32_t chunk = num_chunks; chunk < INDEX_NVS_MAX_CHUNKS; chunk++) {
         char key[16];
-        snprintf(key, sizeof(key), "idx_%u", chunk);
+        snprintf(key, sizeof(key), "idx_%" PRIu32, chunk);
         err = nvs_erase_key(nvs, key);
         if (err == ESP_ERR_NVS_NOT_FOUND) break;
         if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
@@ -111,17 +166,22 @@ static int load_index_from_nvs(storage_engine_t *engine)
         return STORAGE_ERR_IO;
     }
 
-    err = nvs_get_u16(nvs, "count", &engine->index_count);
+    err = nvs_get_u32(nvs, "count32", &engine->index_count);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        uint16_t legacy_count = 0;
+        err = nvs_get_u16(nvs, "count", &legacy_count);
+        engine->index_count = legacy_count;
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to get count: %d", err);
         nvs_close(nvs);
         return STORAGE_ERR_IO;
     }
 
-    if (engine->index_count > engine->max_index_entries) {
-        ESP_LOGW(TAG, "Truncating index count from %" PRIu16 " to %" PRIu16,
-                 engine->index_count, engine->max_index_entries);
-        engine->index_count = engine->max_index_entries;
+    if (engine->index_count > INDEX_NVS_MAX_CHUNKS * INDEX_NVS_CHUNK) {
+        ESP_LOGE(TAG, "Index count %" PRIu32 " out of range", engine->index_count);
+        nvs_close(nvs);
+        return STORAGE_ERR_IO;
     }
 
     err = nvs_get_u32(nvs, "next_idx", &engine->next_file_index);
@@ -131,32 +191,89 @@ static int load_index_from_nvs(storage_engine_t *engine)
         return STORAGE_ERR_IO;
     }
 
-    const uint16_t chunk_size = 50;
-    for (uint16_t i = 0; i < engine->index_count; i += chunk_size) {
+    // A legacy index can hold more entries than the hot tier; read it whole
+    // and move the oldest into cold segments before anything is saved
+    uint32_t stored = engine->index_count;
+    storage_index_entry_t *entries = engine->index;
+    if (stored > engine->max_index_entries) {
+        entries = heap_caps_malloc(stored * sizeof(storage_index_entry_t),
+                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!entries) entries = malloc(stored * sizeof(storage_index_entry_t));
+        if (!entries) {
+            nvs_close(nvs);
+            return STORAGE_ERR_NO_MEM;
+        }
+    }
+
+    const uint32_t chunk_size = INDEX_NVS_CHUNK;
+    for (uint32_t i = 0; i < stored; i += chunk_size) {
         char key[16];
-        snprintf(key, sizeof(key), "idx_%u", i / chunk_size);
-        uint16_t entries = engine->index_count - i;
-        if (entries > chunk_size) entries = chunk_size;
-        size_t expected_len = entries * sizeof(storage_index_entry_t);
+        snprintf(key, sizeof(key), "idx_%" PRIu32, i / chunk_size);
+        uint32_t n = stored - i;
+        if (n > chunk_size) n = chunk_size;
+        size_t expected_len = n * sizeof(storage_index_entry_t);
         size_t len = expected_len;
-        err = nvs_get_blob(nvs, key, &engine->index[i], &len);
-        if (err != ESP_OK) {
+        err = nvs_get_blob(nvs, key, &entries[i], &len);
+        if (err == ESP_OK && len != expected_len) {
+            ESP_LOGE(TAG, "Blob %s size mismatch: got %zu, expected %zu", key, len, expected_len);
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to get blob %s: %d", key, err);
-            nvs_close(nvs);
-            return STORAGE_ERR_IO;
         }
-        if (len != expected_len) {
-            ESP_LOGE(TAG, "Blob %s size mismatch: got %zu, expected %zu", key, len, expected_len);
+        if (err != ESP_OK) {
+            if (entries != engine->index) free(entries);
             nvs_close(nvs);
             return STORAGE_ERR_IO;
         }
     }
-
     nvs_close(nvs);
-    ESP_LOGI(TAG, "Loaded %" PRIu16 " index entries", engine->index_count);
+
+    if (entries != engine->index) {
+        uint32_t spill = stored - engine->max_index_entries;
+        uint32_t moved = 0;
+        while (moved < spill) {
+            uint32_t n = spill - moved;
+            if (n > INDEX_SEG_MAX_ENTRIES) n = INDEX_SEG_MAX_ENTRIES;
+            if (index_segs_append(&engine->cold, entries + moved, n) != ESP_OK) break;
+            moved += n;
+        }
+        if (moved < spill) {
+            ESP_LOGE(TAG, "Dropped %" PRIu32 " legacy index entries, cold index append failed",
+                     spill - moved);
+        }
+
+        engine->index_count = engine->max_index_entries;
+        memcpy(engine->index, entries + spill, engine->index_count * sizeof(storage_index_entry_t));
+        free(entries);
+        ESP_LOGI(TAG, "Migrated legacy index: %" PRIu32 " entries moved to cold tier", moved);
+        save_index_to_nvs(engine);
+    }
+
+    ESP_LOGI(TAG, "Loaded %" PRIu32 " index entries", engine->index_count);
     return STORAGE_OK;
 }
 
+// A reset between a cold spill and the following NVS save leaves the spilled
+// entries in both tiers; the segment is durable, so the hot copy goes
+static void drop_spilled_entries(storage_engine_t *engine)
+{
+    uint32_t dropped = 0;
+    for (uint32_t i = 0; i < engine->index_count; i++) {
+        storage_index_entry_t *entry = &engine->index[i];
+        if (entry->flags & STORAGE_FLAG_DELETED) continue;
+        if (index_segs_find(&engine->cold, entry->event_id, NULL, NULL, NULL)) {
+            entry->flags |= STORAGE_FLAG_DELETED;
+            dropped++;
+        }
+    }
+
+    if (dropped > 0) {
+        compact_hot_tier(engine);
+        save_index_to_nvs(engine);
+        ESP_LOGW(TAG, "Dropped %" PRIu32 " hot entries already in the cold tier", dropped);
+    }
+}
+
 esp_err_t storage_init(storage_engine_t *engine, uint32_t default_ttl_sec)
 {
     memset(engine, 0, sizeof(storage_engine_t));
@@ -173,7 +290,6 @@ esp_err_t storage_init(storage_engine_t *engine, uint32_t default_ttl_sec)
                                      sizeof(storage_index_entry_t),
                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     if (!engine->index) {
-        engine->max_index_entries = 1000;
         engine->index = calloc(engine->max_index_entries, sizeof(storage_index_entry_t));
         if (!engine->index) {
             vSemaphoreDelete(engine->lock);
@@ -181,6 +297,13 @@ esp_err_t storage_init(storage_engine_t *engine, uint32_t default_ttl_sec)
         }
     }
 
+    engine->page_buf = malloc(INDEX_SEG_PAGE_ENTRIES * sizeof(storage_index_entry_t));
+    if (!engine->page_buf) {
+        free(engine->index);
+        vSemaphoreDelete(engine->lock);
+        return ESP_ERR_NO_MEM;
+    }
+
     esp_vfs_littlefs_conf_t conf = {
         .base_path = "/littlefs",
         .partition_label = STORAGE_PARTITION_LABEL,
@@ -191,6 +314,7 @@ esp_err_t storage_init(storage_engine_t *engine, uint32_t default_ttl_sec)
     esp_err_t ret = esp_vfs_littlefs_register(&conf);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to mount LittleFS: %d", ret);
+        free(engine->page_buf);
         free(engine->index);
         vSemaphoreDelete(engine->lock);
         return ret;
@@ -204,19 +328,24 @@ esp_err_t storage_init(storage_engine_t *engine, uint32_t default_ttl_sec)
         mkdir(subdir, 0755);
     }
 
+    if (index_segs_init(&engine->cold, STORAGE_INDEX_DIR) != ESP_OK) {
+        ESP_LOGW(TAG, "Cold index unavailable, using hot tier only");
+    }
+
     int load_err = load_index_from_nvs(engine);
     if (load_err != STORAGE_OK) {
         ESP_LOGW(TAG, "Failed to load index, starting fresh");
         engine->index_count = 0;
         engine->next_file_index = 0;
     }
+    drop_spilled_entries(engine);
 
     engine->initialized = true;
 
     size_t total, used;
     esp_littlefs_info(STORAGE_PARTITION_LABEL, &total, &used);
-    ESP_LOGI(TAG, "Storage initialized: %" PRIu16 " events, %zu/%zu bytes used",
-             engine->index_count, used, total);
+    ESP_LOGI(TAG, "Storage initialized: %" PRIu32 " hot + %" PRIu32 " cold events, %zu/%zu bytes used",
+             engine->index_count, engine->cold.live_entries, used, total);
 
     return ESP_OK;
 }
@@ -235,10 +364,14 @@ void storage_destroy(storage_engine_t *engine)
     save_index_to_nvs(engine);
     esp_vfs_littlefs_unregister(STORAGE_PARTITION_LABEL);
 
+    index_segs_destroy(&engine->cold);
+
     if (engine->index) {
         free(engine->index);
         engine->index = NULL;
     }
+    free(engine->page_buf);
+    engine->page_buf = NULL;
     if (engine->lock) {
         vSemaphoreDelete(engine->lock);
         engine->lock = NULL;
@@ -246,21 +379,50 @@ void storage_destroy(storage_engine_t *engine)
     engine->initialized = false;
 }
 
+static storage_error_t make_hot_room(storage_engine_t *engine)
+{
+    if (compact_hot_tier(engine) > 0 && engine->index_count < engine->max_index_entries) {
+        save_index_to_nvs(engine);
+        return STORAGE_OK;
+    }
+
+    uint32_t spill = engine->index_count / 2;
+    if (spill == 0) spill = 1;
+    if (spill > INDEX_SEG_MAX_ENTRIES) spill = INDEX_SEG_MAX_ENTRIES;
+
+    if (index_segs_append(&engine->cold, engine->index, spill) != ESP_OK) {
+        ESP_LOGW(TAG, "Storage full: cold index append failed");
+        return STORAGE_ERR_FULL;
+    }
+
+    engine->index_count -= spill;
+    memmove(engine->index, engine->index + spill,
+            engine->index_count * sizeof(storage_index_entry_t));
+    save_index_to_nvs(engine);
+
+    ESP_LOGI(TAG, "Spilled %" PRIu32 " entries to cold index (%" PRIu32 " segments, %" PRIu32 " cold events)",
+             spill, engine->cold.seg_count, engine->cold.live_entries);
+    return STORAGE_OK;
+}
+
 storage_error_t storage_save_event(storage_engine_t *engine, const nostr_event *event)
 {
     if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
-    if (find_index_entry(engine, event->id)) {
+    index_loc_t loc;
+    if (locate_entry(engine, event->id, &loc)) {
         xSemaphoreGive(engine->lock);
         return STORAGE_ERR_DUPLICATE;
     }
 
     if (engine->index_count >= engine->max_index_entries) {
-        xSemaphoreGive(engine->lock);
-        ESP_LOGW(TAG, "Storage full");
-        return STORAGE_ERR_FULL;
+        storage_error_t room = make_hot_room(engine);
+        if (room != STORAGE_OK) {
+            xSemaphoreGive(engine->lock);
+            return room;
+        }
     }
 
     char *json = malloc(STORAGE_MAX_EVENT_SIZE);
@@ -339,7 +501,8 @@ bool storage_event_exists(storage_engine_t *engine, const uint8_t event_id[32])
     if (!engine->initialized) return false;
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
-    bool exists = (find_index_entry(engine, event_id) != NULL);
+    index_loc_t loc;
+    bool exists = locate_entry(engine, event_id, &loc);
     xSemaphoreGive(engine->lock);
 
     return exists;
@@ -435,58 +598,157 @@ static bool index_matches_filter(const storage_index_entry_t *entry,
     return true;
 }
 
-static void mark_entry_expired(storage_index_entry_t *entry)
+typedef bool (*index_visit_fn)(storage_engine_t *engine, const storage_index_entry_t *entry, void *ctx);
+
+static void unlink_entry_file(const storage_index_entry_t *entry)
 {
     char path[128];
     get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
     unlink(path);
-    entry->flags |= STORAGE_FLAG_DELETED;
 }
 
-storage_error_t storage_query_events(storage_engine_t *engine,
-                                     const nostr_filter_t *filter,
-                                     nostr_event ***results,
-                                     uint16_t *count,
-                                     uint16_t limit)
+static bool entry_expired(const storage_index_entry_t *entry, uint32_t now)
 {
-    if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
+    return entry->expires_at > 0 && entry->expires_at < now;
+}
 
-    *results = NULL;
-    *count = 0;
+static int visit_cold_segment(storage_engine_t *engine, uint32_t seg_idx,
+                              uint32_t since, uint32_t until, uint32_t now,
+                              index_visit_fn fn, void *ctx, bool *stop)
+{
+    index_seg_t *seg = &engine->cold.segs[seg_idx];
+    uint32_t end = until > 0 ? index_segs_upper_bound(&engine->cold, seg_idx, until) : seg->count;
+    int expired = 0;
+
+    while (end > 0 && !*stop) {
+        uint32_t start = end > INDEX_SEG_PAGE_ENTRIES ? end - INDEX_SEG_PAGE_ENTRIES : 0;
+        if (index_segs_read(&engine->cold, seg_idx, start, engine->page_buf, end - start) != ESP_OK) {
+            break;
+        }
 
-    if (limit > 500) limit = 500;
+        for (uint32_t j = end - start; j-- > 0;) {
+            storage_index_entry_t *entry = &engine->page_buf[j];
 
-    nostr_event **events = calloc(limit, sizeof(nostr_event *));
-    if (!events) return STORAGE_ERR_NO_MEM;
+            if (since > 0 && entry->created_at < since) {
+                return expired;
+            }
+            if (entry->flags & STORAGE_FLAG_DELETED) continue;
 
-    xSemaphoreTake(engine->lock, portMAX_DELAY);
+            if (entry_expired(entry, now)) {
+                unlink_entry_file(entry);
+                index_segs_mark_deleted(&engine->cold, seg_idx, start + j);
+                expired++;
+                continue;
+            }
+
+            if (fn && !fn(engine, entry, ctx)) {
+                *stop = true;
+                break;
+            }
+        }
+        end = start;
+    }
+    return expired;
+}
 
+static int visit_index(storage_engine_t *engine, uint32_t since, uint32_t until,
+                       index_visit_fn fn, void *ctx)
+{
     uint32_t now = (uint32_t)time(NULL);
+    int expired = 0;
+    bool stop = false;
 
-    for (int i = engine->index_count - 1; i >= 0 && *count < limit; i--) {
+    for (uint32_t i = engine->index_count; i-- > 0 && !stop;) {
         storage_index_entry_t *entry = &engine->index[i];
 
         if (entry->flags & STORAGE_FLAG_DELETED) continue;
 
-        if (entry->expires_at > 0 && entry->expires_at < now) {
-            mark_entry_expired(entry);
+        if (entry_expired(entry, now)) {
+            unlink_entry_file(entry);
+            entry->flags |= STORAGE_FLAG_DELETED;
+            expired++;
             continue;
         }
 
-        if (!index_matches_filter(entry, filter)) continue;
+        if (fn && !fn(engine, entry, ctx)) {
+            stop = true;
+        }
+    }
 
-        char path[128];
-        get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
-        nostr_event *event = load_event_from_file(path);
+    for (uint32_t s = engine->cold.seg_count; s-- > 0 && !stop;) {
+        index_seg_t *seg = &engine->cold.segs[s];
 
-        if (event && nostr_filter_matches(filter, event)) {
-            events[*count] = event;
-            (*count)++;
-        } else if (event) {
-            nostr_event_destroy(event);
-        }
+        if (seg->live_count == 0) continue;
+        if (since > 0 && seg->max_created_at < since) continue;
+        if (until > 0 && seg->min_created_at > until) continue;
+        if (!fn && seg->min_expires_at >= now) continue;
+
+        expired += visit_cold_segment(engine, s, since, until, now, fn, ctx, &stop);
+    }
+
+    return expired;
+}
+
+typedef struct {
+    const nostr_filter_t *filter;
+    nostr_event **events;
+    uint16_t *count;
+    uint16_t limit;
+} query_ctx_t;
+
+static bool query_visit(storage_engine_t *engine, const storage_index_entry_t *entry, void *arg)
+{
+    query_ctx_t *q = arg;
+
+    if (!index_matches_filter(entry, q->filter)) return true;
+
+    char path[128];
+    get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
+    nostr_event *event = load_event_from_file(path);
+
+    if (event && nostr_filter_matches(q->filter, event)) {
+        q->events[*q->count] = event;
+        (*q->count)++;
+    } else if (event) {
+        nostr_event_destroy(event);
+    }
+
+    return *q->count < q->limit;
+}
+
+storage_error_t storage_query_events(storage_engine_t *engine,
+                                     const nostr_filter_t *filter,
+                                     nostr_event ***results,
+                                     uint16_t *count,
+                                     uint16_t limit)
+{
+    if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
+
+    *results = NULL;
+    *count = 0;
+
+    if (limit > 500) limit = 500;
+
+    nostr_event **events = calloc(limit, sizeof(nostr_event *));
+    if (!events) return STORAGE_ERR_NO_MEM;
+
+    if (limit == 0) {
+        *results = events;
+        return STORAGE_OK;
     }
 
+    query_ctx_t q = {
+        .filter = filter,
+        .events = events,
+        .count = count,
+        .limit = limit,
+    };
+
+    uint32_t since = filter->since > 0 ? (uint32_t)filter->since : 0;
+    uint32_t until = filter->until > 0 ? (uint32_t)filter->until : 0;
+
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+    visit_index(engine, since, until, query_visit, &q);
     xSemaphoreGive(engine->lock);
 
     *results = events;
@@ -505,23 +767,440 @@ void storage_free_query_results(nostr_event **results, uint16_t count)
     free(results);
 }
 
-int storage_purge_expired(storage_engine_t *engine)
+typedef struct {
+    uint8_t bytes[32];
+    uint8_t nibbles;
+} hex_prefix_t;
+
+typedef struct {
+    const nostr_filter_t *filter;
+    hex_prefix_t *ids;
+    size_t ids_count;
+    hex_prefix_t *authors;
+    size_t authors_count;
+    bool index_only;
+} count_filter_t;
+
+struct storage_count_query {
+    count_filter_t *filters;
+    size_t filter_count;
+    uint32_t since;
+    uint32_t until;
+};
+
+#define COUNT_SLICE_ENTRIES 64
+#define COUNT_SLICE_FILES   8
+#define AUTHOR_PREFIX_NIBBLES (2 * sizeof(((storage_index_entry_t *)0)->pubkey_prefix))
+
+static int hex_nibble(char c)
 {
-    if (!engine->initialized) return 0;
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex_prefix(const char *hex, hex_prefix_t *out)
+{
+    size_t len = strlen(hex);
+    if (len == 0 || len > 64) return false;
+
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < len; i++) {
+        int v = hex_nibble(hex[i]);
+        if (v < 0) return false;
+        out->bytes[i / 2] |= (uint8_t)((i & 1) ? v : v << 4);
+    }
+    out->nibbles = (uint8_t)len;
+    return true;
+}
+
+static bool hex_prefix_match(const hex_prefix_t *p, const uint8_t *bytes, size_t nibbles)
+{
+    size_t n = p->nibbles < nibbles ? p->nibbles : nibbles;
+    if (memcmp(p->bytes, bytes, n / 2) != 0) return false;
+    return !(n & 1) || (p->bytes[n / 2] & 0xF0) == (bytes[n / 2] & 0xF0);
+}
+
+static bool prepare_hex_prefixes(char **values, size_t count, hex_prefix_t **out, size_t *out_count)
+{
+    if (count == 0) return true;
+    *out = malloc(count * sizeof(hex_prefix_t));
+    if (!*out) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (parse_hex_prefix(values[i], &(*out)[*out_count])) {
+            (*out_count)++;
+        }
+    }
+    return true;
+}
+
+static bool prepare_count_filter(count_filter_t *cf, const nostr_filter_t *filter)
+{
+    memset(cf, 0, sizeof(*cf));
+    cf->filter = filter;
+    cf->index_only = filter->e_tags_count == 0 && filter->p_tags_count == 0 &&
+                     filter->generic_tags_count == 0;
+
+    if (!prepare_hex_prefixes(filter->ids, filter->ids_count, &cf->ids, &cf->ids_count) ||
+        !prepare_hex_prefixes(filter->authors, filter->authors_count, &cf->authors, &cf->authors_count)) {
+        return false;
+    }
+
+    // Author prefixes no longer than the indexed pubkey prefix are decided
+    // by the index entry alone; longer ones need the event file
+    for (size_t i = 0; i < cf->authors_count; i++) {
+        if (cf->authors[i].nibbles > AUTHOR_PREFIX_NIBBLES) {
+            cf->index_only = false;
+        }
+    }
+    return true;
+}
+
+static bool count_filter_matches_entry(const count_filter_t *cf, const storage_index_entry_t *entry)
+{
+    const nostr_filter_t *filter = cf->filter;
+
+    if (filter->since > 0 && entry->created_at < (uint32_t)filter->since) return false;
+    if (filter->until > 0 && entry->created_at > (uint32_t)filter->until) return false;
+
+    if (filter->kinds_count > 0) {
+        bool found = false;
+        for (size_t k = 0; k < filter->kinds_count && !found; k++) {
+            found = filter->kinds[k] == entry->kind;
+        }
+        if (!found) return false;
+    }
+
+    if (filter->ids_count > 0) {
+        bool found = false;
+        for (size_t k = 0; k < cf->ids_count && !found; k++) {
+            found = hex_prefix_match(&cf->ids[k], entry->event_id, 64);
+        }
+        if (!found) return false;
+    }
+
+    if (filter->authors_count > 0) {
+        bool found = false;
+        for (size_t k = 0; k < cf->authors_count && !found; k++) {
+            found = hex_prefix_match(&cf->authors[k], entry->pubkey_prefix, AUTHOR_PREFIX_NIBBLES);
+        }
+        if (!found) return false;
+    }
+
+    return true;
+}
+
+static bool count_filter_matches_event(const count_filter_t *cf, const nostr_event *event)
+{
+    if (cf->filter->authors_count > 0) {
+        bool found = false;
+        for (size_t k = 0; k < cf->authors_count && !found; k++) {
+            found = hex_prefix_match(&cf->authors[k], event->pubkey.data, 64);
+        }
+        if (!found) return false;
+    }
+
+    nostr_filter_t rest = *cf->filter;
+    rest.ids = NULL;
+    rest.ids_count = 0;
+    rest.authors = NULL;
+    rest.authors_count = 0;
+    return nostr_filter_matches(&rest, event);
+}
+
+storage_count_query_t *storage_count_prepare(const nostr_filter_t *filters, size_t filter_count)
+{
+    storage_count_query_t *query = calloc(1, sizeof(storage_count_query_t));
+    if (!query) return NULL;
+
+    query->filters = calloc(filter_count ? filter_count : 1, sizeof(count_filter_t));
+    if (!query->filters) {
+        free(query);
+        return NULL;
+    }
+    query->filter_count = filter_count;
+    query->since = UINT32_MAX;
+
+    for (size_t i = 0; i < filter_count; i++) {
+        if (!prepare_count_filter(&query->filters[i], &filters[i])) {
+            storage_count_release(query);
+            return NULL;
+        }
+        uint32_t f_since = filters[i].since > 0 ? (uint32_t)filters[i].since : 0;
+        uint32_t f_until = filters[i].until > 0 ? (uint32_t)filters[i].until : UINT32_MAX;
+        if (f_since < query->since) query->since = f_since;
+        if (f_until > query->until) query->until = f_until;
+    }
+    if (query->until == UINT32_MAX) query->until = 0;
+    return query;
+}
+
+void storage_count_release(storage_count_query_t *query)
+{
+    if (!query) return;
+    for (size_t i = 0; i < query->filter_count; i++) {
+        free(query->filters[i].ids);
+        free(query->filters[i].authors);
+    }
+    free(query->filters);
+    free(query);
+}
+
+void storage_cursor_init(storage_engine_t *engine, storage_cursor_t *cursor)
+{
+    memset(cursor, 0, sizeof(storage_cursor_t));
+
+    if (!engine->initialized) {
+        cursor->phase = STORAGE_CURSOR_DONE;
+        return;
+    }
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
+    cursor->hot_bound = engine->next_file_index;
+    cursor->phase = STORAGE_CURSOR_HOT;
+    xSemaphoreGive(engine->lock);
+}
 
-    uint32_t now = (uint32_t)time(NULL);
-    int purged = 0;
+typedef struct {
+    const nostr_filter_t *filter;
+    const storage_count_query_t *count_query;
+    storage_slice_t *slice;
+    nostr_event **events;
+    uint16_t *count;
+    uint16_t max_events;
+    uint32_t *counted;
+    uint32_t since;
+    uint32_t until;
+    uint32_t now;
+} slice_ctx_t;
+
+static bool slice_has_budget(const slice_ctx_t *s)
+{
+    return s->slice->entries_examined < s->slice->max_entries &&
+           s->slice->files_loaded < s->slice->max_files &&
+           (s->count_query || *s->count < s->max_events);
+}
 
-    for (uint16_t i = 0; i < engine->index_count; i++) {
-        storage_index_entry_t *entry = &engine->index[i];
+static void count_examine(slice_ctx_t *s, const storage_index_entry_t *entry)
+{
+    const storage_count_query_t *q = s->count_query;
+    nostr_event *event = NULL;
+    bool loaded = false;
 
-        if (entry->flags & STORAGE_FLAG_DELETED) continue;
+    for (size_t i = 0; i < q->filter_count; i++) {
+        const count_filter_t *cf = &q->filters[i];
+        if (!count_filter_matches_entry(cf, entry)) continue;
+
+        if (cf->index_only) {
+            (*s->counted)++;
+            break;
+        }
+
+        if (!loaded) {
+            char path[128];
+            get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
+            event = load_event_from_file(path);
+            s->slice->files_loaded++;
+            loaded = true;
+        }
+        if (event && count_filter_matches_event(cf, event)) {
+            (*s->counted)++;
+            break;
+        }
+    }
+
+    if (event) {
+        nostr_event_destroy(event);
+    }
+}
+
+static void slice_examine(slice_ctx_t *s, const storage_index_entry_t *entry)
+{
+    s->slice->entries_examined++;
+
+    if (entry->flags & STORAGE_FLAG_DELETED) return;
+    if (entry_expired(entry, s->now)) return;
+    if (s->count_query) {
+        count_examine(s, entry);
+        return;
+    }
+    if (!index_matches_filter(entry, s->filter)) return;
+
+    char path[128];
+    get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
+    nostr_event *event = load_event_from_file(path);
+    s->slice->files_loaded++;
+
+    if (event && nostr_filter_matches(s->filter, event)) {
+        s->events[(*s->count)++] = event;
+    } else if (event) {
+        nostr_event_destroy(event);
+    }
+}
+
+static uint32_t hot_entries_below(storage_engine_t *engine, uint32_t file_bound)
+{
+    uint32_t lo = 0;
+    uint32_t hi = engine->index_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (engine->index[mid].file_index < file_bound) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void slice_hot(storage_engine_t *engine, storage_cursor_t *cursor, slice_ctx_t *s)
+{
+    uint32_t i = hot_entries_below(engine, cursor->hot_bound);
+
+    while (i > 0 && slice_has_budget(s)) {
+        i--;
+        cursor->hot_bound = engine->index[i].file_index;
+        slice_examine(s, &engine->index[i]);
+    }
+
+    if (i == 0) {
+        index_segs_cursor_init(&engine->cold, &cursor->cold, cursor->hot_bound);
+        cursor->phase = STORAGE_CURSOR_COLD;
+    }
+}
+
+static bool slice_visit(const storage_index_entry_t *entry, bool seen, void *ctx)
+{
+    slice_ctx_t *s = ctx;
+    if (seen) {
+        s->slice->entries_examined++;
+    } else {
+        slice_examine(s, entry);
+    }
+    return slice_has_budget(s);
+}
+
+static void slice_cold(storage_engine_t *engine, storage_cursor_t *cursor, slice_ctx_t *s)
+{
+    if (index_segs_cursor_scan(&engine->cold, &cursor->cold, s->since, s->until,
+                               engine->page_buf, slice_visit, s)) {
+        cursor->phase = STORAGE_CURSOR_DONE;
+    }
+}
+
+static void run_slice(storage_engine_t *engine, storage_cursor_t *cursor, slice_ctx_t *s)
+{
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+
+    if (cursor->phase == STORAGE_CURSOR_HOT) {
+        slice_hot(engine, cursor, s);
+    }
+    if (cursor->phase == STORAGE_CURSOR_COLD && slice_has_budget(s)) {
+        slice_cold(engine, cursor, s);
+    }
+
+    xSemaphoreGive(engine->lock);
+}
+
+storage_error_t storage_query_slice(storage_engine_t *engine,
+                                    const nostr_filter_t *filter,
+                                    storage_cursor_t *cursor,
+                                    storage_slice_t *slice,
+                                    nostr_event **events,
+                                    uint16_t *count,
+                                    uint16_t max_events)
+{
+    *count = 0;
+    slice->entries_examined = 0;
+    slice->files_loaded = 0;
+
+    if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
+    if (cursor->phase == STORAGE_CURSOR_DONE || max_events == 0) return STORAGE_OK;
+
+    slice_ctx_t s = {
+        .filter = filter,
+        .slice = slice,
+        .events = events,
+        .count = count,
+        .max_events = max_events,
+        .since = filter->since > 0 ? (uint32_t)filter->since : 0,
+        .until = filter->until > 0 ? (uint32_t)filter->until : 0,
+        .now = (uint32_t)time(NULL),
+    };
+
+    run_slice(engine, cursor, &s);
+    return STORAGE_OK;
+}
+
+storage_error_t storage_count_slice(storage_engine_t *engine,
+                                    const storage_count_query_t *query,
+                                    storage_cursor_t *cursor,
+                                    storage_slice_t *slice,
+                                    uint32_t *count)
+{
+    slice->entries_examined = 0;
+    slice->files_loaded = 0;
+
+    if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
+    if (cursor->phase == STORAGE_CURSOR_DONE) return STORAGE_OK;
+    if (query->filter_count == 0) {
+        cursor->phase = STORAGE_CURSOR_DONE;
+        return STORAGE_OK;
+    }
+
+    slice_ctx_t s = {
+        .count_query = query,
+        .slice = slice,
+        .counted = count,
+        .since = query->since,
+        .until = query->until,
+        .now = (uint32_t)time(NULL),
+    };
+
+    run_slice(engine, cursor, &s);
+    return STORAGE_OK;
+}
+
+storage_error_t storage_count_events(storage_engine_t *engine,
+                                     const nostr_filter_t *filters,
+                                     size_t filter_count,
+                                     uint32_t *count)
+{
+    *count = 0;
+    if (!engine->initialized) return STORAGE_ERR_NOT_INITIALIZED;
+
+    storage_count_query_t *query = storage_count_prepare(filters, filter_count);
+    if (!query) return STORAGE_ERR_NO_MEM;
+
+    storage_cursor_t cursor;
+    storage_cursor_init(engine, &cursor);
+
+    storage_error_t err = STORAGE_OK;
+    while (err == STORAGE_OK && cursor.phase != STORAGE_CURSOR_DONE) {
+        storage_slice_t slice = {
+            .max_entries = COUNT_SLICE_ENTRIES,
+            .max_files = COUNT_SLICE_FILES,
+        };
+        err = storage_count_slice(engine, query, &cursor, &slice, count);
+    }
+
+    storage_count_release(query);
+    ESP_LOGD(TAG, "Count returned %" PRIu32 " events", *count);
+    return err;
+}
 
-        if (entry->expires_at > 0 && entry->expires_at < now) {
-            mark_entry_expired(entry);
-            purged++;
+int storage_purge_expired(storage_engine_t *engine)
+{
+    if (!engine->initialized) return 0;
+
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+
+    int purged = visit_index(engine, 0, 0, NULL, NULL);
+
+    for (uint32_t s = engine->cold.seg_count; s-- > 0;) {
+        if (engine->cold.segs[s].live_count == 0) {
+            index_segs_remove(&engine->cold, s);
         }
     }
 
@@ -540,28 +1219,20 @@ int storage_compact_index(storage_engine_t *engine)
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
-    uint16_t write_idx = 0;
-    int compacted = 0;
-
-    for (uint16_t read_idx = 0; read_idx < engine->index_count; read_idx++) {
-        if (!(engine->index[read_idx].flags & STORAGE_FLAG_DELETED)) {
-            if (write_idx != read_idx) {
-                memcpy(&engine->index[write_idx], &engine->index[read_idx],
-                       sizeof(storage_index_entry_t));
-            }
-            write_idx++;
-        } else {
-            compacted++;
-        }
-    }
+    int compacted = compact_hot_tier(engine);
 
     if (compacted > 0) {
-        engine->index_count = write_idx;
         save_index_to_nvs(engine);
-        ESP_LOGI(TAG, "Compacted index: removed %d entries, %" PRIu16 " remaining",
+        ESP_LOGI(TAG, "Compacted index: removed %d entries, %" PRIu32 " remaining",
                  compacted, engine->index_count);
     }
 
+    int merged = index_segs_compact(&engine->cold);
+    if (merged > 0) {
+        ESP_LOGI(TAG, "Compacted cold index: %d segment merges, %" PRIu32 " segments",
+                 merged, engine->cold.seg_count);
+    }
+
     xSemaphoreGive(engine->lock);
     return compacted;
 }
@@ -572,18 +1243,17 @@ storage_error_t storage_delete_event(storage_engine_t *engine, const uint8_t eve
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
-    storage_index_entry_t *entry = find_index_entry(engine, event_id);
-    if (!entry) {
+    index_loc_t loc;
+    if (!locate_entry(engine, event_id, &loc)) {
         xSemaphoreGive(engine->lock);
         return STORAGE_ERR_NOT_FOUND;
     }
 
-    char path[128];
-    get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
-    unlink(path);
-
-    entry->flags |= STORAGE_FLAG_DELETED;
-    save_index_to_nvs(engine);
+    unlink_entry_file(loc_entry(&loc));
+    mark_loc_deleted(engine, &loc);
+    if (loc.hot) {
+        save_index_to_nvs(engine);
+    }
 
     xSemaphoreGive(engine->lock);
     return STORAGE_OK;
@@ -595,12 +1265,13 @@ nostr_event *storage_get_event(storage_engine_t *engine, const uint8_t event_id[
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
-    storage_index_entry_t *entry = find_index_entry(engine, event_id);
-    if (!entry) {
+    index_loc_t loc;
+    if (!locate_entry(engine, event_id, &loc)) {
         xSemaphoreGive(engine->lock);
         return NULL;
     }
 
+    const storage_index_entry_t *entry = loc_entry(&loc);
     char path[128];
     get_event_path(entry->event_id, entry->file_index, path, sizeof(path));
     nostr_event *event = load_event_from_file(path);
@@ -619,11 +1290,11 @@ void storage_get_stats(storage_engine_t *engine, storage_stats_t *stats)
     uint32_t now = (uint32_t)time(NULL);
     stats->oldest_event_ts = UINT32_MAX;
 
-    for (uint16_t i = 0; i < engine->index_count; i++) {
+    for (uint32_t i = 0; i < engine->index_count; i++) {
         if (engine->index[i].flags & STORAGE_FLAG_DELETED) continue;
-        if (engine->index[i].expires_at > 0 && engine->index[i].expires_at < now) continue;
+        if (entry_expired(&engine->index[i], now)) continue;
 
-        stats->total_events++;
+        stats->hot_events++;
         if (engine->index[i].created_at < stats->oldest_event_ts) {
             stats->oldest_event_ts = engine->index[i].created_at;
         }
@@ -632,6 +1303,21 @@ void storage_get_stats(storage_engine_t *engine, storage_stats_t *stats)
         }
     }
 
+    for (uint32_t s = 0; s < engine->cold.seg_count; s++) {
+        const index_seg_t *seg = &engine->cold.segs[s];
+        if (seg->live_count == 0) continue;
+
+        stats->cold_events += seg->live_count;
+        stats->cold_segments++;
+        if (seg->min_created_at < stats->oldest_event_ts) {
+            stats->oldest_event_ts = seg->min_created_at;
+        }
+        if (seg->max_created_at > stats->newest_event_ts) {
+            stats->newest_event_ts = seg->max_created_at;
+        }
+    }
+
+    stats->total_events = stats->hot_events + stats->cold_events;
     if (stats->total_events == 0) {
         stats->oldest_event_ts = 0;
     }
@@ -671,8 +1357,9 @@ static void storage_cleanup_task(void *arg)
 esp_err_t storage_start_cleanup_task(storage_engine_t *engine)
 {
     engine->cleanup_stop = false;
-    BaseType_t ret = xTaskCreate(storage_cleanup_task, "storage_cleanup", 4096,
-                                 engine, 2, &engine->cleanup_task);
+    BaseType_t ret = xTaskCreatePinnedToCore(storage_cleanup_task, "storage_cleanup", 4096,
+                                             engine, CONFIG_WISP_CLEANUP_PRIORITY, &engine->cleanup_task,
+                                             CONFIG_WISP_CLEANUP_CORE < 0 ? tskNO_AFFINITY : CONFIG_WISP_CLEANUP_CORE);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create cleanup task");
         engine->cleanup_task = NULL;
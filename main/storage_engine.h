@@ -7,12 +7,14 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "index_segments.h"
 #include "nostr_relay_protocol.h"
 
 #define STORAGE_MAX_EVENTS         5000
 #define STORAGE_MAX_EVENT_SIZE     8192
-#define STORAGE_INDEX_ENTRIES      5000
+#define STORAGE_INDEX_ENTRIES      256
 #define STORAGE_PARTITION_LABEL    "storage"
+#define STORAGE_INDEX_DIR          "/littlefs/index"
 
 typedef enum {
     STORAGE_OK = 0,
@@ -25,32 +27,43 @@ typedef enum {
     STORAGE_ERR_SERIALIZE
 } storage_error_t;
 
-#define STORAGE_FLAG_DELETED  0x01
-
-typedef struct __attribute__((packed)) {
-    uint8_t  event_id[32];
-    uint32_t created_at;
-    uint32_t expires_at;
-    uint32_t file_index;
-    uint16_t kind;
-    uint8_t  pubkey_prefix[4];
-    uint8_t  flags;
-    uint8_t  reserved;
-} storage_index_entry_t;
-
 typedef struct {
     uint32_t total_events;
     uint32_t total_bytes;
     uint32_t free_bytes;
     uint32_t oldest_event_ts;
     uint32_t newest_event_ts;
+    uint32_t hot_events;
+    uint32_t cold_events;
+    uint32_t cold_segments;
 } storage_stats_t;
 
+typedef enum {
+    STORAGE_CURSOR_HOT,
+    STORAGE_CURSOR_COLD,
+    STORAGE_CURSOR_DONE
+} storage_cursor_phase_t;
+
+typedef struct {
+    uint32_t hot_bound;
+    index_segs_cursor_t cold;
+    storage_cursor_phase_t phase;
+} storage_cursor_t;
+
+typedef struct {
+    uint32_t max_entries;
+    uint32_t max_files;
+    uint32_t entries_examined;
+    uint32_t files_loaded;
+} storage_slice_t;
+
 typedef struct storage_engine {
     storage_index_entry_t *index;
-    uint16_t index_count;
-    uint16_t max_index_entries;
+    uint32_t index_count;
+    uint32_t max_index_entries;
     uint32_t next_file_index;
+    index_segs_t cold;
+    storage_index_entry_t *page_buf;
     SemaphoreHandle_t lock;
     TaskHandle_t cleanup_task;
     bool initialized;
@@ -72,6 +85,33 @@ storage_error_t storage_query_events(storage_engine_t *engine,
 
 void storage_free_query_results(nostr_event **results, uint16_t count);
 
+typedef struct storage_count_query storage_count_query_t;
+
+storage_error_t storage_count_events(storage_engine_t *engine,
+                                     const nostr_filter_t *filters,
+                                     size_t filter_count,
+                                     uint32_t *count);
+
+storage_count_query_t *storage_count_prepare(const nostr_filter_t *filters, size_t filter_count);
+
+void storage_count_release(storage_count_query_t *query);
+
+void storage_cursor_init(storage_engine_t *engine, storage_cursor_t *cursor);
+
+storage_error_t storage_query_slice(storage_engine_t *engine,
+                                    const nostr_filter_t *filter,
+                                    storage_cursor_t *cursor,
+                                    storage_slice_t *slice,
+                                    nostr_event **events,
+                                    uint16_t *count,
+                                    uint16_t max_events);
+
+storage_error_t storage_count_slice(storage_engine_t *engine,
+                                    const storage_count_query_t *query,
+                                    storage_cursor_t *cursor,
+                                    storage_slice_t *slice,
+                                    uint32_t *count);
+
 bool storage_event_exists(storage_engine_t *engine, const uint8_t event_id[32]);
 
 nostr_event *storage_get_event(storage_engine_t *engine, const uint8_t event_id[32]);
@@ -0,0 +1,280 @@
+#include "sub_index.h"
+#include "esp_heap_caps.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SUB_INDEX_MIN_BUCKETS 64
+
+static uint32_t bucket_of(const sub_index_t *idx, uint64_t key)
+{
+    key ^= key >> 29;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 32;
+    return (uint32_t)key & (idx->bucket_count - 1);
+}
+
+uint64_t sub_index_key(sub_key_class_t cls, char tag, const void *data, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = (h ^ (uint8_t)cls) * 0x100000001b3ULL;
+    h = (h ^ (uint8_t)tag) * 0x100000001b3ULL;
+
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void *index_realloc(const sub_index_t *idx, void *ptr, size_t size)
+{
+    if (idx->use_psram) {
+        void *p = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (p) return p;
+    }
+    return realloc(ptr, size);
+}
+
+static void *index_fill(const sub_index_t *idx, size_t size, uint8_t fill)
+{
+    void *p = index_realloc(idx, NULL, size ? size : 1);
+    if (p) {
+        memset(p, fill, size);
+    }
+    return p;
+}
+
+bool sub_index_init(sub_index_t *idx, uint32_t sub_capacity, bool use_psram)
+{
+    memset(idx, 0, sizeof(sub_index_t));
+    idx->use_psram = use_psram;
+
+    idx->bucket_count = SUB_INDEX_MIN_BUCKETS;
+    idx->buckets = index_fill(idx, idx->bucket_count * sizeof(uint32_t), 0xff);
+    idx->sub_heads = index_fill(idx, sub_capacity * sizeof(uint32_t), 0xff);
+    idx->residual = index_fill(idx, sub_capacity * sizeof(bool), 0);
+    idx->residual_subs = index_realloc(idx, NULL, sub_capacity * sizeof(uint32_t));
+    idx->posting_free = SUB_INDEX_NONE;
+    idx->sub_capacity = sub_capacity;
+
+    if (!idx->buckets || !idx->sub_heads || !idx->residual || !idx->residual_subs) {
+        sub_index_destroy(idx);
+        return false;
+    }
+    return true;
+}
+
+void sub_index_destroy(sub_index_t *idx)
+{
+    free(idx->buckets);
+    free(idx->postings);
+    free(idx->sub_heads);
+    free(idx->residual);
+    free(idx->residual_subs);
+    memset(idx, 0, sizeof(sub_index_t));
+}
+
+static void *dup_array(const sub_index_t *idx, const void *src, size_t size)
+{
+    void *p = index_realloc(idx, NULL, size ? size : 1);
+    if (p && size) {
+        memcpy(p, src, size);
+    }
+    return p;
+}
+
+bool sub_index_clone(sub_index_t *dst, const sub_index_t *src)
+{
+    *dst = *src;
+    dst->buckets = dup_array(src, src->buckets, src->bucket_count * sizeof(uint32_t));
+    dst->postings = dup_array(src, src->postings, src->posting_used * sizeof(sub_posting_t));
+    dst->posting_capacity = src->posting_used;
+    dst->sub_heads = dup_array(src, src->sub_heads, src->sub_capacity * sizeof(uint32_t));
+    dst->residual = dup_array(src, src->residual, src->sub_capacity * sizeof(bool));
+    dst->residual_subs = dup_array(src, src->residual_subs, src->sub_capacity * sizeof(uint32_t));
+
+    if (!dst->buckets || !dst->postings || !dst->sub_heads || !dst->residual || !dst->residual_subs) {
+        sub_index_destroy(dst);
+        return false;
+    }
+    return true;
+}
+
+bool sub_index_grow(sub_index_t *idx, uint32_t sub_capacity)
+{
+    if (sub_capacity <= idx->sub_capacity) return true;
+
+    uint32_t *heads = index_realloc(idx, idx->sub_heads, sub_capacity * sizeof(uint32_t));
+    if (!heads) return false;
+    idx->sub_heads = heads;
+    memset(heads + idx->sub_capacity, 0xff, (sub_capacity - idx->sub_capacity) * sizeof(uint32_t));
+
+    bool *residual = index_realloc(idx, idx->residual, sub_capacity * sizeof(bool));
+    if (!residual) return false;
+    idx->residual = residual;
+    memset(residual + idx->sub_capacity, 0, (sub_capacity - idx->sub_capacity) * sizeof(bool));
+
+    uint32_t *residual_subs = index_realloc(idx, idx->residual_subs, sub_capacity * sizeof(uint32_t));
+    if (!residual_subs) return false;
+    idx->residual_subs = residual_subs;
+
+    idx->sub_capacity = sub_capacity;
+    return true;
+}
+
+static bool rehash(sub_index_t *idx, uint32_t bucket_count)
+{
+    uint32_t *buckets = index_fill(idx, bucket_count * sizeof(uint32_t), 0xff);
+    if (!buckets) return false;
+
+    free(idx->buckets);
+    idx->buckets = buckets;
+    idx->bucket_count = bucket_count;
+
+    for (uint32_t p = 0; p < idx->posting_used; p++) {
+        sub_posting_t *posting = &idx->postings[p];
+        if (posting->sub == SUB_INDEX_NONE) continue;
+        uint32_t b = bucket_of(idx, posting->key);
+        posting->bucket_next = idx->buckets[b];
+        idx->buckets[b] = p;
+    }
+    return true;
+}
+
+// Ensures the next `postings` insertions need no allocation.
+bool sub_index_reserve(sub_index_t *idx, uint32_t postings)
+{
+    if (idx->posting_capacity - idx->live_postings >= postings) return true;
+
+    uint32_t cap = idx->posting_capacity ? idx->posting_capacity * 2 : 64;
+    while (cap - idx->live_postings < postings) cap *= 2;
+    sub_posting_t *grown = index_realloc(idx, idx->postings, cap * sizeof(sub_posting_t));
+    if (!grown) return false;
+    idx->postings = grown;
+    idx->posting_capacity = cap;
+    return true;
+}
+
+static uint32_t alloc_posting(sub_index_t *idx)
+{
+    if (idx->posting_free != SUB_INDEX_NONE) {
+        uint32_t p = idx->posting_free;
+        idx->posting_free = idx->postings[p].sub_next;
+        return p;
+    }
+
+    if (idx->posting_used == idx->posting_capacity) {
+        uint32_t cap = idx->posting_capacity ? idx->posting_capacity * 2 : 64;
+        sub_posting_t *grown = index_realloc(idx, idx->postings, cap * sizeof(sub_posting_t));
+        if (!grown) return SUB_INDEX_NONE;
+        idx->postings = grown;
+        idx->posting_capacity = cap;
+    }
+    return idx->posting_used++;
+}
+
+bool sub_index_add_key(sub_index_t *idx, uint32_t sub, uint64_t key)
+{
+    if (sub >= idx->sub_capacity) return false;
+
+    if (idx->live_postings >= idx->bucket_count * 2) {
+        rehash(idx, idx->bucket_count * 2);
+    }
+
+    uint32_t p = alloc_posting(idx);
+    if (p == SUB_INDEX_NONE) return false;
+
+    uint32_t b = bucket_of(idx, key);
+    sub_posting_t *posting = &idx->postings[p];
+    posting->key = key;
+    posting->sub = sub;
+    posting->bucket_next = idx->buckets[b];
+    posting->sub_next = idx->sub_heads[sub];
+    idx->buckets[b] = p;
+    idx->sub_heads[sub] = p;
+    idx->live_postings++;
+    return true;
+}
+
+bool sub_index_add_residual(sub_index_t *idx, uint32_t sub)
+{
+    if (sub >= idx->sub_capacity) return false;
+    if (!idx->residual[sub]) {
+        idx->residual[sub] = true;
+        idx->residual_subs[idx->residual_count++] = sub;
+    }
+    return true;
+}
+
+static void unlink_from_bucket(sub_index_t *idx, uint32_t p)
+{
+    uint32_t *link = &idx->buckets[bucket_of(idx, idx->postings[p].key)];
+    while (*link != SUB_INDEX_NONE) {
+        if (*link == p) {
+            *link = idx->postings[p].bucket_next;
+            return;
+        }
+        link = &idx->postings[*link].bucket_next;
+    }
+}
+
+void sub_index_remove(sub_index_t *idx, uint32_t sub)
+{
+    if (sub >= idx->sub_capacity) return;
+
+    uint32_t p = idx->sub_heads[sub];
+    while (p != SUB_INDEX_NONE) {
+        uint32_t next = idx->postings[p].sub_next;
+        unlink_from_bucket(idx, p);
+        idx->postings[p].sub = SUB_INDEX_NONE;
+        idx->postings[p].sub_next = idx->posting_free;
+        idx->posting_free = p;
+        idx->live_postings--;
+        p = next;
+    }
+    idx->sub_heads[sub] = SUB_INDEX_NONE;
+
+    if (idx->residual[sub]) {
+        idx->residual[sub] = false;
+        for (uint32_t i = 0; i < idx->residual_count; i++) {
+            if (idx->residual_subs[i] == sub) {
+                idx->residual_subs[i] = idx->residual_subs[--idx->residual_count];
+                break;
+            }
+        }
+    }
+}
+
+static bool mark_seen(uint8_t *seen, uint32_t sub)
+{
+    uint8_t bit = (uint8_t)(1u << (sub & 7));
+    if (seen[sub >> 3] & bit) return false;
+    seen[sub >> 3] |= bit;
+    return true;
+}
+
+uint32_t sub_index_candidates(const sub_index_t *idx, const uint64_t *keys, size_t key_count,
+                              uint8_t *seen, uint32_t *out, uint32_t max_out)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < idx->residual_count && n < max_out; i++) {
+        if (mark_seen(seen, idx->residual_subs[i])) {
+            out[n++] = idx->residual_subs[i];
+        }
+    }
+
+    for (size_t k = 0; k < key_count && n < max_out; k++) {
+        uint32_t p = idx->buckets[bucket_of(idx, keys[k])];
+        while (p != SUB_INDEX_NONE && n < max_out) {
+            const sub_posting_t *posting = &idx->postings[p];
+            if (posting->key == keys[k] && mark_seen(seen, posting->sub)) {
+                out[n++] = posting->sub;
+            }
+            p = posting->bucket_next;
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,56 @@
+#ifndef SUB_INDEX_H
+#define SUB_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUB_INDEX_NONE UINT32_MAX
+
+typedef enum {
+    SUB_KEY_ID = 1,
+    SUB_KEY_AUTHOR,
+    SUB_KEY_KIND,
+    SUB_KEY_TAG,
+} sub_key_class_t;
+
+typedef struct {
+    uint64_t key;
+    uint32_t sub;
+    uint32_t bucket_next;
+    uint32_t sub_next;
+} sub_posting_t;
+
+typedef struct {
+    uint32_t *buckets;
+    uint32_t bucket_count;
+    sub_posting_t *postings;
+    uint32_t posting_capacity;
+    uint32_t posting_used;
+    uint32_t posting_free;
+    uint32_t live_postings;
+    uint32_t *sub_heads;
+    bool *residual;
+    uint32_t *residual_subs;
+    uint32_t residual_count;
+    uint32_t sub_capacity;
+    bool use_psram;
+} sub_index_t;
+
+bool sub_index_init(sub_index_t *idx, uint32_t sub_capacity, bool use_psram);
+void sub_index_destroy(sub_index_t *idx);
+bool sub_index_grow(sub_index_t *idx, uint32_t sub_capacity);
+bool sub_index_reserve(sub_index_t *idx, uint32_t postings);
+bool sub_index_clone(sub_index_t *dst, const sub_index_t *src);
+
+uint64_t sub_index_key(sub_key_class_t cls, char tag, const void *data, size_t len);
+
+// Keys are not de-duplicated here; add each one at most once per sub.
+bool sub_index_add_key(sub_index_t *idx, uint32_t sub, uint64_t key);
+bool sub_index_add_residual(sub_index_t *idx, uint32_t sub);
+void sub_index_remove(sub_index_t *idx, uint32_t sub);
+
+uint32_t sub_index_candidates(const sub_index_t *idx, const uint64_t *keys, size_t key_count,
+                              uint8_t *seen, uint32_t *out, uint32_t max_out);
+
+#endif
@@ -1,164 +1,1066 @@
 #include "sub_manager.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "freertos/task.h"
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char *TAG = "sub_mgr";
 
-static char **copy_string_array(char **src, size_t count)
+#define SUB_POOL_INITIAL      16
+#define SUB_MATCH_INITIAL     8
+#define SUB_MATCH_INLINE      128
+#define SUB_SLOT_NONE         UINT32_MAX
+#define SUB_BATCH_INLINE      4
+
+static int hex_nibble(char c)
 {
-    if (!src || count == 0) return NULL;
-    char **dst = malloc(sizeof(char *) * count);
-    if (!dst) return NULL;
-    for (size_t i = 0; i < count; i++) {
-        dst[i] = strdup(src[i]);
-        if (!dst[i]) {
-            for (size_t j = 0; j < i; j++) free(dst[j]);
-            free(dst);
-            return NULL;
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int decode_hex_prefix(const char *hex, uint8_t out[32])
+{
+    size_t len = strlen(hex);
+    if (len == 0 || len > 64) return -1;
+    memset(out, 0, 32);
+    for (size_t i = 0; i < len; i++) {
+        int v = hex_nibble(hex[i]);
+        if (v < 0) return -1;
+        out[i / 2] |= (uint8_t)((i & 1) ? v : v << 4);
+    }
+    return (int)len;
+}
+
+static int compare_key32(const void *a, const void *b)
+{
+    return memcmp(a, b, 32);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_u16(const void *a, const void *b)
+{
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+static int compare_tag_set(const void *a, const void *b)
+{
+    const sub_tag_set_t *x = a, *y = b;
+    if (x->name != y->name) return (int)(uint8_t)x->name - (int)(uint8_t)y->name;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+static int compare_filter(const void *a, const void *b)
+{
+    uint64_t x = ((const sub_filter_t *)a)->digest, y = ((const sub_filter_t *)b)->digest;
+    return (x > y) - (x < y);
+}
+
+static uint32_t sort_unique(void *base, uint32_t count, size_t size,
+                            int (*compare)(const void *, const void *))
+{
+    if (count < 2) return count;
+    qsort(base, count, size, compare);
+    uint8_t *items = base;
+    uint32_t n = 1;
+    for (uint32_t i = 1; i < count; i++) {
+        if (compare(items + (n - 1) * size, items + i * size) != 0) {
+            memmove(items + n * size, items + i * size, size);
+            n++;
         }
     }
-    return dst;
+    return n;
+}
+
+static uint64_t digest_mix(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+typedef struct {
+    uint8_t *base;
+    size_t used;
+} sub_arena_t;
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
 }
 
-static int32_t *copy_int_array(int32_t *src, size_t count)
+static void *arena_take(sub_arena_t *arena, size_t size)
 {
-    if (!src || count == 0) return NULL;
-    int32_t *dst = malloc(sizeof(int32_t) * count);
-    if (!dst) return NULL;
-    memcpy(dst, src, sizeof(int32_t) * count);
-    return dst;
+    if (size == 0) return NULL;
+    void *p = arena->base + arena->used;
+    arena->used += align8(size);
+    return p;
 }
 
-static nostr_generic_tag_filter_t *copy_generic_tags(nostr_generic_tag_filter_t *src, size_t count)
+static void count_key_set(char **values, size_t count, uint32_t *full, uint32_t *prefixes)
 {
-    if (!src || count == 0) return NULL;
-    nostr_generic_tag_filter_t *dst = calloc(count, sizeof(nostr_generic_tag_filter_t));
-    if (!dst) return NULL;
+    uint8_t bytes[32];
+    *full = 0;
+    *prefixes = 0;
     for (size_t i = 0; i < count; i++) {
-        dst[i].tag_name = src[i].tag_name;
-        dst[i].values_count = src[i].values_count;
-        dst[i].values = copy_string_array(src[i].values, src[i].values_count);
-        if (src[i].values_count > 0 && !dst[i].values) {
-            for (size_t j = 0; j < i; j++) {
-                for (size_t k = 0; k < dst[j].values_count; k++) free(dst[j].values[k]);
-                free(dst[j].values);
-            }
-            free(dst);
-            return NULL;
+        int nibbles = decode_hex_prefix(values[i], bytes);
+        if (nibbles == 64) {
+            (*full)++;
+        } else if (nibbles > 0) {
+            (*prefixes)++;
         }
     }
-    return dst;
 }
 
-static bool filter_copy(nostr_filter_t *dst, const nostr_filter_t *src)
+static size_t key_set_arena_size(char **values, size_t count)
+{
+    uint32_t full, prefixes;
+    count_key_set(values, count, &full, &prefixes);
+    return align8((size_t)full * 32) + align8((size_t)prefixes * sizeof(sub_prefix_t));
+}
+
+static size_t tag_set_count(const nostr_filter_t *f)
+{
+    size_t sets = (f->e_tags_count > 0) + (f->p_tags_count > 0);
+    for (size_t i = 0; i < f->generic_tags_count; i++) {
+        if (f->generic_tags[i].values_count > 0) sets++;
+    }
+    return sets;
+}
+
+static size_t filter_arena_size(const nostr_filter_t *f)
 {
-    memset(dst, 0, sizeof(nostr_filter_t));
+    size_t size = key_set_arena_size(f->ids, f->ids_count) +
+                  key_set_arena_size(f->authors, f->authors_count) +
+                  align8(f->kinds_count * sizeof(uint16_t)) +
+                  align8(tag_set_count(f) * sizeof(sub_tag_set_t)) +
+                  align8(f->e_tags_count * sizeof(uint64_t)) +
+                  align8(f->p_tags_count * sizeof(uint64_t));
+    for (size_t i = 0; i < f->generic_tags_count; i++) {
+        size += align8(f->generic_tags[i].values_count * sizeof(uint64_t));
+    }
+    return size;
+}
+
+static void compile_key_set(sub_arena_t *arena, sub_key_set_t *set, char **values, size_t count)
+{
+    memset(set, 0, sizeof(*set));
+    if (count == 0) return;
+    set->active = true;
+
+    uint32_t full, prefixes;
+    count_key_set(values, count, &full, &prefixes);
+    set->keys = arena_take(arena, (size_t)full * 32);
+    set->prefixes = arena_take(arena, (size_t)prefixes * sizeof(sub_prefix_t));
+
+    uint8_t bytes[32];
+    for (size_t i = 0; i < count; i++) {
+        int nibbles = decode_hex_prefix(values[i], bytes);
+        if (nibbles == 64) {
+            memcpy(set->keys[set->count++], bytes, 32);
+        } else if (nibbles > 0) {
+            memcpy(set->prefixes[set->prefix_count].bytes, bytes, 32);
+            set->prefixes[set->prefix_count++].nibbles = (uint8_t)nibbles;
+        }
+    }
+    set->count = sort_unique(set->keys, set->count, 32, compare_key32);
+}
 
-    dst->ids_count = src->ids_count;
-    dst->ids = copy_string_array(src->ids, src->ids_count);
-    if (src->ids_count > 0 && !dst->ids) goto fail;
+static bool key_set_match(const sub_key_set_t *set, const uint8_t key[32])
+{
+    if (!set->active) return true;
+    if (set->count > 0 && bsearch(key, set->keys, set->count, 32, compare_key32)) {
+        return true;
+    }
+    for (uint32_t i = 0; i < set->prefix_count; i++) {
+        const sub_prefix_t *p = &set->prefixes[i];
+        uint8_t whole = p->nibbles / 2;
+        if (memcmp(p->bytes, key, whole) != 0) continue;
+        if ((p->nibbles & 1) && (p->bytes[whole] & 0xF0) != (key[whole] & 0xF0)) continue;
+        return true;
+    }
+    return false;
+}
 
-    dst->authors_count = src->authors_count;
-    dst->authors = copy_string_array(src->authors, src->authors_count);
-    if (src->authors_count > 0 && !dst->authors) goto fail;
+static void compile_tag_set(sub_arena_t *arena, sub_tag_set_t *set, char name,
+                            char **values, size_t count)
+{
+    set->name = name;
+    set->count = (uint32_t)count;
+    set->hashes = arena_take(arena, count * sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        set->hashes[i] = sub_index_key(SUB_KEY_TAG, name, values[i], strlen(values[i]));
+    }
+    set->count = sort_unique(set->hashes, set->count, sizeof(uint64_t), compare_u64);
+}
 
-    dst->kinds_count = src->kinds_count;
-    dst->kinds = copy_int_array(src->kinds, src->kinds_count);
-    if (src->kinds_count > 0 && !dst->kinds) goto fail;
+static void compile_filter(sub_arena_t *arena, sub_filter_t *dst, const nostr_filter_t *src)
+{
+    memset(dst, 0, sizeof(*dst));
 
-    dst->e_tags_count = src->e_tags_count;
-    dst->e_tags = copy_string_array(src->e_tags, src->e_tags_count);
-    if (src->e_tags_count > 0 && !dst->e_tags) goto fail;
+    compile_key_set(arena, &dst->ids, src->ids, src->ids_count);
+    compile_key_set(arena, &dst->authors, src->authors, src->authors_count);
 
-    dst->p_tags_count = src->p_tags_count;
-    dst->p_tags = copy_string_array(src->p_tags, src->p_tags_count);
-    if (src->p_tags_count > 0 && !dst->p_tags) goto fail;
+    if (src->kinds_count > 0) {
+        dst->has_kinds = true;
+        dst->large_kinds = arena_take(arena, src->kinds_count * sizeof(uint16_t));
+        for (size_t i = 0; i < src->kinds_count; i++) {
+            int32_t kind = src->kinds[i];
+            if (kind < 0 || kind > UINT16_MAX) continue;
+            if (kind < 256) {
+                dst->kind_bits[kind >> 3] |= (uint8_t)(1u << (kind & 7));
+            } else {
+                dst->large_kinds[dst->large_kind_count++] = (uint16_t)kind;
+            }
+        }
+        dst->large_kind_count = sort_unique(dst->large_kinds, dst->large_kind_count,
+                                            sizeof(uint16_t), compare_u16);
+    }
 
-    dst->generic_tags_count = src->generic_tags_count;
-    dst->generic_tags = copy_generic_tags(src->generic_tags, src->generic_tags_count);
-    if (src->generic_tags_count > 0 && !dst->generic_tags) goto fail;
+    size_t tag_sets = tag_set_count(src);
+    if (tag_sets > 0) {
+        dst->tags = arena_take(arena, tag_sets * sizeof(sub_tag_set_t));
+        if (src->e_tags_count > 0) {
+            compile_tag_set(arena, &dst->tags[dst->tag_count++], 'e', src->e_tags, src->e_tags_count);
+        }
+        if (src->p_tags_count > 0) {
+            compile_tag_set(arena, &dst->tags[dst->tag_count++], 'p', src->p_tags, src->p_tags_count);
+        }
+        for (size_t i = 0; i < src->generic_tags_count; i++) {
+            const nostr_generic_tag_filter_t *g = &src->generic_tags[i];
+            if (g->values_count == 0) continue;
+            compile_tag_set(arena, &dst->tags[dst->tag_count++], g->tag_name, g->values, g->values_count);
+        }
+        qsort(dst->tags, dst->tag_count, sizeof(sub_tag_set_t), compare_tag_set);
+    }
 
     dst->since = src->since;
     dst->until = src->until;
-    dst->limit = src->limit;
+}
+
+static uint64_t key_set_digest(uint64_t h, const sub_key_set_t *set)
+{
+    h = digest_mix(h, &set->active, sizeof(set->active));
+    h = digest_mix(h, &set->count, sizeof(set->count));
+    h = digest_mix(h, set->keys, (size_t)set->count * 32);
+    h = digest_mix(h, &set->prefix_count, sizeof(set->prefix_count));
+    return digest_mix(h, set->prefixes, (size_t)set->prefix_count * sizeof(sub_prefix_t));
+}
+
+static uint64_t filter_digest(const sub_filter_t *f)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = digest_mix(h, &f->since, sizeof(f->since));
+    h = digest_mix(h, &f->until, sizeof(f->until));
+    h = digest_mix(h, &f->has_kinds, sizeof(f->has_kinds));
+    h = digest_mix(h, f->kind_bits, sizeof(f->kind_bits));
+    h = digest_mix(h, &f->large_kind_count, sizeof(f->large_kind_count));
+    h = digest_mix(h, f->large_kinds, f->large_kind_count * sizeof(uint16_t));
+    h = key_set_digest(h, &f->ids);
+    h = key_set_digest(h, &f->authors);
+    for (uint8_t i = 0; i < f->tag_count; i++) {
+        h = digest_mix(h, &f->tags[i].name, 1);
+        h = digest_mix(h, &f->tags[i].count, sizeof(f->tags[i].count));
+        h = digest_mix(h, f->tags[i].hashes, f->tags[i].count * sizeof(uint64_t));
+    }
+    return h;
+}
+
+static bool key_set_equal(const sub_key_set_t *a, const sub_key_set_t *b)
+{
+    return a->active == b->active && a->count == b->count && a->prefix_count == b->prefix_count &&
+           (a->count == 0 || memcmp(a->keys, b->keys, (size_t)a->count * 32) == 0) &&
+           (a->prefix_count == 0 ||
+            memcmp(a->prefixes, b->prefixes, a->prefix_count * sizeof(sub_prefix_t)) == 0);
+}
+
+static bool filter_equal(const sub_filter_t *a, const sub_filter_t *b)
+{
+    if (a->digest != b->digest || a->since != b->since || a->until != b->until ||
+        a->has_kinds != b->has_kinds || a->large_kind_count != b->large_kind_count ||
+        a->tag_count != b->tag_count ||
+        memcmp(a->kind_bits, b->kind_bits, sizeof(a->kind_bits)) != 0 ||
+        (a->large_kind_count > 0 &&
+         memcmp(a->large_kinds, b->large_kinds, a->large_kind_count * sizeof(uint16_t)) != 0) ||
+        !key_set_equal(&a->ids, &b->ids) || !key_set_equal(&a->authors, &b->authors)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < a->tag_count; i++) {
+        const sub_tag_set_t *x = &a->tags[i], *y = &b->tags[i];
+        if (x->name != y->name || x->count != y->count ||
+            memcmp(x->hashes, y->hashes, x->count * sizeof(uint64_t)) != 0) {
+            return false;
+        }
+    }
     return true;
+}
 
-fail:
-    nostr_filter_free(dst);
+static bool filter_set_equal(const sub_filter_set_t *a, const sub_filter_set_t *b)
+{
+    if (a->digest != b->digest || a->filter_count != b->filter_count) return false;
+    for (uint8_t i = 0; i < a->filter_count; i++) {
+        if (!filter_equal(&a->filters[i], &b->filters[i])) return false;
+    }
+    return true;
+}
+
+static bool tag_set_match(const sub_tag_set_t *set, const sub_event_digest_t *digest)
+{
+    if (set->count <= digest->tag_count) {
+        for (uint32_t i = 0; i < set->count; i++) {
+            if (bsearch(&set->hashes[i], digest->tag_keys, digest->tag_count,
+                        sizeof(uint64_t), compare_u64)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (uint32_t i = 0; i < digest->tag_count; i++) {
+        if (bsearch(&digest->tag_keys[i], set->hashes, set->count, sizeof(uint64_t), compare_u64)) {
+            return true;
+        }
+    }
     return false;
 }
 
-static void free_filters(subscription_t *sub)
+static bool compiled_filter_match(const sub_filter_t *f, const sub_event_digest_t *digest)
 {
-    for (uint8_t i = 0; i < sub->filter_count; i++) {
-        nostr_filter_free(&sub->filters[i]);
+    if (f->since > 0 && digest->created_at < f->since) return false;
+    if (f->until > 0 && digest->created_at > f->until) return false;
+
+    if (f->has_kinds) {
+        uint16_t kind = digest->kind;
+        if (kind < 256) {
+            if (!(f->kind_bits[kind >> 3] & (1u << (kind & 7)))) return false;
+        } else if (f->large_kind_count == 0 ||
+                   !bsearch(&kind, f->large_kinds, f->large_kind_count, sizeof(uint16_t), compare_u16)) {
+            return false;
+        }
     }
-    sub->filter_count = 0;
+
+    if (!key_set_match(&f->ids, digest->id)) return false;
+    if (!key_set_match(&f->authors, digest->pubkey)) return false;
+
+    for (uint8_t t = 0; t < f->tag_count; t++) {
+        if (!tag_set_match(&f->tags[t], digest)) return false;
+    }
+    return true;
 }
 
-static void clear_subscription(subscription_t *sub)
+static bool filter_set_match(const sub_filter_set_t *set, const sub_event_digest_t *digest)
 {
-    free_filters(sub);
-    memset(sub, 0, sizeof(subscription_t));
+    if (set->filter_count == 0) return true;
+    for (uint8_t i = 0; i < set->filter_count; i++) {
+        if (compiled_filter_match(&set->filters[i], digest)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    uint64_t *keys;
+    uint32_t count;
+    uint32_t capacity;
+} key_list_t;
+
+static bool key_list_push(key_list_t *list, uint64_t key)
+{
+    if (list->count == list->capacity) {
+        uint32_t cap = list->capacity ? list->capacity * 2 : 32;
+        uint64_t *grown = realloc(list->keys, cap * sizeof(uint64_t));
+        if (!grown) return false;
+        list->keys = grown;
+        list->capacity = cap;
+    }
+    list->keys[list->count++] = key;
+    return true;
+}
+
+static bool collect_key_set(key_list_t *list, sub_key_class_t cls, const sub_key_set_t *set)
+{
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (!key_list_push(list, sub_index_key(cls, 0, set->keys[i], 32))) return false;
+    }
+    return true;
+}
+
+static bool collect_kind(key_list_t *list, uint32_t kind)
+{
+    return key_list_push(list, sub_index_key(SUB_KEY_KIND, 0, &kind, sizeof(kind)));
+}
+
+static bool collect_filter_keys(key_list_t *list, const sub_filter_t *f, bool *residual)
+{
+    if (f->ids.active && f->ids.prefix_count == 0) {
+        return collect_key_set(list, SUB_KEY_ID, &f->ids);
+    }
+    if (f->authors.active && f->authors.prefix_count == 0) {
+        return collect_key_set(list, SUB_KEY_AUTHOR, &f->authors);
+    }
+    if (f->tag_count > 0) {
+        const sub_tag_set_t *set = &f->tags[0];
+        for (uint32_t i = 0; i < set->count; i++) {
+            if (!key_list_push(list, set->hashes[i])) return false;
+        }
+        return true;
+    }
+    if (f->has_kinds) {
+        for (uint32_t kind = 0; kind < 256; kind++) {
+            if ((f->kind_bits[kind >> 3] & (1u << (kind & 7))) && !collect_kind(list, kind)) {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < f->large_kind_count; i++) {
+            if (!collect_kind(list, f->large_kinds[i])) return false;
+        }
+        return true;
+    }
+    *residual = true;
+    return true;
+}
+
+static bool collect_group_keys(const sub_filter_set_t *set, key_list_t *list, bool *residual)
+{
+    if (set->filter_count == 0) {
+        *residual = true;
+        return true;
+    }
+    for (uint8_t i = 0; i < set->filter_count; i++) {
+        if (!collect_filter_keys(list, &set->filters[i], residual)) return false;
+    }
+    list->count = sort_unique(list->keys, list->count, sizeof(uint64_t), compare_u64);
+    return true;
+}
+
+bool sub_event_digest_init(sub_event_digest_t *digest, const nostr_event *event)
+{
+    uint32_t kind = event->kind;
+
+    digest->id = event->id;
+    digest->pubkey = event->pubkey.data;
+    digest->kind = event->kind;
+    digest->created_at = event->created_at;
+    digest->keys = digest->inline_keys;
+    if (event->tags_count + SUB_DIGEST_FIXED_KEYS > SUB_DIGEST_INLINE_KEYS) {
+        digest->keys = malloc((event->tags_count + SUB_DIGEST_FIXED_KEYS) * sizeof(uint64_t));
+        if (!digest->keys) {
+            ESP_LOGE(TAG, "Failed to allocate digest for %zu tags", event->tags_count);
+            digest->key_count = 0;
+            digest->tag_count = 0;
+            return false;
+        }
+    }
+
+    digest->keys[0] = sub_index_key(SUB_KEY_ID, 0, event->id, 32);
+    digest->keys[1] = sub_index_key(SUB_KEY_AUTHOR, 0, event->pubkey.data, 32);
+    digest->keys[2] = sub_index_key(SUB_KEY_KIND, 0, &kind, sizeof(kind));
+    digest->tag_keys = digest->keys + SUB_DIGEST_FIXED_KEYS;
+
+    uint32_t n = 0;
+    for (size_t i = 0; i < event->tags_count; i++) {
+        const nostr_tag *tag = &event->tags[i];
+        if (tag->count < 2 || !tag->values[0] || !tag->values[1]) continue;
+        if (tag->values[0][0] == '\0' || tag->values[0][1] != '\0') continue;
+        digest->tag_keys[n++] = sub_index_key(SUB_KEY_TAG, tag->values[0][0], tag->values[1],
+                                              strlen(tag->values[1]));
+    }
+    digest->tag_count = sort_unique(digest->tag_keys, n, sizeof(uint64_t), compare_u64);
+    digest->key_count = SUB_DIGEST_FIXED_KEYS + digest->tag_count;
+    return true;
+}
+
+void sub_event_digest_free(sub_event_digest_t *digest)
+{
+    if (digest->keys != digest->inline_keys) {
+        free(digest->keys);
+    }
+    digest->keys = NULL;
+}
+
+static void *pool_realloc(sub_manager_t *mgr, void *ptr, size_t size)
+{
+    if (mgr->limits.use_psram) {
+        void *p = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (p) return p;
+    }
+    return realloc(ptr, size);
+}
+
+static void sub_release(subscription_t *sub)
+{
+    if (sub && atomic_fetch_sub(&sub->refs, 1) == 1) {
+        free(sub);
+    }
+}
+
+static void filter_set_release(sub_filter_set_t *set)
+{
+    if (set && atomic_fetch_sub(&set->refs, 1) == 1) {
+        free(set->arena);
+        free(set);
+    }
+}
+
+typedef enum {
+    SUB_OP_ADD_GROUP,
+    SUB_OP_DROP_GROUP,
+    SUB_OP_ADD_HOLDER,
+    SUB_OP_DROP_HOLDER,
+} sub_op_kind_t;
+
+typedef struct {
+    sub_op_kind_t kind;
+    uint32_t group;
+    uint32_t slot;
+    subscription_t *sub;
+    sub_filter_set_t *set;
+    key_list_t keys;
+    bool residual;
+} sub_op_t;
+
+typedef struct {
+    sub_op_t *ops;
+    uint32_t count;
+    uint32_t capacity;
+    sub_op_t inline_ops[SUB_BATCH_INLINE];
+} sub_batch_t;
+
+static void batch_init(sub_batch_t *batch)
+{
+    batch->ops = batch->inline_ops;
+    batch->count = 0;
+    batch->capacity = SUB_BATCH_INLINE;
+}
+
+static bool batch_reserve(sub_batch_t *batch, uint32_t extra)
+{
+    if (batch->count + extra <= batch->capacity) return true;
+    uint32_t capacity = batch->capacity * 2;
+    while (capacity < batch->count + extra) capacity *= 2;
+    sub_op_t *ops = malloc(capacity * sizeof(sub_op_t));
+    if (!ops) return false;
+    memcpy(ops, batch->ops, batch->count * sizeof(sub_op_t));
+    if (batch->ops != batch->inline_ops) free(batch->ops);
+    batch->ops = ops;
+    batch->capacity = capacity;
+    return true;
+}
+
+static sub_op_t *batch_push(sub_batch_t *batch, sub_op_kind_t kind, uint32_t group)
+{
+    sub_op_t *op = &batch->ops[batch->count++];
+    memset(op, 0, sizeof(sub_op_t));
+    op->kind = kind;
+    op->group = group;
+    return op;
+}
+
+static bool view_grow(sub_manager_t *mgr, sub_view_t *view, uint32_t capacity)
+{
+    if (capacity <= view->group_capacity) return true;
+
+    sub_filter_set_t **sets = pool_realloc(mgr, view->sets, capacity * sizeof(sub_filter_set_t *));
+    if (!sets) return false;
+    view->sets = sets;
+    uint32_t *group_head = pool_realloc(mgr, view->group_head, capacity * sizeof(uint32_t));
+    if (!group_head) return false;
+    view->group_head = group_head;
+    uint32_t *holder_next = pool_realloc(mgr, view->holder_next, capacity * sizeof(uint32_t));
+    if (!holder_next) return false;
+    view->holder_next = holder_next;
+    subscription_t **holders = pool_realloc(mgr, view->holders, capacity * sizeof(subscription_t *));
+    if (!holders) return false;
+    view->holders = holders;
+    if (!sub_index_grow(&view->index, capacity)) return false;
+
+    for (uint32_t i = view->group_capacity; i < capacity; i++) {
+        sets[i] = NULL;
+        group_head[i] = SUB_SLOT_NONE;
+        holder_next[i] = SUB_SLOT_NONE;
+        holders[i] = NULL;
+    }
+    view->group_capacity = capacity;
+    return true;
+}
+
+static void view_destroy(sub_view_t *view)
+{
+    sub_index_destroy(&view->index);
+    free(view->sets);
+    free(view->group_head);
+    free(view->holder_next);
+    free(view->holders);
+    memset(view, 0, sizeof(sub_view_t));
+}
+
+static void view_apply(sub_view_t *view, const sub_batch_t *batch)
+{
+    for (uint32_t i = 0; i < batch->count; i++) {
+        const sub_op_t *op = &batch->ops[i];
+        uint32_t *link;
+        switch (op->kind) {
+            case SUB_OP_ADD_GROUP:
+                view->sets[op->group] = op->set;
+                view->group_head[op->group] = SUB_SLOT_NONE;
+                for (uint32_t k = 0; k < op->keys.count; k++) {
+                    sub_index_add_key(&view->index, op->group, op->keys.keys[k]);
+                }
+                if (op->residual) {
+                    sub_index_add_residual(&view->index, op->group);
+                }
+                break;
+            case SUB_OP_DROP_GROUP:
+                sub_index_remove(&view->index, op->group);
+                view->sets[op->group] = NULL;
+                break;
+            case SUB_OP_ADD_HOLDER:
+                view->holders[op->slot] = op->sub;
+                view->holder_next[op->slot] = view->group_head[op->group];
+                view->group_head[op->group] = op->slot;
+                break;
+            case SUB_OP_DROP_HOLDER:
+                link = &view->group_head[op->group];
+                while (*link != op->slot) link = &view->holder_next[*link];
+                *link = view->holder_next[op->slot];
+                view->holders[op->slot] = NULL;
+                break;
+        }
+    }
+}
+
+static sub_view_t *standby_view(sub_manager_t *mgr)
+{
+    return &mgr->views[1 - atomic_load(&mgr->active)];
+}
+
+// Readers only ever enter the active view. Flipping waits until the old one
+// has drained, after which the writer owns it until the next flip.
+static void views_flip(sub_manager_t *mgr)
+{
+    int old = atomic_load(&mgr->active);
+    atomic_store(&mgr->active, 1 - old);
+    while (atomic_load(&mgr->readers[old]) > 0) {
+        vTaskDelay(1);
+    }
+}
+
+static const sub_view_t *view_enter(sub_manager_t *mgr, int *which)
+{
+    for (;;) {
+        int i = atomic_load(&mgr->active);
+        atomic_fetch_add(&mgr->readers[i], 1);
+        if (atomic_load(&mgr->active) == i) {
+            *which = i;
+            return &mgr->views[i];
+        }
+        atomic_fetch_sub(&mgr->readers[i], 1);
+    }
+}
+
+static void view_leave(sub_manager_t *mgr, int which)
+{
+    atomic_fetch_sub(&mgr->readers[which], 1);
+}
+
+static bool views_grow(sub_manager_t *mgr, uint32_t capacity)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        if (!view_grow(mgr, standby_view(mgr), capacity)) return false;
+        views_flip(mgr);
+    }
+    return true;
+}
+
+// Both views must be able to take the postings before a batch touches
+// either, so that applying it to the second one cannot fail half way.
+static bool views_reserve(sub_manager_t *mgr, uint32_t postings)
+{
+    if (!sub_index_reserve(&standby_view(mgr)->index, postings)) return false;
+    const sub_index_t *live = &mgr->views[atomic_load(&mgr->active)].index;
+    if (live->posting_capacity - live->live_postings >= postings) return true;
+    views_flip(mgr);
+    return sub_index_reserve(&standby_view(mgr)->index, postings);
+}
+
+static void batch_commit(sub_manager_t *mgr, sub_batch_t *batch)
+{
+    if (batch->count > 0) {
+        view_apply(standby_view(mgr), batch);
+        views_flip(mgr);
+        view_apply(standby_view(mgr), batch);
+    }
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        sub_op_t *op = &batch->ops[i];
+        if (op->kind == SUB_OP_DROP_HOLDER) sub_release(op->sub);
+        if (op->kind == SUB_OP_DROP_GROUP) filter_set_release(op->set);
+        free(op->keys.keys);
+    }
+    if (batch->ops != batch->inline_ops) free(batch->ops);
+    batch_init(batch);
+}
+
+static uint32_t slot_hash(int conn_fd, const char *sub_id)
+{
+    uint32_t h = 2166136261u ^ (uint32_t)conn_fd;
+    for (const char *p = sub_id; *p; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t conn_hash(int conn_fd)
+{
+    return (uint32_t)conn_fd * 2654435761u;
+}
+
+static uint32_t *id_bucket(sub_manager_t *mgr, int conn_fd, const char *sub_id)
+{
+    return &mgr->id_buckets[slot_hash(conn_fd, sub_id) & (mgr->bucket_count - 1)];
+}
+
+static uint32_t *conn_bucket(sub_manager_t *mgr, int conn_fd)
+{
+    return &mgr->conn_buckets[conn_hash(conn_fd) & (mgr->bucket_count - 1)];
 }
 
-esp_err_t sub_manager_init(sub_manager_t *mgr)
+static uint32_t *group_bucket(sub_manager_t *mgr, uint64_t digest)
+{
+    return &mgr->group_buckets[(uint32_t)(digest ^ (digest >> 32)) & (mgr->bucket_count - 1)];
+}
+
+static void link_slot(sub_manager_t *mgr, uint32_t slot)
+{
+    sub_slot_t *s = &mgr->slots[slot];
+    uint32_t *head = id_bucket(mgr, s->sub->conn_fd, s->sub->sub_id);
+    s->id_next = *head;
+    *head = slot;
+    head = conn_bucket(mgr, s->sub->conn_fd);
+    s->conn_next = *head;
+    *head = slot;
+}
+
+static void unlink_slot(sub_manager_t *mgr, uint32_t slot)
+{
+    const subscription_t *sub = mgr->slots[slot].sub;
+
+    uint32_t *link = id_bucket(mgr, sub->conn_fd, sub->sub_id);
+    while (*link != slot) link = &mgr->slots[*link].id_next;
+    *link = mgr->slots[slot].id_next;
+
+    link = conn_bucket(mgr, sub->conn_fd);
+    while (*link != slot) link = &mgr->slots[*link].conn_next;
+    *link = mgr->slots[slot].conn_next;
+}
+
+static void link_group(sub_manager_t *mgr, uint32_t group)
+{
+    uint32_t *head = group_bucket(mgr, mgr->groups[group].set->digest);
+    mgr->groups[group].hash_next = *head;
+    *head = group;
+}
+
+static void unlink_group(sub_manager_t *mgr, uint32_t group)
+{
+    uint32_t *link = group_bucket(mgr, mgr->groups[group].set->digest);
+    while (*link != group) link = &mgr->groups[*link].hash_next;
+    *link = mgr->groups[group].hash_next;
+}
+
+static bool rehash_links(sub_manager_t *mgr, uint32_t capacity)
+{
+    uint32_t bucket_count = SUB_POOL_INITIAL;
+    while (bucket_count < capacity) bucket_count <<= 1;
+    if (bucket_count == mgr->bucket_count) return true;
+
+    size_t size = bucket_count * sizeof(uint32_t);
+    uint32_t *id_buckets = pool_realloc(mgr, NULL, size);
+    uint32_t *conn_buckets = pool_realloc(mgr, NULL, size);
+    uint32_t *group_buckets = pool_realloc(mgr, NULL, size);
+    if (!id_buckets || !conn_buckets || !group_buckets) {
+        free(id_buckets);
+        free(conn_buckets);
+        free(group_buckets);
+        return false;
+    }
+    free(mgr->id_buckets);
+    free(mgr->conn_buckets);
+    free(mgr->group_buckets);
+    mgr->id_buckets = id_buckets;
+    mgr->conn_buckets = conn_buckets;
+    mgr->group_buckets = group_buckets;
+    mgr->bucket_count = bucket_count;
+    memset(id_buckets, 0xff, size);
+    memset(conn_buckets, 0xff, size);
+    memset(group_buckets, 0xff, size);
+
+    for (uint32_t i = 0; i < mgr->capacity; i++) {
+        if (mgr->slots[i].sub) link_slot(mgr, i);
+        if (mgr->groups[i].set) link_group(mgr, i);
+    }
+    return true;
+}
+
+static bool grow_pool(sub_manager_t *mgr)
+{
+    if (mgr->capacity >= mgr->limits.max_total) return false;
+
+    uint32_t capacity = mgr->capacity ? mgr->capacity * 2 : SUB_POOL_INITIAL;
+    if (capacity > mgr->limits.max_total) capacity = mgr->limits.max_total;
+
+    sub_slot_t *slots = pool_realloc(mgr, mgr->slots, capacity * sizeof(sub_slot_t));
+    if (!slots) return false;
+    mgr->slots = slots;
+    memset(&slots[mgr->capacity], 0, (capacity - mgr->capacity) * sizeof(sub_slot_t));
+
+    sub_group_t *groups = pool_realloc(mgr, mgr->groups, capacity * sizeof(sub_group_t));
+    if (!groups) return false;
+    mgr->groups = groups;
+    memset(&groups[mgr->capacity], 0, (capacity - mgr->capacity) * sizeof(sub_group_t));
+
+    if (!views_grow(mgr, capacity) || !rehash_links(mgr, capacity)) return false;
+
+    for (uint32_t i = capacity; i > mgr->capacity; i--) {
+        slots[i - 1].id_next = mgr->free_slot;
+        mgr->free_slot = i - 1;
+        groups[i - 1].hash_next = mgr->free_group;
+        mgr->free_group = i - 1;
+    }
+
+    ESP_LOGI(TAG, "Subscription pool grown %" PRIu32 " -> %" PRIu32, mgr->capacity, capacity);
+    mgr->capacity = capacity;
+    return true;
+}
+
+esp_err_t sub_manager_init(sub_manager_t *mgr, const sub_limits_t *limits)
 {
     memset(mgr, 0, sizeof(sub_manager_t));
+    mgr->limits = *limits;
+    mgr->free_slot = SUB_SLOT_NONE;
+    mgr->free_group = SUB_SLOT_NONE;
+    if (mgr->limits.max_total == 0) mgr->limits.max_total = 1;
+    if (mgr->limits.max_per_conn == 0) mgr->limits.max_per_conn = 1;
+
+    atomic_init(&mgr->active, 0);
+    atomic_init(&mgr->readers[0], 0);
+    atomic_init(&mgr->readers[1], 0);
+
     mgr->lock = xSemaphoreCreateMutex();
-    if (!mgr->lock) return ESP_ERR_NO_MEM;
-    ESP_LOGI(TAG, "Initialized (max=%d, per_conn=%d)", SUB_MAX_TOTAL, SUB_MAX_PER_CONN);
+    if (!mgr->lock) {
+        sub_manager_destroy(mgr);
+        return ESP_ERR_NO_MEM;
+    }
+    if (!sub_index_init(&mgr->views[0].index, SUB_POOL_INITIAL, mgr->limits.use_psram) ||
+        !sub_index_init(&mgr->views[1].index, SUB_POOL_INITIAL, mgr->limits.use_psram) || !grow_pool(mgr)) {
+        sub_manager_destroy(mgr);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Initialized (max=%" PRIu32 ", per_conn=%u, psram=%d)",
+             mgr->limits.max_total, mgr->limits.max_per_conn, mgr->limits.use_psram);
     return ESP_OK;
 }
 
 void sub_manager_destroy(sub_manager_t *mgr)
 {
     if (!mgr) return;
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (mgr->subs[i].active) {
-            clear_subscription(&mgr->subs[i]);
-        }
+    for (uint32_t i = 0; i < mgr->capacity; i++) {
+        sub_release(mgr->slots[i].sub);
+        filter_set_release(mgr->groups[i].set);
     }
+    view_destroy(&mgr->views[0]);
+    view_destroy(&mgr->views[1]);
+    free(mgr->slots);
+    free(mgr->groups);
+    free(mgr->id_buckets);
+    free(mgr->conn_buckets);
+    free(mgr->group_buckets);
     if (mgr->lock) {
         vSemaphoreDelete(mgr->lock);
-        mgr->lock = NULL;
     }
+    memset(mgr, 0, sizeof(sub_manager_t));
 }
 
-static subscription_t *sub_manager_find(sub_manager_t *mgr, int conn_fd, const char *sub_id)
+void sub_manager_set_limits(sub_manager_t *mgr, uint32_t max_total, uint16_t max_per_conn)
 {
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (mgr->subs[i].active &&
-            mgr->subs[i].conn_fd == conn_fd &&
-            strcmp(mgr->subs[i].sub_id, sub_id) == 0) {
-            return &mgr->subs[i];
+    xSemaphoreTake(mgr->lock, portMAX_DELAY);
+    mgr->limits.max_total = max_total > 0 ? max_total : 1;
+    mgr->limits.max_per_conn = max_per_conn > 0 ? max_per_conn : 1;
+    xSemaphoreGive(mgr->lock);
+    ESP_LOGI(TAG, "Limits set (max=%" PRIu32 ", per_conn=%u)", max_total, max_per_conn);
+}
+
+static int32_t find_slot(sub_manager_t *mgr, int conn_fd, const char *sub_id)
+{
+    for (uint32_t i = *id_bucket(mgr, conn_fd, sub_id); i != SUB_SLOT_NONE; i = mgr->slots[i].id_next) {
+        const subscription_t *sub = mgr->slots[i].sub;
+        if (sub->conn_fd == conn_fd && strcmp(sub->sub_id, sub_id) == 0) {
+            return (int32_t)i;
         }
     }
-    return NULL;
+    return -1;
 }
 
-static subscription_t *find_free_slot(sub_manager_t *mgr)
+static uint32_t conn_count(sub_manager_t *mgr, int conn_fd)
 {
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (!mgr->subs[i].active) return &mgr->subs[i];
+    uint32_t count = 0;
+    for (uint32_t i = *conn_bucket(mgr, conn_fd); i != SUB_SLOT_NONE; i = mgr->slots[i].conn_next) {
+        if (mgr->slots[i].sub->conn_fd == conn_fd) count++;
     }
-    return NULL;
+    return count;
 }
 
-static bool copy_filters_to_slot(subscription_t *slot, const nostr_filter_t *filters,
-                                 size_t filter_count)
+static int32_t find_free_slot(sub_manager_t *mgr)
 {
+    if (mgr->active_count >= mgr->limits.max_total) return -1;
+    if (mgr->free_slot == SUB_SLOT_NONE && !grow_pool(mgr)) return -1;
+    uint32_t slot = mgr->free_slot;
+    mgr->free_slot = mgr->slots[slot].id_next;
+    return (int32_t)slot;
+}
+
+static subscription_t *create_subscription(sub_manager_t *mgr, int conn_fd, const char *sub_id)
+{
+    subscription_t *sub = pool_realloc(mgr, NULL, sizeof(subscription_t));
+    if (!sub) return NULL;
+    memset(sub, 0, sizeof(subscription_t));
+    strncpy(sub->sub_id, sub_id, SUB_MAX_ID_LEN);
+    sub->sub_id[SUB_MAX_ID_LEN] = '\0';
+    sub->conn_fd = conn_fd;
+    atomic_init(&sub->refs, 1);
+    return sub;
+}
+
+static sub_filter_set_t *create_filter_set(sub_manager_t *mgr, const nostr_filter_t *filters,
+                                           size_t filter_count)
+{
+    sub_filter_set_t *set = pool_realloc(mgr, NULL, sizeof(sub_filter_set_t));
+    if (!set) return NULL;
+    memset(set, 0, sizeof(sub_filter_set_t));
+    atomic_init(&set->refs, 1);
+
+    size_t size = 0;
     for (size_t i = 0; i < filter_count; i++) {
-        if (!filter_copy(&slot->filters[i], &filters[i])) {
-            for (size_t j = 0; j < i; j++) {
-                nostr_filter_free(&slot->filters[j]);
-            }
-            return false;
+        size += filter_arena_size(&filters[i]);
+    }
+
+    sub_arena_t arena = {0};
+    if (size > 0) {
+        arena.base = pool_realloc(mgr, NULL, size);
+        if (!arena.base) {
+            free(set);
+            return NULL;
         }
     }
-    slot->filter_count = (uint8_t)filter_count;
-    return true;
+
+    for (size_t i = 0; i < filter_count; i++) {
+        compile_filter(&arena, &set->filters[i], &filters[i]);
+        set->filters[i].digest = filter_digest(&set->filters[i]);
+    }
+    set->arena = arena.base;
+    set->filter_count = (uint8_t)filter_count;
+    qsort(set->filters, set->filter_count, sizeof(sub_filter_t), compare_filter);
+
+    set->digest = digest_mix(0xcbf29ce484222325ULL, &set->filter_count, 1);
+    for (uint8_t i = 0; i < set->filter_count; i++) {
+        set->digest = digest_mix(set->digest, &set->filters[i].digest, sizeof(uint64_t));
+    }
+    return set;
+}
+
+static uint32_t attach_group(sub_manager_t *mgr, sub_filter_set_t *set, sub_batch_t *batch)
+{
+    for (uint32_t g = *group_bucket(mgr, set->digest); g != SUB_SLOT_NONE; g = mgr->groups[g].hash_next) {
+        if (filter_set_equal(mgr->groups[g].set, set)) {
+            filter_set_release(set);
+            return g;
+        }
+    }
+
+    uint32_t g = mgr->free_group;
+    key_list_t keys = {0};
+    bool residual = false;
+    if (g == SUB_SLOT_NONE || !collect_group_keys(set, &keys, &residual) ||
+        !views_reserve(mgr, keys.count)) {
+        free(keys.keys);
+        filter_set_release(set);
+        return SUB_SLOT_NONE;
+    }
+
+    sub_op_t *op = batch_push(batch, SUB_OP_ADD_GROUP, g);
+    op->set = set;
+    op->keys = keys;
+    op->residual = residual;
+
+    mgr->free_group = mgr->groups[g].hash_next;
+    mgr->groups[g].set = set;
+    mgr->groups[g].head = SUB_SLOT_NONE;
+    mgr->groups[g].holders = 0;
+    link_group(mgr, g);
+    mgr->group_count++;
+    return g;
+}
+
+static void detach_group(sub_manager_t *mgr, uint32_t slot, sub_batch_t *batch)
+{
+    uint32_t g = mgr->slots[slot].group;
+    sub_group_t *group = &mgr->groups[g];
+
+    uint32_t *link = &group->head;
+    while (*link != slot) link = &mgr->slots[*link].group_next;
+    *link = mgr->slots[slot].group_next;
+
+    if (--group->holders > 0) return;
+
+    batch_push(batch, SUB_OP_DROP_GROUP, g)->set = group->set;
+    unlink_group(mgr, g);
+    group->set = NULL;
+    group->hash_next = mgr->free_group;
+    mgr->free_group = g;
+    mgr->group_count--;
+}
+
+static void fill_slot(sub_manager_t *mgr, uint32_t slot, subscription_t *sub, uint32_t group,
+                      sub_batch_t *batch)
+{
+    sub_op_t *op = batch_push(batch, SUB_OP_ADD_HOLDER, group);
+    op->slot = slot;
+    op->sub = sub;
+
+    sub_slot_t *s = &mgr->slots[slot];
+    s->sub = sub;
+    s->group = group;
+    s->group_next = mgr->groups[group].head;
+    mgr->groups[group].head = slot;
+    mgr->groups[group].holders++;
+    link_slot(mgr, slot);
+    mgr->active_count++;
+}
+
+// The slot's subscription and, for the last holder, the group's filter set
+// stay alive until the batch has been committed to both views.
+static void clear_slot(sub_manager_t *mgr, uint32_t slot, sub_batch_t *batch)
+{
+    sub_op_t *op = batch_push(batch, SUB_OP_DROP_HOLDER, mgr->slots[slot].group);
+    op->slot = slot;
+    op->sub = mgr->slots[slot].sub;
+
+    detach_group(mgr, slot, batch);
+    unlink_slot(mgr, slot);
+    mgr->slots[slot].sub = NULL;
+    mgr->slots[slot].id_next = mgr->free_slot;
+    mgr->free_slot = slot;
+    mgr->active_count--;
 }
 
 nostr_relay_error_t sub_manager_add(sub_manager_t *mgr, int conn_fd,
@@ -170,73 +1072,82 @@ nostr_relay_error_t sub_manager_add(sub_manager_t *mgr, int conn_fd,
         filter_count = SUB_MAX_FILTERS;
     }
 
-    xSemaphoreTake(mgr->lock, portMAX_DELAY);
-
-    subscription_t *existing = sub_manager_find(mgr, conn_fd, sub_id);
-    if (existing) {
-        free_filters(existing);
-        existing->events_sent = 0;
-        if (!copy_filters_to_slot(existing, filters, filter_count)) {
-            xSemaphoreGive(mgr->lock);
-            return NOSTR_RELAY_ERR_MEMORY;
-        }
-        ESP_LOGD(TAG, "Updated sub=%s fd=%d filters=%zu", sub_id, conn_fd, filter_count);
-        xSemaphoreGive(mgr->lock);
-        return NOSTR_RELAY_OK;
+    subscription_t *sub = create_subscription(mgr, conn_fd, sub_id);
+    sub_filter_set_t *set = create_filter_set(mgr, filters, filter_count);
+    if (!sub || !set) {
+        sub_release(sub);
+        filter_set_release(set);
+        return NOSTR_RELAY_ERR_MEMORY;
     }
 
-    uint8_t conn_count = 0;
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (mgr->subs[i].active && mgr->subs[i].conn_fd == conn_fd) {
-            conn_count++;
-        }
-    }
-    if (conn_count >= SUB_MAX_PER_CONN) {
+    sub_batch_t batch;
+    batch_init(&batch);
+
+    xSemaphoreTake(mgr->lock, portMAX_DELAY);
+
+    int32_t slot = find_slot(mgr, conn_fd, sub_id);
+    bool updated = slot >= 0;
+    if (updated) {
+        clear_slot(mgr, (uint32_t)slot, &batch);
+    } else if (conn_count(mgr, conn_fd) >= mgr->limits.max_per_conn) {
         ESP_LOGW(TAG, "Too many subs for fd=%d", conn_fd);
         xSemaphoreGive(mgr->lock);
+        sub_release(sub);
+        filter_set_release(set);
         return NOSTR_RELAY_ERR_TOO_MANY_FILTERS;
     }
 
-    subscription_t *slot = find_free_slot(mgr);
-    if (!slot) {
-        ESP_LOGW(TAG, "No free slots");
-        xSemaphoreGive(mgr->lock);
-        return NOSTR_RELAY_ERR_MEMORY;
+    slot = find_free_slot(mgr);
+    if (slot < 0) {
+        ESP_LOGW(TAG, "No free slots (active=%" PRIu32 ")", mgr->active_count);
+        goto fail;
     }
 
-    memset(slot, 0, sizeof(subscription_t));
-    strncpy(slot->sub_id, sub_id, SUB_MAX_ID_LEN);
-    slot->sub_id[SUB_MAX_ID_LEN] = '\0';
-    slot->conn_fd = conn_fd;
-
-    if (!copy_filters_to_slot(slot, filters, filter_count)) {
-        clear_subscription(slot);
-        xSemaphoreGive(mgr->lock);
-        return NOSTR_RELAY_ERR_MEMORY;
+    uint32_t group = attach_group(mgr, set, &batch);
+    set = NULL;
+    if (group == SUB_SLOT_NONE) {
+        mgr->slots[slot].id_next = mgr->free_slot;
+        mgr->free_slot = (uint32_t)slot;
+        goto fail;
     }
-    slot->active = true;
-    mgr->active_count++;
 
-    ESP_LOGI(TAG, "Added sub=%s fd=%d filters=%zu total=%d",
-             sub_id, conn_fd, filter_count, mgr->active_count);
+    fill_slot(mgr, (uint32_t)slot, sub, group, &batch);
+    batch_commit(mgr, &batch);
+
+    if (updated) {
+        ESP_LOGD(TAG, "Updated sub=%s fd=%d filters=%zu", sub_id, conn_fd, filter_count);
+    } else {
+        ESP_LOGI(TAG, "Added sub=%s fd=%d filters=%zu total=%" PRIu32 " distinct=%" PRIu32,
+                 sub_id, conn_fd, filter_count, mgr->active_count, mgr->group_count);
+    }
 
     xSemaphoreGive(mgr->lock);
     return NOSTR_RELAY_OK;
+
+fail:
+    batch_commit(mgr, &batch);
+    xSemaphoreGive(mgr->lock);
+    sub_release(sub);
+    filter_set_release(set);
+    return NOSTR_RELAY_ERR_MEMORY;
 }
 
 nostr_relay_error_t sub_manager_remove(sub_manager_t *mgr, int conn_fd, const char *sub_id)
 {
+    sub_batch_t batch;
+    batch_init(&batch);
+
     xSemaphoreTake(mgr->lock, portMAX_DELAY);
 
-    subscription_t *sub = sub_manager_find(mgr, conn_fd, sub_id);
-    if (!sub) {
+    int32_t slot = find_slot(mgr, conn_fd, sub_id);
+    if (slot < 0) {
         xSemaphoreGive(mgr->lock);
         return NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID;
     }
 
-    clear_subscription(sub);
-    mgr->active_count--;
-    ESP_LOGD(TAG, "Removed sub=%s fd=%d remaining=%d", sub_id, conn_fd, mgr->active_count);
+    clear_slot(mgr, (uint32_t)slot, &batch);
+    batch_commit(mgr, &batch);
+    ESP_LOGD(TAG, "Removed sub=%s fd=%d remaining=%" PRIu32, sub_id, conn_fd, mgr->active_count);
 
     xSemaphoreGive(mgr->lock);
     return NOSTR_RELAY_OK;
@@ -244,16 +1155,27 @@ nostr_relay_error_t sub_manager_remove(sub_manager_t *mgr, int conn_fd, const ch
 
 void sub_manager_remove_all(sub_manager_t *mgr, int conn_fd)
 {
+    sub_batch_t batch;
+    batch_init(&batch);
+
     xSemaphoreTake(mgr->lock, portMAX_DELAY);
 
+    batch_reserve(&batch, conn_count(mgr, conn_fd) * 2);
+
     int removed = 0;
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (mgr->subs[i].active && mgr->subs[i].conn_fd == conn_fd) {
-            clear_subscription(&mgr->subs[i]);
-            mgr->active_count--;
+    uint32_t i = *conn_bucket(mgr, conn_fd);
+    while (i != SUB_SLOT_NONE) {
+        uint32_t next = mgr->slots[i].conn_next;
+        if (mgr->slots[i].sub->conn_fd == conn_fd) {
+            if (!batch_reserve(&batch, 2)) {
+                batch_commit(mgr, &batch);
+            }
+            clear_slot(mgr, i, &batch);
             removed++;
         }
+        i = next;
     }
+    batch_commit(mgr, &batch);
 
     if (removed > 0) {
         ESP_LOGI(TAG, "Removed %d subs for fd=%d", removed, conn_fd);
@@ -262,39 +1184,96 @@ void sub_manager_remove_all(sub_manager_t *mgr, int conn_fd)
     xSemaphoreGive(mgr->lock);
 }
 
-void sub_manager_match(sub_manager_t *mgr, const nostr_event *event,
+static bool reserve_match(sub_match_result_t *result, uint32_t extra)
+{
+    if (result->count + extra <= result->capacity) return true;
+    uint32_t capacity = result->capacity ? result->capacity : SUB_MATCH_INITIAL;
+    while (capacity < result->count + extra) capacity *= 2;
+    sub_match_entry_t *grown = realloc(result->matches, capacity * sizeof(sub_match_entry_t));
+    if (!grown) return false;
+    result->matches = grown;
+    result->capacity = capacity;
+    return true;
+}
+
+// Scratch lives in the result so a caller that keeps its result across
+// events stops allocating once it has grown to the view's group capacity
+static bool reserve_scratch(sub_match_result_t *result, uint32_t groups)
+{
+    if (groups <= result->scratch_capacity) return true;
+    uint8_t *seen = realloc(result->seen, (groups + 7) / 8);
+    if (!seen) return false;
+    result->seen = seen;
+    uint32_t *candidates = realloc(result->candidates, groups * sizeof(uint32_t));
+    if (!candidates) return false;
+    result->candidates = candidates;
+    result->scratch_capacity = groups;
+    return true;
+}
+
+void sub_match_result_free(sub_match_result_t *result)
+{
+    free(result->matches);
+    free(result->seen);
+    free(result->candidates);
+    memset(result, 0, sizeof(*result));
+}
+
+void sub_manager_match(sub_manager_t *mgr, const sub_event_digest_t *digest,
                        sub_match_result_t *result)
 {
     result->count = 0;
 
-    xSemaphoreTake(mgr->lock, portMAX_DELAY);
+    int which;
+    const sub_view_t *view = view_enter(mgr, &which);
 
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        subscription_t *sub = &mgr->subs[i];
-        if (!sub->active) continue;
+    uint8_t inline_seen[SUB_MATCH_INLINE / 8];
+    uint32_t inline_candidates[SUB_MATCH_INLINE];
+    uint8_t *seen = inline_seen;
+    uint32_t *candidates = inline_candidates;
+    if (view->group_capacity > SUB_MATCH_INLINE) {
+        if (!reserve_scratch(result, view->group_capacity)) {
+            ESP_LOGE(TAG, "Failed to allocate match scratch for %" PRIu32 " filters",
+                     view->group_capacity);
+            goto release;
+        }
+        seen = result->seen;
+        candidates = result->candidates;
+    }
+    memset(seen, 0, (view->group_capacity + 7) / 8);
+
+    uint32_t candidate_count = sub_index_candidates(&view->index, digest->keys, digest->key_count,
+                                                    seen, candidates, view->group_capacity);
 
-        if (nostr_filters_match(sub->filters, sub->filter_count, event)) {
+    for (uint32_t i = 0; i < candidate_count; i++) {
+        uint32_t g = candidates[i];
+        const sub_filter_set_t *set = view->sets[g];
+        if (!set || !filter_set_match(set, digest)) {
+            continue;
+        }
+
+        for (uint32_t h = view->group_head[g]; h != SUB_SLOT_NONE; h = view->holder_next[h]) {
+            if (!reserve_match(result, 1)) {
+                ESP_LOGE(TAG, "Match result full at %" PRIu32 " entries", result->count);
+                goto release;
+            }
+            const subscription_t *sub = view->holders[h];
             sub_match_entry_t *entry = &result->matches[result->count++];
             entry->conn_fd = sub->conn_fd;
             memcpy(entry->sub_id, sub->sub_id, sizeof(entry->sub_id));
         }
     }
 
-    xSemaphoreGive(mgr->lock);
-    ESP_LOGD(TAG, "Event matched %d subs", result->count);
+release:
+    view_leave(mgr, which);
+    ESP_LOGD(TAG, "Event matched %" PRIu32 " subs", result->count);
 }
 
 uint8_t sub_manager_count(sub_manager_t *mgr, int conn_fd)
 {
-    uint8_t count = 0;
-
     xSemaphoreTake(mgr->lock, portMAX_DELAY);
-    for (int i = 0; i < SUB_MAX_TOTAL; i++) {
-        if (mgr->subs[i].active && mgr->subs[i].conn_fd == conn_fd) {
-            count++;
-        }
-    }
+    uint32_t count = conn_count(mgr, conn_fd);
     xSemaphoreGive(mgr->lock);
 
-    return count;
+    return (uint8_t)count;
 }
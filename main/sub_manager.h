@@ -1,45 +1,145 @@
 #ifndef SUB_MANAGER_H
 #define SUB_MANAGER_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "nostr_relay_protocol.h"
+#include "sub_index.h"
 
-#define SUB_MAX_TOTAL         64
-#define SUB_MAX_PER_CONN      8
-#define SUB_MAX_FILTERS       4
-#define SUB_MAX_ID_LEN        64
+#define SUB_MAX_FILTERS        4
+#define SUB_MAX_ID_LEN         64
+#define SUB_DIGEST_FIXED_KEYS  3
+#define SUB_DIGEST_INLINE_KEYS 32
+
+typedef struct {
+    uint8_t bytes[32];
+    uint8_t nibbles;
+} sub_prefix_t;
+
+typedef struct {
+    uint8_t (*keys)[32];
+    uint32_t count;
+    sub_prefix_t *prefixes;
+    uint32_t prefix_count;
+    bool active;
+} sub_key_set_t;
+
+typedef struct {
+    char name;
+    uint32_t count;
+    uint64_t *hashes;
+} sub_tag_set_t;
+
+typedef struct {
+    sub_key_set_t ids;
+    sub_key_set_t authors;
+    uint8_t kind_bits[32];
+    uint16_t *large_kinds;
+    uint32_t large_kind_count;
+    bool has_kinds;
+    int64_t since;
+    int64_t until;
+    sub_tag_set_t *tags;
+    uint8_t tag_count;
+    uint64_t digest;
+} sub_filter_t;
+
+typedef struct {
+    sub_filter_t filters[SUB_MAX_FILTERS];
+    uint8_t filter_count;
+    uint64_t digest;
+    void *arena;
+    atomic_int refs;
+} sub_filter_set_t;
 
 typedef struct {
     char sub_id[SUB_MAX_ID_LEN + 1];
     int conn_fd;
-    nostr_filter_t filters[SUB_MAX_FILTERS];
-    uint8_t filter_count;
-    uint16_t events_sent;
-    bool active;
+    atomic_int refs;
 } subscription_t;
 
+typedef struct {
+    subscription_t *sub;
+    uint32_t group;
+    uint32_t id_next;
+    uint32_t conn_next;
+    uint32_t group_next;
+} sub_slot_t;
+
+typedef struct {
+    sub_filter_set_t *set;
+    uint32_t head;
+    uint32_t holders;
+    uint32_t hash_next;
+} sub_group_t;
+
+typedef struct {
+    sub_index_t index;
+    sub_filter_set_t **sets;
+    uint32_t *group_head;
+    uint32_t *holder_next;
+    subscription_t **holders;
+    uint32_t group_capacity;
+} sub_view_t;
+
+typedef struct {
+    uint32_t max_total;
+    uint16_t max_per_conn;
+    bool use_psram;
+} sub_limits_t;
+
 typedef struct sub_manager {
-    subscription_t subs[SUB_MAX_TOTAL];
+    sub_slot_t *slots;
+    sub_group_t *groups;
+    uint32_t *id_buckets;
+    uint32_t *conn_buckets;
+    uint32_t *group_buckets;
+    uint32_t bucket_count;
+    uint32_t free_slot;
+    uint32_t free_group;
+    uint32_t capacity;
+    sub_limits_t limits;
+    sub_view_t views[2];
+    atomic_int active;
+    atomic_int readers[2];
     SemaphoreHandle_t lock;
-    uint16_t active_count;
+    uint32_t active_count;
+    uint32_t group_count;
 } sub_manager_t;
 
+typedef struct {
+    const uint8_t *id;
+    const uint8_t *pubkey;
+    uint16_t kind;
+    int64_t created_at;
+    uint64_t *keys;
+    uint32_t key_count;
+    uint64_t *tag_keys;
+    uint32_t tag_count;
+    uint64_t inline_keys[SUB_DIGEST_INLINE_KEYS];
+} sub_event_digest_t;
+
 typedef struct {
     int conn_fd;
     char sub_id[SUB_MAX_ID_LEN + 1];
 } sub_match_entry_t;
 
 typedef struct {
-    sub_match_entry_t matches[SUB_MAX_TOTAL];
-    uint8_t count;
+    sub_match_entry_t *matches;
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t *seen;
+    uint32_t *candidates;
+    uint32_t scratch_capacity;
 } sub_match_result_t;
 
-esp_err_t sub_manager_init(sub_manager_t *mgr);
+esp_err_t sub_manager_init(sub_manager_t *mgr, const sub_limits_t *limits);
 void sub_manager_destroy(sub_manager_t *mgr);
+void sub_manager_set_limits(sub_manager_t *mgr, uint32_t max_total, uint16_t max_per_conn);
 
 nostr_relay_error_t sub_manager_add(sub_manager_t *mgr, int conn_fd,
                                     const char *sub_id,
@@ -51,8 +151,12 @@ nostr_relay_error_t sub_manager_remove(sub_manager_t *mgr, int conn_fd,
 
 void sub_manager_remove_all(sub_manager_t *mgr, int conn_fd);
 
-void sub_manager_match(sub_manager_t *mgr, const nostr_event *event,
+bool sub_event_digest_init(sub_event_digest_t *digest, const nostr_event *event);
+void sub_event_digest_free(sub_event_digest_t *digest);
+
+void sub_manager_match(sub_manager_t *mgr, const sub_event_digest_t *digest,
                        sub_match_result_t *result);
+void sub_match_result_free(sub_match_result_t *result);
 
 uint8_t sub_manager_count(sub_manager_t *mgr, int conn_fd);
 
@@ -1,5 +1,6 @@
 #include "validator.h"
 #include "nostr.h"
+#include "storage_engine.h"
 #include "esp_log.h"
 #include <inttypes.h>
 
@@ -64,12 +65,17 @@ validation_result_t validator_check_pow(const nostr_event *event, uint8_t min_di
     return VALIDATION_OK;
 }
 
-static validation_result_t check_duplicate(storage_engine_t *storage)
+static validation_result_t check_duplicate(const nostr_event *event, storage_engine_t *storage)
 {
     if (!storage) {
         return VALIDATION_OK;
     }
 
+    if (storage_event_exists(storage, event->id)) {
+        ESP_LOGD(TAG, "Duplicate event, skipping verification");
+        return VALIDATION_ERR_DUPLICATE;
+    }
+
     return VALIDATION_OK;
 }
 
@@ -81,6 +87,13 @@ validation_result_t validator_check_event(
     validation_result_t result;
     nostr_validation_result_t libnostr_result;
 
+    if (config->check_duplicates && !nostr_kind_is_ephemeral(event->kind)) {
+        result = check_duplicate(event, storage);
+        if (result != VALIDATION_OK) {
+            return result;
+        }
+    }
+
     nostr_relay_error_t err = nostr_event_validate_full(event, config->max_future_sec, &libnostr_result);
     if (err != NOSTR_RELAY_OK) {
         ESP_LOGD(TAG, "libnostr validation failed: %s", libnostr_result.error_message);
@@ -97,13 +110,6 @@ validation_result_t validator_check_event(
         return result;
     }
 
-    if (config->check_duplicates && !nostr_kind_is_ephemeral(event->kind)) {
-        result = check_duplicate(storage);
-        if (result != VALIDATION_OK) {
-            return result;
-        }
-    }
-
     return VALIDATION_OK;
 }
 
@@ -0,0 +1,174 @@
+#include "worker_pool.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "worker_pool";
+
+#define WORKER_STOP_WAIT_MS 2000
+
+typedef enum {
+    WORKER_ITEM_MESSAGE,
+    WORKER_ITEM_DISCONNECT,
+    WORKER_ITEM_STOP,
+} worker_item_type_t;
+
+typedef struct {
+    worker_item_type_t type;
+    int fd;
+    char *data;
+    size_t len;
+} worker_item_t;
+
+static worker_t *worker_for_fd(worker_pool_t *pool, int fd)
+{
+    return &pool->workers[(unsigned)fd % pool->worker_count];
+}
+
+static void worker_task(void *arg)
+{
+    worker_t *worker = (worker_t *)arg;
+    worker_pool_t *pool = worker->pool;
+    worker_item_t item;
+
+    while (1) {
+        if (xQueueReceive(worker->queue, &item, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (item.type == WORKER_ITEM_STOP) {
+            break;
+        }
+
+        if (item.type == WORKER_ITEM_MESSAGE) {
+            if (pool->on_message) {
+                pool->on_message(item.fd, item.data, item.len);
+            }
+            rx_pool_release(pool->buffers, item.data);
+        } else if (pool->on_disconnect) {
+            pool->on_disconnect(item.fd);
+        }
+        worker->processed++;
+    }
+
+    worker->task = NULL;
+    vTaskDelete(NULL);
+}
+
+static void drain_queue(worker_pool_t *pool, QueueHandle_t queue)
+{
+    worker_item_t item;
+    while (xQueueReceive(queue, &item, 0) == pdTRUE) {
+        rx_pool_release(pool->buffers, item.data);
+    }
+}
+
+esp_err_t worker_pool_init(worker_pool_t *pool, const worker_pool_config_t *config,
+                           worker_message_fn on_message, worker_disconnect_fn on_disconnect)
+{
+    memset(pool, 0, sizeof(worker_pool_t));
+
+    uint8_t count = config->worker_count;
+    if (count == 0) count = 1;
+    if (count > WORKER_POOL_MAX_WORKERS) count = WORKER_POOL_MAX_WORKERS;
+
+    pool->buffers = config->buffers;
+    pool->on_message = on_message;
+    pool->on_disconnect = on_disconnect;
+
+    for (uint8_t i = 0; i < count; i++) {
+        worker_t *worker = &pool->workers[i];
+
+        worker->queue = xQueueCreate(config->queue_depth, sizeof(worker_item_t));
+        if (!worker->queue) {
+            worker_pool_stop(pool);
+            return ESP_ERR_NO_MEM;
+        }
+        pool->worker_count = i + 1;
+
+        worker->pool = pool;
+        char name[16];
+        snprintf(name, sizeof(name), "ws_worker%u", i);
+        BaseType_t ret = xTaskCreatePinnedToCore(worker_task, name, config->stack_size,
+                                                 worker, config->priority,
+                                                 &worker->task, config->core_id);
+        if (ret != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create %s", name);
+            worker->task = NULL;
+            worker_pool_stop(pool);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(TAG, "Started %u workers (queue=%u, core=%d)",
+             count, config->queue_depth, (int)config->core_id);
+    return ESP_OK;
+}
+
+void worker_pool_stop(worker_pool_t *pool)
+{
+    worker_item_t stop = { .type = WORKER_ITEM_STOP, .fd = -1 };
+
+    for (uint8_t i = 0; i < pool->worker_count; i++) {
+        worker_t *worker = &pool->workers[i];
+        if (worker->task) {
+            xQueueSendToBack(worker->queue, &stop, pdMS_TO_TICKS(WORKER_STOP_WAIT_MS));
+        }
+    }
+
+    for (uint8_t i = 0; i < pool->worker_count; i++) {
+        worker_t *worker = &pool->workers[i];
+        for (int waited = 0; worker->task && waited < WORKER_STOP_WAIT_MS; waited += 10) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        if (worker->task) {
+            ESP_LOGW(TAG, "Worker %u did not stop, deleting", i);
+            vTaskDelete(worker->task);
+            worker->task = NULL;
+        }
+        if (worker->queue) {
+            drain_queue(pool, worker->queue);
+            vQueueDelete(worker->queue);
+            worker->queue = NULL;
+        }
+    }
+
+    pool->worker_count = 0;
+}
+
+esp_err_t worker_pool_submit(worker_pool_t *pool, int fd, char *data, size_t len,
+                             TickType_t timeout)
+{
+    if (pool->worker_count == 0) return ESP_ERR_INVALID_STATE;
+
+    worker_t *worker = worker_for_fd(pool, fd);
+    worker_item_t item = {
+        .type = WORKER_ITEM_MESSAGE,
+        .fd = fd,
+        .data = data,
+        .len = len,
+    };
+
+    if (xQueueSendToBack(worker->queue, &item, timeout) != pdTRUE) {
+        worker->dropped++;
+        ESP_LOGW(TAG, "Worker queue full, dropped frame fd=%d (dropped=%" PRIu32 ")",
+                 fd, worker->dropped);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t worker_pool_submit_disconnect(worker_pool_t *pool, int fd)
+{
+    if (pool->worker_count == 0) return ESP_ERR_INVALID_STATE;
+
+    worker_item_t item = { .type = WORKER_ITEM_DISCONNECT, .fd = fd };
+    if (xQueueSendToBack(worker_for_fd(pool, fd)->queue, &item, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "rx_pool.h"
+
+#define WORKER_POOL_MAX_WORKERS 4
+
+typedef struct worker_pool worker_pool_t;
+
+typedef void (*worker_message_fn)(int fd, const char *data, size_t len);
+typedef void (*worker_disconnect_fn)(int fd);
+
+typedef struct {
+    uint8_t worker_count;
+    uint16_t queue_depth;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core_id;
+    rx_pool_t *buffers;
+} worker_pool_config_t;
+
+typedef struct {
+    worker_pool_t *pool;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    uint32_t processed;
+    uint32_t dropped;
+} worker_t;
+
+struct worker_pool {
+    worker_t workers[WORKER_POOL_MAX_WORKERS];
+    uint8_t worker_count;
+    rx_pool_t *buffers;
+    worker_message_fn on_message;
+    worker_disconnect_fn on_disconnect;
+};
+
+esp_err_t worker_pool_init(worker_pool_t *pool, const worker_pool_config_t *config,
+                           worker_message_fn on_message, worker_disconnect_fn on_disconnect);
+void worker_pool_stop(worker_pool_t *pool);
+
+esp_err_t worker_pool_submit(worker_pool_t *pool, int fd, char *data, size_t len,
+                             TickType_t timeout);
+esp_err_t worker_pool_submit_disconnect(worker_pool_t *pool, int fd);
+
+#endif
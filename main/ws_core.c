@@ -0,0 +1,1027 @@
+#include "ws_core.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#else
+#define ESP_LOGI(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGW(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGE(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#endif
+
+static const char *TAG = "ws_core";
+
+#define WS_CORE_RX_INITIAL 512
+#define WS_CORE_TX_MAX     (WS_CORE_HTTP_MAX + 2 * (2 + 125))
+#define WS_CORE_GUID       "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define WS_CLOSE_PROTOCOL  1002
+#define WS_CLOSE_TOO_BIG   1009
+
+static void mutex_init(ws_core_mutex_t *m)
+{
+#ifdef ESP_PLATFORM
+    *m = xSemaphoreCreateMutex();
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+static void mutex_lock(ws_core_mutex_t *m)
+{
+#ifdef ESP_PLATFORM
+    xSemaphoreTake(*m, portMAX_DELAY);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static void mutex_unlock(ws_core_mutex_t *m)
+{
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(*m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+static void mutex_destroy(ws_core_mutex_t *m)
+{
+#ifdef ESP_PLATFORM
+    if (*m) {
+        vSemaphoreDelete(*m);
+        *m = NULL;
+    }
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+static uint32_t rol32(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *block)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void sha1(const uint8_t *data, size_t len, uint8_t out[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t block[64];
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        sha1_block(h, data + i);
+    }
+    size_t rest = len - i;
+    memcpy(block, data + i, rest);
+    block[rest++] = 0x80;
+    if (rest > 56) {
+        memset(block + rest, 0, 64 - rest);
+        sha1_block(h, block);
+        rest = 0;
+    }
+    memset(block + rest, 0, 56 - rest);
+    uint64_t bits = (uint64_t)len * 8;
+    for (int b = 0; b < 8; b++) {
+        block[56 + b] = (uint8_t)(bits >> (56 - 8 * b));
+    }
+    sha1_block(h, block);
+
+    for (int w = 0; w < 5; w++) {
+        out[w * 4] = (uint8_t)(h[w] >> 24);
+        out[w * 4 + 1] = (uint8_t)(h[w] >> 16);
+        out[w * 4 + 2] = (uint8_t)(h[w] >> 8);
+        out[w * 4 + 3] = (uint8_t)h[w];
+    }
+}
+
+static size_t base64_encode(const uint8_t *in, size_t len, char *out)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = alphabet[(v >> 18) & 0x3F];
+        out[o++] = alphabet[(v >> 12) & 0x3F];
+        out[o++] = i + 1 < len ? alphabet[(v >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < len ? alphabet[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+    return o;
+}
+
+void ws_core_accept_key(const char *key, size_t key_len, char out[WS_CORE_ACCEPT_LEN + 1])
+{
+    uint8_t buf[128];
+    uint8_t digest[20];
+    size_t guid_len = sizeof(WS_CORE_GUID) - 1;
+
+    if (key_len > sizeof(buf) - guid_len) {
+        key_len = sizeof(buf) - guid_len;
+    }
+    memcpy(buf, key, key_len);
+    memcpy(buf + key_len, WS_CORE_GUID, guid_len);
+    sha1(buf, key_len + guid_len, digest);
+    base64_encode(digest, sizeof(digest), out);
+}
+
+static bool token_eq(const char *s, size_t len, const char *lit)
+{
+    return strlen(lit) == len && strncasecmp(s, lit, len) == 0;
+}
+
+static bool contains_token(const char *s, size_t len, const char *token)
+{
+    size_t tlen = strlen(token);
+    for (size_t i = 0; i + tlen <= len; i++) {
+        if (strncasecmp(s + i, token, tlen) == 0) return true;
+    }
+    return false;
+}
+
+int ws_core_parse_http(const char *buf, size_t len, ws_core_http_t *out)
+{
+    memset(out, 0, sizeof(ws_core_http_t));
+
+    size_t end = 0;
+    for (size_t i = 3; i < len; i++) {
+        if (buf[i - 3] == '\r' && buf[i - 2] == '\n' && buf[i - 1] == '\r' && buf[i] == '\n') {
+            end = i + 1;
+            break;
+        }
+    }
+    if (end == 0) {
+        return len >= WS_CORE_HTTP_MAX ? -1 : 0;
+    }
+
+    const char *line = buf;
+    const char *eol = memchr(line, '\r', end);
+    const char *sp1 = memchr(line, ' ', (size_t)(eol - line));
+    if (!sp1) return -1;
+    const char *sp2 = memchr(sp1 + 1, ' ', (size_t)(eol - sp1 - 1));
+    if (!sp2) return -1;
+    out->method = line;
+    out->method_len = (size_t)(sp1 - line);
+    out->path = sp1 + 1;
+    out->path_len = (size_t)(sp2 - sp1 - 1);
+
+    bool upgrade_ws = false;
+    bool connection_upgrade = false;
+    for (line = eol + 2; line < buf + end - 2; line = eol + 2) {
+        eol = memchr(line, '\r', (size_t)(buf + end - line));
+        const char *colon = memchr(line, ':', (size_t)(eol - line));
+        if (!colon) return -1;
+
+        size_t name_len = (size_t)(colon - line);
+        const char *value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) value++;
+        size_t value_len = (size_t)(eol - value);
+        while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t')) {
+            value_len--;
+        }
+
+        if (token_eq(line, name_len, "Upgrade")) {
+            upgrade_ws = contains_token(value, value_len, "websocket");
+        } else if (token_eq(line, name_len, "Connection")) {
+            connection_upgrade = contains_token(value, value_len, "upgrade");
+        } else if (token_eq(line, name_len, "Sec-WebSocket-Key")) {
+            out->key = value;
+            out->key_len = value_len;
+        } else if (token_eq(line, name_len, "Sec-WebSocket-Extensions")) {
+            out->extensions = value;
+            out->extensions_len = value_len;
+        } else if (token_eq(line, name_len, "Accept")) {
+            out->accept = value;
+            out->accept_len = value_len;
+        }
+    }
+
+    out->upgrade = token_eq(out->method, out->method_len, "GET") &&
+                   upgrade_ws && connection_upgrade && out->key_len > 0;
+    return (int)end;
+}
+
+int ws_core_decode_frame(uint8_t *buf, size_t len, size_t max_payload, ws_core_frame_t *out)
+{
+    if (len < 2) return WS_CORE_FRAME_INCOMPLETE;
+
+    uint8_t b0 = buf[0];
+    uint8_t b1 = buf[1];
+    if (b0 & 0x30) return WS_CORE_FRAME_ERR_PROTOCOL;
+    if (!(b1 & 0x80)) return WS_CORE_FRAME_ERR_PROTOCOL;
+
+    out->fin = (b0 & 0x80) != 0;
+    out->rsv1 = (b0 & 0x40) != 0;
+    out->opcode = b0 & 0x0F;
+
+    uint64_t plen = b1 & 0x7F;
+    size_t pos = 2;
+    if (plen == 126) {
+        if (len < 4) return WS_CORE_FRAME_INCOMPLETE;
+        plen = ((uint64_t)buf[2] << 8) | buf[3];
+        pos = 4;
+    } else if (plen == 127) {
+        if (len < 10) return WS_CORE_FRAME_INCOMPLETE;
+        plen = 0;
+        for (int i = 0; i < 8; i++) {
+            plen = (plen << 8) | buf[2 + i];
+        }
+        if (plen >> 63) return WS_CORE_FRAME_ERR_PROTOCOL;
+        pos = 10;
+    }
+
+    if ((out->opcode & 0x08) && (!out->fin || plen > 125)) {
+        return WS_CORE_FRAME_ERR_PROTOCOL;
+    }
+    if (plen > max_payload) return WS_CORE_FRAME_ERR_TOO_BIG;
+    if (len < pos + 4 + plen) return WS_CORE_FRAME_INCOMPLETE;
+
+    const uint8_t *mask = buf + pos;
+    pos += 4;
+    out->payload = buf + pos;
+    out->len = (size_t)plen;
+    for (size_t i = 0; i < out->len; i++) {
+        out->payload[i] ^= mask[i & 3];
+    }
+    return (int)(pos + out->len);
+}
+
+size_t ws_core_encode_header(uint8_t *out, uint8_t opcode, bool fin, size_t len)
+{
+    out[0] = (uint8_t)((fin ? 0x80 : 0) | (opcode & 0x0F));
+    if (len < 126) {
+        out[1] = (uint8_t)len;
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (uint8_t)(len >> 8);
+        out[3] = (uint8_t)len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+static void *core_alloc(bool use_psram, size_t size)
+{
+#ifdef ESP_PLATFORM
+    if (use_psram) {
+        void *p = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (p) return p;
+    }
+#else
+    (void)use_psram;
+#endif
+    return calloc(1, size);
+}
+
+static ws_core_conn_t *find_conn(ws_core_t *core, int fd)
+{
+    for (uint16_t i = 0; i < core->max_conns; i++) {
+        if (core->conns[i].state != WS_CORE_CONN_FREE && core->conns[i].fd == fd) {
+            return &core->conns[i];
+        }
+    }
+    return NULL;
+}
+
+static ssize_t send_some(int fd, const void *data, size_t len)
+{
+    ssize_t n;
+    do {
+        n = send(fd, data, len, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    return n;
+}
+
+static ssize_t sendv_some(int fd, const struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg = { .msg_iov = (struct iovec *)iov, .msg_iovlen = iovcnt };
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    return n;
+}
+
+static bool conn_write(ws_core_conn_t *conn, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    if (conn->tx_len == 0 && !conn->tx_partial) {
+        ssize_t n = send_some(conn->fd, p, len);
+        if (n < 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    if (len == 0) return true;
+    if (conn->tx_len + len > WS_CORE_TX_MAX) return false;
+
+    uint8_t *tx = realloc(conn->tx, conn->tx_len + len);
+    if (!tx) return false;
+    memcpy(tx + conn->tx_len, p, len);
+    conn->tx = tx;
+    conn->tx_len += len;
+    return true;
+}
+
+static bool send_control(ws_core_conn_t *conn, uint8_t opcode, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[2 + 125];
+    size_t hlen = ws_core_encode_header(frame, opcode, true, len);
+    memcpy(frame + hlen, payload, len);
+    return conn_write(conn, frame, hlen + len);
+}
+
+static void send_close(ws_core_conn_t *conn, uint16_t code)
+{
+    uint8_t payload[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+    send_control(conn, WS_CORE_OP_CLOSE, payload, sizeof(payload));
+}
+
+static void close_conn(ws_core_t *core, ws_core_conn_t *conn)
+{
+    if (conn->state == WS_CORE_CONN_FREE) return;
+
+    int fd = conn->fd;
+    if (core->cb.on_close) {
+        core->cb.on_close(core->user, fd);
+    }
+    close(fd);
+    ws_deflate_destroy(conn->deflate);
+    rx_pool_release(core->rx_pool, (char *)conn->rx);
+    rx_pool_release(core->rx_pool, conn->msg);
+    free(conn->tx);
+    memset(conn, 0, sizeof(ws_core_conn_t));
+    conn->fd = -1;
+    mutex_lock(&core->lock);
+    core->conn_count--;
+    mutex_unlock(&core->lock);
+    ESP_LOGD(TAG, "Closed fd=%d (open=%u)", fd, core->conn_count);
+}
+
+static void attach_conn(ws_core_t *core, int fd)
+{
+    ws_core_conn_t *conn = NULL;
+    for (uint16_t i = 0; i < core->max_conns && !conn; i++) {
+        if (core->conns[i].state == WS_CORE_CONN_FREE) conn = &core->conns[i];
+    }
+    if (!conn) {
+        core->rejected++;
+        ESP_LOGW(TAG, "Connection rejected - pool full (%u)", core->max_conns);
+        close(fd);
+        return;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(fd);
+        return;
+    }
+    conn->fd = fd;
+    conn->state = WS_CORE_CONN_HTTP;
+    mutex_lock(&core->lock);
+    core->conn_count++;
+    mutex_unlock(&core->lock);
+    core->accepted++;
+
+    if (core->cb.on_open && !core->cb.on_open(core->user, fd)) {
+        close_conn(core, conn);
+    }
+}
+
+static void accept_conn(ws_core_t *core)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = accept(core->listen_fd, (struct sockaddr *)&addr, &addr_len);
+    if (fd < 0) return;
+
+    if (core->cb.on_accept && core->cb.on_accept(core->user, fd)) return;
+    attach_conn(core, fd);
+}
+
+static bool deliver(ws_core_t *core, ws_core_conn_t *conn, char *data, size_t len)
+{
+    if (conn->msg_compressed) {
+        char *plain;
+        size_t plain_len;
+        bool ok = ws_deflate_decompress(conn->deflate, core->rx_pool, (const uint8_t *)data, len,
+                                        core->max_frame, &plain, &plain_len);
+        rx_pool_release(core->rx_pool, data);
+        if (!ok) {
+            send_close(conn, WS_CLOSE_TOO_BIG);
+            return false;
+        }
+        conn->msg_compressed = false;
+        return deliver(core, conn, plain, plain_len);
+    }
+
+    data[len] = '\0';
+    if (core->cb.on_message) {
+        core->cb.on_message(core->user, conn->fd, data, len);
+    } else {
+        rx_pool_release(core->rx_pool, data);
+    }
+    return conn->state == WS_CORE_CONN_OPEN;
+}
+
+static char *take_payload(ws_core_t *core, ws_core_conn_t *conn, const ws_core_frame_t *f, bool last)
+{
+    if (!last) {
+        char *data = rx_pool_alloc(core->rx_pool, f->len);
+        if (data) memcpy(data, f->payload, f->len);
+        return data;
+    }
+
+    char *data = (char *)conn->rx;
+    memmove(data, f->payload, f->len);
+    conn->rx = NULL;
+    conn->rx_len = 0;
+    conn->rx_cap = 0;
+    return data;
+}
+
+static bool handle_frame(ws_core_t *core, ws_core_conn_t *conn, const ws_core_frame_t *f, bool last)
+{
+    if (f->rsv1 && (!conn->deflate || f->opcode == WS_CORE_OP_CONT || (f->opcode & 0x08))) {
+        send_close(conn, WS_CLOSE_PROTOCOL);
+        return false;
+    }
+
+    switch (f->opcode) {
+        case WS_CORE_OP_TEXT:
+        case WS_CORE_OP_BINARY: {
+            if (conn->in_message) return false;
+            conn->msg_compressed = f->rsv1;
+            if (f->fin) {
+                char *data = take_payload(core, conn, f, last);
+                return data && deliver(core, conn, data, f->len);
+            }
+            conn->msg = rx_pool_alloc(core->rx_pool, f->len);
+            if (!conn->msg) return false;
+            memcpy(conn->msg, f->payload, f->len);
+            conn->msg_len = f->len;
+            conn->in_message = true;
+            return true;
+        }
+
+        case WS_CORE_OP_CONT: {
+            if (!conn->in_message || conn->msg_len + f->len > core->max_frame) return false;
+            char *msg = rx_pool_grow(core->rx_pool, conn->msg, conn->msg_len, conn->msg_len + f->len);
+            if (!msg) return false;
+            conn->msg = msg;
+            memcpy(conn->msg + conn->msg_len, f->payload, f->len);
+            conn->msg_len += f->len;
+            if (!f->fin) return true;
+            char *data = conn->msg;
+            size_t len = conn->msg_len;
+            conn->msg = NULL;
+            conn->msg_len = 0;
+            conn->in_message = false;
+            return deliver(core, conn, data, len);
+        }
+
+        case WS_CORE_OP_PING:
+            return send_control(conn, WS_CORE_OP_PONG, f->payload, f->len);
+
+        case WS_CORE_OP_PONG:
+            return true;
+
+        case WS_CORE_OP_CLOSE:
+            send_control(conn, WS_CORE_OP_CLOSE, f->payload, f->len < 2 ? 0 : 2);
+            return false;
+
+        default:
+            send_close(conn, WS_CLOSE_PROTOCOL);
+            return false;
+    }
+}
+
+static size_t build_handshake(char *out, size_t size, const ws_core_http_t *req,
+                              const char *extensions)
+{
+    char accept[WS_CORE_ACCEPT_LEN + 1];
+    ws_core_accept_key(req->key, req->key_len, accept);
+    int n = snprintf(out, size,
+                     "HTTP/1.1 101 Switching Protocols\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n%s\r\n", accept, extensions);
+    return n < 0 || (size_t)n >= size ? 0 : (size_t)n;
+}
+
+static bool process_http(ws_core_t *core, ws_core_conn_t *conn, size_t *consumed)
+{
+    ws_core_http_t req;
+    int r = ws_core_parse_http((const char *)conn->rx, conn->rx_len, &req);
+    if (r == 0) return true;
+    if (r < 0) {
+        static const char bad[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        conn->closing = true;
+        return conn_write(conn, bad, sizeof(bad) - 1);
+    }
+
+    char resp[WS_CORE_HTTP_MAX];
+    if (!req.upgrade) {
+        size_t n = core->cb.on_http ? core->cb.on_http(core->user, &req, resp, sizeof(resp)) : 0;
+        if (n == 0) {
+            static const char missing[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            n = sizeof(missing) - 1;
+            memcpy(resp, missing, n);
+        }
+        conn->closing = true;
+        return conn_write(conn, resp, n);
+    }
+
+    char extensions[WS_DEFLATE_RESPONSE_MAX] = "";
+    ws_deflate_params_t params;
+    if (ws_deflate_negotiate(req.extensions, req.extensions_len, &core->deflate, &params) &&
+        ws_deflate_response(&params, extensions, sizeof(extensions)) > 0) {
+        conn->deflate = ws_deflate_create(&params, core->deflate.mem_level);
+        if (!conn->deflate) extensions[0] = '\0';
+    }
+
+    size_t n = build_handshake(resp, sizeof(resp), &req, extensions);
+    if (n == 0 || !conn_write(conn, resp, n)) return false;
+
+    conn->state = WS_CORE_CONN_OPEN;
+    *consumed = (size_t)r;
+    ESP_LOGD(TAG, "WebSocket handshake completed fd=%d", conn->fd);
+    return true;
+}
+
+static bool process_frames(ws_core_t *core, ws_core_conn_t *conn, size_t *consumed)
+{
+    while (*consumed < conn->rx_len) {
+        ws_core_frame_t frame;
+        int r = ws_core_decode_frame(conn->rx + *consumed, conn->rx_len - *consumed,
+                                     core->max_frame, &frame);
+        if (r == WS_CORE_FRAME_INCOMPLETE) return true;
+        if (r < 0) {
+            send_close(conn, r == WS_CORE_FRAME_ERR_TOO_BIG ? WS_CLOSE_TOO_BIG : WS_CLOSE_PROTOCOL);
+            return false;
+        }
+        bool last = *consumed + (size_t)r == conn->rx_len;
+        if (!handle_frame(core, conn, &frame, last)) return false;
+        *consumed = conn->rx ? *consumed + (size_t)r : 0;
+    }
+    return true;
+}
+
+static size_t frame_need(const uint8_t *p, size_t len)
+{
+    if (len < 2) return 0;
+    size_t hlen = 2 + ((p[1] & 0x80) ? 4 : 0);
+    uint64_t plen = p[1] & 0x7F;
+    if (plen == 126) {
+        if (len < 4) return 0;
+        plen = ((uint64_t)p[2] << 8) | p[3];
+        hlen += 2;
+    } else if (plen == 127) {
+        if (len < 10) return 0;
+        plen = 0;
+        for (int i = 0; i < 8; i++) plen = (plen << 8) | p[2 + i];
+        hlen += 8;
+    }
+    return plen > SIZE_MAX - hlen ? SIZE_MAX : hlen + (size_t)plen;
+}
+
+static bool grow_rx(ws_core_t *core, ws_core_conn_t *conn)
+{
+    size_t limit = conn->state == WS_CORE_CONN_HTTP ? WS_CORE_HTTP_MAX
+                                                    : core->max_frame + WS_CORE_HEADER_MAX;
+    if (conn->rx_cap >= limit) return false;
+
+    size_t cap = conn->rx_cap ? conn->rx_cap * 2 : WS_CORE_RX_INITIAL;
+    if (conn->state == WS_CORE_CONN_OPEN) {
+        size_t need = frame_need(conn->rx, conn->rx_len);
+        if (need > cap) cap = need;
+    }
+    if (cap > limit) cap = limit;
+    char *rx = rx_pool_grow(core->rx_pool, (char *)conn->rx, conn->rx_len, cap);
+    if (!rx) return false;
+    conn->rx = (uint8_t *)rx;
+    conn->rx_cap = rx_pool_capacity(rx) < limit ? rx_pool_capacity(rx) : limit;
+    return true;
+}
+
+static void release_rx(ws_core_t *core, ws_core_conn_t *conn)
+{
+    rx_pool_release(core->rx_pool, (char *)conn->rx);
+    conn->rx = NULL;
+    conn->rx_cap = 0;
+}
+
+static void read_conn(ws_core_t *core, ws_core_conn_t *conn)
+{
+    if (conn->rx_len == conn->rx_cap && !grow_rx(core, conn)) {
+        if (conn->state == WS_CORE_CONN_OPEN) send_close(conn, WS_CLOSE_TOO_BIG);
+        close_conn(core, conn);
+        return;
+    }
+
+    ssize_t n = recv(conn->fd, conn->rx + conn->rx_len, conn->rx_cap - conn->rx_len, 0);
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            if (conn->rx_len == 0) release_rx(core, conn);
+            return;
+        }
+        close_conn(core, conn);
+        return;
+    }
+    conn->rx_len += (size_t)n;
+    if (conn->state == WS_CORE_CONN_OPEN && core->cb.on_activity) {
+        core->cb.on_activity(core->user, conn->fd);
+    }
+
+    size_t consumed = 0;
+    bool ok = true;
+    if (conn->state == WS_CORE_CONN_HTTP) {
+        ok = process_http(core, conn, &consumed);
+    }
+    if (ok && conn->state == WS_CORE_CONN_OPEN) {
+        ok = process_frames(core, conn, &consumed);
+    }
+    if (!ok || (conn->closing && conn->tx_len == 0)) {
+        close_conn(core, conn);
+        return;
+    }
+
+    if (consumed > 0) {
+        memmove(conn->rx, conn->rx + consumed, conn->rx_len - consumed);
+        conn->rx_len -= consumed;
+    }
+    if (conn->rx_len == 0) {
+        release_rx(core, conn);
+    }
+}
+
+static void write_conn(ws_core_t *core, ws_core_conn_t *conn)
+{
+    if (conn->tx_len > 0 && !conn->tx_partial) {
+        ssize_t n = send_some(conn->fd, conn->tx, conn->tx_len);
+        if (n < 0) {
+            close_conn(core, conn);
+            return;
+        }
+        memmove(conn->tx, conn->tx + n, conn->tx_len - (size_t)n);
+        conn->tx_len -= (size_t)n;
+        if (conn->tx_len > 0) return;
+        if (conn->closing) {
+            close_conn(core, conn);
+            return;
+        }
+    }
+    if (conn->want_write) {
+        conn->want_write = false;
+        if (core->cb.on_writable) {
+            core->cb.on_writable(core->user, conn->fd);
+        }
+    }
+}
+
+static void run_work(ws_core_t *core)
+{
+    mutex_lock(&core->lock);
+    ws_core_work_t *work = core->work_head;
+    core->work_head = NULL;
+    core->work_tail = NULL;
+    mutex_unlock(&core->lock);
+
+    while (work) {
+        ws_core_work_t *next = work->next;
+        int fd = (int)(intptr_t)work->arg;
+        if (work->kind == WS_CORE_WORK_CALL) {
+            work->fn(work->arg);
+        } else if (work->kind == WS_CORE_WORK_CLOSE) {
+            ws_core_conn_t *conn = find_conn(core, fd);
+            if (conn) close_conn(core, conn);
+        } else {
+            attach_conn(core, fd);
+            mutex_lock(&core->lock);
+            core->adopting--;
+            mutex_unlock(&core->lock);
+        }
+        free(work);
+        work = next;
+    }
+}
+
+static int open_listener(uint16_t port, int backlog)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_wake(uint16_t *port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+bool ws_core_init(ws_core_t *core, const ws_core_config_t *config,
+                  const ws_core_callbacks_t *cb, void *user)
+{
+    if (!config->rx_pool) return false;
+
+    memset(core, 0, sizeof(ws_core_t));
+    core->listen_fd = -1;
+    core->wake_fd = -1;
+    core->max_conns = config->max_conns > 0 ? config->max_conns : 1;
+    core->max_frame = config->max_frame;
+    core->rx_pool = config->rx_pool;
+    core->deflate = config->deflate;
+    core->cb = *cb;
+    core->user = user;
+    mutex_init(&core->lock);
+
+    core->conns = core_alloc(config->use_psram, core->max_conns * sizeof(ws_core_conn_t));
+    if (!core->conns) {
+        ws_core_destroy(core);
+        return false;
+    }
+    for (uint16_t i = 0; i < core->max_conns; i++) {
+        core->conns[i].fd = -1;
+    }
+
+    if (!config->adopt_only) {
+        core->listen_fd = open_listener(config->port, core->max_conns);
+    }
+    core->wake_fd = open_wake(&core->wake_port);
+    if ((!config->adopt_only && core->listen_fd < 0) || core->wake_fd < 0) {
+        ESP_LOGE(TAG, "Failed to open sockets on port %u: %d", config->port, errno);
+        ws_core_destroy(core);
+        return false;
+    }
+
+    if (core->listen_fd >= 0) {
+        ESP_LOGI(TAG, "Listening on port %u (max %u connections)", config->port, core->max_conns);
+    }
+    return true;
+}
+
+void ws_core_destroy(ws_core_t *core)
+{
+    if (core->conns) {
+        for (uint16_t i = 0; i < core->max_conns; i++) {
+            close_conn(core, &core->conns[i]);
+        }
+        free(core->conns);
+        core->conns = NULL;
+    }
+    if (core->listen_fd >= 0) {
+        close(core->listen_fd);
+        core->listen_fd = -1;
+    }
+    if (core->wake_fd >= 0) {
+        close(core->wake_fd);
+        core->wake_fd = -1;
+    }
+    while (core->work_head) {
+        ws_core_work_t *work = core->work_head;
+        core->work_head = work->next;
+        if (work->kind == WS_CORE_WORK_ADOPT) {
+            close((int)(intptr_t)work->arg);
+        }
+        free(work);
+    }
+    core->work_tail = NULL;
+    core->adopting = 0;
+    mutex_destroy(&core->lock);
+}
+
+bool ws_core_poll(ws_core_t *core, int timeout_ms)
+{
+    fd_set rfds;
+    fd_set wfds;
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    if (core->listen_fd >= 0) {
+        FD_SET(core->listen_fd, &rfds);
+    }
+    FD_SET(core->wake_fd, &rfds);
+    int maxfd = core->listen_fd > core->wake_fd ? core->listen_fd : core->wake_fd;
+
+    for (uint16_t i = 0; i < core->max_conns; i++) {
+        ws_core_conn_t *conn = &core->conns[i];
+        if (conn->state == WS_CORE_CONN_FREE) continue;
+        if (!conn->closing) {
+            FD_SET(conn->fd, &rfds);
+        }
+        if (conn->want_write || (conn->tx_len > 0 && !conn->tx_partial)) {
+            FD_SET(conn->fd, &wfds);
+        }
+        if (conn->fd > maxfd) maxfd = conn->fd;
+    }
+
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int ready = select(maxfd + 1, &rfds, &wfds, NULL, timeout_ms < 0 ? NULL : &tv);
+    if (ready < 0) {
+        return errno == EINTR;
+    }
+
+    if (FD_ISSET(core->wake_fd, &rfds)) {
+        uint8_t drain[16];
+        while (recv(core->wake_fd, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+        }
+    }
+    run_work(core);
+
+    for (uint16_t i = 0; i < core->max_conns; i++) {
+        ws_core_conn_t *conn = &core->conns[i];
+        if (conn->state != WS_CORE_CONN_FREE && FD_ISSET(conn->fd, &wfds)) {
+            write_conn(core, conn);
+        }
+        if (conn->state != WS_CORE_CONN_FREE && FD_ISSET(conn->fd, &rfds)) {
+            read_conn(core, conn);
+        }
+    }
+
+    if (core->listen_fd >= 0 && FD_ISSET(core->listen_fd, &rfds)) {
+        accept_conn(core);
+    }
+    return true;
+}
+
+static bool push_work(ws_core_t *core, ws_core_work_kind_t kind, ws_core_work_fn fn, void *arg)
+{
+    ws_core_work_t *work = malloc(sizeof(ws_core_work_t));
+    if (!work) return false;
+    work->next = NULL;
+    work->kind = kind;
+    work->fn = fn;
+    work->arg = arg;
+
+    mutex_lock(&core->lock);
+    if (kind == WS_CORE_WORK_ADOPT) {
+        core->adopting++;
+    }
+    if (core->work_tail) {
+        core->work_tail->next = work;
+    } else {
+        core->work_head = work;
+    }
+    core->work_tail = work;
+    mutex_unlock(&core->lock);
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(core->wake_port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    uint8_t byte = 0;
+    sendto(core->wake_fd, &byte, 1, 0, (struct sockaddr *)&addr, sizeof(addr));
+    return true;
+}
+
+bool ws_core_queue_work(ws_core_t *core, ws_core_work_fn fn, void *arg)
+{
+    return push_work(core, WS_CORE_WORK_CALL, fn, arg);
+}
+
+int ws_core_send(ws_core_t *core, int fd, const char *data, size_t len)
+{
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    return ws_core_sendv(core, fd, &iov, 1);
+}
+
+int ws_core_sendv(ws_core_t *core, int fd, const struct iovec *iov, int iovcnt)
+{
+    ws_core_conn_t *conn = find_conn(core, fd);
+    if (!conn || conn->closing) return -1;
+
+    if (conn->tx_len > 0 && !conn->tx_partial) {
+        conn->want_write = true;
+        return 0;
+    }
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    ssize_t n = sendv_some(fd, iov, iovcnt);
+    if (n < 0) return -1;
+    conn->tx_partial = (size_t)n < len;
+    if (conn->tx_partial) {
+        conn->want_write = true;
+    }
+    return (int)n;
+}
+
+bool ws_core_close(ws_core_t *core, int fd)
+{
+    return push_work(core, WS_CORE_WORK_CLOSE, NULL, (void *)(intptr_t)fd);
+}
+
+bool ws_core_adopt(ws_core_t *core, int fd)
+{
+    return push_work(core, WS_CORE_WORK_ADOPT, NULL, (void *)(intptr_t)fd);
+}
+
+uint16_t ws_core_load(ws_core_t *core)
+{
+    mutex_lock(&core->lock);
+    uint16_t load = core->conn_count + core->adopting;
+    mutex_unlock(&core->lock);
+    return load;
+}
+
+ws_deflate_t *ws_core_deflate(ws_core_t *core, int fd)
+{
+    ws_core_conn_t *conn = find_conn(core, fd);
+    return conn ? conn->deflate : NULL;
+}
@@ -0,0 +1,157 @@
+#ifndef WS_CORE_H
+#define WS_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "ws_deflate.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+typedef SemaphoreHandle_t ws_core_mutex_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t ws_core_mutex_t;
+#endif
+
+#define WS_CORE_OP_CONT   0x0
+#define WS_CORE_OP_TEXT   0x1
+#define WS_CORE_OP_BINARY 0x2
+#define WS_CORE_OP_CLOSE  0x8
+#define WS_CORE_OP_PING   0x9
+#define WS_CORE_OP_PONG   0xA
+
+#define WS_CORE_HEADER_MAX   14
+#define WS_CORE_HTTP_MAX     2048
+#define WS_CORE_ACCEPT_LEN   28
+
+typedef enum {
+    WS_CORE_FRAME_INCOMPLETE = 0,
+    WS_CORE_FRAME_ERR_PROTOCOL = -1,
+    WS_CORE_FRAME_ERR_TOO_BIG = -2,
+} ws_core_frame_status_t;
+
+typedef struct {
+    const char *method;
+    size_t method_len;
+    const char *path;
+    size_t path_len;
+    const char *key;
+    size_t key_len;
+    const char *accept;
+    size_t accept_len;
+    const char *extensions;
+    size_t extensions_len;
+    bool upgrade;
+} ws_core_http_t;
+
+typedef struct {
+    uint8_t opcode;
+    bool fin;
+    bool rsv1;
+    uint8_t *payload;
+    size_t len;
+} ws_core_frame_t;
+
+typedef struct ws_core ws_core_t;
+
+typedef struct {
+    bool (*on_open)(void *user, int fd);
+    void (*on_message)(void *user, int fd, char *data, size_t len);
+    void (*on_close)(void *user, int fd);
+    void (*on_activity)(void *user, int fd);
+    void (*on_writable)(void *user, int fd);
+    bool (*on_accept)(void *user, int fd);
+    size_t (*on_http)(void *user, const ws_core_http_t *req, char *resp, size_t resp_size);
+} ws_core_callbacks_t;
+
+typedef struct {
+    uint16_t port;
+    uint16_t max_conns;
+    size_t max_frame;
+    bool use_psram;
+    bool adopt_only;
+    rx_pool_t *rx_pool;
+    ws_deflate_config_t deflate;
+} ws_core_config_t;
+
+typedef enum {
+    WS_CORE_CONN_FREE,
+    WS_CORE_CONN_HTTP,
+    WS_CORE_CONN_OPEN,
+} ws_core_conn_state_t;
+
+typedef struct {
+    int fd;
+    ws_core_conn_state_t state;
+    uint8_t *rx;
+    size_t rx_len;
+    size_t rx_cap;
+    char *msg;
+    size_t msg_len;
+    uint8_t *tx;
+    size_t tx_len;
+    ws_deflate_t *deflate;
+    bool in_message;
+    bool msg_compressed;
+    bool tx_partial;
+    bool want_write;
+    bool closing;
+} ws_core_conn_t;
+
+typedef void (*ws_core_work_fn)(void *arg);
+
+typedef enum {
+    WS_CORE_WORK_CALL,
+    WS_CORE_WORK_CLOSE,
+    WS_CORE_WORK_ADOPT,
+} ws_core_work_kind_t;
+
+typedef struct ws_core_work {
+    struct ws_core_work *next;
+    ws_core_work_kind_t kind;
+    ws_core_work_fn fn;
+    void *arg;
+} ws_core_work_t;
+
+struct ws_core {
+    int listen_fd;
+    int wake_fd;
+    uint16_t wake_port;
+    ws_core_conn_t *conns;
+    uint16_t max_conns;
+    uint16_t conn_count;
+    size_t max_frame;
+    rx_pool_t *rx_pool;
+    ws_deflate_config_t deflate;
+    ws_core_callbacks_t cb;
+    void *user;
+    ws_core_mutex_t lock;
+    ws_core_work_t *work_head;
+    ws_core_work_t *work_tail;
+    uint16_t adopting;
+    uint32_t accepted;
+    uint32_t rejected;
+};
+
+int ws_core_parse_http(const char *buf, size_t len, ws_core_http_t *out);
+void ws_core_accept_key(const char *key, size_t key_len, char out[WS_CORE_ACCEPT_LEN + 1]);
+int ws_core_decode_frame(uint8_t *buf, size_t len, size_t max_payload, ws_core_frame_t *out);
+size_t ws_core_encode_header(uint8_t *out, uint8_t opcode, bool fin, size_t len);
+
+bool ws_core_init(ws_core_t *core, const ws_core_config_t *config,
+                  const ws_core_callbacks_t *cb, void *user);
+void ws_core_destroy(ws_core_t *core);
+bool ws_core_poll(ws_core_t *core, int timeout_ms);
+
+bool ws_core_queue_work(ws_core_t *core, ws_core_work_fn fn, void *arg);
+int ws_core_send(ws_core_t *core, int fd, const char *data, size_t len);
+int ws_core_sendv(ws_core_t *core, int fd, const struct iovec *iov, int iovcnt);
+bool ws_core_close(ws_core_t *core, int fd);
+bool ws_core_adopt(ws_core_t *core, int fd);
+uint16_t ws_core_load(ws_core_t *core);
+ws_deflate_t *ws_core_deflate(ws_core_t *core, int fd);
+
+#endif
@@ -0,0 +1,268 @@
+#include "ws_deflate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define WS_DEFLATE_LEVEL 6
+
+static const uint8_t SYNC_TAIL[4] = { 0x00, 0x00, 0xff, 0xff };
+
+static const char *trim(const char *p, const char *end, const char **out_end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (end - p >= 2 && *p == '"' && end[-1] == '"') {
+        p++;
+        end--;
+    }
+    *out_end = end;
+    return p;
+}
+
+static bool token_eq(const char *p, const char *end, const char *lit)
+{
+    size_t len = strlen(lit);
+    return (size_t)(end - p) == len && strncasecmp(p, lit, len) == 0;
+}
+
+static int parse_bits(const char *p, const char *end)
+{
+    if (end - p < 1 || end - p > 2) return -1;
+    int v = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return -1;
+        v = v * 10 + (*p - '0');
+    }
+    return v >= 8 && v <= WS_DEFLATE_MAX_WINDOW_BITS ? v : -1;
+}
+
+static bool parse_offer(const char *p, const char *end, const ws_deflate_config_t *config,
+                        ws_deflate_params_t *out)
+{
+    const char *semi = memchr(p, ';', (size_t)(end - p));
+    const char *name_end;
+    const char *name = trim(p, semi ? semi : end, &name_end);
+    if (!token_eq(name, name_end, "permessage-deflate")) return false;
+
+    ws_deflate_params_t params = {
+        .server_window_bits = config->window_bits,
+        .client_window_bits = WS_DEFLATE_MAX_WINDOW_BITS,
+    };
+    bool seen_server_bits = false;
+    bool seen_client_nct = false;
+
+    while (semi) {
+        p = semi + 1;
+        semi = memchr(p, ';', (size_t)(end - p));
+        const char *param_end = semi ? semi : end;
+        const char *eq = memchr(p, '=', (size_t)(param_end - p));
+
+        const char *key_end;
+        const char *key = trim(p, eq ? eq : param_end, &key_end);
+        const char *val = NULL;
+        const char *val_end = NULL;
+        if (eq) {
+            val = trim(eq + 1, param_end, &val_end);
+        }
+
+        if (token_eq(key, key_end, "server_no_context_takeover")) {
+            if (val || params.server_no_context_takeover) return false;
+            params.server_no_context_takeover = true;
+        } else if (token_eq(key, key_end, "client_no_context_takeover")) {
+            if (val || seen_client_nct) return false;
+            seen_client_nct = true;
+        } else if (token_eq(key, key_end, "server_max_window_bits")) {
+            int bits = val ? parse_bits(val, val_end) : -1;
+            if (bits < WS_DEFLATE_MIN_WINDOW_BITS || seen_server_bits) return false;
+            seen_server_bits = true;
+            if (bits < params.server_window_bits) params.server_window_bits = (uint8_t)bits;
+        } else if (token_eq(key, key_end, "client_max_window_bits")) {
+            int bits = val ? parse_bits(val, val_end) : WS_DEFLATE_MAX_WINDOW_BITS;
+            if (bits < 0 || params.client_window_negotiated) return false;
+            params.client_window_negotiated = true;
+            params.client_window_bits = (uint8_t)(bits < config->window_bits ? bits : config->window_bits);
+        } else {
+            return false;
+        }
+    }
+
+    *out = params;
+    return true;
+}
+
+bool ws_deflate_negotiate(const char *offers, size_t len, const ws_deflate_config_t *config,
+                          ws_deflate_params_t *out)
+{
+    if (!config->enabled || !offers) return false;
+
+    const char *p = offers;
+    const char *end = offers + len;
+    while (p < end) {
+        const char *comma = memchr(p, ',', (size_t)(end - p));
+        if (parse_offer(p, comma ? comma : end, config, out)) return true;
+        p = comma ? comma + 1 : end;
+    }
+    return false;
+}
+
+size_t ws_deflate_response(const ws_deflate_params_t *params, char *out, size_t size)
+{
+    int n = snprintf(out, size, "Sec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover");
+    if (n > 0 && params->server_no_context_takeover) {
+        n += snprintf(out + n, size > (size_t)n ? size - n : 0, "; server_no_context_takeover");
+    }
+    if (n > 0 && params->server_window_bits < WS_DEFLATE_MAX_WINDOW_BITS) {
+        n += snprintf(out + n, size > (size_t)n ? size - n : 0, "; server_max_window_bits=%u",
+                      params->server_window_bits);
+    }
+    if (n > 0 && params->client_window_negotiated) {
+        n += snprintf(out + n, size > (size_t)n ? size - n : 0, "; client_max_window_bits=%u",
+                      params->client_window_bits);
+    }
+    if (n > 0) {
+        n += snprintf(out + n, size > (size_t)n ? size - n : 0, "\r\n");
+    }
+    return n < 0 || (size_t)n >= size ? 0 : (size_t)n;
+}
+
+ws_deflate_t *ws_deflate_create(const ws_deflate_params_t *params, uint8_t mem_level)
+{
+    ws_deflate_t *d = calloc(1, sizeof(ws_deflate_t));
+    if (!d) return NULL;
+    d->params = *params;
+    d->mem_level = mem_level;
+    return d;
+}
+
+void ws_deflate_destroy(ws_deflate_t *d)
+{
+    if (!d) return;
+    if (d->tx_ready) {
+        deflateEnd(&d->tx);
+    }
+    free(d);
+}
+
+static void reset_tx(ws_deflate_t *d)
+{
+    deflateEnd(&d->tx);
+    d->tx_ready = false;
+}
+
+static bool deflate_part(ws_deflate_t *d, const char *data, size_t len, int flush)
+{
+    d->tx.next_in = (Bytef *)data;
+    d->tx.avail_in = (uInt)len;
+    int ret = deflate(&d->tx, flush);
+    return (ret == Z_OK || ret == Z_BUF_ERROR) && d->tx.avail_in == 0;
+}
+
+bool ws_deflate_compress(ws_deflate_t *d, const char *head, size_t head_len,
+                         const char *body, size_t body_len, uint8_t **out, size_t *out_len)
+{
+    if (!d->tx_ready) {
+        memset(&d->tx, 0, sizeof(d->tx));
+        if (deflateInit2(&d->tx, WS_DEFLATE_LEVEL, Z_DEFLATED, -(int)d->params.server_window_bits,
+                         d->mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        d->tx_ready = true;
+    }
+
+    size_t cap = deflateBound(&d->tx, head_len + body_len) + sizeof(SYNC_TAIL) + 8;
+    uint8_t *buf = malloc(cap);
+    if (!buf) return false;
+
+    d->tx.next_out = buf;
+    d->tx.avail_out = (uInt)cap;
+    bool ok = deflate_part(d, head, head_len, Z_NO_FLUSH) &&
+              deflate_part(d, body, body_len, Z_SYNC_FLUSH) &&
+              d->tx.avail_out > 0;
+
+    size_t produced = cap - d->tx.avail_out;
+    if (!ok || produced < sizeof(SYNC_TAIL) ||
+        memcmp(buf + produced - sizeof(SYNC_TAIL), SYNC_TAIL, sizeof(SYNC_TAIL)) != 0) {
+        free(buf);
+        reset_tx(d);
+        return false;
+    }
+
+    if (d->params.server_no_context_takeover) {
+        deflateReset(&d->tx);
+    }
+    *out = buf;
+    *out_len = produced - sizeof(SYNC_TAIL);
+    return true;
+}
+
+static bool grow_output(rx_pool_t *pool, z_stream *rx, char **buf, size_t *cap, size_t max_out)
+{
+    size_t used = *cap - rx->avail_out;
+    if (*cap >= max_out) return false;
+
+    size_t next = *cap * 2;
+    if (next > max_out) next = max_out;
+    char *grown = rx_pool_grow(pool, *buf, used, next);
+    if (!grown) return false;
+
+    *buf = grown;
+    *cap = rx_pool_capacity(grown) < max_out ? rx_pool_capacity(grown) : max_out;
+    rx->next_out = (Bytef *)grown + used;
+    rx->avail_out = (uInt)(*cap - used);
+    return true;
+}
+
+bool ws_deflate_decompress(ws_deflate_t *d, rx_pool_t *pool, const uint8_t *in, size_t len,
+                           size_t max_out, char **out, size_t *out_len)
+{
+    int bits = d->params.client_window_bits < WS_DEFLATE_MIN_WINDOW_BITS
+                   ? WS_DEFLATE_MIN_WINDOW_BITS : d->params.client_window_bits;
+    z_stream rx;
+    memset(&rx, 0, sizeof(rx));
+    if (inflateInit2(&rx, -bits) != Z_OK) return false;
+
+    size_t cap = len * 4 + 64;
+    if (cap > max_out) cap = max_out;
+    char *buf = rx_pool_alloc(pool, cap);
+    if (!buf) {
+        inflateEnd(&rx);
+        return false;
+    }
+    cap = rx_pool_capacity(buf) < max_out ? rx_pool_capacity(buf) : max_out;
+
+    rx.next_out = (Bytef *)buf;
+    rx.avail_out = (uInt)cap;
+
+    const uint8_t *inputs[2] = { in, SYNC_TAIL };
+    size_t lens[2] = { len, sizeof(SYNC_TAIL) };
+    bool ok = true;
+    int ret = Z_OK;
+    for (int i = 0; i < 2 && ok && ret != Z_STREAM_END; i++) {
+        rx.next_in = (Bytef *)inputs[i];
+        rx.avail_in = (uInt)lens[i];
+        do {
+            if (rx.avail_out == 0 && !grow_output(pool, &rx, &buf, &cap, max_out)) {
+                ok = false;
+                break;
+            }
+            ret = inflate(&rx, Z_SYNC_FLUSH);
+            if (ret == Z_STREAM_END) break;
+            if (ret != Z_OK && !(ret == Z_BUF_ERROR && (rx.avail_in == 0 || rx.avail_out == 0))) {
+                ok = false;
+                break;
+            }
+        } while (rx.avail_in > 0 || rx.avail_out == 0);
+    }
+    inflateEnd(&rx);
+
+    if (!ok) {
+        rx_pool_release(pool, buf);
+        return false;
+    }
+    *out_len = cap - rx.avail_out;
+    buf[*out_len] = '\0';
+    *out = buf;
+    return true;
+}
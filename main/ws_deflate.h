@@ -0,0 +1,46 @@
+#ifndef WS_DEFLATE_H
+#define WS_DEFLATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "zlib.h"
+#include "rx_pool.h"
+
+#define WS_DEFLATE_MIN_WINDOW_BITS 9
+#define WS_DEFLATE_MAX_WINDOW_BITS 15
+#define WS_DEFLATE_RESPONSE_MAX    160
+
+typedef struct {
+    bool enabled;
+    uint8_t window_bits;
+    uint8_t mem_level;
+} ws_deflate_config_t;
+
+typedef struct {
+    uint8_t server_window_bits;
+    uint8_t client_window_bits;
+    bool server_no_context_takeover;
+    bool client_window_negotiated;
+} ws_deflate_params_t;
+
+typedef struct {
+    ws_deflate_params_t params;
+    uint8_t mem_level;
+    bool tx_ready;
+    z_stream tx;
+} ws_deflate_t;
+
+bool ws_deflate_negotiate(const char *offers, size_t len, const ws_deflate_config_t *config,
+                          ws_deflate_params_t *out);
+size_t ws_deflate_response(const ws_deflate_params_t *params, char *out, size_t size);
+
+ws_deflate_t *ws_deflate_create(const ws_deflate_params_t *params, uint8_t mem_level);
+void ws_deflate_destroy(ws_deflate_t *d);
+
+bool ws_deflate_compress(ws_deflate_t *d, const char *head, size_t head_len,
+                         const char *body, size_t body_len, uint8_t **out, size_t *out_len);
+bool ws_deflate_decompress(ws_deflate_t *d, rx_pool_t *pool, const uint8_t *in, size_t len,
+                           size_t max_out, char **out, size_t *out_len);
+
+#endif
@@ -2,6 +2,10 @@
 #include "nip11.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
@@ -13,8 +17,42 @@
 static const char *TAG = "ws_server";
 static ws_message_cb_t g_message_callback = NULL;
 static ws_disconnect_cb_t g_disconnect_callback = NULL;
+static ws_idle_cb_t g_idle_callback = NULL;
 static ws_server_t *g_server = NULL;
-static __thread httpd_req_t *g_current_req = NULL;
+
+#define WS_HEADER_MAX 10
+#define WS_BATCH_IOV  32
+
+#define WS_OPCODE_TEXT         0x1
+#define WS_OPCODE_PING         0x9
+#define WS_OPCODE_PONG         0xA
+
+#define WS_REAPER_STACK        3072
+#define WS_REAPER_PRIORITY     2
+#define WS_REAPER_TICK_MS      1000
+#define WS_REAPER_STOP_WAIT_MS 2000
+
+#define WS_CORE_TASK_STACK     6144
+#define WS_CORE_POLL_MS        1000
+#define WS_CORE_STOP_WAIT_MS   2000
+
+#ifdef CONFIG_WISP_RX_POOL_PSRAM
+#define WS_RX_POOL_PSRAM       true
+#else
+#define WS_RX_POOL_PSRAM       false
+#endif
+
+#ifdef CONFIG_WISP_WS_DEFLATE
+#define WS_DEFLATE_MIN_BYTES   CONFIG_WISP_WS_DEFLATE_MIN_BYTES
+#else
+#define WS_DEFLATE_MIN_BYTES   SIZE_MAX
+#endif
+
+#define WS_BUSY_NOTICE "[\"NOTICE\",\"rate-limited: relay busy, message dropped\"]"
+
+static esp_err_t send_control(ws_server_t *server, int fd, uint8_t opcode,
+                              const char *payload, size_t len);
+static void schedule_flush(ws_server_t *server, ws_connection_t *conn);
 
 static ws_connection_t* find_free_slot(ws_server_t *server)
 {
@@ -36,12 +74,133 @@ static ws_connection_t* find_connection_by_fd(ws_server_t *server, int fd)
     return NULL;
 }
 
-static void update_connection_activity(ws_server_t *server, int fd)
+static BaseType_t instance_core(uint8_t index)
+{
+    if (CONFIG_WISP_HTTPD_CORE < 0) return tskNO_AFFINITY;
+    return (CONFIG_WISP_HTTPD_CORE + index) % portNUM_PROCESSORS;
+}
+
+static ws_instance_t *instance_of(ws_server_t *server, const ws_connection_t *conn)
+{
+    return &server->instances[conn->instance];
+}
+
+static bool transport_running(const ws_server_t *server)
+{
+    return server->instance_count > 0;
+}
+
+static esp_err_t transport_queue_work(ws_instance_t *inst, void (*fn)(void *), void *arg)
+{
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    return ws_core_queue_work(&inst->core, fn, arg) ? ESP_OK : ESP_ERR_NO_MEM;
+#else
+    return httpd_queue_work(inst->server, fn, arg);
+#endif
+}
+
+static int transport_send(ws_instance_t *inst, int fd, const char *data, size_t len)
+{
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    return ws_core_send(&inst->core, fd, data, len);
+#else
+    int n = httpd_socket_send(inst->server, fd, data, len, MSG_DONTWAIT);
+    return n == HTTPD_SOCK_ERR_TIMEOUT ? 0 : n;
+#endif
+}
+
+static int transport_sendv(ws_instance_t *inst, int fd, const struct iovec *iov, int iovcnt)
+{
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    return ws_core_sendv(&inst->core, fd, iov, iovcnt);
+#else
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        int n = transport_send(inst, fd, iov[i].iov_base, iov[i].iov_len);
+        if (n < 0) return -1;
+        total += n;
+        if ((size_t)n < iov[i].iov_len) break;
+    }
+    return total;
+#endif
+}
+
+static bool transport_notifies_writable(void)
+{
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void transport_close(ws_instance_t *inst, int fd)
+{
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    ws_core_close(&inst->core, fd);
+#else
+    httpd_sess_trigger_close(inst->server, fd);
+#endif
+}
+
+static void close_fd(ws_server_t *server, int fd)
 {
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    ws_instance_t *inst = conn ? instance_of(server, conn) : NULL;
+    xSemaphoreGive(server->lock);
+
+    if (inst) {
+        transport_close(inst, fd);
+    }
+}
+
+struct ws_out_frame {
+    ws_out_frame_t *next;
+    ws_frame_t *body;
+    int64_t enqueued_at;
+    size_t bytes;
+    size_t len;
+    uint8_t opcode;
+    bool live;
+    bool compress;
+    char data[];
+};
+
+static void free_out_frame(ws_out_frame_t *frame)
+{
+    ws_frame_release(frame->body);
+    free(frame);
+}
+
+static void clear_out_queue(ws_connection_t *conn)
+{
+    while (conn->out_head) {
+        ws_out_frame_t *frame = conn->out_head;
+        conn->out_head = frame->next;
+        free_out_frame(frame);
+    }
+    conn->out_tail = NULL;
+    conn->out_bytes = 0;
+    conn->out_frames = 0;
+    free(conn->tx_pending);
+    conn->tx_pending = NULL;
+    conn->tx_pending_len = 0;
+    memset(&conn->tx_pending_stamps, 0, sizeof(conn->tx_pending_stamps));
+    conn->tx_blocked = false;
+}
+
+static void update_connection_activity(ws_server_t *server, int fd, bool message)
+{
+    uint32_t now = esp_timer_get_time() / 1000000;
     xSemaphoreTake(server->lock, portMAX_DELAY);
     ws_connection_t *conn = find_connection_by_fd(server, fd);
     if (conn) {
-        conn->last_activity = esp_timer_get_time() / 1000000;
+        conn->last_seen = now;
+        conn->ping_sent_at = 0;
+        if (message) {
+            conn->last_activity = now;
+        }
     }
     xSemaphoreGive(server->lock);
 }
@@ -83,23 +242,23 @@ static void get_client_ip(int fd, char *ip_buf, size_t buf_len)
     }
 }
 
-static esp_err_t on_open(httpd_handle_t hd, int sockfd)
+static bool conn_open(int sockfd, uint8_t instance)
 {
-    if (!g_server) return ESP_FAIL;
+    if (!g_server) return false;
 
     xSemaphoreTake(g_server->lock, portMAX_DELAY);
 
     if (g_server->connection_count >= WS_MAX_CONNECTIONS) {
         xSemaphoreGive(g_server->lock);
         ESP_LOGW(TAG, "Connection rejected - max connections reached");
-        return ESP_FAIL;
+        return false;
     }
 
     ws_connection_t *conn = find_free_slot(g_server);
     if (!conn) {
         xSemaphoreGive(g_server->lock);
         ESP_LOGE(TAG, "No free slot despite connection_count < WS_MAX_CONNECTIONS (fd=%d)", sockfd);
-        return ESP_FAIL;
+        return false;
     }
 
     struct linger so_linger = { .l_onoff = 1, .l_linger = 0 };
@@ -110,22 +269,25 @@ static esp_err_t on_open(httpd_handle_t hd, int sockfd)
 
     conn->fd = sockfd;
     conn->active = true;
+    conn->instance = instance;
     conn->connected_at = esp_timer_get_time() / 1000000;
     conn->last_activity = conn->connected_at;
+    conn->last_seen = conn->connected_at;
     get_client_ip(sockfd, conn->remote_ip, sizeof(conn->remote_ip));
     g_server->connection_count++;
-    ESP_LOGI(TAG, "New connection from %s (fd=%d, total=%d)",
-             conn->remote_ip, sockfd, g_server->connection_count);
+    ESP_LOGI(TAG, "New connection from %s (fd=%d, instance=%u, total=%d)",
+             conn->remote_ip, sockfd, instance, g_server->connection_count);
 
     xSemaphoreGive(g_server->lock);
-    return ESP_OK;
+    return true;
 }
 
-static void on_close(httpd_handle_t hd, int sockfd)
+static void conn_close(int sockfd)
 {
     if (!g_server) return;
 
-    if (g_disconnect_callback) {
+    if (worker_pool_submit_disconnect(&g_server->workers, sockfd) != ESP_OK &&
+        g_disconnect_callback) {
         g_disconnect_callback(sockfd);
     }
 
@@ -134,6 +296,7 @@ static void on_close(httpd_handle_t hd, int sockfd)
     ws_connection_t *conn = find_connection_by_fd(g_server, sockfd);
     if (conn) {
         ESP_LOGI(TAG, "Connection closed (fd=%d, ip=%s)", sockfd, conn->remote_ip);
+        clear_out_queue(conn);
         memset(conn, 0, sizeof(ws_connection_t));
         g_server->connection_count--;
     }
@@ -141,11 +304,210 @@ static void on_close(httpd_handle_t hd, int sockfd)
     xSemaphoreGive(g_server->lock);
 }
 
+static bool submit_text(int fd, char *payload, size_t len)
+{
+    ESP_LOGD(TAG, "Received %zu bytes from fd=%d", len, fd);
+    if (worker_pool_submit(&g_server->workers, fd, payload, len,
+                           pdMS_TO_TICKS(CONFIG_WISP_WORKER_SUBMIT_TIMEOUT_MS)) == ESP_OK) {
+        return true;
+    }
+    ws_server_send(g_server, fd, WS_BUSY_NOTICE, sizeof(WS_BUSY_NOTICE) - 1);
+    return false;
+}
+
 void ws_server_set_disconnect_cb(ws_disconnect_cb_t cb)
 {
     g_disconnect_callback = cb;
 }
 
+void ws_server_set_idle_cb(ws_idle_cb_t cb)
+{
+    g_idle_callback = cb;
+}
+
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+static bool core_on_open(void *user, int fd)
+{
+    ws_server_t *server = g_server;
+    return server && conn_open(fd, (uint8_t)((ws_instance_t *)user - server->instances));
+}
+
+static bool core_on_accept(void *user, int fd)
+{
+    ws_server_t *server = g_server;
+    if (!server) return false;
+
+    ws_instance_t *self = user;
+    ws_instance_t *target = self;
+    uint16_t best = ws_core_load(&self->core);
+    for (uint8_t i = 0; i < server->instance_count; i++) {
+        uint16_t load = ws_core_load(&server->instances[i].core);
+        if (load < best) {
+            best = load;
+            target = &server->instances[i];
+        }
+    }
+    return target != self && ws_core_adopt(&target->core, fd);
+}
+
+static void core_on_close(void *user, int fd)
+{
+    (void)user;
+    conn_close(fd);
+}
+
+static void core_on_activity(void *user, int fd)
+{
+    (void)user;
+    if (g_server) {
+        update_connection_activity(g_server, fd, false);
+    }
+}
+
+static void core_on_writable(void *user, int fd)
+{
+    (void)user;
+    ws_server_t *server = g_server;
+    if (!server) return;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    if (conn) {
+        conn->tx_blocked = false;
+        schedule_flush(server, conn);
+    }
+    xSemaphoreGive(server->lock);
+}
+
+static void core_on_message(void *user, int fd, char *data, size_t len)
+{
+    ws_instance_t *inst = user;
+    if (!g_server || len == 0) {
+        rx_pool_release(inst->core.rx_pool, data);
+        return;
+    }
+
+    update_connection_activity(g_server, fd, true);
+    if (!submit_text(fd, data, len)) {
+        rx_pool_release(&g_server->rx_pool, data);
+    }
+}
+
+static size_t core_on_http(void *user, const ws_core_http_t *req, char *resp, size_t resp_size)
+{
+    (void)user;
+    bool options = req->method_len == 7 && strncmp(req->method, "OPTIONS", 7) == 0;
+    bool get = req->method_len == 3 && strncmp(req->method, "GET", 3) == 0;
+    if (!options && !get) return 0;
+
+    bool nostr_json = false;
+    for (size_t i = 0; req->accept && i + 22 <= req->accept_len && !nostr_json; i++) {
+        nostr_json = strncmp(req->accept + i, "application/nostr+json", 22) == 0;
+    }
+    return nip11_build_response(resp, resp_size, options, nostr_json);
+}
+
+static void core_task(void *arg)
+{
+    ws_instance_t *inst = arg;
+    while (!inst->core_stop) {
+        ws_core_poll(&inst->core, WS_CORE_POLL_MS);
+    }
+    inst->core_task = NULL;
+    vTaskDelete(NULL);
+}
+
+static void core_wake(void *arg)
+{
+    (void)arg;
+}
+
+static void core_stop(ws_server_t *server)
+{
+    for (uint8_t i = 0; i < server->instance_count; i++) {
+        ws_instance_t *inst = &server->instances[i];
+        if (inst->core_task) {
+            inst->core_stop = true;
+            ws_core_queue_work(&inst->core, core_wake, NULL);
+        }
+    }
+    for (uint8_t i = 0; i < server->instance_count; i++) {
+        ws_instance_t *inst = &server->instances[i];
+        for (int waited = 0; inst->core_task && waited < WS_CORE_STOP_WAIT_MS; waited += 10) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        if (inst->core_task) {
+            ESP_LOGW(TAG, "WebSocket core task %u did not stop, deleting", i);
+            vTaskDelete(inst->core_task);
+            inst->core_task = NULL;
+        }
+    }
+    for (uint8_t i = 0; i < server->instance_count; i++) {
+        ws_core_destroy(&server->instances[i].core);
+    }
+    server->instance_count = 0;
+}
+
+static esp_err_t core_start(ws_server_t *server, uint16_t port)
+{
+    ws_core_config_t config = {
+        .port = port,
+        .max_conns = WS_MAX_CONNECTIONS,
+        .max_frame = WS_MAX_FRAME_SIZE,
+        .use_psram = true,
+        .rx_pool = &server->rx_pool,
+#ifdef CONFIG_WISP_WS_DEFLATE
+        .deflate = {
+            .enabled = true,
+            .window_bits = CONFIG_WISP_WS_DEFLATE_WINDOW_BITS,
+            .mem_level = CONFIG_WISP_WS_DEFLATE_MEM_LEVEL,
+        },
+#endif
+    };
+    ws_core_callbacks_t cb = {
+        .on_open = core_on_open,
+        .on_message = core_on_message,
+        .on_close = core_on_close,
+        .on_activity = core_on_activity,
+        .on_writable = core_on_writable,
+        .on_accept = core_on_accept,
+        .on_http = core_on_http,
+    };
+    for (uint8_t i = 0; i < WS_MAX_INSTANCES; i++) {
+        config.adopt_only = i > 0;
+        if (!ws_core_init(&server->instances[i].core, &config, &cb, &server->instances[i])) {
+            core_stop(server);
+            return ESP_FAIL;
+        }
+        server->instance_count = i + 1;
+    }
+
+    for (uint8_t i = WS_MAX_INSTANCES; i-- > 0;) {
+        ws_instance_t *inst = &server->instances[i];
+        char name[12];
+        snprintf(name, sizeof(name), "ws_core%u", i);
+        inst->core_stop = false;
+        if (xTaskCreatePinnedToCore(core_task, name, WS_CORE_TASK_STACK, inst,
+                                    CONFIG_WISP_HTTPD_PRIORITY, &inst->core_task,
+                                    instance_core(i)) != pdPASS) {
+            inst->core_task = NULL;
+            core_stop(server);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+#else
+static esp_err_t on_open(httpd_handle_t hd, int sockfd)
+{
+    return conn_open(sockfd, 0) ? ESP_OK : ESP_FAIL;
+}
+
+static void on_close(httpd_handle_t hd, int sockfd)
+{
+    conn_close(sockfd);
+}
+
 static esp_err_t ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
@@ -177,7 +539,10 @@ static esp_err_t ws_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    ws_pkt.payload = malloc(ws_pkt.len + 1);
+    ws_server_t *server = g_server;
+    if (!server) return ESP_FAIL;
+
+    ws_pkt.payload = (uint8_t *)rx_pool_alloc(&server->rx_pool, ws_pkt.len);
     if (!ws_pkt.payload) {
         ESP_LOGE(TAG, "Failed to allocate %zu bytes", ws_pkt.len);
         return ESP_ERR_NO_MEM;
@@ -186,40 +551,34 @@ static esp_err_t ws_handler(httpd_req_t *req)
     ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to receive frame: %d", ret);
-        free(ws_pkt.payload);
+        rx_pool_release(&server->rx_pool, (char *)ws_pkt.payload);
         return ret;
     }
 
     ((char *)ws_pkt.payload)[ws_pkt.len] = '\0';
 
     int fd = httpd_req_to_sockfd(req);
-    if (g_server) {
-        update_connection_activity(g_server, fd);
-    }
+    update_connection_activity(server, fd, ws_pkt.type == HTTPD_WS_TYPE_TEXT);
 
     switch (ws_pkt.type) {
         case HTTPD_WS_TYPE_TEXT:
-            ESP_LOGD(TAG, "Received %zu bytes from fd=%d", ws_pkt.len, fd);
-            if (g_message_callback) {
-                g_current_req = req;
-                g_message_callback(fd, (char *)ws_pkt.payload, ws_pkt.len);
-                g_current_req = NULL;
+            if (submit_text(fd, (char *)ws_pkt.payload, ws_pkt.len)) {
+                return ESP_OK;
             }
             break;
 
         case HTTPD_WS_TYPE_PING:
-            ws_pkt.type = HTTPD_WS_TYPE_PONG;
-            ret = httpd_ws_send_frame(req, &ws_pkt);
+            ret = send_control(server, fd, WS_OPCODE_PONG, (const char *)ws_pkt.payload, ws_pkt.len);
             if (ret != ESP_OK) {
                 ESP_LOGW(TAG, "Failed to send PONG to fd=%d: %d", fd, ret);
-                free(ws_pkt.payload);
+                rx_pool_release(&server->rx_pool, (char *)ws_pkt.payload);
                 return ret;
             }
             break;
 
         case HTTPD_WS_TYPE_CLOSE: {
             ESP_LOGD(TAG, "Received CLOSE frame from fd=%d", fd);
-            free(ws_pkt.payload);
+            rx_pool_release(&server->rx_pool, (char *)ws_pkt.payload);
             httpd_ws_frame_t close_pkt = {
                 .type = HTTPD_WS_TYPE_CLOSE,
                 .payload = NULL,
@@ -233,43 +592,578 @@ static esp_err_t ws_handler(httpd_req_t *req)
             break;
     }
 
-    free(ws_pkt.payload);
+    rx_pool_release(&server->rx_pool, (char *)ws_pkt.payload);
     return ESP_OK;
 }
+#endif
+
+static ws_out_frame_t *pop_out_frame(ws_connection_t *conn)
+{
+    ws_out_frame_t *frame = conn->out_head;
+    if (!frame) return NULL;
+    conn->out_head = frame->next;
+    if (!conn->out_head) {
+        conn->out_tail = NULL;
+    }
+    conn->out_bytes -= frame->bytes;
+    conn->out_frames--;
+    return frame;
+}
+
+static bool drop_oldest_live(ws_connection_t *conn)
+{
+    ws_out_frame_t **link = &conn->out_head;
+    ws_out_frame_t *prev = NULL;
+    while (*link && !(*link)->live) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    ws_out_frame_t *frame = *link;
+    if (!frame) return false;
+
+    *link = frame->next;
+    if (conn->out_tail == frame) {
+        conn->out_tail = prev;
+    }
+    conn->out_bytes -= frame->bytes;
+    conn->out_frames--;
+    conn->out_dropped++;
+    free_out_frame(frame);
+    return true;
+}
+
+static size_t ws_frame_header(char *out, uint8_t opcode, size_t payload_len, bool compressed)
+{
+    out[0] = (char)(0x80 | (compressed ? 0x40 : 0) | opcode);
+    if (payload_len < 126) {
+        out[1] = (char)payload_len;
+        return 2;
+    }
+    if (payload_len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (char)(payload_len >> 8);
+        out[3] = (char)payload_len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = (char)((uint64_t)payload_len >> (56 - 8 * i));
+    }
+    return WS_HEADER_MAX;
+}
 
 typedef struct {
-    httpd_handle_t hd;
+    ws_server_t *server;
+    ws_instance_t *inst;
     int fd;
-    char *data;
     size_t len;
-} async_send_arg_t;
+    struct iovec iov[WS_BATCH_IOV];
+    int iovcnt;
+    ws_frame_t *held[WS_BATCH_IOV];
+    int held_count;
+    char *spill;
+    size_t spill_len;
+    size_t spill_cap;
+    bool blocked;
+    ws_send_stamps_t stamps;
+} ws_batch_t;
+
+static void stamp_frame(ws_send_stamps_t *stamps, int64_t enqueued_at)
+{
+    if (stamps->frames == 0 || enqueued_at < stamps->oldest) stamps->oldest = enqueued_at;
+    if (stamps->frames == 0 || enqueued_at > stamps->newest) stamps->newest = enqueued_at;
+    stamps->sum += enqueued_at;
+    stamps->frames++;
+}
 
-static void ws_async_send(void *arg)
+// Live frames count as sent once the whole batch carrying them has been
+// accepted by the socket, so a blocked batch records on the flush that drains it.
+static void record_sent(ws_server_t *server, const ws_send_stamps_t *stamps)
 {
-    async_send_arg_t *a = (async_send_arg_t *)arg;
+    if (stamps->frames == 0) return;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t oldest = (uint32_t)(now - stamps->oldest);
+    atomic_fetch_add(&server->live_sent, stamps->frames);
+    atomic_fetch_add(&server->live_total_us, (unsigned long long)(now * stamps->frames - stamps->sum));
+    atomic_store(&server->live_last_us, (uint32_t)(now - stamps->newest));
+    unsigned int peak = atomic_load(&server->live_max_us);
+    while (oldest > peak && !atomic_compare_exchange_weak(&server->live_max_us, &peak, oldest)) {
+    }
+}
 
-    httpd_ws_frame_t ws_pkt = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)a->data,
-        .len = a->len,
-    };
+static esp_err_t batch_spill(ws_batch_t *batch, const char *data, size_t len)
+{
+    if (len > batch->spill_cap - batch->spill_len) {
+        size_t cap = batch->spill_cap ? batch->spill_cap * 2 : CONFIG_WISP_OUTQ_COALESCE_BYTES;
+        if (cap < batch->spill_len + len) cap = batch->spill_len + len;
+        char *spill = realloc(batch->spill, cap);
+        if (!spill) return ESP_ERR_NO_MEM;
+        batch->spill = spill;
+        batch->spill_cap = cap;
+    }
+    memcpy(batch->spill + batch->spill_len, data, len);
+    batch->spill_len += len;
+    return ESP_OK;
+}
+
+static esp_err_t batch_write(ws_batch_t *batch, const char *data, size_t len)
+{
+    if (!batch->blocked) {
+        int n = transport_send(batch->inst, batch->fd, data, len);
+        if (n < 0) return ESP_FAIL;
+        data += n;
+        len -= (size_t)n;
+        batch->blocked = len > 0;
+    }
+    return len > 0 ? batch_spill(batch, data, len) : ESP_OK;
+}
+
+static esp_err_t batch_resume(ws_batch_t *batch, char *pending, size_t len)
+{
+    int n = transport_send(batch->inst, batch->fd, pending, len);
+    if (n < 0) {
+        free(pending);
+        return ESP_FAIL;
+    }
+    if ((size_t)n == len) {
+        free(pending);
+        return ESP_OK;
+    }
+    memmove(pending, pending + n, len - (size_t)n);
+    batch->spill = pending;
+    batch->spill_len = len - (size_t)n;
+    batch->spill_cap = len;
+    batch->blocked = true;
+    return ESP_OK;
+}
+
+static void batch_reset(ws_batch_t *batch)
+{
+    for (int i = 0; i < batch->held_count; i++) {
+        ws_frame_release(batch->held[i]);
+    }
+    batch->held_count = 0;
+    batch->iovcnt = 0;
+    batch->len = 0;
+}
 
-    esp_err_t ret = httpd_ws_send_frame_async(a->hd, a->fd, &ws_pkt);
+// One gathered send covers the coalesced headers and prefixes plus every
+// shared body they point at; whatever the socket refuses moves to spill.
+static esp_err_t batch_flush(ws_batch_t *batch)
+{
+    esp_err_t ret = ESP_OK;
+    size_t skip = 0;
+    if (!batch->blocked && batch->iovcnt > 0) {
+        int n = transport_sendv(batch->inst, batch->fd, batch->iov, batch->iovcnt);
+        if (n < 0) ret = ESP_FAIL;
+        else skip = (size_t)n;
+    }
+    for (int i = 0; ret == ESP_OK && i < batch->iovcnt; i++) {
+        const struct iovec *v = &batch->iov[i];
+        if (skip >= v->iov_len) {
+            skip -= v->iov_len;
+            continue;
+        }
+        batch->blocked = true;
+        ret = batch_spill(batch, (const char *)v->iov_base + skip, v->iov_len - skip);
+        skip = 0;
+    }
+    batch_reset(batch);
+    return ret;
+}
+
+static esp_err_t batch_append(ws_batch_t *batch, const char *data, size_t len)
+{
+    if (len > CONFIG_WISP_OUTQ_COALESCE_BYTES - batch->len || batch->iovcnt == WS_BATCH_IOV) {
+        esp_err_t ret = batch_flush(batch);
+        if (ret != ESP_OK) return ret;
+        if (len > CONFIG_WISP_OUTQ_COALESCE_BYTES) {
+            return batch_write(batch, data, len);
+        }
+    }
+    char *dst = batch->inst->coalesce_buf + batch->len;
+    memcpy(dst, data, len);
+    batch->len += len;
+    struct iovec *last = batch->iovcnt > 0 ? &batch->iov[batch->iovcnt - 1] : NULL;
+    if (last && (char *)last->iov_base + last->iov_len == dst) {
+        last->iov_len += len;
+    } else {
+        batch->iov[batch->iovcnt++] = (struct iovec){ .iov_base = dst, .iov_len = len };
+    }
+    return ESP_OK;
+}
+
+static esp_err_t batch_share(ws_batch_t *batch, ws_frame_t *body)
+{
+#ifndef CONFIG_WISP_WS_BACKEND_CORE
+    // httpd has no gathered send, and a socket call per body costs more
+    // than copying it into the coalesced write
+    return batch_append(batch, body->data, body->len);
+#endif
+    if (batch->iovcnt == WS_BATCH_IOV) {
+        esp_err_t ret = batch_flush(batch);
+        if (ret != ESP_OK) return ret;
+    }
+    ws_frame_retain(body);
+    batch->held[batch->held_count++] = body;
+    batch->iov[batch->iovcnt++] = (struct iovec){ .iov_base = body->data, .iov_len = body->len };
+    return ESP_OK;
+}
+
+static esp_err_t batch_compressed(ws_batch_t *batch, const ws_out_frame_t *frame, bool *sent)
+{
+    *sent = false;
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    ws_deflate_t *deflate = ws_core_deflate(&batch->inst->core, batch->fd);
+    uint8_t *out;
+    size_t out_len;
+    if (!deflate || !ws_deflate_compress(deflate, frame->data, frame->len,
+                                         frame->body ? frame->body->data : NULL,
+                                         frame->body ? frame->body->len : 0, &out, &out_len)) {
+        return ESP_OK;
+    }
+
+    char header[WS_HEADER_MAX];
+    size_t header_len = ws_frame_header(header, frame->opcode, out_len, true);
+    esp_err_t ret = batch_append(batch, header, header_len);
+    if (ret == ESP_OK) {
+        ret = batch_append(batch, (const char *)out, out_len);
+    }
+    free(out);
+    atomic_fetch_add(&batch->server->tx_raw_bytes, frame->bytes);
+    atomic_fetch_add(&batch->server->tx_wire_bytes, out_len);
+    *sent = true;
+    return ret;
+#else
+    return ESP_OK;
+#endif
+}
+
+static esp_err_t batch_frame(ws_batch_t *batch, const ws_out_frame_t *frame)
+{
+    if (frame->enqueued_at) {
+        stamp_frame(&batch->stamps, frame->enqueued_at);
+    }
+    if (frame->compress) {
+        bool sent;
+        esp_err_t ret = batch_compressed(batch, frame, &sent);
+        if (sent || ret != ESP_OK) return ret;
+    }
+
+    size_t body_len = frame->body ? frame->body->len : 0;
+    char header[WS_HEADER_MAX];
+    size_t header_len = ws_frame_header(header, frame->opcode, frame->len + body_len, false);
+    atomic_fetch_add(&batch->server->tx_raw_bytes, frame->bytes);
+    atomic_fetch_add(&batch->server->tx_wire_bytes, frame->bytes);
+
+    esp_err_t ret = batch_append(batch, header, header_len);
+    if (ret == ESP_OK) {
+        ret = batch_append(batch, frame->data, frame->len);
+    }
+    if (ret == ESP_OK && body_len > 0) {
+        ret = batch_share(batch, frame->body);
+    }
+    return ret;
+}
+
+static void ws_flush_work(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    ws_server_t *server = g_server;
+    if (!server) return;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    if (!conn) {
+        xSemaphoreGive(server->lock);
+        return;
+    }
+    ws_batch_t batch = { .server = server, .inst = instance_of(server, conn), .fd = fd };
+    char *pending = conn->tx_pending;
+    size_t pending_len = conn->tx_pending_len;
+    batch.stamps = conn->tx_pending_stamps;
+    conn->tx_pending = NULL;
+    conn->tx_pending_len = 0;
+    memset(&conn->tx_pending_stamps, 0, sizeof(conn->tx_pending_stamps));
+    xSemaphoreGive(server->lock);
+
+    esp_err_t ret = pending ? batch_resume(&batch, pending, pending_len) : ESP_OK;
+    size_t taken = 0;
+    while (ret == ESP_OK && !batch.blocked) {
+        xSemaphoreTake(server->lock, portMAX_DELAY);
+        conn = find_connection_by_fd(server, fd);
+        if (!conn || !conn->out_head || taken >= CONFIG_WISP_OUTQ_COALESCE_BYTES) {
+            xSemaphoreGive(server->lock);
+            break;
+        }
+        ws_out_frame_t *frame = pop_out_frame(conn);
+        xSemaphoreGive(server->lock);
+
+        taken += frame->bytes;
+        ret = batch_frame(&batch, frame);
+        free_out_frame(frame);
+    }
+    if (ret == ESP_OK && batch.iovcnt > 0) {
+        ret = batch_flush(&batch);
+    }
+    batch_reset(&batch);
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    conn = find_connection_by_fd(server, fd);
+    if (conn && ret != ESP_OK) {
+        clear_out_queue(conn);
+    }
+    if (conn && ret == ESP_OK) {
+        conn->tx_pending = batch.spill;
+        conn->tx_pending_len = batch.spill_len;
+        if (batch.blocked) {
+            conn->tx_pending_stamps = batch.stamps;
+        }
+        conn->tx_blocked = batch.blocked && transport_notifies_writable();
+        batch.spill = NULL;
+    }
+    if (conn) {
+        conn->flush_scheduled = conn->out_head && ret == ESP_OK && !batch.blocked &&
+                                transport_queue_work(instance_of(server, conn), ws_flush_work, arg) == ESP_OK;
+    }
+    xSemaphoreGive(server->lock);
+    free(batch.spill);
+
+    if (ret == ESP_OK && !batch.blocked) {
+        record_sent(server, &batch.stamps);
+    }
     if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Async send failed to fd=%d: %d", a->fd, ret);
+        ESP_LOGW(TAG, "Send failed to fd=%d, closing", fd);
+        transport_close(batch.inst, fd);
     }
+}
 
-    free(a->data);
-    free(a);
+static void schedule_flush(ws_server_t *server, ws_connection_t *conn)
+{
+    if (conn->flush_scheduled || conn->tx_blocked || (!conn->out_head && !conn->tx_pending)) return;
+    if (conn->corked > 0 && conn->out_bytes < CONFIG_WISP_OUTQ_COALESCE_BYTES) return;
+
+    if (transport_queue_work(instance_of(server, conn), ws_flush_work,
+                             (void *)(intptr_t)conn->fd) == ESP_OK) {
+        conn->flush_scheduled = true;
+    } else {
+        ESP_LOGW(TAG, "Failed to schedule flush for fd=%d", conn->fd);
+    }
 }
 
-static void cleanup_server_init(ws_server_t *server, bool stop_httpd)
+static bool out_queue_full(const ws_connection_t *conn, size_t bytes)
 {
-    g_server = NULL;
-    g_message_callback = NULL;
-    if (stop_httpd && server->server) {
-        httpd_stop(server->server);
-        server->server = NULL;
+    return conn->out_bytes + conn->tx_pending_len + bytes > CONFIG_WISP_OUTQ_MAX_BYTES ||
+           conn->out_frames >= CONFIG_WISP_OUTQ_MAX_FRAMES;
+}
+
+static esp_err_t enqueue_out_frame(ws_server_t *server, int fd, ws_out_frame_t *frame)
+{
+    bool disconnect = false;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    if (!conn) {
+        xSemaphoreGive(server->lock);
+        free_out_frame(frame);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    bool full = out_queue_full(conn, frame->bytes);
+    while (full && drop_oldest_live(conn)) {
+        full = out_queue_full(conn, frame->bytes);
+    }
+
+    if (full) {
+        if (frame->live) {
+            conn->out_dropped++;
+        }
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        frame->next = NULL;
+        if (conn->out_tail) {
+            conn->out_tail->next = frame;
+        } else {
+            conn->out_head = frame;
+        }
+        conn->out_tail = frame;
+        conn->out_bytes += frame->bytes;
+        conn->out_frames++;
+        if (conn->out_bytes > conn->out_bytes_peak) {
+            conn->out_bytes_peak = conn->out_bytes;
+        }
+        frame = NULL;
+        schedule_flush(server, conn);
+    }
+
+    if (CONFIG_WISP_OUTQ_DISCONNECT_DROPS > 0 &&
+        conn->out_dropped >= CONFIG_WISP_OUTQ_DISCONNECT_DROPS && !conn->slow_closing) {
+        conn->slow_closing = true;
+        disconnect = true;
+    }
+    uint32_t dropped = conn->out_dropped;
+    ws_instance_t *inst = instance_of(server, conn);
+    xSemaphoreGive(server->lock);
+
+    if (frame) {
+        free_out_frame(frame);
+        ESP_LOGD(TAG, "Outbound queue full fd=%d", fd);
+    }
+    if (disconnect) {
+        ESP_LOGW(TAG, "Disconnecting slow consumer fd=%d (dropped=%" PRIu32 ")", fd, dropped);
+        transport_close(inst, fd);
+    }
+    return ret;
+}
+
+static void dispatch_message(int fd, const char *data, size_t len)
+{
+    ws_message_cb_t cb = g_message_callback;
+    if (cb) {
+        cb(fd, data, len);
+    }
+}
+
+static void dispatch_disconnect(int fd)
+{
+    ws_disconnect_cb_t cb = g_disconnect_callback;
+    if (cb) {
+        cb(fd);
+    }
+}
+
+static esp_err_t send_control(ws_server_t *server, int fd, uint8_t opcode,
+                              const char *payload, size_t len)
+{
+    ws_out_frame_t *frame = malloc(sizeof(ws_out_frame_t) + len);
+    if (!frame) return ESP_ERR_NO_MEM;
+
+    if (len > 0) {
+        memcpy(frame->data, payload, len);
+    }
+    frame->body = NULL;
+    frame->enqueued_at = 0;
+    frame->len = len;
+    frame->bytes = 0;
+    frame->opcode = opcode;
+    frame->live = false;
+    frame->compress = false;
+    return enqueue_out_frame(server, fd, frame);
+}
+
+static bool mark_reaped(ws_server_t *server, int fd)
+{
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    bool marked = conn && !conn->reaped;
+    if (marked) {
+        conn->reaped = true;
+    }
+    xSemaphoreGive(server->lock);
+    return marked;
+}
+
+static void reap_scan(ws_server_t *server)
+{
+    int ping_fds[WS_MAX_CONNECTIONS];
+    int idle_fds[WS_MAX_CONNECTIONS];
+    int dead_fds[WS_MAX_CONNECTIONS];
+    int pings = 0;
+    int idles = 0;
+    int dead = 0;
+    uint32_t now = esp_timer_get_time() / 1000000;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    uint32_t ping_after = server->connection_count >= WS_MAX_CONNECTIONS
+                              ? CONFIG_WISP_WS_PING_TIMEOUT_S : CONFIG_WISP_WS_PING_INTERVAL_S;
+    for (int i = 0; i < WS_MAX_CONNECTIONS; i++) {
+        ws_connection_t *conn = &server->connections[i];
+        if (!conn->active || conn->reaped) continue;
+
+        if (conn->tx_pending && !conn->flush_scheduled) {
+            conn->tx_blocked = false;
+            schedule_flush(server, conn);
+        }
+        if (conn->ping_sent_at) {
+            if (now - conn->ping_sent_at >= CONFIG_WISP_WS_PING_TIMEOUT_S) {
+                conn->reaped = true;
+                dead_fds[dead++] = conn->fd;
+            }
+        } else if (CONFIG_WISP_WS_PING_INTERVAL_S > 0 && now - conn->last_seen >= ping_after) {
+            conn->ping_sent_at = now;
+            ping_fds[pings++] = conn->fd;
+        } else if (CONFIG_WISP_WS_IDLE_TIMEOUT_S > 0 &&
+                   now - conn->last_activity >= CONFIG_WISP_WS_IDLE_TIMEOUT_S) {
+            idle_fds[idles++] = conn->fd;
+        }
+    }
+    xSemaphoreGive(server->lock);
+
+    for (int i = 0; i < pings; i++) {
+        if (send_control(server, ping_fds[i], WS_OPCODE_PING, NULL, 0) != ESP_OK) {
+            ESP_LOGD(TAG, "Ping not queued for fd=%d", ping_fds[i]);
+        }
+    }
+
+    ws_idle_cb_t idle_cb = g_idle_callback;
+    for (int i = 0; i < idles; i++) {
+        if (idle_cb && idle_cb(idle_fds[i]) && mark_reaped(server, idle_fds[i])) {
+            ESP_LOGI(TAG, "Reaping idle connection fd=%d", idle_fds[i]);
+            close_fd(server, idle_fds[i]);
+        }
+    }
+
+    for (int i = 0; i < dead; i++) {
+        ESP_LOGI(TAG, "Reaping unresponsive connection fd=%d", dead_fds[i]);
+        close_fd(server, dead_fds[i]);
+    }
+}
+
+static void reaper_task(void *arg)
+{
+    ws_server_t *server = arg;
+    while (!server->reaper_stop) {
+        vTaskDelay(pdMS_TO_TICKS(WS_REAPER_TICK_MS));
+        if (!server->reaper_stop) {
+            reap_scan(server);
+        }
+    }
+    server->reaper_task = NULL;
+    vTaskDelete(NULL);
+}
+
+static void start_reaper(ws_server_t *server)
+{
+    server->reaper_stop = false;
+    if (xTaskCreatePinnedToCore(reaper_task, "ws_reaper", WS_REAPER_STACK, server,
+                                WS_REAPER_PRIORITY, &server->reaper_task, instance_core(0)) != pdPASS) {
+        server->reaper_task = NULL;
+        ESP_LOGW(TAG, "Failed to start idle reaper");
+    }
+}
+
+static void stop_reaper(ws_server_t *server)
+{
+    server->reaper_stop = true;
+    for (int waited = 0; server->reaper_task && waited < WS_REAPER_STOP_WAIT_MS; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (server->reaper_task) {
+        ESP_LOGW(TAG, "Idle reaper did not stop, deleting");
+        vTaskDelete(server->reaper_task);
+        server->reaper_task = NULL;
+    }
+}
+
+static void release_resources(ws_server_t *server)
+{
+    worker_pool_stop(&server->workers);
+    rx_pool_destroy(&server->rx_pool);
+    for (int i = 0; i < WS_MAX_INSTANCES; i++) {
+        free(server->instances[i].coalesce_buf);
+        server->instances[i].coalesce_buf = NULL;
     }
     if (server->lock) {
         vSemaphoreDelete(server->lock);
@@ -277,22 +1171,70 @@ static void cleanup_server_init(ws_server_t *server, bool stop_httpd)
     }
 }
 
+static void cleanup_server_init(ws_server_t *server, bool stop_httpd)
+{
+    g_server = NULL;
+    g_message_callback = NULL;
+    if (stop_httpd && server->instances[0].server) {
+        httpd_stop(server->instances[0].server);
+        server->instances[0].server = NULL;
+    }
+    server->instance_count = 0;
+    release_resources(server);
+}
+
 esp_err_t ws_server_init(ws_server_t *server, uint16_t port, ws_message_cb_t on_message)
 {
-    if (server->server != NULL) {
+    if (transport_running(server)) {
         ESP_LOGE(TAG, "Server already initialized, call ws_server_stop first");
         return ESP_ERR_INVALID_STATE;
     }
 
     memset(server, 0, sizeof(ws_server_t));
     server->lock = xSemaphoreCreateMutex();
-    if (!server->lock) {
+    bool buffers = true;
+    for (int i = 0; i < WS_MAX_INSTANCES; i++) {
+        server->instances[i].coalesce_buf = malloc(CONFIG_WISP_OUTQ_COALESCE_BYTES);
+        buffers = buffers && server->instances[i].coalesce_buf;
+    }
+    if (!server->lock || !buffers ||
+        rx_pool_init(&server->rx_pool, CONFIG_WISP_RX_POOL_CACHE_BYTES, WS_RX_POOL_PSRAM) != ESP_OK) {
+        release_resources(server);
         return ESP_ERR_NO_MEM;
     }
 
+    worker_pool_config_t pool_config = {
+        .worker_count = CONFIG_WISP_WORKER_COUNT,
+        .queue_depth = CONFIG_WISP_WORKER_QUEUE_DEPTH,
+        .stack_size = CONFIG_WISP_WORKER_STACK_SIZE,
+        .priority = CONFIG_WISP_WORKER_PRIORITY,
+        .core_id = CONFIG_WISP_WORKER_CORE < 0 ? tskNO_AFFINITY : CONFIG_WISP_WORKER_CORE,
+        .buffers = &server->rx_pool,
+    };
+    esp_err_t ret = worker_pool_init(&server->workers, &pool_config,
+                                     dispatch_message, dispatch_disconnect);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start worker pool: %d", ret);
+        release_resources(server);
+        return ret;
+    }
+
     g_server = server;
     g_message_callback = on_message;
 
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    ret = core_start(server, port);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start WebSocket core: %d", ret);
+        cleanup_server_init(server, false);
+        return ret;
+    }
+
+    start_reaper(server);
+    ESP_LOGI(TAG, "WebSocket core started on port %d (max %d connections, %d instances)",
+             port, WS_MAX_CONNECTIONS, WS_MAX_INSTANCES);
+    return ESP_OK;
+#else
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = port;
     config.ctrl_port = port + 1;
@@ -306,15 +1248,18 @@ esp_err_t ws_server_init(ws_server_t *server, uint16_t port, ws_message_cb_t on_
     config.keep_alive_interval = 1;
     config.keep_alive_count = 3;
     config.stack_size = 12288;
+    config.task_priority = CONFIG_WISP_HTTPD_PRIORITY;
+    config.core_id = instance_core(0);
     config.open_fn = on_open;
     config.close_fn = on_close;
 
-    esp_err_t ret = httpd_start(&server->server, &config);
+    ret = httpd_start(&server->instances[0].server, &config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start server: %d", ret);
         cleanup_server_init(server, false);
         return ret;
     }
+    server->instance_count = 1;
 
     httpd_uri_t ws_uri = {
         .uri = "/",
@@ -325,7 +1270,7 @@ esp_err_t ws_server_init(ws_server_t *server, uint16_t port, ws_message_cb_t on_
         .handle_ws_control_frames = true,
     };
 
-    ret = httpd_register_uri_handler(server->server, &ws_uri);
+    ret = httpd_register_uri_handler(server->instances[0].server, &ws_uri);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register WS handler: %d", ret);
         cleanup_server_init(server, true);
@@ -339,13 +1284,15 @@ esp_err_t ws_server_init(ws_server_t *server, uint16_t port, ws_message_cb_t on_
         .user_ctx = NULL,
     };
 
-    ret = httpd_register_uri_handler(server->server, &options_uri);
+    ret = httpd_register_uri_handler(server->instances[0].server, &options_uri);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to register OPTIONS handler: %d", ret);
     }
 
+    start_reaper(server);
     ESP_LOGI(TAG, "WebSocket server started on port %d", port);
     return ESP_OK;
+#endif
 }
 
 void ws_server_stop(ws_server_t *server)
@@ -353,14 +1300,20 @@ void ws_server_stop(ws_server_t *server)
     g_server = NULL;
     g_message_callback = NULL;
     g_disconnect_callback = NULL;
-
-    if (server->server) {
-        httpd_stop(server->server);
-        server->server = NULL;
+    g_idle_callback = NULL;
+
+    stop_reaper(server);
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    core_stop(server);
+#endif
+    if (server->instances[0].server) {
+        httpd_stop(server->instances[0].server);
+        server->instances[0].server = NULL;
     }
-    if (server->lock) {
-        vSemaphoreDelete(server->lock);
-        server->lock = NULL;
+    server->instance_count = 0;
+    release_resources(server);
+    for (int i = 0; i < WS_MAX_CONNECTIONS; i++) {
+        clear_out_queue(&server->connections[i]);
     }
     memset(server->connections, 0, sizeof(server->connections));
     server->connection_count = 0;
@@ -368,63 +1321,157 @@ void ws_server_stop(ws_server_t *server)
 
 bool ws_server_is_running(ws_server_t *server)
 {
-    return server && server->server != NULL;
+    return server && transport_running(server);
 }
 
 esp_err_t ws_server_send(ws_server_t *server, int fd, const char *data, size_t len)
 {
-    if (!server->server) return ESP_ERR_INVALID_STATE;
+    if (!transport_running(server)) return ESP_ERR_INVALID_STATE;
+
+    ws_out_frame_t *frame = malloc(sizeof(ws_out_frame_t) + len);
+    if (!frame) return ESP_ERR_NO_MEM;
+
+    memcpy(frame->data, data, len);
+    frame->body = NULL;
+    frame->enqueued_at = 0;
+    frame->len = len;
+    frame->bytes = len;
+    frame->opcode = WS_OPCODE_TEXT;
+    frame->live = false;
+    frame->compress = len >= WS_DEFLATE_MIN_BYTES;
+    return enqueue_out_frame(server, fd, frame);
+}
 
-    if (g_current_req && httpd_req_to_sockfd(g_current_req) == fd) {
-        httpd_ws_frame_t ws_pkt = {
-            .type = HTTPD_WS_TYPE_TEXT,
-            .payload = (uint8_t *)data,
-            .len = len,
-        };
-        return httpd_ws_send_frame(g_current_req, &ws_pkt);
-    }
+esp_err_t ws_server_send_shared(ws_server_t *server, int fd, const char *prefix,
+                                size_t prefix_len, ws_frame_t *body)
+{
+    if (!transport_running(server)) return ESP_ERR_INVALID_STATE;
+    if (prefix_len == 0) return ESP_ERR_INVALID_SIZE;
+
+    ws_out_frame_t *frame = malloc(sizeof(ws_out_frame_t) + prefix_len);
+    if (!frame) return ESP_ERR_NO_MEM;
+
+    memcpy(frame->data, prefix, prefix_len);
+    ws_frame_retain(body);
+    frame->body = body;
+    frame->enqueued_at = body->enqueued_at;
+    frame->len = prefix_len;
+    frame->bytes = prefix_len + body->len;
+    frame->opcode = WS_OPCODE_TEXT;
+    frame->live = true;
+    frame->compress = body->compress && frame->bytes >= WS_DEFLATE_MIN_BYTES;
+    return enqueue_out_frame(server, fd, frame);
+}
 
-    async_send_arg_t *arg = malloc(sizeof(async_send_arg_t));
-    if (!arg) return ESP_ERR_NO_MEM;
+esp_err_t ws_server_broadcast(ws_server_t *server, const char *data, size_t len)
+{
+    int fds[WS_MAX_CONNECTIONS];
+    int count = 0;
 
-    arg->data = malloc(len);
-    if (!arg->data) {
-        free(arg);
-        return ESP_ERR_NO_MEM;
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    for (int i = 0; i < WS_MAX_CONNECTIONS; i++) {
+        if (server->connections[i].active) {
+            fds[count++] = server->connections[i].fd;
+        }
     }
+    xSemaphoreGive(server->lock);
 
-    memcpy(arg->data, data, len);
-    arg->hd = server->server;
-    arg->fd = fd;
-    arg->len = len;
-
-    esp_err_t ret = httpd_queue_work(server->server, ws_async_send, arg);
-    if (ret != ESP_OK) {
-        free(arg->data);
-        free(arg);
-        return ret;
+    for (int i = 0; i < count; i++) {
+        ws_server_send(server, fds[i], data, len);
     }
     return ESP_OK;
 }
 
-esp_err_t ws_server_broadcast(ws_server_t *server, const char *data, size_t len)
+void ws_server_cork(ws_server_t *server, int fd)
 {
+    if (!server->lock) return;
+
     xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    if (conn) {
+        conn->corked++;
+    }
+    xSemaphoreGive(server->lock);
+}
 
-    for (int i = 0; i < WS_MAX_CONNECTIONS; i++) {
-        if (server->connections[i].active) {
-            ws_server_send(server, server->connections[i].fd, data, len);
-        }
+void ws_server_uncork(ws_server_t *server, int fd)
+{
+    if (!server->lock) return;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    if (conn && conn->corked > 0 && --conn->corked == 0) {
+        schedule_flush(server, conn);
     }
+    xSemaphoreGive(server->lock);
+}
 
+bool ws_server_backfill_paused(ws_server_t *server, int fd)
+{
+    if (!server->lock) return false;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    ws_connection_t *conn = find_connection_by_fd(server, fd);
+    bool paused = conn &&
+        ((uint64_t)conn->out_bytes * 100 >= (uint64_t)CONFIG_WISP_OUTQ_MAX_BYTES * CONFIG_WISP_OUTQ_BACKFILL_PAUSE_PCT ||
+         (uint32_t)conn->out_frames * 100 >= (uint32_t)CONFIG_WISP_OUTQ_MAX_FRAMES * CONFIG_WISP_OUTQ_BACKFILL_PAUSE_PCT);
     xSemaphoreGive(server->lock);
-    return ESP_OK;
+    return paused;
+}
+
+uint8_t ws_server_queue_stats(ws_server_t *server, ws_queue_stats_t *out, uint8_t max)
+{
+    uint8_t count = 0;
+    if (!server->lock) return 0;
+
+    xSemaphoreTake(server->lock, portMAX_DELAY);
+    for (int i = 0; i < WS_MAX_CONNECTIONS && count < max; i++) {
+        const ws_connection_t *conn = &server->connections[i];
+        if (!conn->active) continue;
+        out[count].fd = conn->fd;
+        out[count].bytes = conn->out_bytes;
+        out[count].bytes_peak = conn->out_bytes_peak;
+        out[count].frames = conn->out_frames;
+        out[count].dropped = conn->out_dropped;
+        count++;
+    }
+    xSemaphoreGive(server->lock);
+    return count;
 }
 
 void ws_server_close_connection(ws_server_t *server, int fd)
 {
-    if (!server || !server->server) {
+    if (!server || !transport_running(server)) {
         return;
     }
-    httpd_sess_trigger_close(server->server, fd);
+    close_fd(server, fd);
+}
+
+ws_frame_t *ws_frame_alloc(size_t capacity)
+{
+    ws_frame_t *frame = malloc(sizeof(ws_frame_t) + capacity);
+    if (!frame) return NULL;
+    atomic_init(&frame->refs, 1);
+    frame->enqueued_at = 0;
+    frame->len = 0;
+    frame->compress = true;
+    return frame;
+}
+
+ws_frame_t *ws_frame_shrink(ws_frame_t *frame)
+{
+    ws_frame_t *shrunk = realloc(frame, sizeof(ws_frame_t) + frame->len);
+    return shrunk ? shrunk : frame;
+}
+
+void ws_frame_retain(ws_frame_t *frame)
+{
+    atomic_fetch_add(&frame->refs, 1);
+}
+
+void ws_frame_release(ws_frame_t *frame)
+{
+    if (frame && atomic_fetch_sub(&frame->refs, 1) == 1) {
+        free(frame);
+    }
 }
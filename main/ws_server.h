@@ -1,6 +1,7 @@
 #ifndef WS_SERVER_H
 #define WS_SERVER_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -8,34 +9,123 @@
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "rx_pool.h"
+#include "worker_pool.h"
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+#include "ws_core.h"
+#endif
 
-#define WS_MAX_CONNECTIONS     8
+#define WS_MAX_CONNECTIONS     CONFIG_WISP_WS_MAX_CONNECTIONS
 #define WS_MAX_FRAME_SIZE      65536
 
+#ifdef CONFIG_WISP_WS_INSTANCES
+#define WS_MAX_INSTANCES       CONFIG_WISP_WS_INSTANCES
+#else
+#define WS_MAX_INSTANCES       1
+#endif
+
+typedef struct ws_out_frame ws_out_frame_t;
+
+typedef struct {
+    uint32_t frames;
+    int64_t sum;
+    int64_t oldest;
+    int64_t newest;
+} ws_send_stamps_t;
+
 typedef struct {
     int fd;
     bool active;
+    uint8_t instance;
     uint32_t connected_at;
     uint32_t last_activity;
+    uint32_t last_seen;
+    uint32_t ping_sent_at;
     char remote_ip[INET6_ADDRSTRLEN];
+    ws_out_frame_t *out_head;
+    ws_out_frame_t *out_tail;
+    uint32_t out_bytes;
+    uint32_t out_bytes_peak;
+    uint16_t out_frames;
+    uint32_t out_dropped;
+    char *tx_pending;
+    size_t tx_pending_len;
+    ws_send_stamps_t tx_pending_stamps;
+    uint8_t corked;
+    bool flush_scheduled;
+    bool tx_blocked;
+    bool slow_closing;
+    bool reaped;
 } ws_connection_t;
 
 typedef struct {
     httpd_handle_t server;
+    char *coalesce_buf;
+#ifdef CONFIG_WISP_WS_BACKEND_CORE
+    ws_core_t core;
+    TaskHandle_t core_task;
+    volatile bool core_stop;
+#endif
+} ws_instance_t;
+
+typedef struct {
+    ws_instance_t instances[WS_MAX_INSTANCES];
+    uint8_t instance_count;
     ws_connection_t connections[WS_MAX_CONNECTIONS];
     SemaphoreHandle_t lock;
-    uint8_t connection_count;
+    uint16_t connection_count;
+    worker_pool_t workers;
+    rx_pool_t rx_pool;
+    atomic_uint tx_raw_bytes;
+    atomic_uint tx_wire_bytes;
+    atomic_uint live_sent;
+    atomic_uint live_last_us;
+    atomic_uint live_max_us;
+    atomic_ullong live_total_us;
+    TaskHandle_t reaper_task;
+    volatile bool reaper_stop;
 } ws_server_t;
 
+typedef struct {
+    int fd;
+    uint32_t bytes;
+    uint32_t bytes_peak;
+    uint16_t frames;
+    uint32_t dropped;
+} ws_queue_stats_t;
+
+typedef struct {
+    atomic_int refs;
+    int64_t enqueued_at;
+    size_t len;
+    bool compress;
+    char data[];
+} ws_frame_t;
+
 typedef void (*ws_message_cb_t)(int fd, const char *data, size_t len);
 typedef void (*ws_disconnect_cb_t)(int fd);
+typedef bool (*ws_idle_cb_t)(int fd);
 
 esp_err_t ws_server_init(ws_server_t *server, uint16_t port, ws_message_cb_t on_message);
 void ws_server_set_disconnect_cb(ws_disconnect_cb_t cb);
+void ws_server_set_idle_cb(ws_idle_cb_t cb);
 void ws_server_stop(ws_server_t *server);
 bool ws_server_is_running(ws_server_t *server);
 esp_err_t ws_server_send(ws_server_t *server, int fd, const char *data, size_t len);
+esp_err_t ws_server_send_shared(ws_server_t *server, int fd, const char *prefix,
+                                size_t prefix_len, ws_frame_t *body);
 esp_err_t ws_server_broadcast(ws_server_t *server, const char *data, size_t len);
 void ws_server_close_connection(ws_server_t *server, int fd);
+void ws_server_cork(ws_server_t *server, int fd);
+void ws_server_uncork(ws_server_t *server, int fd);
+bool ws_server_backfill_paused(ws_server_t *server, int fd);
+uint8_t ws_server_queue_stats(ws_server_t *server, ws_queue_stats_t *out, uint8_t max);
+
+ws_frame_t *ws_frame_alloc(size_t capacity);
+ws_frame_t *ws_frame_shrink(ws_frame_t *frame);
+void ws_frame_retain(ws_frame_t *frame);
+void ws_frame_release(ws_frame_t *frame);
 
 #endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "test_fixtures.h"
+#include "sub_index.h"
+
+#define BENCH_EVENTS          20000
+#define BENCH_AUTHORS         2048
+#define BENCH_FOLLOWS         20
+#define BENCH_EVENT_TAGS      4
+
+typedef struct {
+    uint64_t keys[BENCH_FOLLOWS];
+    uint32_t key_count;
+} bench_sub_t;
+
+typedef struct {
+    uint64_t keys[3 + BENCH_EVENT_TAGS];
+    uint32_t key_count;
+} bench_event_t;
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint64_t author_key(uint32_t author)
+{
+    uint8_t pubkey[32] = {0};
+    memcpy(pubkey, &author, sizeof(author));
+    return sub_index_key(SUB_KEY_AUTHOR, 0, pubkey, 32);
+}
+
+static uint64_t kind_key(uint32_t kind)
+{
+    return sub_index_key(SUB_KEY_KIND, 0, &kind, sizeof(kind));
+}
+
+static uint64_t tag_key(char tag, uint32_t value)
+{
+    char hex[16];
+    int len = snprintf(hex, sizeof(hex), "%08x", value);
+    return sub_index_key(SUB_KEY_TAG, tag, hex, (size_t)len);
+}
+
+static void make_sub(bench_sub_t *sub)
+{
+    uint32_t shape = rng() % 10;
+    sub->key_count = 0;
+    if (shape < 6) {
+        for (uint32_t i = 0; i < BENCH_FOLLOWS; i++) {
+            sub->keys[sub->key_count++] = author_key(rng() % BENCH_AUTHORS);
+        }
+    } else if (shape < 9) {
+        sub->keys[sub->key_count++] = tag_key('p', rng() % BENCH_AUTHORS);
+    } else {
+        sub->keys[sub->key_count++] = kind_key(30000 + rng() % 64);
+    }
+}
+
+static void make_event(bench_event_t *event)
+{
+    uint32_t id = rng();
+    event->key_count = 0;
+    event->keys[event->key_count++] = sub_index_key(SUB_KEY_ID, 0, &id, sizeof(id));
+    event->keys[event->key_count++] = author_key(rng() % BENCH_AUTHORS);
+    event->keys[event->key_count++] = kind_key(rng() % 8 == 0 ? 30000 + rng() % 64 : 1);
+    for (uint32_t i = 0; i < BENCH_EVENT_TAGS; i++) {
+        event->keys[event->key_count++] = tag_key('p', rng() % BENCH_AUTHORS);
+    }
+}
+
+static bool sub_matches(const bench_sub_t *sub, const bench_event_t *event)
+{
+    for (uint32_t i = 0; i < sub->key_count; i++) {
+        for (uint32_t j = 0; j < event->key_count; j++) {
+            if (sub->keys[i] == event->keys[j]) return true;
+        }
+    }
+    return false;
+}
+
+static double elapsed_ns(struct timespec start, struct timespec end)
+{
+    return (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+}
+
+static void run_scale(uint32_t sub_count)
+{
+    bench_sub_t *subs = malloc(sub_count * sizeof(bench_sub_t));
+    bench_event_t *events = malloc(BENCH_EVENTS * sizeof(bench_event_t));
+    uint32_t *out = malloc(sub_count * sizeof(uint32_t));
+    uint8_t *seen = malloc((sub_count + 7) / 8);
+    TEST_ASSERT_NOT_NULL(subs);
+    TEST_ASSERT_NOT_NULL(events);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_NOT_NULL(seen);
+
+    sub_index_t idx;
+    TEST_ASSERT_TRUE(sub_index_init(&idx, 16, false));
+    TEST_ASSERT_TRUE(sub_index_grow(&idx, sub_count));
+
+    for (uint32_t s = 0; s < sub_count; s++) {
+        make_sub(&subs[s]);
+        for (uint32_t k = 0; k < subs[s].key_count; k++) {
+            TEST_ASSERT_TRUE(sub_index_add_key(&idx, s, subs[s].keys[k]));
+        }
+    }
+    for (uint32_t e = 0; e < BENCH_EVENTS; e++) {
+        make_event(&events[e]);
+    }
+
+    struct timespec t0, t1, t2;
+    uint64_t linear_matches = 0, index_candidates = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t e = 0; e < BENCH_EVENTS; e++) {
+        for (uint32_t s = 0; s < sub_count; s++) {
+            linear_matches += sub_matches(&subs[s], &events[e]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (uint32_t e = 0; e < BENCH_EVENTS; e++) {
+        memset(seen, 0, (sub_count + 7) / 8);
+        index_candidates += sub_index_candidates(&idx, events[e].keys, events[e].key_count,
+                                                 seen, out, sub_count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    TEST_ASSERT_EQUAL(linear_matches, index_candidates);
+
+    printf("  subs=%-5u linear=%9.0f ns/event  index=%7.0f ns/event  matches/event=%.2f  postings=%u\n",
+           sub_count,
+           elapsed_ns(t0, t1) / BENCH_EVENTS,
+           elapsed_ns(t1, t2) / BENCH_EVENTS,
+           (double)index_candidates / BENCH_EVENTS,
+           idx.live_postings);
+
+    sub_index_destroy(&idx);
+    free(seen);
+    free(out);
+    free(events);
+    free(subs);
+}
+
+int main(void)
+{
+    printf("=== Subscription Scaling Benchmark ===\n\n");
+    run_scale(64);
+    run_scale(512);
+    run_scale(4096);
+    printf("\n=== Benchmark complete ===\n");
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#ifndef ESP_LOGI
+#define ESP_LOGI(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGW(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGE(tag, fmt, ...) ((void)(tag))
+#endif
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+#define portMAX_DELAY 0xFFFFFFFFUL
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) { return (void*)1; }
+static inline void vSemaphoreDelete(SemaphoreHandle_t s) { (void)s; }
+static inline int xSemaphoreTake(SemaphoreHandle_t s, uint32_t t) { (void)s; (void)t; return 1; }
+static inline int xSemaphoreGive(SemaphoreHandle_t s) { (void)s; return 1; }
+
+#endif
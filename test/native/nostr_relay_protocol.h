@@ -0,0 +1,21 @@
+#ifndef NOSTR_RELAY_PROTOCOL_H
+#define NOSTR_RELAY_PROTOCOL_H
+
+#include <stdio.h>
+#include "test_fixtures.h"
+
+static inline void nostr_free(void* p) {
+    free(p);
+}
+
+static inline void nostr_event_destroy(nostr_event* e) {
+    if (!e) return;
+    for (size_t t = 0; t < e->tags_count; t++) {
+        FREE_STRING_ARRAY(e->tags[t].values, e->tags[t].count);
+    }
+    free(e->tags);
+    free(e->content);
+    free(e);
+}
+
+#endif
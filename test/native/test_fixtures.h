@@ -26,19 +26,15 @@
 #define UNITY_END() (0)
 #endif
 
-#define portMAX_DELAY 0xFFFFFFFFUL
-typedef void* SemaphoreHandle_t;
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 typedef void* TaskHandle_t;
 typedef int esp_err_t;
 #define ESP_OK 0
 #define ESP_FAIL -1
 #define ESP_ERR_NO_MEM -2
 
-static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) { return (void*)1; }
-static inline void vSemaphoreDelete(SemaphoreHandle_t s) { (void)s; }
-static inline int xSemaphoreTake(SemaphoreHandle_t s, uint32_t t) { (void)s; (void)t; return 1; }
-static inline int xSemaphoreGive(SemaphoreHandle_t s) { (void)s; return 1; }
-
 #define ESP_LOGI(tag, fmt, ...) ((void)0)
 #define ESP_LOGD(tag, fmt, ...) ((void)0)
 #define ESP_LOGW(tag, fmt, ...) ((void)0)
@@ -49,7 +45,7 @@ static inline int xSemaphoreGive(SemaphoreHandle_t s) { (void)s; return 1; }
 
 typedef struct { uint8_t data[32]; } nostr_key;
 typedef struct nostr_tag_arena nostr_tag_arena;
-typedef struct { char** values; size_t values_count; } nostr_tag;
+typedef struct { char** values; size_t count; } nostr_tag;
 
 typedef struct nostr_event {
     uint8_t id[NOSTR_ID_SIZE];
@@ -103,7 +99,7 @@ typedef enum {
 #define NOSTR_OK_PREFIX_INVALID "invalid:"
 
 #define FREE_STRING_ARRAY(arr, count) do { \
-    for (size_t i = 0; i < (count); i++) free((arr)[i]); \
+    for (size_t _i = 0; _i < (count); _i++) free((arr)[_i]); \
     free(arr); \
 } while(0)
 
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "test_fixtures.h"
+#include "index_segments.h"
+
+static char g_dir[INDEX_SEG_DIR_LEN];
+
+static void make_entry(storage_index_entry_t *e, uint32_t n, uint32_t created_at)
+{
+    memset(e, 0, sizeof(*e));
+    for (int i = 0; i < 32; i += 4) {
+        uint32_t v = n * 2654435761u + (uint32_t)i * 40503u;
+        memcpy(e->event_id + i, &v, 4);
+    }
+    e->created_at = created_at;
+    e->file_index = n;
+    e->kind = 1;
+}
+
+void setUp(void)
+{
+    strcpy(g_dir, "/tmp/wisp_segXXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(g_dir));
+}
+
+void tearDown(void)
+{
+    DIR *d = opendir(g_dir);
+    struct dirent *de;
+    char path[300];
+    while (d && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", g_dir, de->d_name);
+        unlink(path);
+    }
+    if (d) closedir(d);
+    rmdir(g_dir);
+}
+
+static void append_range(index_segs_t *segs, uint32_t first, uint32_t count, uint32_t base_ts)
+{
+    storage_index_entry_t *entries = calloc(count, sizeof(storage_index_entry_t));
+    for (uint32_t i = 0; i < count; i++) {
+        make_entry(&entries[i], first + i, base_ts + (count - 1 - i) * 10);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_append(segs, entries, count));
+    free(entries);
+}
+
+static void test_index_segs_append_sorts_and_reads(void)
+{
+    index_segs_t segs;
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    TEST_ASSERT_EQUAL(0, segs.seg_count);
+
+    append_range(&segs, 0, 200, 1000);
+    TEST_ASSERT_EQUAL(1, segs.seg_count);
+    TEST_ASSERT_EQUAL(200, segs.live_entries);
+    TEST_ASSERT_EQUAL(1000, segs.segs[0].min_created_at);
+    TEST_ASSERT_EQUAL(2990, segs.segs[0].max_created_at);
+
+    storage_index_entry_t page[INDEX_SEG_PAGE_ENTRIES];
+    uint32_t prev = 0;
+    for (uint32_t p = 0; p < 200; p += INDEX_SEG_PAGE_ENTRIES) {
+        uint32_t n = 200 - p < INDEX_SEG_PAGE_ENTRIES ? 200 - p : INDEX_SEG_PAGE_ENTRIES;
+        TEST_ASSERT_EQUAL(ESP_OK, index_segs_read(&segs, 0, p, page, n));
+        for (uint32_t i = 0; i < n; i++) {
+            TEST_ASSERT(page[i].created_at >= prev);
+            prev = page[i].created_at;
+        }
+    }
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, index_segs_read(&segs, 0, 190, page, 20));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, index_segs_read(&segs, 1, 0, page, 1));
+
+    TEST_ASSERT_EQUAL(0, index_segs_upper_bound(&segs, 0, 999));
+    TEST_ASSERT_EQUAL(1, index_segs_upper_bound(&segs, 0, 1000));
+    TEST_ASSERT_EQUAL(1, index_segs_upper_bound(&segs, 0, 1009));
+    TEST_ASSERT_EQUAL(100, index_segs_upper_bound(&segs, 0, 1990));
+    TEST_ASSERT_EQUAL(200, index_segs_upper_bound(&segs, 0, 5000));
+
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, index_segs_append(&segs, page, 0));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, index_segs_append(&segs, page, INDEX_SEG_MAX_ENTRIES + 1));
+    index_segs_destroy(&segs);
+}
+
+static void test_index_segs_find_and_delete_persist(void)
+{
+    index_segs_t segs;
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    append_range(&segs, 0, 100, 1000);
+    append_range(&segs, 100, 100, 5000);
+
+    storage_index_entry_t want, got;
+    uint32_t seg_idx, pos;
+    make_entry(&want, 150, 0);
+    TEST_ASSERT_TRUE(index_segs_find(&segs, want.event_id, &got, &seg_idx, &pos));
+    TEST_ASSERT_EQUAL(1, seg_idx);
+    TEST_ASSERT_EQUAL(150, got.file_index);
+
+    make_entry(&want, 12345, 0);
+    TEST_ASSERT_FALSE(index_segs_find(&segs, want.event_id, NULL, NULL, NULL));
+
+    make_entry(&want, 7, 0);
+    TEST_ASSERT_TRUE(index_segs_find(&segs, want.event_id, NULL, &seg_idx, &pos));
+    TEST_ASSERT_EQUAL(0, seg_idx);
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_mark_deleted(&segs, seg_idx, pos));
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_mark_deleted(&segs, seg_idx, pos));
+    TEST_ASSERT_FALSE(index_segs_find(&segs, want.event_id, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(99, segs.segs[0].live_count);
+    TEST_ASSERT_EQUAL(199, segs.live_entries);
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, index_segs_mark_deleted(&segs, 0, 100));
+    index_segs_destroy(&segs);
+
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    TEST_ASSERT_EQUAL(2, segs.seg_count);
+    TEST_ASSERT_EQUAL(199, segs.live_entries);
+    TEST_ASSERT_EQUAL(2, segs.next_seq);
+    TEST_ASSERT_FALSE(index_segs_find(&segs, want.event_id, NULL, NULL, NULL));
+    make_entry(&want, 8, 0);
+    TEST_ASSERT_TRUE(index_segs_find(&segs, want.event_id, NULL, NULL, NULL));
+    index_segs_destroy(&segs);
+}
+
+static void test_index_segs_compact_merges_and_drops(void)
+{
+    index_segs_t segs;
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    append_range(&segs, 0, 10, 1000);
+    append_range(&segs, 10, 10, 2000);
+    append_range(&segs, 20, 10, 3000);
+    append_range(&segs, 30, INDEX_SEG_MAX_ENTRIES, 4000);
+
+    storage_index_entry_t want;
+    uint32_t seg_idx, pos;
+    for (uint32_t n = 20; n < 30; n++) {
+        make_entry(&want, n, 0);
+        TEST_ASSERT_TRUE(index_segs_find(&segs, want.event_id, NULL, &seg_idx, &pos));
+        TEST_ASSERT_EQUAL(ESP_OK, index_segs_mark_deleted(&segs, seg_idx, pos));
+    }
+    make_entry(&want, 3, 0);
+    TEST_ASSERT_TRUE(index_segs_find(&segs, want.event_id, NULL, &seg_idx, &pos));
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_mark_deleted(&segs, seg_idx, pos));
+
+    uint32_t gen = segs.generation;
+    TEST_ASSERT_EQUAL(2, index_segs_compact(&segs));
+    TEST_ASSERT_EQUAL(2, segs.seg_count);
+    TEST_ASSERT(segs.generation > gen);
+    TEST_ASSERT_EQUAL(19, segs.segs[0].count);
+    TEST_ASSERT_EQUAL(2, segs.segs[0].seq);
+    TEST_ASSERT_EQUAL(1000, segs.segs[0].min_created_at);
+    TEST_ASSERT_EQUAL(2090, segs.segs[0].max_created_at);
+    TEST_ASSERT_EQUAL(19 + INDEX_SEG_MAX_ENTRIES, segs.live_entries);
+
+    for (uint32_t n = 0; n < 20; n++) {
+        make_entry(&want, n, 0);
+        TEST_ASSERT_EQUAL(n != 3, index_segs_find(&segs, want.event_id, NULL, NULL, NULL));
+    }
+    TEST_ASSERT_EQUAL(0, index_segs_compact(&segs));
+    index_segs_destroy(&segs);
+
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    TEST_ASSERT_EQUAL(2, segs.seg_count);
+    TEST_ASSERT_EQUAL(19 + INDEX_SEG_MAX_ENTRIES, segs.live_entries);
+    index_segs_destroy(&segs);
+}
+
+static void test_index_segs_recovers_tmp_and_drops_corrupt(void)
+{
+    index_segs_t segs;
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    append_range(&segs, 0, 50, 1000);
+    index_segs_destroy(&segs);
+
+    char idx_path[128], tmp_path[128], bad_path[128];
+    snprintf(idx_path, sizeof(idx_path), "%s/seg_00000000.idx", g_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/seg_00000000.tmp", g_dir);
+    snprintf(bad_path, sizeof(bad_path), "%s/seg_00000009.idx", g_dir);
+    TEST_ASSERT_EQUAL(0, rename(idx_path, tmp_path));
+    FILE *f = fopen(bad_path, "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    fputs("not a segment", f);
+    fclose(f);
+
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    TEST_ASSERT_EQUAL(1, segs.seg_count);
+    TEST_ASSERT_EQUAL(50, segs.live_entries);
+    TEST_ASSERT_EQUAL(1, segs.next_seq);
+    TEST_ASSERT_EQUAL(0, access(idx_path, F_OK));
+    TEST_ASSERT_NOT_EQUAL(0, access(tmp_path, F_OK));
+    TEST_ASSERT_NOT_EQUAL(0, access(bad_path, F_OK));
+    index_segs_destroy(&segs);
+}
+
+typedef struct {
+    uint8_t hits[64];
+    uint32_t budget;
+} visit_log_t;
+
+static bool log_visit(const storage_index_entry_t *entry, bool seen, void *ctx)
+{
+    visit_log_t *log = ctx;
+    if (!seen) {
+        TEST_ASSERT(entry->file_index < sizeof(log->hits));
+        log->hits[entry->file_index]++;
+    }
+    return --log->budget > 0;
+}
+
+static void scan_compacting_after(uint32_t first_slice)
+{
+    index_segs_t segs;
+    TEST_ASSERT_EQUAL(ESP_OK, index_segs_init(&segs, g_dir));
+    append_range(&segs, 0, 10, 1000);
+    append_range(&segs, 10, 10, 1005);
+    append_range(&segs, 20, 10, 1002);
+
+    storage_index_entry_t page[INDEX_SEG_PAGE_ENTRIES];
+    index_segs_cursor_t cur;
+    visit_log_t log = {0};
+    index_segs_cursor_init(&segs, &cur, 30);
+
+    log.budget = first_slice;
+    TEST_ASSERT_FALSE(index_segs_cursor_scan(&segs, &cur, 0, 0, page, log_visit, &log));
+    TEST_ASSERT(index_segs_compact(&segs) > 0);
+    TEST_ASSERT_EQUAL(1, segs.seg_count);
+
+    log.budget = 3;
+    index_segs_cursor_scan(&segs, &cur, 0, 0, page, log_visit, &log);
+    append_range(&segs, 30, 10, 1001);
+    TEST_ASSERT(index_segs_compact(&segs) > 0);
+
+    log.budget = UINT32_MAX;
+    TEST_ASSERT_TRUE(index_segs_cursor_scan(&segs, &cur, 0, 0, page, log_visit, &log));
+    for (uint32_t n = 0; n < 30; n++) {
+        TEST_ASSERT_EQUAL(1, log.hits[n]);
+    }
+    for (uint32_t n = 30; n < 40; n++) {
+        TEST_ASSERT_EQUAL(0, log.hits[n]);
+    }
+    index_segs_destroy(&segs);
+}
+
+static void test_index_segs_cursor_survives_compaction(void)
+{
+    static const uint32_t slices[] = {1, 5, 10, 11, 15, 20, 24, 28};
+    for (size_t i = 0; i < sizeof(slices) / sizeof(slices[0]); i++) {
+        scan_compacting_after(slices[i]);
+        tearDown();
+        setUp();
+    }
+}
+
+int main(void)
+{
+    printf("=== Index Segment Tests ===\n\n");
+#ifdef HAVE_UNITY
+    UNITY_BEGIN();
+    RUN_TEST(test_index_segs_append_sorts_and_reads);
+    RUN_TEST(test_index_segs_find_and_delete_persist);
+    RUN_TEST(test_index_segs_compact_merges_and_drops);
+    RUN_TEST(test_index_segs_recovers_tmp_and_drops_corrupt);
+    RUN_TEST(test_index_segs_cursor_survives_compaction);
+    return UNITY_END();
+#else
+    setUp();
+    RUN_TEST(test_index_segs_append_sorts_and_reads);
+    tearDown();
+    setUp();
+    RUN_TEST(test_index_segs_find_and_delete_persist);
+    tearDown();
+    setUp();
+    RUN_TEST(test_index_segs_compact_merges_and_drops);
+    tearDown();
+    setUp();
+    RUN_TEST(test_index_segs_recovers_tmp_and_drops_corrupt);
+    tearDown();
+    setUp();
+    RUN_TEST(test_index_segs_cursor_survives_compaction);
+    tearDown();
+    printf("\n=== All tests passed ===\n");
+    return 0;
+#endif
+}
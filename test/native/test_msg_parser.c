@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_fixtures.h"
+#include "msg_parser.h"
+
+#define HEX64 "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+#define PUB64 "fedcba9876543210fedcba9876543210fedcba9876543210fedcba9876543210"
+#define SIG128 HEX64 HEX64
+
+static const char *EVENT_JSON =
+    "[\"EVENT\", {\"id\":\"" HEX64 "\",\"pubkey\":\"" PUB64 "\","
+    "\"created_at\":1700000000,\"kind\":1,"
+    "\"tags\":[[\"e\",\"" HEX64 "\",\"wss://r\"],[\"t\",\"caf\\u00e9\"],[]],"
+    "\"content\":\"hi \\\"there\\\"\\n\\ud83d\\ude00\",\"sig\":\"" SIG128 "\"}]";
+
+static nostr_relay_error_t parse(const char *json, msg_parsed_t *out)
+{
+    return msg_parse(json, strlen(json), out);
+}
+
+static void test_msg_parser_event(void)
+{
+    msg_parsed_t msg;
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse(EVENT_JSON, &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_EVENT, msg.type);
+
+    nostr_event *ev = msg.event;
+    TEST_ASSERT_NOT_NULL(ev);
+    TEST_ASSERT_EQUAL(0x01, ev->id[0]);
+    TEST_ASSERT_EQUAL(0xef, ev->id[31]);
+    TEST_ASSERT_EQUAL(0xfe, ev->pubkey.data[0]);
+    TEST_ASSERT_EQUAL(0xef, ev->sig[63]);
+    TEST_ASSERT_EQUAL(1700000000, ev->created_at);
+    TEST_ASSERT_EQUAL(1, ev->kind);
+    TEST_ASSERT_EQUAL_STRING("hi \"there\"\n\xf0\x9f\x98\x80", ev->content);
+
+    TEST_ASSERT_EQUAL(3, ev->tags_count);
+    TEST_ASSERT_EQUAL(3, ev->tags[0].count);
+    TEST_ASSERT_EQUAL_STRING("e", ev->tags[0].values[0]);
+    TEST_ASSERT_EQUAL_STRING(HEX64, ev->tags[0].values[1]);
+    TEST_ASSERT_EQUAL_STRING("wss://r", ev->tags[0].values[2]);
+    TEST_ASSERT_EQUAL_STRING("caf\xc3\xa9", ev->tags[1].values[1]);
+    TEST_ASSERT_EQUAL(0, ev->tags[2].count);
+    msg_parsed_free(&msg);
+}
+
+static void test_msg_parser_req_and_count(void)
+{
+    msg_parsed_t msg;
+    const char *req =
+        "[\"REQ\",\"sub\\u0031\",{\"ids\":[\"abcd\"],\"authors\":[\"" PUB64 "\"],"
+        "\"kinds\":[0,1,30023],\"#e\":[\"x\"],\"#t\":[\"nostr\",\"esp32\"],\"#p\":[],"
+        "\"since\":10,\"until\":20,\"limit\":99999999999,\"search\":{\"q\":[1.5e3,true,null]}},{}]";
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse(req, &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_REQ, msg.type);
+    TEST_ASSERT_EQUAL_STRING("sub1", msg.sub_id);
+    TEST_ASSERT_EQUAL(2, msg.filter_count);
+
+    nostr_filter_t *f = &msg.filters[0];
+    TEST_ASSERT_EQUAL(1, f->ids_count);
+    TEST_ASSERT_EQUAL_STRING("abcd", f->ids[0]);
+    TEST_ASSERT_EQUAL_STRING(PUB64, f->authors[0]);
+    TEST_ASSERT_EQUAL(3, f->kinds_count);
+    TEST_ASSERT_EQUAL(30023, f->kinds[2]);
+    TEST_ASSERT_EQUAL_STRING("x", f->e_tags[0]);
+    TEST_ASSERT_EQUAL(0, f->p_tags_count);
+    TEST_ASSERT_EQUAL(1, f->generic_tags_count);
+    TEST_ASSERT_EQUAL('t', f->generic_tags[0].tag_name);
+    TEST_ASSERT_EQUAL(2, f->generic_tags[0].values_count);
+    TEST_ASSERT_EQUAL_STRING("esp32", f->generic_tags[0].values[1]);
+    TEST_ASSERT_EQUAL(10, f->since);
+    TEST_ASSERT_EQUAL(20, f->until);
+    TEST_ASSERT_EQUAL(INT32_MAX, f->limit);
+    TEST_ASSERT_NULL(msg.filters[1].ids);
+    msg_parsed_free(&msg);
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse(" [ \"COUNT\" , \"c\" , {\"kinds\":[7]} ] \n", &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_COUNT, msg.type);
+    TEST_ASSERT_EQUAL_STRING("c", msg.sub_id);
+    TEST_ASSERT_EQUAL(7, msg.filters[0].kinds[0]);
+    msg_parsed_free(&msg);
+}
+
+static void test_msg_parser_close_auth_unknown(void)
+{
+    msg_parsed_t msg;
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse("[\"CLOSE\",\"sub1\"]", &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_CLOSE, msg.type);
+    TEST_ASSERT_EQUAL_STRING("sub1", msg.sub_id);
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse("[\"AUTH\",{\"kind\":22242,\"tags\":[]}]", &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_AUTH, msg.type);
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_OK, parse("[\"NEG-OPEN\",\"x\",{}]", &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_UNKNOWN, msg.type);
+}
+
+static void replace(char *buf, const char *from, const char *to)
+{
+    char *p = strstr(buf, from);
+    TEST_ASSERT_NOT_NULL(p);
+    size_t fl = strlen(from), tl = strlen(to);
+    memmove(p + tl, p + fl, strlen(p + fl) + 1);
+    memcpy(p, to, tl);
+}
+
+static void expect_event_error(const char *from, const char *to, nostr_relay_error_t err)
+{
+    static char buf[4096];
+    msg_parsed_t msg;
+    strcpy(buf, EVENT_JSON);
+    replace(buf, from, to);
+    TEST_ASSERT_EQUAL(err, parse(buf, &msg));
+    TEST_ASSERT_NULL(msg.event);
+}
+
+static void test_msg_parser_rejects_bad_events(void)
+{
+    expect_event_error("\"id\":\"01", "\"id\":\"0", NOSTR_RELAY_ERR_INVALID_ID);
+    expect_event_error("\"pubkey\":\"fe", "\"pubkey\":\"zz", NOSTR_RELAY_ERR_INVALID_PUBKEY);
+    expect_event_error("\"sig\":\"01", "\"sig\":\"\\u0030", NOSTR_RELAY_ERR_INVALID_SIG);
+    expect_event_error("\"kind\":1", "\"kind\":65536", NOSTR_RELAY_ERR_INVALID_KIND);
+    expect_event_error("\"kind\":1", "\"kind\":1.0", NOSTR_RELAY_ERR_INVALID_KIND);
+    expect_event_error("\"created_at\":1700000000", "\"created_at\":-1", NOSTR_RELAY_ERR_INVALID_CREATED_AT);
+    expect_event_error("[\"t\",", "[\"t\",7,", NOSTR_RELAY_ERR_INVALID_TAGS);
+    expect_event_error("\\ud83d\\ude00", "\\ude00", NOSTR_RELAY_ERR_INVALID_CONTENT);
+    expect_event_error("hi ", "\\u0000", NOSTR_RELAY_ERR_INVALID_CONTENT);
+    expect_event_error("hi ", "\t", NOSTR_RELAY_ERR_INVALID_CONTENT);
+    expect_event_error("\"kind\":1,", "", NOSTR_RELAY_ERR_MISSING_FIELD);
+    expect_event_error("\"kind\":1,", "\"kind\":1,\"kind\":1,", NOSTR_RELAY_ERR_INVALID_JSON);
+    expect_event_error("\"}]", "\"}],", NOSTR_RELAY_ERR_INVALID_JSON);
+    expect_event_error("\"}]", "\"}]x", NOSTR_RELAY_ERR_INVALID_JSON);
+
+    char *big = malloc(MSG_PARSER_MAX_TAGS * 6 + 4096);
+    strcpy(big, EVENT_JSON);
+    char tags[MSG_PARSER_MAX_TAGS * 6 + 16] = "\"tags\":[";
+    for (int i = 0; i <= MSG_PARSER_MAX_TAGS; i++) strcat(tags, i ? ",[\"a\"]" : "[\"a\"]");
+    replace(big, "\"tags\":[", tags);
+    msg_parsed_t msg;
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_TAGS, msg_parse(big, strlen(big), &msg));
+    free(big);
+
+    size_t len = strlen(EVENT_JSON);
+    for (size_t i = 0; i < len; i++) {
+        TEST_ASSERT_NOT_EQUAL(NOSTR_RELAY_OK, msg_parse(EVENT_JSON, i, &msg));
+        TEST_ASSERT_NULL(msg.event);
+    }
+}
+
+static void test_msg_parser_rejects_bad_reqs(void)
+{
+    msg_parsed_t msg;
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_MISSING_FIELD, parse("[\"REQ\",\"s\"]", &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"REQ\",\"s\",{\"ids\":[\"xyz\"]}]", &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"REQ\",\"s\",{\"kinds\":[1],\"kinds\":[2]}]", &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"REQ\",\"s\",{\"#t\":[\"a\"],\"#t\":[\"b\"]}]", &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"REQ\",\"s\",{\"kinds\":[1]},{\"since\":\"x\"}]", &msg));
+    TEST_ASSERT_NULL(msg.filters);
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"REQ\",\"s\",[]]", &msg));
+
+    char buf[256] = "[\"REQ\",\"s\"";
+    for (int i = 0; i <= MSG_PARSER_MAX_FILTERS; i++) strcat(buf, ",{}");
+    strcat(buf, "]");
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_TOO_MANY_FILTERS, parse(buf, &msg));
+
+    char sub[128] = "[\"CLOSE\",\"";
+    memset(sub + strlen(sub), 'a', MSG_PARSER_MAX_SUB_ID + 1);
+    strcat(sub, "\"]");
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID, parse(sub, &msg));
+
+    char deep[64] = "[\"AUTH\",";
+    for (int i = 0; i < 20; i++) strcat(deep, "[");
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse(deep, &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("{\"REQ\":1}", &msg));
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, msg_parse("[\"CLOSE\",\"s\"]", MSG_PARSER_MAX_LEN + 1, &msg));
+}
+
+static void test_msg_parser_errors_keep_ids(void)
+{
+    msg_parsed_t msg;
+    const char *late_id = "[\"EVENT\",{\"kind\":\"x\",\"content\":\"\",\"id\":\"" HEX64 "\"}]";
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_KIND, parse(late_id, &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_EVENT, msg.type);
+    TEST_ASSERT_EQUAL_STRING(HEX64, msg.event_id);
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_ID, parse("[\"EVENT\",{\"id\":\"abc\"}]", &msg));
+    TEST_ASSERT_EQUAL_STRING("abc", msg.event_id);
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"EVENT\",{\"id\":\"" HEX64 "\"", &msg));
+    TEST_ASSERT_EQUAL_STRING(HEX64, msg.event_id);
+
+    char sub[128] = "[\"REQ\",\"";
+    memset(sub + strlen(sub), 'a', MSG_PARSER_MAX_SUB_ID + 8);
+    strcat(sub, "\",{}]");
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_SUBSCRIPTION_ID, parse(sub, &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_REQ, msg.type);
+    TEST_ASSERT_EQUAL(MSG_PARSER_MAX_SUB_ID, strlen(msg.sub_id));
+
+    TEST_ASSERT_EQUAL(NOSTR_RELAY_ERR_INVALID_JSON, parse("[\"COUNT\",\"c\",{\"since\":-1}]", &msg));
+    TEST_ASSERT_EQUAL(MSG_PARSER_COUNT, msg.type);
+    TEST_ASSERT_EQUAL_STRING("c", msg.sub_id);
+    TEST_ASSERT_NULL(msg.filters);
+}
+
+int main(void)
+{
+    printf("=== Message Parser Tests ===\n\n");
+#ifdef HAVE_UNITY
+    UNITY_BEGIN();
+    RUN_TEST(test_msg_parser_event);
+    RUN_TEST(test_msg_parser_req_and_count);
+    RUN_TEST(test_msg_parser_close_auth_unknown);
+    RUN_TEST(test_msg_parser_rejects_bad_events);
+    RUN_TEST(test_msg_parser_rejects_bad_reqs);
+    RUN_TEST(test_msg_parser_errors_keep_ids);
+    return UNITY_END();
+#else
+    RUN_TEST(test_msg_parser_event);
+    RUN_TEST(test_msg_parser_req_and_count);
+    RUN_TEST(test_msg_parser_close_auth_unknown);
+    RUN_TEST(test_msg_parser_rejects_bad_events);
+    RUN_TEST(test_msg_parser_rejects_bad_reqs);
+    RUN_TEST(test_msg_parser_errors_keep_ids);
+    printf("\n=== All tests passed ===\n");
+    return 0;
+#endif
+}
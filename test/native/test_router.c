@@ -58,6 +58,23 @@ static void test_parse_req_multiple_filters(void) {
     printf("PASS: REQ multiple filters\n");
 }
 
+static void test_parse_count_format(void) {
+    const char *json = "[\"COUNT\",\"followers\",{\"kinds\":[3],\"#p\":[\"abc\"]}]";
+
+    cJSON *root = cJSON_Parse(json);
+    assert(root != NULL);
+    assert(cJSON_GetArraySize(root) == 3);
+
+    cJSON *type = cJSON_GetArrayItem(root, 0);
+    assert(strcmp(type->valuestring, "COUNT") == 0);
+
+    cJSON *sub_id = cJSON_GetArrayItem(root, 1);
+    assert(strcmp(sub_id->valuestring, "followers") == 0);
+
+    cJSON_Delete(root);
+    printf("PASS: COUNT format parsing\n");
+}
+
 static void test_parse_close_format(void) {
     const char *json = "[\"CLOSE\",\"sub123\"]";
 
@@ -145,18 +162,36 @@ static void test_serialize_closed(void) {
     printf("PASS: serialize CLOSED\n");
 }
 
+static void test_serialize_count(void) {
+    const char *json = "[\"COUNT\",\"sub123\",{\"count\":42}]";
+
+    cJSON *root = cJSON_Parse(json);
+    assert(root != NULL);
+    assert(cJSON_GetArraySize(root) == 3);
+    assert(strcmp(cJSON_GetArrayItem(root, 0)->valuestring, "COUNT") == 0);
+
+    cJSON *count = cJSON_GetObjectItem(cJSON_GetArrayItem(root, 2), "count");
+    assert(cJSON_IsNumber(count));
+    assert(count->valueint == 42);
+
+    cJSON_Delete(root);
+    printf("PASS: serialize COUNT\n");
+}
+
 int main(void) {
     printf("=== Router JSON Tests ===\n");
 
     test_parse_event_format();
     test_parse_req_format();
     test_parse_req_multiple_filters();
+    test_parse_count_format();
     test_parse_close_format();
     test_parse_invalid_json();
     test_serialize_ok();
     test_serialize_notice();
     test_serialize_eose();
     test_serialize_closed();
+    test_serialize_count();
 
     printf("\n=== All tests passed ===\n");
     return 0;
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_fixtures.h"
+#include "rx_pool.h"
+
+static rx_pool_t pool;
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 131072, false));
+}
+
+void tearDown(void)
+{
+    rx_pool_destroy(&pool);
+}
+
+static void test_rx_pool_size_classes(void)
+{
+    char *small = rx_pool_alloc(&pool, 1);
+    char *mid = rx_pool_alloc(&pool, 513);
+    char *max = rx_pool_alloc(&pool, RX_POOL_MAX_SIZE + RX_POOL_HEADROOM);
+    TEST_ASSERT_EQUAL(512u, rx_pool_capacity(small));
+    TEST_ASSERT_EQUAL(2048u, rx_pool_capacity(mid));
+    TEST_ASSERT_EQUAL((size_t)RX_POOL_MAX_SIZE + RX_POOL_HEADROOM, rx_pool_capacity(max));
+    TEST_ASSERT_NULL(rx_pool_alloc(&pool, RX_POOL_MAX_SIZE + RX_POOL_HEADROOM + 1));
+
+    max[RX_POOL_MAX_SIZE + RX_POOL_HEADROOM] = '\0';
+    rx_pool_release(&pool, small);
+    rx_pool_release(&pool, mid);
+    rx_pool_release(&pool, max);
+}
+
+static void test_rx_pool_mixed_sizes_reuse(void)
+{
+    static const size_t sizes[] = { 180, 420, 1500, 700, 6000, 90, 20000, 2000, 60000, 300 };
+    uint32_t seed = 12345;
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245u + 12345u;
+        size_t len = sizes[(seed >> 16) % (sizeof(sizes) / sizeof(sizes[0]))];
+        if (i < 5) len = sizes[i * 2];
+        char *buf = rx_pool_alloc(&pool, len);
+        TEST_ASSERT_NOT_NULL(buf);
+        memset(buf, 'x', len);
+        buf[len] = '\0';
+        rx_pool_release(&pool, buf);
+    }
+
+    rx_pool_stats_t stats;
+    rx_pool_get_stats(&pool, &stats);
+    printf("(%u reused, %u allocated) ", (unsigned)stats.hits, (unsigned)stats.misses);
+    TEST_ASSERT_EQUAL(995u, stats.hits);
+    TEST_ASSERT_EQUAL(5u, stats.misses);
+    TEST_ASSERT_EQUAL(0u, stats.in_use);
+}
+
+static void test_rx_pool_grow_keeps_contents(void)
+{
+    char *buf = rx_pool_alloc(&pool, 100);
+    memcpy(buf, "hello", 5);
+    TEST_ASSERT_TRUE(rx_pool_grow(&pool, buf, 5, 400) == buf);
+
+    char *grown = rx_pool_grow(&pool, buf, 5, 3000);
+    TEST_ASSERT_NOT_NULL(grown);
+    TEST_ASSERT_EQUAL(8192u, rx_pool_capacity(grown));
+    TEST_ASSERT_EQUAL_MEMORY("hello", grown, 5);
+
+    rx_pool_stats_t stats;
+    rx_pool_get_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(1u, stats.in_use);
+    TEST_ASSERT_EQUAL(512u, stats.cached_bytes);
+    rx_pool_release(&pool, grown);
+}
+
+static void test_rx_pool_cache_limit(void)
+{
+    rx_pool_destroy(&pool);
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 4096, false));
+
+    char *a = rx_pool_alloc(&pool, 2000);
+    char *b = rx_pool_alloc(&pool, 2000);
+    char *c = rx_pool_alloc(&pool, 2000);
+    rx_pool_release(&pool, a);
+    rx_pool_release(&pool, b);
+    rx_pool_release(&pool, c);
+
+    rx_pool_stats_t stats;
+    rx_pool_get_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(4096u, stats.cached_bytes);
+    TEST_ASSERT_EQUAL(0u, stats.in_use);
+}
+
+int main(void)
+{
+    printf("=== Receive Buffer Pool Tests ===\n\n");
+#ifdef HAVE_UNITY
+    UNITY_BEGIN();
+    RUN_TEST(test_rx_pool_size_classes);
+    RUN_TEST(test_rx_pool_mixed_sizes_reuse);
+    RUN_TEST(test_rx_pool_grow_keeps_contents);
+    RUN_TEST(test_rx_pool_cache_limit);
+    return UNITY_END();
+#else
+    setUp();
+    RUN_TEST(test_rx_pool_size_classes);
+    tearDown(); setUp();
+    RUN_TEST(test_rx_pool_mixed_sizes_reuse);
+    tearDown(); setUp();
+    RUN_TEST(test_rx_pool_grow_keeps_contents);
+    tearDown(); setUp();
+    RUN_TEST(test_rx_pool_cache_limit);
+    tearDown();
+    printf("\n=== All tests passed ===\n");
+    return 0;
+#endif
+}
@@ -14,6 +14,7 @@ typedef enum {
 } storage_error_t;
 
 #define STORAGE_MAX_EVENTS         100
+#define STORAGE_COLD_MAX_EVENTS    1000
 #define STORAGE_FLAG_DELETED       0x01
 
 typedef struct __attribute__((packed)) {
@@ -38,7 +39,10 @@ typedef struct {
 typedef struct storage_engine {
     storage_index_entry_t index[STORAGE_MAX_EVENTS];
     nostr_event *events[STORAGE_MAX_EVENTS];
-    uint16_t index_count;
+    uint32_t index_count;
+    storage_index_entry_t cold[STORAGE_COLD_MAX_EVENTS];
+    nostr_event *cold_events[STORAGE_COLD_MAX_EVENTS];
+    uint32_t cold_count;
     uint32_t next_file_index;
     SemaphoreHandle_t lock;
     bool initialized;
@@ -64,6 +68,12 @@ static void storage_destroy(storage_engine_t *engine) {
             engine->events[i] = NULL;
         }
     }
+    for (uint32_t i = 0; i < engine->cold_count; i++) {
+        if (engine->cold_events[i]) {
+            fixture_free_event(engine->cold_events[i]);
+            engine->cold_events[i] = NULL;
+        }
+    }
     if (engine->lock) {
         vSemaphoreDelete(engine->lock);
         engine->lock = NULL;
@@ -71,21 +81,45 @@ static void storage_destroy(storage_engine_t *engine) {
     engine->initialized = false;
 }
 
-static int find_event_index(storage_engine_t *engine, const uint8_t event_id[32]) {
-    for (int i = 0; i < engine->index_count; i++) {
-        if (!(engine->index[i].flags & STORAGE_FLAG_DELETED) &&
-            memcmp(engine->index[i].event_id, event_id, 32) == 0) {
-            return i;
+static int find_in(storage_index_entry_t *entries, uint32_t count, const uint8_t event_id[32]) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(entries[i].flags & STORAGE_FLAG_DELETED) &&
+            memcmp(entries[i].event_id, event_id, 32) == 0) {
+            return (int)i;
         }
     }
     return -1;
 }
 
+static int find_event_index(storage_engine_t *engine, const uint8_t event_id[32]) {
+    return find_in(engine->index, engine->index_count, event_id);
+}
+
+static int find_cold_index(storage_engine_t *engine, const uint8_t event_id[32]) {
+    return find_in(engine->cold, engine->cold_count, event_id);
+}
+
+static storage_error_t spill_to_cold(storage_engine_t *engine) {
+    uint32_t spill = engine->index_count / 2;
+    if (spill == 0) spill = 1;
+    if (engine->cold_count + spill > STORAGE_COLD_MAX_EVENTS) return STORAGE_ERR_FULL;
+
+    memcpy(&engine->cold[engine->cold_count], engine->index, spill * sizeof(storage_index_entry_t));
+    memcpy(&engine->cold_events[engine->cold_count], engine->events, spill * sizeof(nostr_event *));
+    engine->cold_count += spill;
+
+    engine->index_count -= spill;
+    memmove(engine->index, engine->index + spill, engine->index_count * sizeof(storage_index_entry_t));
+    memmove(engine->events, engine->events + spill, engine->index_count * sizeof(nostr_event *));
+    memset(&engine->events[engine->index_count], 0, spill * sizeof(nostr_event *));
+    return STORAGE_OK;
+}
+
 static bool storage_event_exists(storage_engine_t *engine, const uint8_t event_id[32]) {
     xSemaphoreTake(engine->lock, portMAX_DELAY);
-    int idx = find_event_index(engine, event_id);
+    bool found = find_event_index(engine, event_id) >= 0 || find_cold_index(engine, event_id) >= 0;
     xSemaphoreGive(engine->lock);
-    return idx >= 0;
+    return found;
 }
 
 static storage_error_t storage_save_event(storage_engine_t *engine, const nostr_event *event) {
@@ -93,20 +127,20 @@ static storage_error_t storage_save_event(storage_engine_t *engine, const nostr_
 
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
-    if (find_event_index(engine, event->id) >= 0) {
+    if (find_event_index(engine, event->id) >= 0 || find_cold_index(engine, event->id) >= 0) {
         xSemaphoreGive(engine->lock);
         return STORAGE_ERR_DUPLICATE;
     }
 
     int slot = -1;
-    for (int i = 0; i < engine->index_count; i++) {
+    for (uint32_t i = 0; i < engine->index_count; i++) {
         if (engine->index[i].flags & STORAGE_FLAG_DELETED) {
-            slot = i;
+            slot = (int)i;
             break;
         }
     }
     if (slot < 0) {
-        if (engine->index_count >= STORAGE_MAX_EVENTS) {
+        if (engine->index_count >= STORAGE_MAX_EVENTS && spill_to_cold(engine) != STORAGE_OK) {
             xSemaphoreGive(engine->lock);
             return STORAGE_ERR_FULL;
         }
@@ -142,15 +176,22 @@ static storage_error_t storage_delete_event(storage_engine_t *engine, const uint
     xSemaphoreTake(engine->lock, portMAX_DELAY);
 
     int idx = find_event_index(engine, event_id);
+    storage_index_entry_t *entries = engine->index;
+    nostr_event **events = engine->events;
+    if (idx < 0) {
+        idx = find_cold_index(engine, event_id);
+        entries = engine->cold;
+        events = engine->cold_events;
+    }
     if (idx < 0) {
         xSemaphoreGive(engine->lock);
         return STORAGE_ERR_NOT_FOUND;
     }
 
-    engine->index[idx].flags |= STORAGE_FLAG_DELETED;
-    if (engine->events[idx]) {
-        fixture_free_event(engine->events[idx]);
-        engine->events[idx] = NULL;
+    entries[idx].flags |= STORAGE_FLAG_DELETED;
+    if (events[idx]) {
+        fixture_free_event(events[idx]);
+        events[idx] = NULL;
     }
 
     xSemaphoreGive(engine->lock);
@@ -171,10 +212,14 @@ static storage_error_t storage_query_events(storage_engine_t *engine,
     }
 
     uint16_t matched = 0;
-    for (int i = 0; i < engine->index_count && matched < limit; i++) {
-        storage_index_entry_t *entry = &engine->index[i];
+    uint32_t total = engine->index_count + engine->cold_count;
+    for (uint32_t n = 0; n < total && matched < limit; n++) {
+        bool hot = n < engine->index_count;
+        uint32_t i = hot ? n : n - engine->index_count;
+        storage_index_entry_t *entry = hot ? &engine->index[i] : &engine->cold[i];
+        nostr_event *event = hot ? engine->events[i] : engine->cold_events[i];
         if (entry->flags & STORAGE_FLAG_DELETED) continue;
-        if (!engine->events[i]) continue;
+        if (!event) continue;
 
         if (filter->kinds_count > 0) {
             bool kind_match = false;
@@ -186,7 +231,7 @@ static storage_error_t storage_query_events(storage_engine_t *engine,
         if (filter->since > 0 && entry->created_at < (uint32_t)filter->since) continue;
         if (filter->until > 0 && entry->created_at > (uint32_t)filter->until) continue;
 
-        res[matched++] = engine->events[i];
+        res[matched++] = event;
     }
 
     *results = res;
@@ -196,6 +241,101 @@ static storage_error_t storage_query_events(storage_engine_t *engine,
     return STORAGE_OK;
 }
 
+static bool entry_matches_filter(const storage_index_entry_t *entry, const nostr_filter_t *filter) {
+    if (filter->kinds_count > 0) {
+        bool kind_match = false;
+        for (size_t k = 0; k < filter->kinds_count && !kind_match; k++) {
+            kind_match = (filter->kinds[k] == entry->kind);
+        }
+        if (!kind_match) return false;
+    }
+    if (filter->since > 0 && entry->created_at < (uint32_t)filter->since) return false;
+    if (filter->until > 0 && entry->created_at > (uint32_t)filter->until) return false;
+    return true;
+}
+
+typedef struct {
+    uint8_t bytes[32];
+    uint8_t nibbles;
+} hex_prefix_t;
+
+static int hex_nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex_prefix(const char *hex, hex_prefix_t *out) {
+    size_t len = strlen(hex);
+    if (len == 0 || len > 64) return false;
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < len; i++) {
+        int v = hex_nibble(hex[i]);
+        if (v < 0) return false;
+        out->bytes[i / 2] |= (uint8_t)((i & 1) ? v : v << 4);
+    }
+    out->nibbles = (uint8_t)len;
+    return true;
+}
+
+static bool hex_prefix_match(const hex_prefix_t *p, const uint8_t *bytes, size_t nibbles) {
+    size_t n = p->nibbles < nibbles ? p->nibbles : nibbles;
+    if (memcmp(p->bytes, bytes, n / 2) != 0) return false;
+    return !(n & 1) || (p->bytes[n / 2] & 0xF0) == (bytes[n / 2] & 0xF0);
+}
+
+static bool any_prefix_match(char **values, size_t count, const uint8_t *bytes, size_t nibbles) {
+    for (size_t k = 0; k < count; k++) {
+        hex_prefix_t p;
+        if (parse_hex_prefix(values[k], &p) && hex_prefix_match(&p, bytes, nibbles)) return true;
+    }
+    return false;
+}
+
+static bool count_entry_matches(const storage_index_entry_t *entry, const nostr_filter_t *filter) {
+    if (!entry_matches_filter(entry, filter)) return false;
+    if (filter->ids_count > 0 && !any_prefix_match(filter->ids, filter->ids_count, entry->event_id, 64)) {
+        return false;
+    }
+    if (filter->authors_count > 0 &&
+        !any_prefix_match(filter->authors, filter->authors_count, entry->pubkey_prefix, 8)) {
+        return false;
+    }
+    return true;
+}
+
+static storage_error_t storage_count_events(storage_engine_t *engine,
+                                            const nostr_filter_t *filters,
+                                            size_t filter_count,
+                                            uint32_t *count) {
+    xSemaphoreTake(engine->lock, portMAX_DELAY);
+
+    *count = 0;
+    uint32_t total = engine->index_count + engine->cold_count;
+    for (uint32_t n = 0; n < total; n++) {
+        bool hot = n < engine->index_count;
+        uint32_t i = hot ? n : n - engine->index_count;
+        storage_index_entry_t *entry = hot ? &engine->index[i] : &engine->cold[i];
+        nostr_event *event = hot ? engine->events[i] : engine->cold_events[i];
+        if (entry->flags & STORAGE_FLAG_DELETED) continue;
+
+        for (size_t f = 0; f < filter_count; f++) {
+            const nostr_filter_t *filter = &filters[f];
+            if (!count_entry_matches(entry, filter)) continue;
+            if (filter->authors_count > 0 &&
+                !any_prefix_match(filter->authors, filter->authors_count, event->pubkey.data, 64)) {
+                continue;
+            }
+            (*count)++;
+            break;
+        }
+    }
+
+    xSemaphoreGive(engine->lock);
+    return STORAGE_OK;
+}
+
 static void storage_free_query_results(nostr_event **results, uint16_t count) {
     (void)count;
     free(results);
@@ -207,7 +347,7 @@ static int storage_purge_expired(storage_engine_t *engine) {
     int purged = 0;
     uint32_t now = (uint32_t)g_mock_now;
 
-    for (int i = 0; i < engine->index_count; i++) {
+    for (uint32_t i = 0; i < engine->index_count; i++) {
         if (engine->index[i].flags & STORAGE_FLAG_DELETED) continue;
         if (engine->index[i].expires_at > 0 && engine->index[i].expires_at <= now) {
             engine->index[i].flags |= STORAGE_FLAG_DELETED;
@@ -312,6 +452,103 @@ void test_storage_query_time_range(void) {
     nostr_filter_free(&filter);
 }
 
+void test_storage_count_union_of_filters(void) {
+    for (int i = 0; i < STORAGE_MAX_EVENTS * 2; i++) {
+        nostr_event *event = fixture_create_event(i % 4, g_mock_now - 1000 + i);
+        storage_save_event(&g_storage, event);
+        fixture_free_event(event);
+    }
+
+    nostr_filter_t filters[2];
+    filters[0] = fixture_kinds_filter(1);
+    filters[1] = fixture_kinds_filter(3);
+    filters[1].since = g_mock_now - 1000 + STORAGE_MAX_EVENTS;
+
+    uint32_t count = 0;
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, filters, 2, &count));
+    TEST_ASSERT_EQUAL(STORAGE_MAX_EVENTS / 2 + STORAGE_MAX_EVENTS / 4, count);
+
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, filters, 0, &count));
+    TEST_ASSERT_EQUAL(0, count);
+
+    nostr_filter_free(&filters[0]);
+    nostr_filter_free(&filters[1]);
+}
+
+static char *hex_string(const uint8_t *bytes, size_t nibbles) {
+    char *out = malloc(nibbles + 1);
+    for (size_t i = 0; i < nibbles; i++) {
+        uint8_t b = bytes[i / 2];
+        out[i] = "0123456789abcdef"[(i & 1) ? (b & 0x0F) : (b >> 4)];
+    }
+    out[nibbles] = '\0';
+    return out;
+}
+
+static nostr_filter_t single_value_filter(bool authors, char *value) {
+    nostr_filter_t f = {0};
+    char **values = malloc(sizeof(char *));
+    values[0] = value;
+    if (authors) {
+        f.authors = values;
+        f.authors_count = 1;
+    } else {
+        f.ids = values;
+        f.ids_count = 1;
+    }
+    return f;
+}
+
+void test_storage_count_author_prefix_collision(void) {
+    nostr_event *a = fixture_create_event(1, g_mock_now - 10);
+    nostr_event *b = fixture_create_event(1, g_mock_now - 5);
+    memcpy(b->pubkey.data, a->pubkey.data, 4);
+    b->pubkey.data[31] = (uint8_t)(a->pubkey.data[31] ^ 0xFF);
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, a));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, b));
+
+    uint32_t count = 0;
+    nostr_filter_t full = single_value_filter(true, hex_string(a->pubkey.data, 64));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, &full, 1, &count));
+    TEST_ASSERT_EQUAL(1, count);
+
+    nostr_filter_t prefix = single_value_filter(true, hex_string(a->pubkey.data, 5));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, &prefix, 1, &count));
+    TEST_ASSERT_EQUAL(2, count);
+
+    nostr_filter_free(&full);
+    nostr_filter_free(&prefix);
+    fixture_free_event(a);
+    fixture_free_event(b);
+}
+
+void test_storage_count_id_prefix(void) {
+    nostr_event *a = fixture_create_event(1, g_mock_now - 10);
+    nostr_event *b = fixture_create_event(1, g_mock_now - 5);
+    b->id[0] = (uint8_t)(a->id[0] ^ 0x01);
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, a));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, b));
+
+    uint32_t count = 0;
+    nostr_filter_t prefix = single_value_filter(false, hex_string(a->id, 10));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, &prefix, 1, &count));
+    TEST_ASSERT_EQUAL(1, count);
+
+    nostr_filter_t nibble = single_value_filter(false, hex_string(a->id, 1));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, &nibble, 1, &count));
+    TEST_ASSERT_EQUAL(2, count);
+
+    nostr_filter_t bad = single_value_filter(false, strdup("zz"));
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_count_events(&g_storage, &bad, 1, &count));
+    TEST_ASSERT_EQUAL(0, count);
+
+    nostr_filter_free(&prefix);
+    nostr_filter_free(&nibble);
+    nostr_filter_free(&bad);
+    fixture_free_event(a);
+    fixture_free_event(b);
+}
+
 void test_storage_delete_event(void) {
     nostr_event *event = fixture_create_event(1, g_mock_now - 60);
 
@@ -364,14 +601,42 @@ void test_storage_limit_results(void) {
     storage_free_query_results(results, count);
 }
 
-void test_storage_full(void) {
-    for (int i = 0; i < STORAGE_MAX_EVENTS; i++) {
+void test_storage_spills_to_cold_tier(void) {
+    nostr_event *first = fixture_create_event(1, g_mock_now - 120);
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, first));
+
+    for (int i = 0; i < STORAGE_MAX_EVENTS * 3; i++) {
         nostr_event *event = fixture_create_event(1, g_mock_now - 60 + i);
         TEST_ASSERT_EQUAL(STORAGE_OK, storage_save_event(&g_storage, event));
         fixture_free_event(event);
     }
 
-    nostr_event *overflow = fixture_create_event(1, g_mock_now);
+    TEST_ASSERT_TRUE(g_storage.cold_count > 0);
+    TEST_ASSERT_TRUE(g_storage.index_count <= STORAGE_MAX_EVENTS);
+    TEST_ASSERT_TRUE(storage_event_exists(&g_storage, first->id));
+    TEST_ASSERT_EQUAL(STORAGE_ERR_DUPLICATE, storage_save_event(&g_storage, first));
+
+    nostr_filter_t filter = {0};
+    nostr_event **results;
+    uint16_t count;
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_query_events(&g_storage, &filter, &results, &count, 500));
+    TEST_ASSERT_EQUAL(STORAGE_MAX_EVENTS * 3 + 1, count);
+    storage_free_query_results(results, count);
+
+    TEST_ASSERT_EQUAL(STORAGE_OK, storage_delete_event(&g_storage, first->id));
+    TEST_ASSERT_FALSE(storage_event_exists(&g_storage, first->id));
+
+    fixture_free_event(first);
+}
+
+void test_storage_full(void) {
+    for (int i = 0; i < STORAGE_MAX_EVENTS + STORAGE_COLD_MAX_EVENTS; i++) {
+        nostr_event *event = fixture_create_event(1, g_mock_now - 60 + i);
+        storage_save_event(&g_storage, event);
+        fixture_free_event(event);
+    }
+
+    nostr_event *overflow = fixture_create_event(1, g_mock_now + STORAGE_COLD_MAX_EVENTS * 2);
     TEST_ASSERT_EQUAL(STORAGE_ERR_FULL, storage_save_event(&g_storage, overflow));
     fixture_free_event(overflow);
 }
@@ -408,10 +673,14 @@ int main(void) {
     RUN_TEST(test_storage_query_by_kind);
     RUN_TEST(test_storage_query_multiple_kinds);
     RUN_TEST(test_storage_query_time_range);
+    RUN_TEST(test_storage_count_union_of_filters);
+    RUN_TEST(test_storage_count_author_prefix_collision);
+    RUN_TEST(test_storage_count_id_prefix);
     RUN_TEST(test_storage_delete_event);
     RUN_TEST(test_storage_delete_nonexistent);
     RUN_TEST(test_storage_purge_expired);
     RUN_TEST(test_storage_limit_results);
+    RUN_TEST(test_storage_spills_to_cold_tier);
     RUN_TEST(test_storage_full);
     RUN_TEST(test_storage_reuses_deleted_slots);
     return UNITY_END();
@@ -427,6 +696,12 @@ int main(void) {
     tearDown(); setUp();
     RUN_TEST(test_storage_query_time_range);
     tearDown(); setUp();
+    RUN_TEST(test_storage_count_union_of_filters);
+    tearDown(); setUp();
+    RUN_TEST(test_storage_count_author_prefix_collision);
+    tearDown(); setUp();
+    RUN_TEST(test_storage_count_id_prefix);
+    tearDown(); setUp();
     RUN_TEST(test_storage_delete_event);
     tearDown(); setUp();
     RUN_TEST(test_storage_delete_nonexistent);
@@ -435,6 +710,8 @@ int main(void) {
     tearDown(); setUp();
     RUN_TEST(test_storage_limit_results);
     tearDown(); setUp();
+    RUN_TEST(test_storage_spills_to_cold_tier);
+    tearDown(); setUp();
     RUN_TEST(test_storage_full);
     tearDown(); setUp();
     RUN_TEST(test_storage_reuses_deleted_slots);
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_fixtures.h"
+#include "sub_index.h"
+
+static sub_index_t idx;
+
+static uint64_t kind_key(uint32_t kind)
+{
+    return sub_index_key(SUB_KEY_KIND, 0, &kind, sizeof(kind));
+}
+
+static uint64_t tag_key(char tag, const char *value)
+{
+    return sub_index_key(SUB_KEY_TAG, tag, value, strlen(value));
+}
+
+static uint32_t candidates(const uint64_t *keys, size_t key_count, uint32_t *out, uint32_t max_out)
+{
+    uint8_t seen[8] = {0};
+    return sub_index_candidates(&idx, keys, key_count, seen, out, max_out);
+}
+
+static bool contains(const uint32_t *subs, uint32_t count, uint32_t sub)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (subs[i] == sub) return true;
+    }
+    return false;
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_TRUE(sub_index_init(&idx, 64, false));
+}
+
+void tearDown(void)
+{
+    sub_index_destroy(&idx);
+}
+
+void test_sub_index_key_classes_differ(void)
+{
+    uint8_t id[32];
+    memset(id, 0xab, sizeof(id));
+    TEST_ASSERT_NOT_EQUAL(sub_index_key(SUB_KEY_ID, 0, id, 32),
+                          sub_index_key(SUB_KEY_AUTHOR, 0, id, 32));
+    TEST_ASSERT_NOT_EQUAL(tag_key('e', "abc"), tag_key('p', "abc"));
+    TEST_ASSERT_EQUAL(tag_key('t', "nostr"), tag_key('t', "nostr"));
+}
+
+void test_sub_index_candidates_by_key(void)
+{
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 3, kind_key(1)));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 7, kind_key(7)));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 9, tag_key('t', "nostr")));
+
+    uint32_t out[64];
+    uint64_t keys[] = { kind_key(1), tag_key('t', "nostr") };
+    uint32_t n = candidates(keys, 2, out, 64);
+    TEST_ASSERT_EQUAL(2, n);
+    TEST_ASSERT_TRUE(contains(out, n, 3));
+    TEST_ASSERT_TRUE(contains(out, n, 9));
+    TEST_ASSERT_FALSE(contains(out, n, 7));
+}
+
+void test_sub_index_dedupes_candidates(void)
+{
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 5, kind_key(1)));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 5, tag_key('p', "alice")));
+
+    uint32_t out[64];
+    uint64_t keys[] = { kind_key(1), tag_key('p', "alice"), kind_key(1) };
+    TEST_ASSERT_EQUAL(1, candidates(keys, 3, out, 64));
+    TEST_ASSERT_EQUAL(2, idx.live_postings);
+    TEST_ASSERT_EQUAL(5, out[0]);
+}
+
+void test_sub_index_residual_always_candidate(void)
+{
+    TEST_ASSERT_TRUE(sub_index_add_residual(&idx, 11));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 12, kind_key(1)));
+
+    uint32_t out[64];
+    uint64_t keys[] = { kind_key(30023) };
+    uint32_t n = candidates(keys, 1, out, 64);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL(11, out[0]);
+}
+
+void test_sub_index_remove(void)
+{
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 1, kind_key(1)));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 1, kind_key(7)));
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 2, kind_key(1)));
+    TEST_ASSERT_TRUE(sub_index_add_residual(&idx, 3));
+
+    sub_index_remove(&idx, 1);
+    sub_index_remove(&idx, 3);
+
+    uint32_t out[64];
+    uint64_t keys[] = { kind_key(1), kind_key(7) };
+    uint32_t n = candidates(keys, 2, out, 64);
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_EQUAL(2, out[0]);
+    TEST_ASSERT_EQUAL(1, idx.live_postings);
+    TEST_ASSERT_EQUAL(0, idx.residual_count);
+}
+
+void test_sub_index_clone_is_independent(void)
+{
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 4, kind_key(1)));
+
+    sub_index_t copy;
+    TEST_ASSERT_TRUE(sub_index_clone(&copy, &idx));
+    sub_index_remove(&idx, 4);
+    TEST_ASSERT_TRUE(sub_index_add_key(&idx, 6, kind_key(1)));
+
+    uint32_t out[64];
+    uint8_t seen[8] = {0};
+    uint64_t keys[] = { kind_key(1) };
+    TEST_ASSERT_EQUAL(1, sub_index_candidates(&copy, keys, 1, seen, out, 64));
+    TEST_ASSERT_EQUAL(4, out[0]);
+    TEST_ASSERT_EQUAL(1, candidates(keys, 1, out, 64));
+    TEST_ASSERT_EQUAL(6, out[0]);
+    sub_index_destroy(&copy);
+}
+
+void test_sub_index_grows_and_reuses_postings(void)
+{
+    for (uint32_t round = 0; round < 3; round++) {
+        for (uint32_t sub = 0; sub < 64; sub++) {
+            for (uint32_t k = 0; k < 16; k++) {
+                TEST_ASSERT_TRUE(sub_index_add_key(&idx, sub, kind_key(sub * 16 + k)));
+            }
+        }
+        TEST_ASSERT_EQUAL(64 * 16, idx.live_postings);
+
+        uint32_t out[64];
+        uint64_t keys[] = { kind_key(5 * 16 + 3), kind_key(40 * 16) };
+        uint32_t n = candidates(keys, 2, out, 64);
+        TEST_ASSERT_EQUAL(2, n);
+        TEST_ASSERT_TRUE(contains(out, n, 5));
+        TEST_ASSERT_TRUE(contains(out, n, 40));
+
+        for (uint32_t sub = 0; sub < 64; sub++) {
+            sub_index_remove(&idx, sub);
+        }
+        TEST_ASSERT_EQUAL(0, idx.live_postings);
+    }
+}
+
+void test_sub_index_respects_max_out(void)
+{
+    for (uint32_t sub = 0; sub < 10; sub++) {
+        TEST_ASSERT_TRUE(sub_index_add_key(&idx, sub, kind_key(1)));
+    }
+    uint32_t out[4];
+    uint64_t keys[] = { kind_key(1) };
+    TEST_ASSERT_EQUAL(4, candidates(keys, 1, out, 4));
+}
+
+int main(void)
+{
+    printf("=== Subscription Index Tests ===\n\n");
+#ifdef HAVE_UNITY
+    UNITY_BEGIN();
+    RUN_TEST(test_sub_index_key_classes_differ);
+    RUN_TEST(test_sub_index_candidates_by_key);
+    RUN_TEST(test_sub_index_dedupes_candidates);
+    RUN_TEST(test_sub_index_residual_always_candidate);
+    RUN_TEST(test_sub_index_remove);
+    RUN_TEST(test_sub_index_clone_is_independent);
+    RUN_TEST(test_sub_index_grows_and_reuses_postings);
+    RUN_TEST(test_sub_index_respects_max_out);
+    return UNITY_END();
+#else
+    setUp();
+    RUN_TEST(test_sub_index_key_classes_differ);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_candidates_by_key);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_dedupes_candidates);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_residual_always_candidate);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_remove);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_clone_is_independent);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_grows_and_reuses_postings);
+    tearDown(); setUp();
+    RUN_TEST(test_sub_index_respects_max_out);
+    tearDown();
+    printf("\n=== All tests passed ===\n");
+    return 0;
+#endif
+}
@@ -32,6 +32,8 @@ typedef struct {
 static int64_t g_mock_now = 0;
 static nostr_relay_error_t g_mock_validate_result = NOSTR_RELAY_OK;
 static int g_mock_pow_difficulty = 0;
+static bool g_mock_exists = false;
+static int g_validate_calls = 0;
 
 static int64_t nostr_timestamp_now(void) {
     return g_mock_now;
@@ -45,6 +47,7 @@ static nostr_relay_error_t nostr_event_validate_full(const nostr_event *event, i
         }
         return NOSTR_RELAY_ERR_MISSING_FIELD;
     }
+    g_validate_calls++;
     result->valid = (g_mock_validate_result == NOSTR_RELAY_OK);
     result->error_code = g_mock_validate_result;
     result->error_message[0] = '\0';
@@ -64,6 +67,22 @@ static int nostr_nip13_calculate_difficulty(const uint8_t *id) {
 
 typedef struct storage_engine storage_engine_t;
 
+static bool storage_event_exists(storage_engine_t *engine, const uint8_t event_id[32]) {
+    (void)engine;
+    (void)event_id;
+    return g_mock_exists;
+}
+
+static bool nostr_kind_is_ephemeral(uint16_t kind) {
+    return kind >= 20000 && kind < 30000;
+}
+
+static validation_result_t check_duplicate(const nostr_event *event, storage_engine_t *storage) {
+    if (!storage) return VALIDATION_OK;
+    if (storage_event_exists(storage, event->id)) return VALIDATION_ERR_DUPLICATE;
+    return VALIDATION_OK;
+}
+
 static validation_result_t map_relay_error(nostr_relay_error_t err) {
     switch (err) {
         case NOSTR_RELAY_OK: return VALIDATION_OK;
@@ -95,10 +114,14 @@ static validation_result_t validator_check_event(
     const nostr_event *event,
     const validator_config_t *config,
     storage_engine_t *storage) {
-    (void)storage;
     validation_result_t result;
     nostr_validation_result_t libnostr_result;
 
+    if (config->check_duplicates && !nostr_kind_is_ephemeral(event->kind)) {
+        result = check_duplicate(event, storage);
+        if (result != VALIDATION_OK) return result;
+    }
+
     nostr_relay_error_t err = nostr_event_validate_full(event, config->max_future_sec, &libnostr_result);
     if (err != NOSTR_RELAY_OK) return map_relay_error(err);
 
@@ -131,6 +154,8 @@ void setUp(void) {
     g_mock_now = 1700000000;
     g_mock_validate_result = NOSTR_RELAY_OK;
     g_mock_pow_difficulty = 0;
+    g_mock_exists = false;
+    g_validate_calls = 0;
 }
 
 void tearDown(void) {}
@@ -246,6 +271,31 @@ void test_validator_rejects_schema_errors(void) {
     fixture_free_event(event);
 }
 
+void test_validator_duplicate_skips_verification(void) {
+    nostr_event *event = fixture_create_event(1, g_mock_now - 60);
+    storage_engine_t *storage = (storage_engine_t *)event;
+    g_mock_exists = true;
+    g_mock_validate_result = NOSTR_RELAY_ERR_SIG_MISMATCH;
+    validator_config_t config = { .check_duplicates = true };
+    TEST_ASSERT_EQUAL(VALIDATION_ERR_DUPLICATE, validator_check_event(event, &config, storage));
+    TEST_ASSERT_EQUAL(0, g_validate_calls);
+
+    config.check_duplicates = false;
+    TEST_ASSERT_EQUAL(VALIDATION_ERR_SIG, validator_check_event(event, &config, storage));
+    TEST_ASSERT_EQUAL(1, g_validate_calls);
+    fixture_free_event(event);
+}
+
+void test_validator_ephemeral_skips_duplicate_check(void) {
+    nostr_event *event = fixture_create_event(20001, g_mock_now - 60);
+    storage_engine_t *storage = (storage_engine_t *)event;
+    g_mock_exists = true;
+    validator_config_t config = { .check_duplicates = true };
+    TEST_ASSERT_EQUAL(VALIDATION_OK, validator_check_event(event, &config, storage));
+    TEST_ASSERT_EQUAL(1, g_validate_calls);
+    fixture_free_event(event);
+}
+
 int main(void) {
     printf("=== Validator Tests ===\n");
 #ifdef HAVE_UNITY
@@ -262,6 +312,8 @@ int main(void) {
     RUN_TEST(test_validator_skips_pow_when_disabled);
     RUN_TEST(test_validator_result_strings);
     RUN_TEST(test_validator_rejects_schema_errors);
+    RUN_TEST(test_validator_duplicate_skips_verification);
+    RUN_TEST(test_validator_ephemeral_skips_duplicate_check);
     return UNITY_END();
 #else
     setUp();
@@ -288,6 +340,10 @@ int main(void) {
     RUN_TEST(test_validator_result_strings);
     setUp();
     RUN_TEST(test_validator_rejects_schema_errors);
+    setUp();
+    RUN_TEST(test_validator_duplicate_skips_verification);
+    setUp();
+    RUN_TEST(test_validator_ephemeral_skips_duplicate_check);
     printf("\n=== All tests passed ===\n");
     return 0;
 #endif
@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "test_fixtures.h"
+#include "ws_core.h"
+#include "ws_deflate.h"
+#include "rx_pool.h"
+
+static rx_pool_t pool;
+
+static void release_pool(void)
+{
+    rx_pool_stats_t stats;
+    rx_pool_get_stats(&pool, &stats);
+    TEST_ASSERT_EQUAL(0u, stats.in_use);
+    rx_pool_destroy(&pool);
+}
+
+typedef struct {
+    ws_core_t *core;
+    int opened;
+    int closed;
+    int messages;
+    char last[64];
+} echo_state_t;
+
+static bool echo_open(void *user, int fd)
+{
+    (void)fd;
+    ((echo_state_t *)user)->opened++;
+    return true;
+}
+
+static void echo_message(void *user, int fd, char *data, size_t len)
+{
+    echo_state_t *st = user;
+    st->messages++;
+    snprintf(st->last, sizeof(st->last), "%s", data);
+
+    uint8_t header[WS_CORE_HEADER_MAX];
+    size_t hlen = ws_core_encode_header(header, WS_CORE_OP_TEXT, true, len);
+    ws_core_send(st->core, fd, (const char *)header, hlen);
+    ws_core_send(st->core, fd, data, len);
+    rx_pool_release(&pool, data);
+}
+
+static void echo_close(void *user, int fd)
+{
+    (void)fd;
+    ((echo_state_t *)user)->closed++;
+}
+
+static size_t echo_http(void *user, const ws_core_http_t *req, char *resp, size_t size)
+{
+    (void)user;
+    (void)req;
+    return (size_t)snprintf(resp, size, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}");
+}
+
+static size_t mask_frame(uint8_t *out, uint8_t opcode, bool fin, const char *payload, size_t len)
+{
+    static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+    size_t hlen = ws_core_encode_header(out, opcode, fin, len);
+    out[1] |= 0x80;
+    memcpy(out + hlen, mask, 4);
+    for (size_t i = 0; i < len; i++) {
+        out[hlen + 4 + i] = (uint8_t)payload[i] ^ mask[i & 3];
+    }
+    return hlen + 4 + len;
+}
+
+static void test_ws_core_accept_key_rfc6455(void)
+{
+    char accept[WS_CORE_ACCEPT_LEN + 1];
+    const char *key = "dGhlIHNhbXBsZSBub25jZQ==";
+    ws_core_accept_key(key, strlen(key), accept);
+    TEST_ASSERT_EQUAL_STRING("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept);
+}
+
+static void test_ws_core_parse_upgrade(void)
+{
+    const char *req =
+        "GET / HTTP/1.1\r\n"
+        "Host: relay\r\n"
+        "upgrade: WebSocket\r\n"
+        "Connection: keep-alive, Upgrade\r\n"
+        "Sec-WebSocket-Key:   dGhlIHNhbXBsZSBub25jZQ==  \r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+        "\r\n";
+    ws_core_http_t http;
+    int r = ws_core_parse_http(req, strlen(req), &http);
+    TEST_ASSERT_EQUAL((int)strlen(req), r);
+    TEST_ASSERT_TRUE(http.upgrade);
+    TEST_ASSERT_EQUAL(24, (int)http.key_len);
+    TEST_ASSERT_EQUAL_MEMORY("dGhlIHNhbXBsZSBub25jZQ==", http.key, http.key_len);
+    TEST_ASSERT_EQUAL_MEMORY("permessage-deflate", http.extensions, http.extensions_len);
+
+    TEST_ASSERT_EQUAL(0, ws_core_parse_http(req, strlen(req) - 2, &http));
+}
+
+static void test_ws_core_parse_plain_get(void)
+{
+    const char *req = "GET / HTTP/1.1\r\nAccept: application/nostr+json\r\n\r\n";
+    ws_core_http_t http;
+    TEST_ASSERT_EQUAL((int)strlen(req), ws_core_parse_http(req, strlen(req), &http));
+    TEST_ASSERT_FALSE(http.upgrade);
+    TEST_ASSERT_EQUAL_MEMORY("application/nostr+json", http.accept, http.accept_len);
+
+    TEST_ASSERT_EQUAL(-1, ws_core_parse_http("GARBAGE\r\n\r\n", 11, &http));
+}
+
+static void test_ws_core_frame_roundtrip(void)
+{
+    uint8_t buf[512];
+    char payload[300];
+    memset(payload, 'x', sizeof(payload));
+
+    size_t n = mask_frame(buf, WS_CORE_OP_TEXT, true, payload, sizeof(payload));
+    ws_core_frame_t frame;
+    TEST_ASSERT_EQUAL(WS_CORE_FRAME_INCOMPLETE, ws_core_decode_frame(buf, n - 1, 1024, &frame));
+    TEST_ASSERT_EQUAL((int)n, ws_core_decode_frame(buf, n, 1024, &frame));
+    TEST_ASSERT_EQUAL(WS_CORE_OP_TEXT, frame.opcode);
+    TEST_ASSERT_TRUE(frame.fin);
+    TEST_ASSERT_EQUAL(sizeof(payload), frame.len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, frame.payload, frame.len);
+
+    n = mask_frame(buf, WS_CORE_OP_TEXT, true, payload, sizeof(payload));
+    TEST_ASSERT_EQUAL(WS_CORE_FRAME_ERR_TOO_BIG, ws_core_decode_frame(buf, n, 100, &frame));
+}
+
+static void test_ws_core_frame_rejects_bad_frames(void)
+{
+    uint8_t buf[256];
+    ws_core_frame_t frame;
+
+    size_t n = ws_core_encode_header(buf, WS_CORE_OP_TEXT, true, 3);
+    memcpy(buf + n, "abc", 3);
+    TEST_ASSERT_EQUAL(WS_CORE_FRAME_ERR_PROTOCOL, ws_core_decode_frame(buf, n + 3, 1024, &frame));
+
+    char ping[126];
+    memset(ping, 'p', sizeof(ping));
+    n = mask_frame(buf, WS_CORE_OP_PING, true, ping, sizeof(ping));
+    TEST_ASSERT_EQUAL(WS_CORE_FRAME_ERR_PROTOCOL, ws_core_decode_frame(buf, n, 1024, &frame));
+
+    n = mask_frame(buf, WS_CORE_OP_PING, false, "p", 1);
+    TEST_ASSERT_EQUAL(WS_CORE_FRAME_ERR_PROTOCOL, ws_core_decode_frame(buf, n, 1024, &frame));
+}
+
+static void test_ws_deflate_negotiate(void)
+{
+    ws_deflate_config_t config = { .enabled = true, .window_bits = 11, .mem_level = 4 };
+    ws_deflate_params_t params;
+    const char *chrome = "permessage-deflate; client_max_window_bits";
+    TEST_ASSERT_TRUE(ws_deflate_negotiate(chrome, strlen(chrome), &config, &params));
+    TEST_ASSERT_EQUAL(11, params.server_window_bits);
+    TEST_ASSERT_EQUAL(11, params.client_window_bits);
+
+    char resp[WS_DEFLATE_RESPONSE_MAX];
+    TEST_ASSERT_TRUE(ws_deflate_response(&params, resp, sizeof(resp)) > 0);
+    TEST_ASSERT_EQUAL_STRING("Sec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover; "
+                             "server_max_window_bits=11; client_max_window_bits=11\r\n", resp);
+
+    const char *offers = "x-webkit-deflate-frame, permessage-deflate; foo=1, "
+                         "permessage-deflate; server_max_window_bits=\"10\"; server_no_context_takeover";
+    TEST_ASSERT_TRUE(ws_deflate_negotiate(offers, strlen(offers), &config, &params));
+    TEST_ASSERT_EQUAL(10, params.server_window_bits);
+    TEST_ASSERT_TRUE(params.server_no_context_takeover);
+    TEST_ASSERT_FALSE(params.client_window_negotiated);
+    TEST_ASSERT_EQUAL(15, params.client_window_bits);
+
+    const char *tiny = "permessage-deflate; server_max_window_bits=8";
+    TEST_ASSERT_FALSE(ws_deflate_negotiate(tiny, strlen(tiny), &config, &params));
+
+    config.enabled = false;
+    TEST_ASSERT_FALSE(ws_deflate_negotiate(chrome, strlen(chrome), &config, &params));
+}
+
+static void test_ws_deflate_backfill_ratio(void)
+{
+    ws_deflate_params_t params = { .server_window_bits = 11, .client_window_bits = 11 };
+    ws_deflate_t *tx = ws_deflate_create(&params, 4);
+    TEST_ASSERT_NOT_NULL(tx);
+
+    z_stream rx;
+    memset(&rx, 0, sizeof(rx));
+    TEST_ASSERT_EQUAL(Z_OK, inflateInit2(&rx, -11));
+    static const uint8_t tail[4] = { 0x00, 0x00, 0xff, 0xff };
+
+    const char *prefix = "[\"EVENT\",\"backfill\",";
+    size_t raw = 0;
+    size_t wire = 0;
+    for (int i = 0; i < 20; i++) {
+        char body[512];
+        int n = snprintf(body, sizeof(body),
+                         "{\"id\":\"%064d\",\"pubkey\":\"%064d\",\"created_at\":%d,\"kind\":1,"
+                         "\"tags\":[[\"p\",\"%064d\"]],\"content\":\"gm nostr %d\",\"sig\":\"%0128d\"}]",
+                         i, 42, 1700000000 + i, 7, i, i);
+        uint8_t *out;
+        size_t out_len;
+        TEST_ASSERT_TRUE(ws_deflate_compress(tx, prefix, strlen(prefix), body, (size_t)n, &out, &out_len));
+        raw += strlen(prefix) + (size_t)n;
+        wire += out_len;
+
+        uint8_t plain[1024];
+        rx.next_out = plain;
+        rx.avail_out = sizeof(plain);
+        rx.next_in = out;
+        rx.avail_in = (uInt)out_len;
+        TEST_ASSERT_EQUAL(Z_OK, inflate(&rx, Z_SYNC_FLUSH));
+        rx.next_in = (Bytef *)tail;
+        rx.avail_in = sizeof(tail);
+        inflate(&rx, Z_SYNC_FLUSH);
+        TEST_ASSERT_EQUAL(strlen(prefix) + (size_t)n, sizeof(plain) - rx.avail_out);
+        TEST_ASSERT_EQUAL_MEMORY(prefix, plain, strlen(prefix));
+        TEST_ASSERT_EQUAL_MEMORY(body, plain + strlen(prefix), (size_t)n);
+        free(out);
+    }
+    TEST_ASSERT_TRUE(wire * 3 < raw);
+
+    inflateEnd(&rx);
+    ws_deflate_destroy(tx);
+}
+
+static size_t raw_deflate(const char *in, size_t len, uint8_t *out, size_t cap)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&zs, 6, Z_DEFLATED, -11, 4, Z_DEFAULT_STRATEGY));
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = out;
+    zs.avail_out = (uInt)cap;
+    TEST_ASSERT_EQUAL(Z_OK, deflate(&zs, Z_SYNC_FLUSH));
+    size_t n = cap - zs.avail_out - 4;
+    deflateEnd(&zs);
+    return n;
+}
+
+static void test_ws_deflate_rejects_oversized_output(void)
+{
+    ws_deflate_params_t params = { .server_window_bits = 11, .client_window_bits = 11 };
+    ws_deflate_t *d = ws_deflate_create(&params, 4);
+    char zeros[8192];
+    memset(zeros, '0', sizeof(zeros));
+    uint8_t packed[256];
+    size_t n = raw_deflate(zeros, sizeof(zeros), packed, sizeof(packed));
+
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    char *plain;
+    size_t plain_len;
+    TEST_ASSERT_FALSE(ws_deflate_decompress(d, &pool, packed, n, 1024, &plain, &plain_len));
+    TEST_ASSERT_TRUE(ws_deflate_decompress(d, &pool, packed, n, 16384, &plain, &plain_len));
+    TEST_ASSERT_EQUAL(sizeof(zeros), plain_len);
+    TEST_ASSERT_TRUE(rx_pool_capacity(plain) >= sizeof(zeros));
+    rx_pool_release(&pool, plain);
+    ws_deflate_destroy(d);
+    release_pool();
+}
+
+static int connect_client(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    TEST_ASSERT_EQUAL(0, connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 20000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static size_t pump_recv(ws_core_t *core, int fd, char *buf, size_t want)
+{
+    size_t got = 0;
+    for (int i = 0; i < 50 && got < want; i++) {
+        ws_core_poll(core, 10);
+        ssize_t n = recv(fd, buf + got, want - got, 0);
+        if (n > 0) got += (size_t)n;
+        if (n == 0) break;
+    }
+    return got;
+}
+
+static uint16_t listen_port(ws_core_t *core)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(core->listen_fd, (struct sockaddr *)&addr, &len);
+    return ntohs(addr.sin_port);
+}
+
+static void test_ws_core_loopback_echo(void)
+{
+    static ws_core_t core;
+    echo_state_t st = { .core = &core };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = { .port = 0, .max_conns = 4, .max_frame = 4096, .rx_pool = &pool };
+    ws_core_callbacks_t cb = {
+        .on_open = echo_open, .on_message = echo_message, .on_close = echo_close, .on_http = echo_http,
+    };
+    TEST_ASSERT_TRUE(ws_core_init(&core, &config, &cb, &st));
+    int client = connect_client(listen_port(&core));
+
+    const char *req =
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    send(client, req, strlen(req), 0);
+
+    char resp[256] = {0};
+    const char *expect =
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n";
+    TEST_ASSERT_EQUAL(strlen(expect), pump_recv(&core, client, resp, strlen(expect)));
+    TEST_ASSERT_EQUAL_STRING(expect, resp);
+    TEST_ASSERT_EQUAL(1, st.opened);
+
+    uint8_t frame[64];
+    size_t n = mask_frame(frame, WS_CORE_OP_TEXT, false, "[\"REQ\",", 7);
+    n += mask_frame(frame + n, WS_CORE_OP_PING, true, "hi", 2);
+    n += mask_frame(frame + n, WS_CORE_OP_CONT, true, "\"s\"]", 4);
+    send(client, frame, n, 0);
+
+    char out[64] = {0};
+    TEST_ASSERT_EQUAL(4u + 13u, pump_recv(&core, client, out, 4 + 13));
+    TEST_ASSERT_EQUAL((char)0x8A, out[0]);
+    TEST_ASSERT_EQUAL_MEMORY("hi", out + 2, 2);
+    TEST_ASSERT_EQUAL((char)0x81, out[4]);
+    TEST_ASSERT_EQUAL(11, out[5]);
+    TEST_ASSERT_EQUAL_MEMORY("[\"REQ\",\"s\"]", out + 6, 11);
+    TEST_ASSERT_EQUAL(1, st.messages);
+    TEST_ASSERT_EQUAL_STRING("[\"REQ\",\"s\"]", st.last);
+
+    TEST_ASSERT_TRUE(ws_core_close(&core, core.conns[0].fd));
+    TEST_ASSERT_EQUAL(0u, pump_recv(&core, client, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(1, st.closed);
+    TEST_ASSERT_EQUAL(0, core.conn_count);
+
+    close(client);
+    ws_core_destroy(&core);
+    release_pool();
+}
+
+static void test_ws_core_loopback_deflate(void)
+{
+    static ws_core_t core;
+    echo_state_t st = { .core = &core };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = {
+        .port = 0, .max_conns = 2, .max_frame = 4096, .rx_pool = &pool,
+        .deflate = { .enabled = true, .window_bits = 11, .mem_level = 4 },
+    };
+    ws_core_callbacks_t cb = { .on_open = echo_open, .on_message = echo_message, .on_close = echo_close };
+    TEST_ASSERT_TRUE(ws_core_init(&core, &config, &cb, &st));
+    int client = connect_client(listen_port(&core));
+
+    const char *req =
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n\r\n";
+    send(client, req, strlen(req), 0);
+
+    char resp[512] = {0};
+    pump_recv(&core, client, resp, sizeof(resp) - 1);
+    TEST_ASSERT_TRUE(strstr(resp, "permessage-deflate; client_no_context_takeover") != NULL);
+    TEST_ASSERT_NOT_NULL(ws_core_deflate(&core, core.conns[0].fd));
+
+    const char *msg = "[\"REQ\",\"sub\",{\"kinds\":[1,1,1,1,1,1,1,1,1,1,1,1]}]";
+    uint8_t packed[128];
+    size_t packed_len = raw_deflate(msg, strlen(msg), packed, sizeof(packed));
+    uint8_t frame[160];
+    size_t n = mask_frame(frame, WS_CORE_OP_TEXT, true, (const char *)packed, packed_len);
+    frame[0] |= 0x40;
+    send(client, frame, n, 0);
+
+    char out[128] = {0};
+    TEST_ASSERT_EQUAL(2 + strlen(msg), pump_recv(&core, client, out, 2 + strlen(msg)));
+    TEST_ASSERT_EQUAL(1, st.messages);
+    TEST_ASSERT_EQUAL_STRING(msg, st.last);
+
+    close(client);
+    ws_core_destroy(&core);
+    release_pool();
+}
+
+static void test_ws_core_plain_http_and_pool_limit(void)
+{
+    static ws_core_t core;
+    echo_state_t st = { .core = &core };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = { .port = 0, .max_conns = 1, .max_frame = 1024, .rx_pool = &pool };
+    ws_core_callbacks_t cb = {
+        .on_open = echo_open, .on_message = echo_message, .on_close = echo_close, .on_http = echo_http,
+    };
+    TEST_ASSERT_TRUE(ws_core_init(&core, &config, &cb, &st));
+    uint16_t port = listen_port(&core);
+
+    int first = connect_client(port);
+    ws_core_poll(&core, 10);
+    int second = connect_client(port);
+    char buf[128] = {0};
+    TEST_ASSERT_EQUAL(0u, pump_recv(&core, second, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL(1u, core.rejected);
+
+    const char *get = "GET / HTTP/1.1\r\nAccept: application/nostr+json\r\n\r\n";
+    send(first, get, strlen(get), 0);
+    size_t n = pump_recv(&core, first, buf, sizeof(buf) - 1);
+    TEST_ASSERT_TRUE(n > 0);
+    TEST_ASSERT_TRUE(strstr(buf, "200 OK") != NULL);
+    TEST_ASSERT_EQUAL(1, st.closed);
+
+    close(first);
+    close(second);
+    ws_core_destroy(&core);
+    release_pool();
+}
+
+static ws_core_t *handoff_target;
+
+static bool handoff_accept(void *user, int fd)
+{
+    (void)user;
+    return ws_core_load(handoff_target) == 0 && ws_core_adopt(handoff_target, fd);
+}
+
+static void test_ws_core_handoff_to_adopting_core(void)
+{
+    static ws_core_t front;
+    static ws_core_t back;
+    echo_state_t front_st = { .core = &front };
+    echo_state_t back_st = { .core = &back };
+    ws_core_callbacks_t cb = {
+        .on_open = echo_open, .on_message = echo_message, .on_close = echo_close,
+        .on_accept = handoff_accept,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = { .port = 0, .max_conns = 2, .max_frame = 1024, .rx_pool = &pool };
+    TEST_ASSERT_TRUE(ws_core_init(&front, &config, &cb, &front_st));
+    config.adopt_only = true;
+    TEST_ASSERT_TRUE(ws_core_init(&back, &config, &cb, &back_st));
+    TEST_ASSERT_EQUAL(-1, back.listen_fd);
+    handoff_target = &back;
+
+    int first = connect_client(listen_port(&front));
+    ws_core_poll(&front, 50);
+    TEST_ASSERT_EQUAL(1, ws_core_load(&back));
+    TEST_ASSERT_EQUAL(0, ws_core_load(&front));
+    ws_core_poll(&back, 10);
+    TEST_ASSERT_EQUAL(1, back_st.opened);
+    TEST_ASSERT_EQUAL(1, ws_core_load(&back));
+
+    int second = connect_client(listen_port(&front));
+    ws_core_poll(&front, 50);
+    TEST_ASSERT_EQUAL(1, front_st.opened);
+
+    const char *req =
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    send(first, req, strlen(req), 0);
+    char resp[256] = {0};
+    TEST_ASSERT_TRUE(pump_recv(&back, first, resp, sizeof(resp) - 1) > 0);
+    TEST_ASSERT_TRUE(strstr(resp, "101 Switching Protocols") != NULL);
+
+    close(first);
+    close(second);
+    ws_core_destroy(&back);
+    ws_core_destroy(&front);
+    release_pool();
+}
+
+static void test_ws_core_sendv_gathers_buffers(void)
+{
+    static ws_core_t core;
+    echo_state_t st = { .core = &core };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = { .port = 0, .max_conns = 1, .max_frame = 1024, .rx_pool = &pool };
+    ws_core_callbacks_t cb = { .on_open = echo_open, .on_close = echo_close };
+    TEST_ASSERT_TRUE(ws_core_init(&core, &config, &cb, &st));
+    int client = connect_client(listen_port(&core));
+
+    const char *req =
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    send(client, req, strlen(req), 0);
+    char resp[256] = {0};
+    TEST_ASSERT_TRUE(pump_recv(&core, client, resp, 129) == 129);
+
+    struct iovec iov[3] = {
+        { .iov_base = "[\"EVENT\",", .iov_len = 9 },
+        { .iov_base = "\"s\",", .iov_len = 4 },
+        { .iov_base = "{}]", .iov_len = 3 },
+    };
+    TEST_ASSERT_EQUAL(16, ws_core_sendv(&core, core.conns[0].fd, iov, 3));
+    char rx[32] = {0};
+    TEST_ASSERT_EQUAL(16u, pump_recv(&core, client, rx, 16));
+    TEST_ASSERT_EQUAL_MEMORY("[\"EVENT\",\"s\",{}]", rx, 16);
+    TEST_ASSERT_FALSE(core.conns[0].tx_partial);
+
+    close(client);
+    ws_core_destroy(&core);
+    release_pool();
+}
+
+static int writable_calls;
+
+static void count_writable(void *user, int fd)
+{
+    (void)user;
+    (void)fd;
+    writable_calls++;
+}
+
+static void test_ws_core_partial_write_waits_for_writable(void)
+{
+    static ws_core_t core;
+    echo_state_t st = { .core = &core };
+    TEST_ASSERT_EQUAL(ESP_OK, rx_pool_init(&pool, 65536, false));
+    ws_core_config_t config = { .port = 0, .max_conns = 1, .max_frame = 1024, .rx_pool = &pool };
+    ws_core_callbacks_t cb = { .on_open = echo_open, .on_close = echo_close, .on_writable = count_writable };
+    TEST_ASSERT_TRUE(ws_core_init(&core, &config, &cb, &st));
+    int client = connect_client(listen_port(&core));
+
+    const char *req =
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    send(client, req, strlen(req), 0);
+    char resp[256] = {0};
+    TEST_ASSERT_TRUE(pump_recv(&core, client, resp, 129) == 129);
+    int fd = core.conns[0].fd;
+    int small = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+    size_t big = 1 << 20;
+    char *data = malloc(big);
+    char *rx = malloc(big + 4);
+    memset(data, 'x', big);
+    int n = ws_core_send(&core, fd, data, big);
+    TEST_ASSERT_TRUE(n >= 0 && (size_t)n < big);
+    TEST_ASSERT_TRUE(core.conns[0].tx_partial);
+
+    uint8_t ping[16];
+    send(client, ping, mask_frame(ping, WS_CORE_OP_PING, true, "hi", 2), 0);
+    ws_core_poll(&core, 10);
+    TEST_ASSERT_EQUAL(4u, core.conns[0].tx_len);
+
+    size_t sent = (size_t)n;
+    size_t got = 0;
+    int handled = 0;
+    for (int i = 0; i < 5000 && got < big + 4; i++) {
+        ssize_t r = recv(client, rx + got, big + 4 - got, 0);
+        if (r > 0) got += (size_t)r;
+        ws_core_poll(&core, 0);
+        if (writable_calls > handled && sent < big) {
+            handled = writable_calls;
+            n = ws_core_send(&core, fd, data + sent, big - sent);
+            TEST_ASSERT_TRUE(n >= 0);
+            sent += (size_t)n;
+        }
+    }
+    TEST_ASSERT_TRUE(writable_calls > 0);
+    TEST_ASSERT_EQUAL(big + 4, got);
+    TEST_ASSERT_EQUAL_MEMORY(data, rx, big);
+    TEST_ASSERT_EQUAL((char)0x8A, rx[big]);
+    TEST_ASSERT_EQUAL_MEMORY("hi", rx + big + 2, 2);
+    TEST_ASSERT_EQUAL(0u, core.conns[0].tx_len);
+
+    free(data);
+    free(rx);
+    close(client);
+    ws_core_destroy(&core);
+    release_pool();
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+int main(void)
+{
+    printf("=== WebSocket Core Tests ===\n\n");
+#ifdef HAVE_UNITY
+    UNITY_BEGIN();
+    RUN_TEST(test_ws_core_accept_key_rfc6455);
+    RUN_TEST(test_ws_core_parse_upgrade);
+    RUN_TEST(test_ws_core_parse_plain_get);
+    RUN_TEST(test_ws_core_frame_roundtrip);
+    RUN_TEST(test_ws_core_frame_rejects_bad_frames);
+    RUN_TEST(test_ws_deflate_negotiate);
+    RUN_TEST(test_ws_deflate_backfill_ratio);
+    RUN_TEST(test_ws_deflate_rejects_oversized_output);
+    RUN_TEST(test_ws_core_loopback_echo);
+    RUN_TEST(test_ws_core_loopback_deflate);
+    RUN_TEST(test_ws_core_plain_http_and_pool_limit);
+    RUN_TEST(test_ws_core_handoff_to_adopting_core);
+    RUN_TEST(test_ws_core_sendv_gathers_buffers);
+    RUN_TEST(test_ws_core_partial_write_waits_for_writable);
+    return UNITY_END();
+#else
+    RUN_TEST(test_ws_core_accept_key_rfc6455);
+    RUN_TEST(test_ws_core_parse_upgrade);
+    RUN_TEST(test_ws_core_parse_plain_get);
+    RUN_TEST(test_ws_core_frame_roundtrip);
+    RUN_TEST(test_ws_core_frame_rejects_bad_frames);
+    RUN_TEST(test_ws_deflate_negotiate);
+    RUN_TEST(test_ws_deflate_backfill_ratio);
+    RUN_TEST(test_ws_deflate_rejects_oversized_output);
+    RUN_TEST(test_ws_core_loopback_echo);
+    RUN_TEST(test_ws_core_loopback_deflate);
+    RUN_TEST(test_ws_core_plain_http_and_pool_limit);
+    RUN_TEST(test_ws_core_handoff_to_adopting_core);
+    RUN_TEST(test_ws_core_sendv_gathers_buffers);
+    RUN_TEST(test_ws_core_partial_write_waits_for_writable);
+    printf("\n=== All tests passed ===\n");
+    return 0;
+#endif
+}